@@ -780,6 +780,78 @@ sub io_message
       }
     }
 
+  # Merge delta status messages (changed fields only) into the last full record
+  if (($m_code eq 'X')&&($clienttype eq 'C'))
+    {
+    if (($m_paranoid)||($data !~ /^([A-Za-z])([0-9A-Fa-f]+)(,(.*))?,([0-9A-Fa-f]{4})$/))
+      {
+      AE::log error => "#$fn $clienttype $vehicleid invalid delta message '$data'";
+      return;
+      }
+    my ($x_code,$x_mask,$x_crc) = ($1,hex($2),hex($5));
+    my @x_fields = split /,/,(defined $4)?$4:'',-1;
+    my $row = $db->selectrow_hashref('SELECT m_msg FROM ovms_carmessages WHERE vehicleid=? AND m_code=? AND m_valid=1 AND m_paranoid=0',
+                                     undef, $vehicleid, $x_code);
+    if (!defined $row)
+      {
+      AE::log info => "#$fn $clienttype $vehicleid delta message for '$x_code' without a full record, ignored";
+      return;
+      }
+    my @fields = split /,/,$row->{'m_msg'},-1;
+    for (my $k=0; $x_mask != 0; $k++, $x_mask >>= 1)
+      {
+      $fields[$k] = shift @x_fields if ($x_mask & 1);
+      }
+    my $x_data = join(',', map { defined $_ ? $_ : '' } @fields);
+    if (&crc16("MP-0 $x_code$x_data") != $x_crc)
+      {
+      # A base record field differs from the car's (i.e. a changed field with
+      # an unchanged field CRC): drop the base, the car sends a full record
+      # every few deltas
+      AE::log error => "#$fn $clienttype $vehicleid delta message for '$x_code' does not match the last full record, ignored";
+      $db->do("UPDATE ovms_carmessages SET m_valid=0 WHERE vehicleid=? AND m_code=?",undef,$vehicleid,$x_code);
+      return;
+      }
+    # Continue as if the full record had been received
+    $code = $m_code = $x_code;
+    $data = $m_data = $x_data;
+    }
+
+  # Expand GPS track batches into historical records & the last location
+  if (($m_code eq 'K')&&($clienttype eq 'C'))
+    {
+    if (($m_paranoid)||($data !~ /^(\d+),([A-Za-z0-9+\/]+)$/))
+      {
+      AE::log error => "#$fn $clienttype $vehicleid invalid track message '$data'";
+      return;
+      }
+    my ($k_fixes,@k_values) = ($1,&track_vlq_decode($2));
+    if (($k_fixes == 0)||(scalar @k_values != $k_fixes*6))
+      {
+      AE::log error => "#$fn $clienttype $vehicleid invalid track message '$data'";
+      return;
+      }
+    # Fields: time, latitude, longitude (1/32 arc seconds), altitude, direction, speed
+    my @fix = (0,0,0,0,0,0);
+    my ($lat,$lon);
+    while (scalar @k_values > 0)
+      {
+      $fix[$_] += shift @k_values foreach (0..5);
+      $fix[4] %= 360;
+      ($lat,$lon) = map { sprintf('%0.6f',$_/32/3600) } ($fix[1],$fix[2]);
+      my @t = gmtime($fix[0]);
+      $db->do("INSERT IGNORE INTO ovms_historicalmessages (vehicleid,h_timestamp,h_recordtype,h_recordnumber,h_data,h_expires) "
+            . "VALUES (?,?,'*-GPS-Track',0,?,UTC_TIMESTAMP()+INTERVAL 86400 SECOND)",
+              undef,
+              $vehicleid,
+              sprintf('%04d-%02d-%02d %02d:%02d:%02d',$t[5]+1900,$t[4]+1,$t[3],$t[2],$t[1],$t[0]),
+              join(',',$lat,$lon,$fix[3],$fix[4],$fix[5]));
+      }
+    # Continue as if the last location had been received
+    $code = $m_code = 'L';
+    $data = $m_data = join(',',$lat,$lon,$fix[4],$fix[3],1,1);
+    }
+
   # Check for App<->Server<->Car command and response messages...
   if ($m_code eq 'C')
     {
@@ -1213,6 +1285,40 @@ sub push_queuenotify
     }
   }
 
+sub crc16
+  {
+  my ($data) = @_;
+
+  # As crc16() of the car firmware: CRC-16/MODBUS (reflected 0x8005, init 0xffff)
+  my $crc = 0xffff;
+  foreach my $c (unpack('C*',$data))
+    {
+    $crc ^= $c;
+    $crc = ($crc & 1) ? (($crc >> 1) ^ 0xA001) : ($crc >> 1) foreach (1..8);
+    }
+  return $crc;
+  }
+
+sub track_vlq_decode
+  {
+  my ($vlq) = @_;
+
+  # Base64 VLQ: 5 bits per character, least significant first, bit 5 set
+  # if another character follows, bit 0 of the value is the sign
+  my @values;
+  my ($v,$shift) = (0,0);
+  foreach my $c (split //,$vlq)
+    {
+    my $d = index('ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/',$c);
+    $v += ($d & 0x1f) << $shift;
+    $shift += 5;
+    next if ($d & 0x20);
+    push @values, ($v & 1) ? -($v >> 1) : ($v >> 1);
+    ($v,$shift) = (0,0);
+    }
+  return @values;
+  }
+
 sub vece_expansion
   {
   my ($vehicletype,$errorcode,$errordata) = @_;
@@ -64,7 +64,9 @@ unsigned char vUARTIntTxBufRdPtr;
 #endif
 
 #if	RXON
+#pragma udata UARTRXBUF
 unsigned char vUARTIntRxBuffer[RX_BUFFER_SIZE];
+#pragma udata
 unsigned char vUARTIntRxBufDataCnt;
 unsigned char vUARTIntRxBufWrPtr;
 unsigned char vUARTIntRxBufRdPtr;
@@ -56,24 +56,77 @@ int acc_last_cac = 0;
 unsigned char acc_last_loc = 0;
 int acc_last_estimate = 0;
 
+// ACC geofence index: RAM copy of the ACC locations, so acc_find() needs
+// no EEprom reads & base64 decoding. Each entry has the cosine of the
+// latitude and the longitude bounds of its ACC_RANGE2 bounding box.
+// Kept current by par_decode() calling acc_index_update().
+struct acc_fence
+  {
+  signed long acc_latitude;         // Latitude of ACC location (0/0 = unused)
+  signed long acc_longitude;        // Longitude of ACC location
+  signed long acc_longmin;          // Bounding box longitude range
+  signed long acc_longmax;
+  int acc_cosine;                   // cosine(latitude) * 2^14
+  };
+struct acc_fence acc_fences[PARAM_ACC_COUNT];
+
+// Bounding box half sizes for ACC_RANGE2 (66 latlon units per meter):
+#define ACC_FENCE_LAT   (66L * (ACC_RANGE2 + 1))
+#define ACC_FENCE_LONG  ((ACC_FENCE_LAT + 1) << 14) // / acc_cosine
+#define ACC_GPS180      (180L * 3600L * 2048L)
+
 rom char ACC_NOTHERE[] = "ACC not at this location";
 
+void acc_index_update(unsigned char k)
+  {
+  struct acc_record ar;
+  struct acc_fence *f = &acc_fences[k];
+  signed long w;
+
+  par_getbase64(k+PARAM_ACC_S, &ar, sizeof(ar));
+  f->acc_latitude = ar.acc_latitude;
+  f->acc_longitude = ar.acc_longitude;
+  f->acc_cosine = IntCosineLat14(ar.acc_latitude);
+
+  // Longitude bounds, open near the poles & the 180 degree meridian:
+  f->acc_longmin = -ACC_GPS180;
+  f->acc_longmax = ACC_GPS180;
+  if (f->acc_cosine > (int)(ACC_FENCE_LONG / ACC_GPS180))
+    {
+    w = ACC_FENCE_LONG / f->acc_cosine + 1;
+    if ((ar.acc_longitude - w > -ACC_GPS180)&&(ar.acc_longitude + w < ACC_GPS180))
+      {
+      f->acc_longmin = ar.acc_longitude - w;
+      f->acc_longmax = ar.acc_longitude + w;
+      }
+    }
+  }
+
+// Find the ACC location at the car position (range <= ACC_RANGE2),
+// returns 1..PARAM_ACC_COUNT with its record in ar, or 0
 signed char acc_find(struct acc_record* ar, int range, BOOL enabledonly)
   {
-  int k;
+  unsigned char k;
+  struct acc_fence *f;
 
-  for (k=0;k<PARAM_ACC_COUNT;k++)
+  memset(ar,0,sizeof(*ar));
+
+  for (k=0,f=acc_fences;k<PARAM_ACC_COUNT;k++,f++)
     {
-    par_getbase64(k+PARAM_ACC_S, ar, sizeof(ar));
-    if ((ar->acc_latitude != 0)||(ar->acc_longitude != 0))
+    if ((f->acc_latitude == 0)&&(f->acc_longitude == 0))
+      continue; // Unused location
+    if ((car_latitude < f->acc_latitude - ACC_FENCE_LAT)
+      ||(car_latitude > f->acc_latitude + ACC_FENCE_LAT)
+      ||(car_longitude < f->acc_longmin)
+      ||(car_longitude > f->acc_longmax))
+      continue; // Outside the bounding box
+    if (FIsLatLongCloseCos(f->acc_latitude, f->acc_longitude, f->acc_cosine,
+                           car_latitude, car_longitude, range)>0)
       {
-      // We have a used location
-      if (FIsLatLongClose(ar->acc_latitude, ar->acc_longitude, car_latitude, car_longitude, range)>0)
-        {
-        // This location matches...
-        if (enabledonly && (!ar->acc_flags.AccEnabled)) return 0;
-        return k+1;
-        }
+      // This location matches...
+      par_getbase64(k+PARAM_ACC_S, ar, sizeof(*ar));
+      if (enabledonly && (!ar->acc_flags.AccEnabled)) return 0;
+      return k+1;
       }
     }
 
@@ -89,7 +142,7 @@ signed char acc_get(struct acc_record* ar, char *location)
   k = atoi(location);
   if ((k>=1)&&(k<=PARAM_ACC_COUNT))
     {
-    par_getbase64(k+PARAM_ACC_S-1, ar, sizeof(ar));
+    par_getbase64(k+PARAM_ACC_S-1, ar, sizeof(*ar));
     return k;
     }
 
@@ -279,8 +332,6 @@ void acc_state_enter(unsigned char newstate)
 
 void acc_state_ticker1(void)
   {
-  char *s;
-
   CHECKPOINT(0x63)
 
   switch (acc_state)
@@ -455,7 +506,6 @@ void acc_state_ticker1(void)
 void acc_state_ticker10(void)
   {
   unsigned long now;
-  char *p;
 
   CHECKPOINT(0x64)
 
@@ -499,8 +549,7 @@ void acc_state_ticker10(void)
         vehicle_fn_commandhandler(FALSE, 12, NULL); // Stop charge
         }
       // Check if charge is due
-      p = par_get(PARAM_TIMEZONE);
-      now = car_time + ((long)timestring_to_mins(p))*60;  // Date+Time in seconds, local time zone
+      now = car_time + ((long)par_timezone)*60;  // Date+Time in seconds, local time zone
       now = (now % 86400) / 60;  // In minutes past the start of the day
       if (now == acc_chargeminute)
         {
@@ -520,6 +569,11 @@ void acc_state_ticker10(void)
 
 void acc_initialise(void)        // ACC Initialisation
   {
+  unsigned char k;
+
+  for (k=0;k<PARAM_ACC_COUNT;k++)
+    acc_index_update(k);
+
   acc_state_enter(ACC_STATE_FIRSTRUN);
   }
 
@@ -544,10 +598,10 @@ BOOL acc_cmd_here(BOOL sms, char* caller, char* arguments)
 
   for (k=0;k<PARAM_ACC_COUNT;k++)
     {
-    par_getbase64(k+PARAM_ACC_S, &ar, sizeof(ar));
-    if ((ar.acc_latitude == 0)&&(ar.acc_longitude == 0))
+    if ((acc_fences[k].acc_latitude == 0)&&(acc_fences[k].acc_longitude == 0))
       {
       // We have a free location
+      memset(&ar,0,sizeof(ar));
       ar.acc_latitude = car_latitude;
       ar.acc_longitude = car_longitude;
       ar.acc_recversion = ACC_RECVERSION;
@@ -619,8 +673,7 @@ BOOL acc_cmd_stat(BOOL sms, char* caller, char *arguments)
   // Return ACC status
   struct acc_record ar;
   int k;
-  char *s,*p;
-  unsigned long r;
+  char *s;
 
   k = acc_find(&ar,ACC_RANGE1,FALSE);
 
@@ -726,7 +779,6 @@ BOOL acc_cmd_enable(BOOL sms, char* caller, char *arguments, unsigned char enabl
   // Enable/Disable ACC
   struct acc_record ar;
   int k;
-  char *s;
 
   if (arguments != NULL)
     {
@@ -740,13 +792,13 @@ BOOL acc_cmd_enable(BOOL sms, char* caller, char *arguments, unsigned char enabl
   net_send_sms_start(caller);
   if (k<0)
     {
-    s = stp_rom(net_scratchpad,ACC_NOTHERE);
+    stp_rom(net_scratchpad,ACC_NOTHERE);
     }
   else
     {
     ar.acc_flags.AccEnabled = enabled;
     par_setbase64(k+PARAM_ACC_S-1,&ar,sizeof(ar));
-    s = stp_rom(net_scratchpad,(enabled)?"ACC enabled":"ACC disabled");
+    stp_rom(net_scratchpad,(enabled)?"ACC enabled":"ACC disabled");
     }
 
   net_puts_ram(net_scratchpad);
@@ -759,7 +811,7 @@ BOOL acc_cmd_enable(BOOL sms, char* caller, char *arguments, unsigned char enabl
 void acc_sms_params(int k, struct acc_record* ar)
   {
   // SMS ACC parameters
-  char *s,*p;
+  char *s;
   unsigned long r;
 
   s = stp_i(net_scratchpad,"ACC #",k);
@@ -814,8 +866,6 @@ BOOL acc_cmd_params(BOOL sms, char* caller, char *arguments)
   // Set ACC params
   struct acc_record ar;
   int k = 0;
-  char p;
-  char *s;
 
   if (arguments != NULL)
     {
@@ -829,7 +879,7 @@ BOOL acc_cmd_params(BOOL sms, char* caller, char *arguments)
   net_send_sms_start(caller);
   if (k<0)
     {
-    s = stp_rom(net_scratchpad,ACC_NOTHERE);
+    stp_rom(net_scratchpad,ACC_NOTHERE);
     }
   else
     {
@@ -920,8 +970,6 @@ BOOL acc_cmd_paramsq(BOOL sms, char* caller, char *arguments)
   // Return ACC status
   struct acc_record ar;
   int k;
-  char *s,*p;
-  unsigned long r;
 
   if (arguments != NULL)
     {
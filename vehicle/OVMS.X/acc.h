@@ -83,6 +83,7 @@ struct acc_record
   };
 
 void acc_initialise(void);        // ACC Initialisation
+void acc_index_update(unsigned char k); // Reload ACC location k into the geofence index
 void acc_ticker(void);            // ACC Ticker
 BOOL acc_handle_sms(char *caller, char *command, char *arguments);
 
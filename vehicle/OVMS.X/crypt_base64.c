@@ -36,7 +36,7 @@ LICENCE:        Copyright (c) 2001 Bob Trower, Trantor Standard Systems Inc.
 
 VERSION HISTORY:
                 Bob Trower 08/04/01 -- Create Version 0.00.00B
-/*********************************************************************/
+**********************************************************************/
 
 #include <string.h>
 #include <stdlib.h>
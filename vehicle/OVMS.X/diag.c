@@ -96,24 +96,12 @@ void diag_ticker(void)
     // re-map DummyData's 8-bit field 0 into an 11-bit CAN ID
     unsigned int message_id = CANIDMap[DummyData[(canwrite_state * 9)]];
     unsigned char field;
+    unsigned char data[8];
 
-    TXB0CON = 0;            // Reset TX buffer
-
-    TXB0SIDL = (message_id & 0x7) << 5;  // Set CAN ID to 0x100
-    TXB0SIDH = message_id >> 3;
-
-    field = 1; // field 0 = CAN ID, data starts from field 1
-    TXB0D0 = DummyData[(canwrite_state * 9) + field++];
-    TXB0D1 = DummyData[(canwrite_state * 9) + field++];
-    TXB0D2 = DummyData[(canwrite_state * 9) + field++];
-    TXB0D3 = DummyData[(canwrite_state * 9) + field++];
-    TXB0D4 = DummyData[(canwrite_state * 9) + field++];
-    TXB0D5 = DummyData[(canwrite_state * 9) + field++];
-    TXB0D6 = DummyData[(canwrite_state * 9) + field++];
-    TXB0D7 = DummyData[(canwrite_state * 9) + field++];
-
-    TXB0DLC = 0b00001000; // data length (8)
-    TXB0CON |= 0b00001000; // mark for transmission
+    // field 0 = CAN ID, data starts from field 1
+    for (field = 0; field < 8; field++)
+      data[field] = DummyData[(canwrite_state * 9) + 1 + field];
+    can_tx_enqueue(message_id, 8, data, CAN_TX_PRIO_LOW);
 
     canwrite_state = (canwrite_state+1)%DATA_COUNT;
     }
@@ -142,7 +130,8 @@ void diag_handle_sms(char *command, char *arguments)
   char *p = par_get(PARAM_REGPHONE);
   if (*p != 0)
     {
-    strncpy(net_caller,p,NET_TEL_MAX);
+    strncpy(net_caller,p,NET_TEL_MAX-1);
+    net_caller[NET_TEL_MAX-1] = '\0';
     }
   else
     {
@@ -215,8 +204,49 @@ void diag_handle_diag(char *command, char *arguments)
   s = stp_rom(s, "\r\n");
   net_puts_ram(net_scratchpad);
 
+  s = stp_ul(net_scratchpad, "#  CAN RX:   ", can_rxq_drops);
+  s = stp_i(s, " dropped / ", can_rxq_highwater);
+  s = stp_rom(s, " max queued\r\n");
+  net_puts_ram(net_scratchpad);
+
+  s = stp_ul(net_scratchpad, "#  CAN TX:   ", can_tx_queued);
+  s = stp_i(s, " queued / ", can_tx_sent);
+  s = stp_i(s, " sent / ", can_tx_aborted);
+  s = stp_i(s, " aborted / ", can_tx_errpassive);
+  s = stp_rom(s, " error passive\r\n");
+  net_puts_ram(net_scratchpad);
+
+  s = stp_ul(net_scratchpad, "#  CAN POLL: ", vehicle_poll_sent);
+  s = stp_ul(s, " sent / ", vehicle_poll_missed);
+  s = stp_rom(s, " missed\r\n");
+  net_puts_ram(net_scratchpad);
+
+  s = stp_i(net_scratchpad, "#  MSG Q:    ", net_msg_qcount);
+  s = stp_i(s, " queued / ", net_msg_qused);
+  s = stp_i(s, " bytes / ", net_msg_qhighwater);
+  s = stp_i(s, " max / lost ", net_msg_qdrops[NET_MSG_Q_ALERT]);
+  s = stp_i(s, " alert ", net_msg_qdrops[NET_MSG_Q_LOG]);
+  s = stp_i(s, " log ", net_msg_qdrops[NET_MSG_Q_STATUS]);
+  s = stp_i(s, " status ", net_msg_qdrops[NET_MSG_Q_STREAM]);
+  s = stp_rom(s, " stream\r\n");
+  net_puts_ram(net_scratchpad);
+
+  s = stp_i(net_scratchpad, "#  CIPSEND:  ", net_msg_txshort);
+  s = stp_rom(s, " blocks short\r\n");
+  net_puts_ram(net_scratchpad);
+
+  s = stp_ul(net_scratchpad, "#  EEPROM:   ", par_ee_writes);
+  s = stp_rom(s, " cells written\r\n");
+  net_puts_ram(net_scratchpad);
+
+  s = stp_ul(net_scratchpad, "#  LOOP:     ", debug_loophist[0]);
+  for (x=1; x<LOOPHIST_MAX; x++)
+    s = stp_ul(s, " / ", debug_loophist[x]);
+  s = stp_rom(s, " (<1/2/5/10/20/50/100/more ms)\r\n");
+  net_puts_ram(net_scratchpad);
+
   #ifdef OVMS_HW_V2
-  x = inputs_voltage()*10;
+  x = inputs_voltage();
   s = stp_l2f(net_scratchpad, "#  12V Line: ", x, 1);
   s = stp_rom(s, " V\r\n");
   net_puts_ram(net_scratchpad);
@@ -234,6 +264,15 @@ void diag_handle_diag(char *command, char *arguments)
   net_puts_ram(net_scratchpad);
   #endif
 
+  #ifdef OVMS_INTERNALGPS
+  s = stp_i(net_scratchpad, "#  GPS:      ", car_gpslock);
+  s = stp_i(s, " lock / ", car_gpssats);
+  s = stp_l2f(s, " sats / HDOP ", car_gpshdop, 1);
+  s = stp_time(s, " / ", car_gpstime);
+  s = stp_rom(s, " UTC\r\n");
+  net_puts_ram(net_scratchpad);
+  #endif
+
   s = stp_i(net_scratchpad, "#  Signal:   ", net_sq);
   s = stp_rom(s, "\r\n\n");
   net_puts_ram(net_scratchpad);
@@ -272,6 +311,29 @@ void diag_handle_csq(char *command, char *arguments)
   net_sq = atoi(arguments);
   }
 
+void diag_handle_canpoll(char *command, char *arguments)
+  {
+  unsigned char k;
+  char *s;
+  const rom vehicle_poll_t *e;
+
+  net_puts_rom("\r\n# CAN POLL: TX/RX/SERVICE/PID PERIOD LATENCY/MAX MISSED\r\n");
+  for (k = 0; k < vehicle_poll_count; k++)
+    {
+    e = &vehicle_poll_list[k];
+    s = stp_x(net_scratchpad, "# ", e->txid);
+    s = stp_x(s, "/", e->rxid);
+    s = stp_x(s, "/", e->service);
+    s = stp_x(s, "/", e->pid);
+    s = stp_i(s, " ", e->polltime);
+    s = stp_i(s, "s ", (int)vehicle_pollstats[k].latency * 2);
+    s = stp_i(s, "/", (int)vehicle_pollstats[k].maxlatency * 2);
+    s = stp_i(s, "ms ", vehicle_pollstats[k].misses);
+    s = stp_rom(s, "\r\n");
+    net_puts_ram(net_scratchpad);
+    }
+  }
+
 void diag_handle_cantxstart(char *command, char *arguments)
   {
   // We're going to initialise ourselves as a CAN bus transmitter
@@ -314,16 +376,18 @@ void diag_handle_t3(char *command, char *arguments)
 // as members of structures), so keep it simple and use two tables. The first
 // is a list of command strings (left match, all upper case). The second are
 // the command handler function pointers. The command string table array is
-// terminated by an empty "" command.
+// terminated by an empty "" command. The command strings are kept in ASCII
+// order for net_sms_cmdfind().
 
 rom char diag_cmdtable[][27] =
-  { "HELP",
+  { "+CSQ:",
     "?",
-    "RESET",
-    "DIAG",
-    "+CSQ:",
+    "CANPOLL",
     "CANTXSTART",
     "CANTXSTOP",
+    "DIAG",
+    "HELP",
+    "RESET",
     "T1",
     "T2",
     "T3",
@@ -331,13 +395,14 @@ rom char diag_cmdtable[][27] =
 
 rom void (*diag_hfntable[])(char *command, char *arguments) =
   {
-  &diag_handle_help,
-  &diag_handle_help,
-  &diag_handle_reset,
-  &diag_handle_diag,
   &diag_handle_csq,
+  &diag_handle_help,
+  &diag_handle_canpoll,
   &diag_handle_cantxstart,
   &diag_handle_cantxstop,
+  &diag_handle_diag,
+  &diag_handle_help,
+  &diag_handle_reset,
   &diag_handle_t1,
   &diag_handle_t2,
   &diag_handle_t3
@@ -352,7 +417,7 @@ void diag_activity(char *buf, unsigned char pos)
   {
   // The buf contains a DIAG command
   char *p;
-  int k;
+  signed char k;
 
   if ((*buf == 0) || (*buf == '#'))
       return; // Ignore empty commands and comments/debug outputs
@@ -363,13 +428,11 @@ void diag_activity(char *buf, unsigned char pos)
   if (*p==' ') p++;
 
   // Command parsing...
-  for (k=0; diag_cmdtable[k][0] != 0; k++)
+  k = net_sms_cmdfind(diag_cmdtable[0], 27, sizeof(diag_cmdtable)/27 - 1, 0, buf);
+  if (k >= 0)
     {
-    if (memcmppgm2ram(buf, (char const rom far*)diag_cmdtable[k], strlenpgm((char const rom far*)diag_cmdtable[k])) == 0)
-      {
-      (*diag_hfntable[k])(buf, p);
-      return;
-      }
+    (*diag_hfntable[k])(buf, p);
+    return;
     }
   if ((buf[0]=='S')&&(buf[1]==' '))
     {
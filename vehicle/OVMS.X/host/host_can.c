@@ -0,0 +1,133 @@
+/*
+ * Host build: CAN controller receive and transmit paths. host_can_rx()
+ * applies the RX buffer acceptance masks and filters as set up by the
+ * vehicle module, loads the frame into RXB0 or RXB1 and calls high_isr().
+ * host_can_tx() sends the requested TX buffers in the controller's order
+ * (highest TXPRI first, equal priorities highest buffer first), sets the
+ * TXBnIF flags and calls high_isr() if a TX interrupt is enabled.
+ */
+
+#include "ovms.h"
+#include "host_sim.h"
+
+void high_isr(void);
+
+unsigned long host_can_rx_frames = 0;
+unsigned long host_can_rx_filtered = 0;
+unsigned long host_can_tx_frames = 0;
+void (*host_fn_can_tx)(unsigned int id, unsigned char len, const unsigned char *data) = NULL;
+
+// 11 bit standard ID from a SIDH/SIDL register pair
+static unsigned int host_sid(unsigned char sidh, unsigned char sidl)
+  {
+  return ((unsigned int)sidh << 3) | (sidl >> 5);
+  }
+
+static BOOL host_can_match(unsigned int id, unsigned int mask,
+                           unsigned char sidh, unsigned char sidl)
+  {
+  return ((id & mask) == (host_sid(sidh, sidl) & mask));
+  }
+
+BOOL host_can_rx(unsigned int id, unsigned char len, const unsigned char *data)
+  {
+  unsigned int m0 = host_sid(RXM0SIDH, RXM0SIDL);
+  unsigned int m1 = host_sid(RXM1SIDH, RXM1SIDL);
+  unsigned char buf, hit, cfg;
+  unsigned char d[8];
+
+  host_can_rx_frames++;
+  memset(d, 0, sizeof(d));
+  memcpy(d, data, (len > 8) ? 8 : len);
+
+  // Acceptance filters (RXM mode 11 = receive all messages):
+  if (((RXB0CON & 0x60) == 0x60) || host_can_match(id, m0, RXF0SIDH, RXF0SIDL))
+    { buf = 0; hit = 0; }
+  else if (host_can_match(id, m0, RXF1SIDH, RXF1SIDL))
+    { buf = 0; hit = 1; }
+  else if (((RXB1CON & 0x60) == 0x60) || host_can_match(id, m1, RXF2SIDH, RXF2SIDL))
+    { buf = 1; hit = 2; }
+  else if (host_can_match(id, m1, RXF3SIDH, RXF3SIDL))
+    { buf = 1; hit = 3; }
+  else if (host_can_match(id, m1, RXF4SIDH, RXF4SIDL))
+    { buf = 1; hit = 4; }
+  else if (host_can_match(id, m1, RXF5SIDH, RXF5SIDL))
+    { buf = 1; hit = 5; }
+  else
+    {
+    host_can_rx_filtered++;
+    return FALSE;
+    }
+
+  if (buf == 0)
+    {
+    cfg = RXB0CON;
+    RXB0CON = (cfg & ~0x01) | hit;
+    RXB0SIDH = id >> 3;
+    RXB0SIDL = (id & 0x07) << 5;
+    RXB0DLC = len;
+    RXB0D0 = d[0]; RXB0D1 = d[1]; RXB0D2 = d[2]; RXB0D3 = d[3];
+    RXB0D4 = d[4]; RXB0D5 = d[5]; RXB0D6 = d[6]; RXB0D7 = d[7];
+    RXB0CONbits.RXFUL = 1;
+    PIR3bits.RXB0IF = 1;
+    high_isr();
+    RXB0CONbits.RXFUL = 0;
+    RXB0CON = cfg;
+    }
+  else
+    {
+    cfg = RXB1CON;
+    RXB1CON = (cfg & ~0x07) | hit;
+    RXB1SIDH = id >> 3;
+    RXB1SIDL = (id & 0x07) << 5;
+    RXB1DLC = len;
+    RXB1D0 = d[0]; RXB1D1 = d[1]; RXB1D2 = d[2]; RXB1D3 = d[3];
+    RXB1D4 = d[4]; RXB1D5 = d[5]; RXB1D6 = d[6]; RXB1D7 = d[7];
+    RXB1CONbits.RXFUL = 1;
+    PIR3bits.RXB1IF = 1;
+    high_isr();
+    RXB1CONbits.RXFUL = 0;
+    RXB1CON = cfg;
+    }
+
+  return TRUE;
+  }
+
+// Send TX buffer n if TXREQ is set, returns its PIR3 TXBnIF bit
+#define HOST_CAN_TXB(n) \
+  static unsigned char host_can_txb##n(void) \
+    { \
+    unsigned char d[8]; \
+    if ((TXB##n##CON & 0x08) == 0) return 0; \
+    d[0] = TXB##n##D0; d[1] = TXB##n##D1; d[2] = TXB##n##D2; d[3] = TXB##n##D3; \
+    d[4] = TXB##n##D4; d[5] = TXB##n##D5; d[6] = TXB##n##D6; d[7] = TXB##n##D7; \
+    if (host_fn_can_tx != NULL) \
+      host_fn_can_tx(host_sid(TXB##n##SIDH, TXB##n##SIDL), TXB##n##DLC & 0x0f, d); \
+    host_can_tx_frames++; \
+    TXB##n##CON = (TXB##n##CON & ~0x48) | 0x80; /* TXBIF, clear TXREQ/TXABT */ \
+    return 0x04 << n; \
+    }
+
+HOST_CAN_TXB(0)
+HOST_CAN_TXB(1)
+HOST_CAN_TXB(2)
+
+// One main loop pass (1 ms) is long enough to send all three TX buffers
+void host_can_tx(void)
+  {
+  unsigned char done = 0;
+  int prio;
+
+  if (((TXB0CON | TXB1CON | TXB2CON) & 0x08) == 0)
+    return;
+  for (prio = 3; prio >= 0; prio--)
+    {
+    if ((TXB2CON & 0x03) == prio) done |= host_can_txb2();
+    if ((TXB1CON & 0x03) == prio) done |= host_can_txb1();
+    if ((TXB0CON & 0x03) == prio) done |= host_can_txb0();
+    }
+
+  PIR3 |= done;
+  if (PIR3 & PIE3 & 0x1c)
+    high_isr();
+  }
@@ -0,0 +1,394 @@
+/*
+ * Host build: CAN log replay.
+ *
+ * Streams a CANdo log (vehicle/roadster_canlogs/, .csv "RD11,time,id,d0,.."
+ * or .txt "time id d0 d1 .. ->comment") through the acceptance filters
+ * into the vehicle module. Simulated time follows the log timestamps, so
+ * vehicle_ticker() & vehicle_ticker10th() run at log time and a replay is
+ * deterministic. With scale > 0 the replay is also paced in wall time.
+ *
+ * Overload mode (host_replay_load()) ignores the log timestamps: frames
+ * arrive back to back at a multiple of the bus rate (from the BRGCONn
+ * bit timing the module set up), and each main loop pass takes an extra
+ * load on top of its millisecond. Frames pile up in can_rxq[] between
+ * passes, as they would behind a slow handler or a modem send, and the
+ * report shows the queue drops & high-water mark.
+ *
+ * Every vehicle_fn_poll0/poll1 call is counted and timed per RX buffer
+ * and CAN ID, and the car_* state is sampled once per simulated second.
+ */
+
+#include "ovms.h"
+#include "host_sim.h"
+
+#define HOST_REPLAY_IDS 0x800 // 11 bit IDs
+
+typedef struct
+  {
+  unsigned long calls;
+  double ns;
+  double ns_max;
+  } host_replay_stat_t;
+
+static host_replay_stat_t host_replay_stats[2][HOST_REPLAY_IDS];
+static unsigned long host_replay_filtered[HOST_REPLAY_IDS];
+static unsigned long host_replay_frames = 0;
+static unsigned long host_replay_skipped = 0;
+static double host_replay_logtime = 0;  // Total log time replayed (s)
+static double host_replay_walltime = 0; // Total wall time used (ns)
+static double host_replay_overload = 0;  // Frames at n x the bus rate (0 = log time)
+static unsigned int host_replay_loadus = 0; // Extra time per main loop pass (us)
+static unsigned long host_replay_passes = 0;
+
+static BOOL (*host_replay_fn_poll[2])(void);
+static FILE *host_replay_trajectory = NULL;
+static char host_replay_lastrow[256];
+
+static double host_replay_ns(void)
+  {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+  }
+
+static void host_replay_call(unsigned char buf)
+  {
+  host_replay_stat_t *st = &host_replay_stats[buf][can_id & (HOST_REPLAY_IDS-1)];
+  double t0, t;
+
+  t0 = host_replay_ns();
+  host_replay_fn_poll[buf]();
+  t = host_replay_ns() - t0;
+
+  st->calls++;
+  st->ns += t;
+  if (t > st->ns_max) st->ns_max = t;
+  }
+
+static BOOL host_replay_poll0(void)
+  {
+  host_replay_call(0);
+  return TRUE;
+  }
+
+static BOOL host_replay_poll1(void)
+  {
+  host_replay_call(1);
+  return TRUE;
+  }
+
+// Interpose the timing wrappers (again, if the module has re-initialised)
+static void host_replay_hook(void)
+  {
+  if ((vehicle_fn_poll0 != NULL) && (vehicle_fn_poll0 != host_replay_poll0))
+    {
+    host_replay_fn_poll[0] = vehicle_fn_poll0;
+    vehicle_fn_poll0 = host_replay_poll0;
+    }
+  if ((vehicle_fn_poll1 != NULL) && (vehicle_fn_poll1 != host_replay_poll1))
+    {
+    host_replay_fn_poll[1] = vehicle_fn_poll1;
+    vehicle_fn_poll1 = host_replay_poll1;
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// car_* state trajectory, one row per simulated second if changed
+
+static rom char host_replay_columns[] =
+  "time_s,car_time,SOC,idealrange,estrange,speed,chargestate,chargesubstate,"
+  "chargemode,chargecurrent,chargelimit,linevoltage,doors1,doors2,doors3,"
+  "doors5,lockstate,odometer,trip,latitude,longitude,direction,tbattery,"
+  "tpem,tmotor,ambient_temp";
+
+static void host_replay_sample(void)
+  {
+  char row[256];
+
+  sprintf(row, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%d,%d,%u,%d,%d,%u,%d",
+    car_time, car_SOC, car_idealrange, car_estrange, car_speed,
+    car_chargestate, car_chargesubstate, car_chargemode, car_chargecurrent,
+    car_chargelimit, car_linevoltage, car_doors1, car_doors2, car_doors3,
+    car_doors5, car_lockstate, car_odometer, car_trip,
+    car_latitude, car_longitude, car_direction, car_tbattery,
+    car_tpem, car_tmotor, car_ambient_temp);
+  if (strcmp(row, host_replay_lastrow) == 0)
+    return;
+  strcpy(host_replay_lastrow, row);
+  fprintf(host_replay_trajectory, "%.1f,%s\n", host_time_us / 1e6, row);
+  }
+
+BOOL host_replay_open(const char *trajectory)
+  {
+  if (trajectory == NULL)
+    return TRUE;
+  host_replay_trajectory = fopen(trajectory, "w");
+  if (host_replay_trajectory == NULL)
+    {
+    perror(trajectory);
+    return FALSE;
+    }
+  fprintf(host_replay_trajectory, "%s\n", host_replay_columns);
+  host_fn_ticker = host_replay_sample;
+  return TRUE;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Overload mode
+
+void host_replay_load(double overload, unsigned int loadus)
+  {
+  host_replay_overload = overload;
+  host_replay_loadus = loadus;
+  }
+
+// CAN bit time (ns) as set up in BRGCON1..3, 20 MHz clock:
+// TQ = 2 * (BRP+1) / Fosc, bit = sync + propagation + phase 1 + phase 2
+static double host_replay_bitns(void)
+  {
+  unsigned int tq = 1 + ((BRGCON2 & 0x07) + 1) + (((BRGCON2 >> 3) & 0x07) + 1);
+
+  if (BRGCON2 & 0x80)
+    tq += (BRGCON3 & 0x07) + 1;
+  else
+    tq += ((BRGCON2 >> 3) & 0x07) + 1; // Phase 2 = phase 1
+  return 100.0 * ((BRGCON1 & 0x3f) + 1) * tq;
+  }
+
+// Time (us) of a back to back standard frame, without stuff bits:
+// 44 frame bits + 8 per data byte + 3 interframe space
+static double host_replay_frameus(unsigned char len)
+  {
+  return (47 + 8 * (unsigned int)len) * host_replay_bitns() / 1000.0;
+  }
+
+// One main loop pass, with the overload mode extra load
+static void host_replay_mainpass(void)
+  {
+  host_mainpass();
+  host_time_us += host_replay_loadus;
+  host_replay_passes++;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Log parser
+
+static BOOL host_replay_hex(const char *s, unsigned int *val)
+  {
+  char *end;
+
+  if ((s == NULL) || (*s == 0))
+    return FALSE;
+  *val = (unsigned int)strtoul(s, &end, 16);
+  return (*end == 0);
+  }
+
+// Parse one log line, returns FALSE for anything but an 11 bit RX frame
+static BOOL host_replay_parse(char *line, double *time, unsigned int *id,
+                              unsigned char *len, unsigned char *data)
+  {
+  char *tok[12];
+  unsigned char n = 0, k;
+  unsigned int v;
+  char *p, *c;
+
+  if ((c = strstr(line, "->")) != NULL)
+    *c = 0; // .txt decoder comment
+  for (p = strtok(line, ", \t\r\n"); (p != NULL) && (n < 12); p = strtok(NULL, ", \t\r\n"))
+    tok[n++] = p;
+
+  if ((n >= 3) && (strcmp(tok[0], "RD11") == 0))
+    k = 1; // .csv: RD11,time,id,data...
+  else if ((n >= 2) && (strchr(tok[0], '.') != NULL))
+    k = 0; // .txt: time id data...
+  else
+    return FALSE;
+
+  *time = atof(tok[k++]);
+  if (!host_replay_hex(tok[k++], id) || (*id >= HOST_REPLAY_IDS))
+    return FALSE;
+  for (*len = 0; (k < n) && (*len < 8); k++)
+    {
+    if (!host_replay_hex(tok[k], &v) || (v > 0xff))
+      return FALSE;
+    data[(*len)++] = v;
+    }
+  return TRUE;
+  }
+
+BOOL host_replay(const char *filename, double scale)
+  {
+  FILE *f;
+  char line[256];
+  double time, wall0, t0, ahead, at = host_time_us;
+  unsigned long start = host_time_us, due, last = 0;
+  unsigned int id;
+  unsigned char len, data[8];
+  struct timespec ts;
+
+  f = fopen(filename, "r");
+  if (f == NULL)
+    {
+    perror(filename);
+    return FALSE;
+    }
+
+  host_replay_hook();
+  wall0 = host_replay_ns();
+  while (fgets(line, sizeof(line), f) != NULL)
+    {
+    if (!host_replay_parse(line, &time, &id, &len, data))
+      {
+      host_replay_skipped++;
+      continue;
+      }
+
+    if (host_replay_overload > 0)
+      {
+      // Run the main loop up to the frame's arrival at n x the bus rate:
+      at += host_replay_frameus(len) / host_replay_overload;
+      due = (unsigned long)at;
+      while ((int)(due - host_time_us) > 0)
+        host_replay_mainpass();
+      }
+    else
+      {
+      // Run the main loop up to the frame's log time:
+      due = start + (unsigned long)(time * 1e6);
+      while ((int)(due - host_time_us) > 0)
+        host_mainpass();
+      }
+    if (due > last) last = due;
+
+    if ((scale > 0) && (host_replay_overload == 0))
+      {
+      ahead = (time * 1e9 / scale) - (host_replay_ns() - wall0);
+      if (ahead > 1e6)
+        {
+        ts.tv_sec = (time_t)(ahead / 1e9);
+        ts.tv_nsec = (int)(ahead - ts.tv_sec * 1e9);
+        nanosleep(&ts, NULL);
+        }
+      }
+
+    host_replay_frames++;
+    if (!host_can_rx(id, len, data))
+      host_replay_filtered[id]++;
+    host_replay_hook();
+    if (host_replay_overload == 0)
+      vehicle_poll(); // The main loop is idle between frames (~200us at 500 kbps)
+    }
+  fclose(f);
+
+  // Let the last frames be decoded & the tickers catch up:
+  host_mainloop(1000);
+
+  t0 = host_replay_ns();
+  host_replay_walltime += t0 - wall0;
+  host_replay_logtime += (last - start) / 1e6;
+  return TRUE;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Dispatch benchmark: the frames of HOST_REPLAY_BENCHLOG, loaded once,
+// offered through the acceptance filters and decoded back to back, with
+// no main loop passes in between
+
+#define HOST_REPLAY_BENCHLOG "../../roadster_canlogs/20120218.drive.a.csv"
+#define HOST_REPLAY_BENCHMAX 16384
+
+typedef struct
+  {
+  unsigned int id;
+  unsigned char len;
+  unsigned char data[8];
+  } host_replay_frame_t;
+
+static host_replay_frame_t host_replay_benchframes[HOST_REPLAY_BENCHMAX];
+static unsigned int host_replay_benchcount = 0;
+
+unsigned long host_replay_bench(unsigned long n)
+  {
+  FILE *f;
+  char line[256];
+  double time;
+  host_replay_frame_t *fr;
+  unsigned long k;
+
+  if (host_replay_benchcount == 0)
+    {
+    f = fopen(HOST_REPLAY_BENCHLOG, "r");
+    if (f == NULL)
+      {
+      perror(HOST_REPLAY_BENCHLOG);
+      return 0;
+      }
+    while ((fgets(line, sizeof(line), f) != NULL)
+           && (host_replay_benchcount < HOST_REPLAY_BENCHMAX))
+      {
+      fr = &host_replay_benchframes[host_replay_benchcount];
+      if (host_replay_parse(line, &time, &fr->id, &fr->len, fr->data))
+        host_replay_benchcount++;
+      }
+    fclose(f);
+    if (host_replay_benchcount == 0)
+      return 0;
+    }
+
+  for (k = 0; k < n; k++)
+    {
+    fr = &host_replay_benchframes[k % host_replay_benchcount];
+    host_can_rx(fr->id, fr->len, fr->data);
+    vehicle_poll();
+    }
+  return n;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Report
+
+void host_replay_report(void)
+  {
+  unsigned int id, buf;
+  unsigned long calls = 0, filtered = 0;
+  double ns = 0;
+  host_replay_stat_t *st;
+
+  printf("handler   id  calls      avg ns   max ns   filtered\n");
+  for (id = 0; id < HOST_REPLAY_IDS; id++)
+    {
+    for (buf = 0; buf < 2; buf++)
+      {
+      st = &host_replay_stats[buf][id];
+      if (st->calls == 0)
+        continue;
+      printf("poll%u    %03x %7u %10.1f %8.0f\n",
+        buf, id, st->calls, st->ns / st->calls, st->ns_max);
+      calls += st->calls;
+      ns += st->ns;
+      }
+    if (host_replay_filtered[id] > 0)
+      {
+      printf("-        %03x %37u\n", id, host_replay_filtered[id]);
+      filtered += host_replay_filtered[id];
+      }
+    }
+
+  printf("frames=%u decoded=%u filtered=%u skipped lines=%u rxq drops=%u highwater=%u\n",
+    host_replay_frames, calls, filtered, host_replay_skipped,
+    can_rxq_drops, can_rxq_highwater);
+  printf("decode avg=%.1f ns/frame | log time %.1fs replayed in %.3fs wall\n",
+    (calls) ? ns / calls : 0.0, host_replay_logtime, host_replay_walltime / 1e9);
+  if (host_replay_overload > 0)
+    printf("overload %.1fx bus rate (%.0f kbps) | loop pass %u us | %.1f frames/pass | rxq %u slots\n",
+      host_replay_overload, 1e6 / host_replay_bitns(), 1000 + host_replay_loadus,
+      (host_replay_passes) ? (double)host_replay_frames / host_replay_passes : 0.0,
+      CAN_RXQ_SIZE - 1);
+  printf("car_type=%s SOC=%u ideal=%u est=%u speed=%u chargestate=%u odometer=%u\n",
+    car_type, car_SOC, car_idealrange, car_estrange, car_speed,
+    car_chargestate, car_odometer);
+
+  if (host_replay_trajectory != NULL)
+    fclose(host_replay_trajectory);
+  }
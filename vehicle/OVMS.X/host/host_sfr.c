@@ -0,0 +1,296 @@
+/*
+ * Host build: special function register storage, EEPROM and timer
+ * emulation, and the MPLAB C18 library functions used by OVMS.
+ * Compiled with the OVMS sources (host.h pre-included).
+ */
+
+#include "ovms.h"
+#include "host_sim.h"
+
+// Plain SFRs
+volatile unsigned char ADCON0;
+volatile unsigned char ADCON1;
+volatile unsigned char ADCON2;
+volatile unsigned short ADRES;
+volatile unsigned char BRGCON1;
+volatile unsigned char BRGCON2;
+volatile unsigned char BRGCON3;
+volatile unsigned char CANCON;
+volatile unsigned char CANSTAT;
+volatile unsigned char CIOCON;
+volatile unsigned char COMSTAT;
+volatile unsigned char EEADR;
+volatile unsigned char EEADRH;
+volatile unsigned char EECON1;
+volatile unsigned char EECON2;
+volatile unsigned char INTCON;
+volatile unsigned char IPR1;
+volatile unsigned char IPR3;
+volatile unsigned char PIE1;
+volatile unsigned char PIE3;
+volatile unsigned char PIR1;
+volatile unsigned char PIR3;
+volatile unsigned char PORTA;
+volatile unsigned char PORTB;
+volatile unsigned char PORTC;
+volatile unsigned char PR2;
+volatile unsigned char RCON;
+volatile unsigned char RCREG;
+volatile unsigned char RCSTA;
+volatile unsigned char RXB0CON;
+volatile unsigned char RXB0D0;
+volatile unsigned char RXB0D1;
+volatile unsigned char RXB0D2;
+volatile unsigned char RXB0D3;
+volatile unsigned char RXB0D4;
+volatile unsigned char RXB0D5;
+volatile unsigned char RXB0D6;
+volatile unsigned char RXB0D7;
+volatile unsigned char RXB0DLC;
+volatile unsigned char RXB0SIDH;
+volatile unsigned char RXB0SIDL;
+volatile unsigned char RXB1CON;
+volatile unsigned char RXB1D0;
+volatile unsigned char RXB1D1;
+volatile unsigned char RXB1D2;
+volatile unsigned char RXB1D3;
+volatile unsigned char RXB1D4;
+volatile unsigned char RXB1D5;
+volatile unsigned char RXB1D6;
+volatile unsigned char RXB1D7;
+volatile unsigned char RXB1DLC;
+volatile unsigned char RXB1SIDH;
+volatile unsigned char RXB1SIDL;
+volatile unsigned char RXF0SIDH;
+volatile unsigned char RXF0SIDL;
+volatile unsigned char RXF1SIDH;
+volatile unsigned char RXF1SIDL;
+volatile unsigned char RXF2SIDH;
+volatile unsigned char RXF2SIDL;
+volatile unsigned char RXF3SIDH;
+volatile unsigned char RXF3SIDL;
+volatile unsigned char RXF4SIDH;
+volatile unsigned char RXF4SIDL;
+volatile unsigned char RXF5SIDH;
+volatile unsigned char RXF5SIDL;
+volatile unsigned char RXM0SIDH;
+volatile unsigned char RXM0SIDL;
+volatile unsigned char RXM1SIDH;
+volatile unsigned char RXM1SIDL;
+volatile unsigned char SPBRG;
+volatile unsigned char SPBRGH;
+volatile unsigned char STATUS;
+volatile unsigned char STKPTR;
+volatile unsigned char T0CON;
+volatile unsigned char T1CON;
+volatile unsigned char T2CON;
+volatile unsigned char TMR0H;
+volatile unsigned char TMR0L;
+volatile unsigned char TMR1H;
+volatile unsigned char TMR1L;
+volatile unsigned char TMR2;
+volatile unsigned char TRISA;
+volatile unsigned char TRISB;
+volatile unsigned char TRISC;
+volatile unsigned char TXB0CON;
+volatile unsigned char TXB0D0;
+volatile unsigned char TXB0D1;
+volatile unsigned char TXB0D2;
+volatile unsigned char TXB0D3;
+volatile unsigned char TXB0D4;
+volatile unsigned char TXB0D5;
+volatile unsigned char TXB0D6;
+volatile unsigned char TXB0D7;
+volatile unsigned char TXB0DLC;
+volatile unsigned char TXB0SIDH;
+volatile unsigned char TXB0SIDL;
+volatile unsigned char TXB1CON;
+volatile unsigned char TXB1D0;
+volatile unsigned char TXB1D1;
+volatile unsigned char TXB1D2;
+volatile unsigned char TXB1D3;
+volatile unsigned char TXB1D4;
+volatile unsigned char TXB1D5;
+volatile unsigned char TXB1D6;
+volatile unsigned char TXB1D7;
+volatile unsigned char TXB1DLC;
+volatile unsigned char TXB1SIDH;
+volatile unsigned char TXB1SIDL;
+volatile unsigned char TXB2CON;
+volatile unsigned char TXB2D0;
+volatile unsigned char TXB2D1;
+volatile unsigned char TXB2D2;
+volatile unsigned char TXB2D3;
+volatile unsigned char TXB2D4;
+volatile unsigned char TXB2D5;
+volatile unsigned char TXB2D6;
+volatile unsigned char TXB2D7;
+volatile unsigned char TXB2DLC;
+volatile unsigned char TXB2SIDH;
+volatile unsigned char TXB2SIDL;
+volatile unsigned char TXREG;
+volatile unsigned char TXSTA;
+
+volatile BAUDCONbits_t BAUDCONbits;
+volatile CANSTATbits_t CANSTATbits;
+volatile COMSTATbits_t COMSTATbits;
+volatile INTCONbits_t INTCONbits;
+volatile IPR1bits_t IPR1bits;
+volatile IPR2bits_t IPR2bits;
+volatile PIE1bits_t PIE1bits;
+volatile PIE2bits_t PIE2bits;
+volatile PIR2bits_t PIR2bits;
+volatile PIE3bits_t PIE3bits;
+volatile PIR3bits_t PIR3bits;
+volatile PORTAbits_t PORTAbits;
+volatile PORTBbits_t PORTBbits;
+volatile PORTCbits_t PORTCbits;
+volatile RCONbits_t RCONbits;
+volatile RCSTAbits_t RCSTAbits;
+volatile RXB0CONbits_t RXB0CONbits;
+volatile RXB1CONbits_t RXB1CONbits;
+volatile STKPTRbits_t STKPTRbits;
+volatile TRISCbits_t TRISCbits;
+volatile TXSTAbits_t TXSTAbits;
+
+// Simulated time and EEPROM statistics
+unsigned long host_time_us = 0;          // Simulated time, advanced by delays
+unsigned long host_ee_reads = 0;         // EEPROM cells read
+unsigned long host_ee_writes = 0;        // EEPROM cells written
+unsigned char host_eeprom[HOST_EEPROM_SIZE];
+
+static volatile ADCON0bits_t host_adcon0;
+static volatile PIR1bits_t host_pir1;
+static volatile EECON1bits_t host_eecon1;
+static volatile unsigned char host_eedata_reg;
+static BOOL host_ee_busy = FALSE;        // A cell write is in progress
+static unsigned int host_ee_wraddr;      // ...its address & data
+static unsigned char host_ee_wrdata;
+static unsigned long host_ee_wrdone;     // ...and host_time_us at completion
+
+// The A/D converter finishes a conversion before it is polled
+volatile ADCON0bits_t *host_adcon0bits(void)
+  {
+  host_adcon0.GO = 0;
+  return &host_adcon0;
+  }
+
+// Timer 2 runs free on the host: each poll of TMR2IF is one TMR2
+// period (100ms/122) of simulated time.
+volatile PIR1bits_t *host_pir1bits(void)
+  {
+  if (!host_pir1.TMR2IF)
+    {
+    host_pir1.TMR2IF = 1;
+    host_time_us += 820;
+    host_uart_poll();
+    }
+  return &host_pir1;
+  }
+
+// Start or complete a cell write: a write started by setting WR takes
+// 4ms of simulated time and sets EEIF when done. Polling WR while the
+// write is busy (a busy-wait) advances the simulated time.
+static void host_ee_write(BOOL poll)
+  {
+  if (!host_eecon1.WR)
+    return;
+  if (!host_eecon1.WREN)
+    {
+    host_eecon1.WR = 0;
+    return;
+    }
+  if (!host_ee_busy)
+    {
+    host_ee_busy = TRUE;
+    host_ee_wraddr = (((unsigned int)EEADRH << 8) + EEADR) & (HOST_EEPROM_SIZE-1);
+    host_ee_wrdata = host_eedata_reg;
+    host_ee_wrdone = host_time_us + 4000; // 4ms per cell
+    }
+  if (poll && ((long)(host_time_us - host_ee_wrdone) < 0))
+    host_time_us++;
+  if ((long)(host_time_us - host_ee_wrdone) >= 0)
+    {
+    host_eeprom[host_ee_wraddr] = host_ee_wrdata;
+    host_ee_writes++;
+    host_ee_busy = FALSE;
+    host_eecon1.WR = 0;
+    PIR2bits.EEIF = 1;
+    }
+  }
+
+// Complete a pending EEPROM read or write
+static void host_ee_cycle(void)
+  {
+  unsigned int addr = (((unsigned int)EEADRH << 8) + EEADR) & (HOST_EEPROM_SIZE-1);
+
+  if (host_eecon1.RD)
+    {
+    host_eedata_reg = host_eeprom[addr];
+    host_eecon1.RD = 0;
+    host_ee_reads++;
+    }
+  host_ee_write(TRUE);
+  }
+
+volatile EECON1bits_t *host_eecon1bits(void)
+  {
+  host_ee_cycle();
+  return &host_eecon1;
+  }
+
+// Called once per main loop pass: complete a cell write that is due,
+// and take the EEIF interrupt (low_isr() -> par_isr())
+void host_eeprom_poll(void)
+  {
+  host_ee_write(FALSE);
+  if (PIR2bits.EEIF && PIE2bits.EEIE)
+    par_isr();
+  }
+
+volatile unsigned char *host_eedata(void)
+  {
+  host_ee_cycle();
+  return &host_eedata_reg;
+  }
+
+// Load the EEPROM image with the firmware defaults
+void host_eeprom_init(void)
+  {
+  memset(host_eeprom, 0, sizeof(host_eeprom));
+  memcpy(host_eeprom, EEparam, sizeof(EEparam));
+  }
+
+// C18 delay library: 1000 instruction cycles at 5MIPS
+void Delay1KTCYx(unsigned char n)
+  {
+  host_time_us += 200 * (unsigned long)n;
+  host_uart_poll();
+  }
+
+// C18 stdlib conversions
+char *itoa(int value, char *s)
+  {
+  sprintf(s, "%d", value);
+  return s;
+  }
+
+char *ltoa(long value, char *s)
+  {
+  sprintf(s, "%d", value);
+  return s;
+  }
+
+char *ultoa(unsigned long value, char *s)
+  {
+  sprintf(s, "%u", value);
+  return s;
+  }
+
+char *strupr(char *s)
+  {
+  char *p;
+  for (p = s; *p; p++)
+    if ((*p >= 'a') && (*p <= 'z')) *p -= 'a' - 'A';
+  return s;
+  }
@@ -0,0 +1,54 @@
+/*
+ * Host build: simulation interface for ovms_host.c, see host/Makefile
+ */
+
+#ifndef __OVMS_HOST_SIM_H
+#define __OVMS_HOST_SIM_H
+
+#define HOST_EEPROM_SIZE 1024
+
+// host_sfr.c:
+extern unsigned long host_time_us;       // Simulated time, advanced by delays
+extern unsigned long host_ee_reads;      // EEPROM cells read
+extern unsigned long host_ee_writes;     // EEPROM cells written
+extern unsigned char host_eeprom[HOST_EEPROM_SIZE];
+extern rom char EEparam[PARAM_MAX][PARAM_MAX_LENGTH];
+void host_eeprom_init(void);
+void host_eeprom_poll(void);             // Complete due EEPROM writes, take EEIF
+
+// host_uart.c:
+extern unsigned long host_uart_tx_bytes; // Bytes sent to the modem
+extern BOOL host_uart_echo;              // Copy modem output to stdout
+extern char *host_uart_capture;          // Copy modem output to this buffer (NULL = off)
+extern unsigned int host_uart_capturen;  // ...bytes copied
+void host_uart_feed(const char *s);      // Queue modem input for net_poll()
+unsigned long host_uart_baud(void);      // Async port rate (SPBRG, BRG16)
+extern BOOL host_modem_at;               // Modem answers AT commands
+extern unsigned long host_modem_baud;    // Modem rate (AT+IPR)
+extern unsigned long host_modem_maxipr;  // Highest rate AT+IPR accepts
+extern unsigned long host_modem_linkbaud; // Highest rate the link carries
+extern unsigned long host_modem_delay_us; // Modem response latency
+extern unsigned long host_modem_early;   // CIPSEND data bytes sent before the prompt
+void host_uart_poll(void);               // Deliver due modem responses
+
+// host_can.c:
+extern unsigned long host_can_rx_frames; // Frames offered to the CAN controller
+extern unsigned long host_can_rx_filtered; // ...rejected by the acceptance filters
+BOOL host_can_rx(unsigned int id, unsigned char len, const unsigned char *data);
+extern unsigned long host_can_tx_frames; // Frames sent by the CAN controller
+extern void (*host_fn_can_tx)(unsigned int id, unsigned char len, const unsigned char *data);
+void host_can_tx(void);                  // Send the requested TX buffers
+
+// ovms_host.c:
+extern void (*host_fn_ticker)(void);     // Called after the 1 second tickers
+void host_mainpass(void);                // One main loop pass (1 ms)
+void host_mainloop(unsigned long ms);    // ms main loop passes
+
+// host_replay.c:
+BOOL host_replay_open(const char *trajectory);
+BOOL host_replay(const char *filename, double scale);
+void host_replay_load(double overload, unsigned int loadus); // Overload mode
+void host_replay_report(void);
+unsigned long host_replay_bench(unsigned long n); // Decode the drive.a log frames
+
+#endif // #ifndef __OVMS_HOST_SIM_H
@@ -0,0 +1,245 @@
+/*
+ * Host build: replacement for the interrupt driven UARTIntC module.
+ * Modem output is counted (and optionally echoed), modem input is
+ * queued by host_uart_feed() and read by net_poll(). The modem only
+ * receives characters sent at its own baud rate (AT+IPR).
+ */
+
+#include "ovms.h"
+#include "host_sim.h"
+
+struct status vUARTIntStatus;
+unsigned char vUARTIntTxBuffer[TX_BUFFER_SIZE];
+unsigned char vUARTIntTxBufDataCnt;
+unsigned char vUARTIntTxBufWrPtr;
+unsigned char vUARTIntTxBufRdPtr;
+unsigned char vUARTIntRxBuffer[RX_BUFFER_SIZE];
+unsigned char vUARTIntRxBufDataCnt;
+unsigned char vUARTIntRxBufWrPtr;
+unsigned char vUARTIntRxBufRdPtr;
+
+unsigned long host_uart_tx_bytes = 0;
+BOOL host_uart_echo = FALSE;
+char *host_uart_capture = NULL;
+unsigned int host_uart_capturen = 0;
+BOOL host_modem_at = FALSE;
+unsigned long host_modem_baud = 9600;
+unsigned long host_modem_maxipr = 115200;
+unsigned long host_modem_linkbaud = 115200;
+unsigned long host_modem_delay_us = 0;
+unsigned long host_modem_early = 0;
+
+void UARTIntInit(void)
+  {
+  TXSTAbits.TRMT = 1; // Transmit shift register always empty
+  vUARTIntTxBufDataCnt = 0;
+  vUARTIntRxBufDataCnt = 0;
+  vUARTIntRxBufWrPtr = vUARTIntRxBufRdPtr = 0;
+  vUARTIntStatus.UARTIntTxBufferFull = 0;
+  vUARTIntStatus.UARTIntTxBufferEmpty = 1;
+  vUARTIntStatus.UARTIntRxBufferFull = 0;
+  vUARTIntStatus.UARTIntRxBufferEmpty = 1;
+  vUARTIntStatus.UARTIntRxOverFlow = 0;
+  vUARTIntStatus.UARTIntRxError = 0;
+  }
+
+void UARTIntISR(void)
+  {
+  }
+
+// The async port baud rate, from the baud rate generator (BRGH=1)
+unsigned long host_uart_baud(void)
+  {
+  unsigned int n = SPBRG;
+
+  if (BAUDCONbits.BRG16)
+    return UART_CLOCK_FREQ / (4UL * ((((unsigned int)SPBRGH << 8) | n) + 1));
+  else
+    return UART_CLOCK_FREQ / (16UL * (n + 1));
+  }
+
+// With host_modem_at, the modem receives our characters if the rates
+// match within 2%, and the link carries the rate
+static BOOL host_modem_sync(void)
+  {
+  unsigned long baud = host_uart_baud();
+
+  return ((baud * 50 > host_modem_baud * 49)&&
+          (baud * 50 < host_modem_baud * 51)&&
+          (host_modem_baud <= host_modem_linkbaud));
+  }
+
+// Minimal model of the modem's CIPSEND data path (QSEND=1):
+// "AT+CIPSEND\r" is answered with the "> " prompt, the Ctrl-Z ending
+// the data block with "DATA ACCEPT:<n>". With host_modem_at, other AT
+// commands are answered with OK, AT+IPR? and AT+IPR=<rate> as a SIM908.
+// With host_modem_delay_us, the responses arrive that much later (as
+// simulated time passes), data sent before the prompt has arrived is
+// counted in host_modem_early. DATA ACCEPT also waits for the serial
+// time of the block at the modem's baud rate.
+static char host_modem_line[16];
+static unsigned char host_modem_pos = 0;
+static BOOL host_modem_data = FALSE;
+static BOOL host_modem_sms = FALSE;
+static BOOL host_modem_prompted = FALSE;
+static unsigned int host_modem_len = 0;
+
+#define HOST_MODEM_PENDING 4
+static struct
+  {
+  unsigned long due;
+  BOOL prompt;
+  char text[24];
+  } host_modem_out[HOST_MODEM_PENDING];
+static unsigned char host_modem_outn = 0;
+
+// Deliver the delayed modem responses that are due
+void host_uart_poll(void)
+  {
+  while ((host_modem_outn > 0)&&((long)(host_time_us - host_modem_out[0].due) >= 0))
+    {
+    host_uart_feed(host_modem_out[0].text);
+    if (host_modem_out[0].prompt)
+      host_modem_prompted = TRUE;
+    memmove(host_modem_out, host_modem_out+1, --host_modem_outn * sizeof(host_modem_out[0]));
+    }
+  }
+
+static void host_modem_reply(const char *text, BOOL prompt, unsigned long delay)
+  {
+  if ((delay == 0)||(host_modem_outn == HOST_MODEM_PENDING))
+    {
+    host_uart_feed(text);
+    if (prompt)
+      host_modem_prompted = TRUE;
+    return;
+    }
+  host_modem_out[host_modem_outn].due = host_time_us + delay;
+  host_modem_out[host_modem_outn].prompt = prompt;
+  strncpy(host_modem_out[host_modem_outn].text, text, sizeof(host_modem_out[0].text)-1);
+  host_modem_out[host_modem_outn].text[sizeof(host_modem_out[0].text)-1] = 0;
+  host_modem_outn++;
+  }
+
+static void host_modem(unsigned char c)
+  {
+  char resp[24];
+
+  if (host_modem_data)
+    {
+    if ((c == '\n')&&(host_modem_sms)&&(host_modem_len == 0))
+      return; // The LF of the AT+CMGS line
+    if (!host_modem_prompted)
+      host_modem_early++;
+    if ((c == 0x1a)&&(host_modem_sms))
+      {
+      host_modem_reply("\r\n+CMGS: 1\r\n\r\nOK\r\n", FALSE, host_modem_delay_us);
+      host_modem_data = FALSE;
+      }
+    else if (c == 0x1a)
+      {
+      sprintf(resp, "\r\nDATA ACCEPT:%u\r\n", host_modem_len);
+      host_modem_reply(resp, FALSE, host_modem_delay_us +
+        (host_modem_len + 1) * 10000000UL / host_uart_baud()); // 8N1
+      host_modem_data = FALSE;
+      }
+    else
+      host_modem_len++;
+    return;
+    }
+
+  if (host_modem_pos < sizeof(host_modem_line)-1)
+    host_modem_line[host_modem_pos++] = c;
+  if (c == '\r')
+    {
+    host_modem_line[host_modem_pos] = 0;
+    if ((strcmp(host_modem_line, "AT+CIPSEND\r") == 0)||
+        (strncmp(host_modem_line, "AT+CMGS=", 8) == 0))
+      {
+      host_modem_prompted = FALSE;
+      host_modem_reply("\r\n> ", TRUE, host_modem_delay_us);
+      host_modem_data = TRUE;
+      host_modem_sms = (host_modem_line[4] == 'M');
+      host_modem_len = 0;
+      }
+    else if ((host_modem_at)&&(strncmp(host_modem_line, "AT+IPR=", 7) == 0))
+      {
+      unsigned long baud = strtoul(host_modem_line + 7, NULL, 10);
+
+      if ((baud > host_modem_maxipr)||
+          ((baud != 9600)&&(baud != 19200)&&(baud != 38400)&&
+           (baud != 57600)&&(baud != 115200)))
+        host_uart_feed("\r\nERROR\r\n");
+      else
+        {
+        host_uart_feed("\r\nOK\r\n"); // (at the old rate)
+        host_modem_baud = baud;
+        }
+      }
+    else if ((host_modem_at)&&(strncmp(host_modem_line, "AT", 2) == 0))
+      {
+      if (strncmp(host_modem_line, "AT+IPR?", 7) == 0)
+        {
+        sprintf(resp, "\r\n+IPR: %u\r\n", host_modem_baud);
+        host_uart_feed(resp);
+        }
+      host_uart_feed("\r\nOK\r\n");
+      }
+    host_modem_pos = 0;
+    }
+  }
+
+// The host "modem" accepts every byte at once
+unsigned char UARTIntPutChar(unsigned char c)
+  {
+  host_uart_tx_bytes++;
+  if (host_uart_echo)
+    putchar(c);
+  if (host_uart_capture != NULL)
+    host_uart_capture[host_uart_capturen++] = c;
+  if ((!host_modem_at)||(host_modem_sync()))
+    host_modem(c);
+  else
+    host_modem_pos = 0; // Garbage at the modem
+  return 1;
+  }
+
+unsigned char UARTIntGetTxBufferEmptySpace(void)
+  {
+  return TX_BUFFER_SIZE;
+  }
+
+unsigned char UARTIntGetChar(unsigned char *c)
+  {
+  if (vUARTIntRxBufDataCnt == 0)
+    return 0;
+  *c = vUARTIntRxBuffer[vUARTIntRxBufRdPtr];
+  vUARTIntRxBufRdPtr = (vUARTIntRxBufRdPtr + 1) % RX_BUFFER_SIZE;
+  if (--vUARTIntRxBufDataCnt == 0)
+    vUARTIntStatus.UARTIntRxBufferEmpty = 1;
+  vUARTIntStatus.UARTIntRxBufferFull = 0;
+  return 1;
+  }
+
+unsigned char UARTIntGetRxBufferDataSize(void)
+  {
+  return vUARTIntRxBufDataCnt;
+  }
+
+void host_uart_feed(const char *s)
+  {
+  for (; *s; s++)
+    {
+    if (vUARTIntRxBufDataCnt == RX_BUFFER_SIZE)
+      {
+      vUARTIntStatus.UARTIntRxOverFlow = 1;
+      return;
+      }
+    vUARTIntRxBuffer[vUARTIntRxBufWrPtr] = *s;
+    vUARTIntRxBufWrPtr = (vUARTIntRxBufWrPtr + 1) % RX_BUFFER_SIZE;
+    vUARTIntRxBufDataCnt++;
+    vUARTIntStatus.UARTIntRxBufferEmpty = 0;
+    }
+  if (vUARTIntRxBufDataCnt == RX_BUFFER_SIZE)
+    vUARTIntStatus.UARTIntRxBufferFull = 1;
+  }
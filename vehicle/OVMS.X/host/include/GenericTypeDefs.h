@@ -0,0 +1,24 @@
+/*
+ * Host build replacement for the Microchip GenericTypeDefs.h,
+ * sized as with MPLAB C18.
+ */
+
+#ifndef __GENERIC_TYPE_DEFS_H_
+#define __GENERIC_TYPE_DEFS_H_
+
+typedef enum _BOOL { FALSE = 0, TRUE } BOOL;
+
+typedef unsigned char   BYTE;           // 8-bit unsigned
+typedef unsigned short  WORD;           // 16-bit unsigned
+typedef unsigned int    DWORD;          // 32-bit unsigned
+
+typedef signed char     INT8;
+typedef signed short    INT16;
+typedef signed int      INT32;
+typedef signed int      INT;
+typedef unsigned char   UINT8;
+typedef unsigned short  UINT16;
+typedef unsigned int    UINT32;
+typedef unsigned int    UINT;
+
+#endif // #ifndef __GENERIC_TYPE_DEFS_H_
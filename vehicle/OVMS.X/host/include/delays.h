@@ -0,0 +1 @@
+// Host build: C18 delay library, see host/include/host.h
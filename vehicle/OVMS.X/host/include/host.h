@@ -0,0 +1,52 @@
+/*
+ * Host build pre-include: maps the MPLAB C18 language extensions and
+ * library calls used by the OVMS sources onto standard C, so the
+ * firmware core can be compiled with gcc (see host/Makefile).
+ *
+ * Note: C18 has a 16 bit int and a 32 bit long. The host keeps its
+ * 32 bit int, but long is mapped to int below (after the system
+ * headers are in) so 32 bit code like MD5 behaves as on the PIC.
+ * The "make conv" check (HOST_CONV) keeps the 64 bit long instead, so
+ * char < int < long are all different sizes as on the PIC, and
+ * -Wconversion reports the long to int truncations C18 would do.
+ */
+
+#ifndef __OVMS_HOST_H
+#define __OVMS_HOST_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+// C18 storage qualifiers
+#define rom
+#define ram
+#define far
+#define near
+#define overlay
+
+// C18 program memory string library
+#define memcmppgm2ram(a,b,n)    memcmp(a,b,n)
+#define strcmppgm2ram(a,b)      strcmp(a,b)
+#define strcpypgm2ram(a,b)      strcpy(a,b)
+#define strcatpgm2ram(a,b)      strcat(a,b)
+#define strlenpgm(a)            strlen(a)
+#define strstrrampgm(a,b)       strstr(a,b)
+#define strtokpgmram(a,b)       strtok(a,b)
+
+// C18 32 bit long
+#ifndef HOST_CONV
+#define long int
+#endif
+
+// C18 library functions, see host_sfr.c
+char *itoa(int value, char *s);
+char *ltoa(long value, char *s);
+char *ultoa(unsigned long value, char *s);
+char *strupr(char *s);
+void Delay1KTCYx(unsigned char n);
+
+#endif // #ifndef __OVMS_HOST_H
@@ -0,0 +1,2 @@
+// Host build: the PIC18F2680 shares the PIC18F2685 register shim
+#include "p18f2685.h"
@@ -0,0 +1,339 @@
+/*
+ * Host build register shim for the PIC18F2680/2685.
+ *
+ * Each special function register used by the OVMS sources is a plain
+ * variable (see host_sfr.c), so the firmware compiles and runs on a PC.
+ * A few registers are accessed through functions, to emulate the
+ * hardware behaviour the firmware busy-waits on:
+ *
+ *   ADCON0bits  A/D conversions complete at once (GO reads as 0).
+ *   PIR1bits    TMR2IF is always set: delay100b() returns at once, and
+ *               the simulated time advances by the delay instead.
+ *   EECON1bits  RD/WR operate on a 1024 byte host EEPROM image. A cell
+ *               write takes 4ms of simulated time, then sets EEIF;
+ *               polling WR while busy advances the simulated time.
+ *   EEDATA      completes a pending EEPROM read before access.
+ *
+ * The CAN TX buffers are sent by host_can_tx(), once per main loop pass.
+ * The async port (host_uart.c) transmits at once: TXSTAbits.TRMT is 1.
+ */
+
+#ifndef __OVMS_HOST_P18_H
+#define __OVMS_HOST_P18_H
+
+extern volatile unsigned char ADCON0;
+extern volatile unsigned char ADCON1;
+extern volatile unsigned char ADCON2;
+extern volatile unsigned short ADRES; // ADRESH:ADRESL
+extern volatile unsigned char BRGCON1;
+extern volatile unsigned char BRGCON2;
+extern volatile unsigned char BRGCON3;
+extern volatile unsigned char CANCON;
+extern volatile unsigned char CANSTAT;
+extern volatile unsigned char CIOCON;
+extern volatile unsigned char COMSTAT;
+extern volatile unsigned char EEADR;
+extern volatile unsigned char EEADRH;
+extern volatile unsigned char EECON1;
+extern volatile unsigned char EECON2;
+extern volatile unsigned char INTCON;
+extern volatile unsigned char IPR1;
+extern volatile unsigned char IPR3;
+extern volatile unsigned char PIE1;
+extern volatile unsigned char PIE3;
+extern volatile unsigned char PIR1;
+extern volatile unsigned char PIR3;
+extern volatile unsigned char PORTA;
+extern volatile unsigned char PORTB;
+extern volatile unsigned char PORTC;
+extern volatile unsigned char PR2;
+extern volatile unsigned char RCON;
+extern volatile unsigned char RCREG;
+extern volatile unsigned char RCSTA;
+extern volatile unsigned char RXB0CON;
+extern volatile unsigned char RXB0D0;
+extern volatile unsigned char RXB0D1;
+extern volatile unsigned char RXB0D2;
+extern volatile unsigned char RXB0D3;
+extern volatile unsigned char RXB0D4;
+extern volatile unsigned char RXB0D5;
+extern volatile unsigned char RXB0D6;
+extern volatile unsigned char RXB0D7;
+extern volatile unsigned char RXB0DLC;
+extern volatile unsigned char RXB0SIDH;
+extern volatile unsigned char RXB0SIDL;
+extern volatile unsigned char RXB1CON;
+extern volatile unsigned char RXB1D0;
+extern volatile unsigned char RXB1D1;
+extern volatile unsigned char RXB1D2;
+extern volatile unsigned char RXB1D3;
+extern volatile unsigned char RXB1D4;
+extern volatile unsigned char RXB1D5;
+extern volatile unsigned char RXB1D6;
+extern volatile unsigned char RXB1D7;
+extern volatile unsigned char RXB1DLC;
+extern volatile unsigned char RXB1SIDH;
+extern volatile unsigned char RXB1SIDL;
+extern volatile unsigned char RXF0SIDH;
+extern volatile unsigned char RXF0SIDL;
+extern volatile unsigned char RXF1SIDH;
+extern volatile unsigned char RXF1SIDL;
+extern volatile unsigned char RXF2SIDH;
+extern volatile unsigned char RXF2SIDL;
+extern volatile unsigned char RXF3SIDH;
+extern volatile unsigned char RXF3SIDL;
+extern volatile unsigned char RXF4SIDH;
+extern volatile unsigned char RXF4SIDL;
+extern volatile unsigned char RXF5SIDH;
+extern volatile unsigned char RXF5SIDL;
+extern volatile unsigned char RXM0SIDH;
+extern volatile unsigned char RXM0SIDL;
+extern volatile unsigned char RXM1SIDH;
+extern volatile unsigned char RXM1SIDL;
+extern volatile unsigned char SPBRG;
+extern volatile unsigned char SPBRGH;
+extern volatile unsigned char STATUS;
+extern volatile unsigned char STKPTR;
+extern volatile unsigned char T0CON;
+extern volatile unsigned char T1CON;
+extern volatile unsigned char T2CON;
+extern volatile unsigned char TMR0H;
+extern volatile unsigned char TMR0L;
+extern volatile unsigned char TMR1H;
+extern volatile unsigned char TMR1L;
+extern volatile unsigned char TMR2;
+extern volatile unsigned char TRISA;
+extern volatile unsigned char TRISB;
+extern volatile unsigned char TRISC;
+extern volatile unsigned char TXB0CON;
+extern volatile unsigned char TXB0D0;
+extern volatile unsigned char TXB0D1;
+extern volatile unsigned char TXB0D2;
+extern volatile unsigned char TXB0D3;
+extern volatile unsigned char TXB0D4;
+extern volatile unsigned char TXB0D5;
+extern volatile unsigned char TXB0D6;
+extern volatile unsigned char TXB0D7;
+extern volatile unsigned char TXB0DLC;
+extern volatile unsigned char TXB0SIDH;
+extern volatile unsigned char TXB0SIDL;
+extern volatile unsigned char TXB1CON;
+extern volatile unsigned char TXB1D0;
+extern volatile unsigned char TXB1D1;
+extern volatile unsigned char TXB1D2;
+extern volatile unsigned char TXB1D3;
+extern volatile unsigned char TXB1D4;
+extern volatile unsigned char TXB1D5;
+extern volatile unsigned char TXB1D6;
+extern volatile unsigned char TXB1D7;
+extern volatile unsigned char TXB1DLC;
+extern volatile unsigned char TXB1SIDH;
+extern volatile unsigned char TXB1SIDL;
+extern volatile unsigned char TXB2CON;
+extern volatile unsigned char TXB2D0;
+extern volatile unsigned char TXB2D1;
+extern volatile unsigned char TXB2D2;
+extern volatile unsigned char TXB2D3;
+extern volatile unsigned char TXB2D4;
+extern volatile unsigned char TXB2D5;
+extern volatile unsigned char TXB2D6;
+extern volatile unsigned char TXB2D7;
+extern volatile unsigned char TXB2DLC;
+extern volatile unsigned char TXB2SIDH;
+extern volatile unsigned char TXB2SIDL;
+extern volatile unsigned char TXREG;
+extern volatile unsigned char TXSTA;
+
+typedef struct
+  {
+  unsigned ADON:1;
+  unsigned GO:1;
+  } ADCON0bits_t;
+volatile ADCON0bits_t *host_adcon0bits(void);
+#define ADCON0bits (*host_adcon0bits())
+
+typedef struct
+  {
+  unsigned BRG16:1;
+  } BAUDCONbits_t;
+extern volatile BAUDCONbits_t BAUDCONbits;
+
+typedef struct
+  {
+  unsigned OPMODE2:1;
+  } CANSTATbits_t;
+extern volatile CANSTATbits_t CANSTATbits;
+
+typedef struct
+  {
+  unsigned RXB0OVFL:1;
+  unsigned RXB1OVFL:1;
+  } COMSTATbits_t;
+extern volatile COMSTATbits_t COMSTATbits;
+
+typedef struct
+  {
+  unsigned RD:1;
+  unsigned WR:1;
+  unsigned WREN:1;
+  } EECON1bits_t;
+volatile EECON1bits_t *host_eecon1bits(void);
+#define EECON1bits (*host_eecon1bits())
+
+typedef struct
+  {
+  unsigned GIE:1;
+  unsigned GIEH:1;
+  unsigned GIEL:1;
+  unsigned PEIE:1;
+  } INTCONbits_t;
+extern volatile INTCONbits_t INTCONbits;
+
+typedef struct
+  {
+  unsigned RCIP:1;
+  unsigned TMR1IP:1;
+  unsigned TXIP:1;
+  } IPR1bits_t;
+extern volatile IPR1bits_t IPR1bits;
+
+typedef struct
+  {
+  unsigned RCIE:1;
+  unsigned TMR1IE:1;
+  unsigned TXIE:1;
+  } PIE1bits_t;
+extern volatile PIE1bits_t PIE1bits;
+
+typedef struct
+  {
+  unsigned EEIP:1;
+  } IPR2bits_t;
+extern volatile IPR2bits_t IPR2bits;
+
+typedef struct
+  {
+  unsigned EEIE:1;
+  } PIE2bits_t;
+extern volatile PIE2bits_t PIE2bits;
+
+typedef struct
+  {
+  unsigned EEIF:1;
+  } PIR2bits_t;
+extern volatile PIR2bits_t PIR2bits;
+
+typedef struct
+  {
+  unsigned RXB0IE:1;
+  unsigned RXB1IE:1;
+  } PIE3bits_t;
+extern volatile PIE3bits_t PIE3bits;
+
+typedef struct
+  {
+  unsigned RCIF:1;
+  unsigned TMR1IF:1;
+  unsigned TMR2IF:1;
+  unsigned TXIF:1;
+  } PIR1bits_t;
+volatile PIR1bits_t *host_pir1bits(void);
+#define PIR1bits (*host_pir1bits())
+
+typedef struct
+  {
+  unsigned RXB0IF:1;
+  unsigned RXB1IF:1;
+  } PIR3bits_t;
+extern volatile PIR3bits_t PIR3bits;
+
+typedef struct
+  {
+  unsigned RA0:1;
+  unsigned RA1:1;
+  unsigned RA2:1;
+  unsigned RA3:1;
+  unsigned RA4:1;
+  unsigned RA5:1;
+  } PORTAbits_t;
+extern volatile PORTAbits_t PORTAbits;
+
+typedef struct
+  {
+  unsigned RB0:1;
+  } PORTBbits_t;
+extern volatile PORTBbits_t PORTBbits;
+
+typedef struct
+  {
+  unsigned RC0:1;
+  unsigned RC1:1;
+  unsigned RC2:1;
+  unsigned RC3:1;
+  unsigned RC4:1;
+  unsigned RC5:1;
+  } PORTCbits_t;
+extern volatile PORTCbits_t PORTCbits;
+
+typedef struct
+  {
+  unsigned IPEN:1;
+  unsigned NOT_BOR:1;
+  unsigned NOT_PD:1;
+  unsigned NOT_POR:1;
+  unsigned NOT_RI:1;
+  unsigned NOT_TO:1;
+  } RCONbits_t;
+extern volatile RCONbits_t RCONbits;
+
+typedef struct
+  {
+  unsigned CREN:1;
+  unsigned FERR:1;
+  unsigned OERR:1;
+  unsigned SPEN:1;
+  } RCSTAbits_t;
+extern volatile RCSTAbits_t RCSTAbits;
+
+typedef struct
+  {
+  unsigned RXFUL:1;
+  } RXB0CONbits_t;
+extern volatile RXB0CONbits_t RXB0CONbits;
+
+typedef struct
+  {
+  unsigned RXFUL:1;
+  } RXB1CONbits_t;
+extern volatile RXB1CONbits_t RXB1CONbits;
+
+typedef struct
+  {
+  unsigned STKFUL:1;
+  unsigned STKUNF:1;
+  } STKPTRbits_t;
+extern volatile STKPTRbits_t STKPTRbits;
+
+typedef struct
+  {
+  unsigned TRISC6:1;
+  unsigned TRISC7:1;
+  } TRISCbits_t;
+extern volatile TRISCbits_t TRISCbits;
+
+typedef struct
+  {
+  unsigned BRGH:1;
+  unsigned TRMT:1;
+  unsigned TXEN:1;
+  } TXSTAbits_t;
+extern volatile TXSTAbits_t TXSTAbits;
+
+volatile unsigned char *host_eedata(void);
+#define EEDATA (*host_eedata())
+
+#define ClrWdt()
+#define Nop()
+#define Reset()
+
+#endif // #ifndef __OVMS_HOST_P18_H
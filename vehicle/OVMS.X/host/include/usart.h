@@ -0,0 +1 @@
+// Host build: C18 usart library (not used, see host_uart.c)
@@ -0,0 +1,2047 @@
+/*
+;    Project:       Open Vehicle Monitor System
+;    Date:          16 October 2011
+;
+;    Host build: simulated main loop and benchmarks, see host/Makefile
+;
+; Permission is hereby granted, free of charge, to any person obtaining a copy
+; of this software and associated documentation files (the "Software"), to deal
+; in the Software without restriction, including without limitation the rights
+; to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+; copies of the Software, and to permit persons to whom the Software is
+; furnished to do so, subject to the following conditions:
+;
+; The above copyright notice and this permission notice shall be included in
+; all copies or substantial portions of the Software.
+;
+; THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+; IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+; FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+; AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+; LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+; OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+; THE SOFTWARE.
+*/
+
+#include "ovms.h"
+#include "led.h"
+#include "inputs.h"
+#include "net_msg.h"
+#include "net_sms.h"
+#include "crypt_md5.h"
+#include "crypt_rc4.h"
+#include "crypt_base64.h"
+#include "crypt_hmac.h"
+#ifdef OVMS_LOGGINGMODULE
+#include "logging.h"
+#endif
+#ifdef OVMS_ACCMODULE
+#include "acc.h"
+#endif
+#include "host_sim.h"
+
+#define HOST_BENCH_MIN_NS 200000000.0 // Run each benchmark for at least 0.2s
+
+typedef struct
+  {
+  const char *name;
+  unsigned long (*fn)(unsigned long n); // Run n iterations, returns units done
+  const char *unit;
+  } host_bench_t;
+
+void (*host_fn_ticker)(void) = NULL; // Called after the 1 second tickers
+
+static char host_buf[NET_BUF_MAX*2];
+static unsigned long host_sink = 0;
+
+static double host_now_ns(void)
+  {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Simulated firmware start up and main loop (cf. ovms.c main())
+
+void host_setup(const char *vehicletype)
+  {
+  unsigned char x;
+
+  CANSTATbits.OPMODE2 = 1; // CAN controller "in configuration mode"
+  host_eeprom_init();
+
+  for (x = 0; x < FEATURES_MAP_PARAM; x++)
+    sys_features[x] = 0;
+  for (x = FEATURES_MAP_PARAM; x < FEATURES_MAX; x++)
+    sys_features[x] = atoi(par_get(PARAM_FEATURE_S + (x - FEATURES_MAP_PARAM)));
+  car_coolingdown = -1;
+
+  inputs_initialise();
+  led_initialise();
+  par_initialise();
+  par_set(PARAM_VEHICLETYPE, (char *)vehicletype);
+  vehicle_initialise();
+  net_initialise();
+
+#ifdef OVMS_HW_V2
+  car_12vline = inputs_voltage();
+  car_12vline_ref = 0;
+#endif
+#ifdef OVMS_ACCMODULE
+  acc_initialise();
+#endif
+  }
+
+// One main loop pass, taking one simulated millisecond. The tickers
+// are driven from simulated time (which delay100() also advances).
+void host_mainpass(void)
+  {
+  static unsigned long last10th = 0, last1s = 0;
+  unsigned int tmr0;
+
+  host_uart_poll();
+  while (!vUARTIntStatus.UARTIntRxBufferEmpty)
+    net_poll();
+  host_eeprom_poll();
+  host_can_tx();
+  vehicle_poll();
+  vehicle_idlepoll();
+  sched_poll();
+
+  host_time_us += 1000;
+  tmr0 = ((host_time_us - last1s) / 512) * 10; // TMR0 runs at 51.2uS
+  TMR0H = tmr0 >> 8;
+  TMR0L = tmr0;
+  if ((host_time_us - last1s) >= 1000000)
+    {
+    last1s = last10th = host_time_us;
+    TMR0H = 0;
+    TMR0L = 0; // Reset each second, as by the main loop
+    sched_ticker10th();
+    net_ticker();
+    vehicle_ticker();
+#ifdef OVMS_LOGGINGMODULE
+    logging_ticker();
+#endif
+#ifdef OVMS_ACCMODULE
+    acc_ticker();
+#endif
+    if (host_fn_ticker != NULL) host_fn_ticker();
+    }
+  else if ((host_time_us - last10th) >= 100000)
+    {
+    last10th = host_time_us;
+    sched_ticker10th();
+    net_ticker10th();
+    vehicle_ticker10th();
+    }
+  }
+
+void host_mainloop(unsigned long ms)
+  {
+  for (; ms > 0; ms--)
+    host_mainpass();
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Benchmarks
+
+// Tesla Roadster frames taken from roadster_canlogs/20120218.drive.a.csv
+static const unsigned char host_can_frames[][9] =
+  {
+  { 8, 0x80,0x60,0xBB,0x00,0x64,0x00,0xAA,0x00 },  // Range / SOC
+  { 8, 0x81,0x00,0x00,0x00,0x42,0xFF,0x3E,0x4F },  // Time
+  { 6, 0x85,0x01,0x86,0x00,0x72,0x00,0x00,0x00 },  // GPS latitude
+  { 6, 0x89,0x00,0xFF,0xFF,0x7F,0xFF,0x00,0x00 },  // Speed
+  { 8, 0x97,0x11,0x10,0x00,0x7C,0xD9,0x00,0x00 },  // Odometer
+  { 7, 0x9B,0x82,0xEF,0x07,0x05,0xFB,0x91,0x00 },  // Charge status
+  { 7, 0xA3,0x11,0x10,0x00,0x00,0x00,0x14,0x00 },  // Temperatures
+  };
+#define HOST_CAN_FRAMES (sizeof(host_can_frames)/sizeof(host_can_frames[0]))
+
+static unsigned long host_bench_can(unsigned long n)
+  {
+  unsigned long k;
+  const unsigned char *f;
+
+  for (k = 0; k < n; k++)
+    {
+    f = host_can_frames[k % HOST_CAN_FRAMES];
+    host_can_rx(0x100, f[0], f+1);
+    vehicle_poll();
+    }
+  return n;
+  }
+
+static unsigned long host_bench_stp(unsigned long n)
+  {
+  unsigned long k;
+  char *s;
+
+  for (k = 0; k < n; k++)
+    {
+    s = stp_i(host_buf, "MP-0 S", car_SOC);
+    s = stp_i(s, ",", car_idealrange);
+    s = stp_l2f(s, ",", 12345 + k, 2);
+    s = stp_latlon(s, ",", car_latitude);
+    s = stp_ulp(s, ",", k, 6, '0');
+    s = stp_time(s, ",", k);
+    host_sink += (unsigned long)(s - host_buf);
+    }
+  return n;
+  }
+
+extern RC4_CTX1 tx_crypto1, pm_crypto1;
+extern RC4_CTX2 tx_crypto2, pm_crypto2;
+extern char ptokenmade;
+extern char pdigest[MD5_SIZE];
+#ifdef OVMS_PMPRIMED
+extern char pm_primed;
+#endif // #ifdef OVMS_PMPRIMED
+
+static unsigned long host_bench_crypto(unsigned long n)
+  {
+  static const unsigned char key[] = "ovms-host-benchmark";
+  static unsigned char msg[NET_BUF_MAX];
+  static unsigned char enc[NET_BUF_MAX*2];
+  unsigned char digest[MD5_SIZE];
+  RC4_CTX1 rx1; RC4_CTX2 rx2;
+  unsigned long k;
+
+  memset(msg, 'A', sizeof(msg));
+  for (k = 0; k < n; k++)
+    {
+    hmac_md5(msg, 32, key, sizeof(key)-1, digest);
+    RC4_setup(&rx1, &rx2, digest, MD5_SIZE);
+    RC4_crypt(&rx1, &rx2, msg, 100);
+    base64encode(msg, 100, enc);
+    host_sink += base64decode(enc, msg);
+    }
+  return n * 100;
+  }
+
+// The paranoid mode cipher of one 100 byte message: net_msg_pm_setup()
+// from the primed copy, and (pmold) with the full re-key and 1024 byte
+// discard it did for every message before OVMS_PMPRIMED
+static unsigned long host_bench_pmrun(unsigned long n, BOOL primed)
+  {
+  static unsigned char msg[100];
+  unsigned long k;
+
+  memset(pdigest, 0x5a, MD5_SIZE);
+#ifdef OVMS_PMPRIMED
+  pm_primed = 0;
+#endif // #ifdef OVMS_PMPRIMED
+  for (k = 0; k < n; k++)
+    {
+#ifdef OVMS_PMPRIMED
+    if (!primed) pm_primed = 0;
+#endif // #ifdef OVMS_PMPRIMED
+    net_msg_pm_setup();
+    RC4_crypt(&pm_crypto1, &pm_crypto2, msg, sizeof(msg));
+    host_sink += msg[0];
+    }
+#ifdef OVMS_PMPRIMED
+  pm_primed = 0;
+#endif // #ifdef OVMS_PMPRIMED
+  return n;
+  }
+
+static unsigned long host_bench_pm(unsigned long n)
+  {
+  return host_bench_pmrun(n, TRUE);
+  }
+
+static unsigned long host_bench_pmold(unsigned long n)
+  {
+  return host_bench_pmrun(n, FALSE);
+  }
+
+// Crypto test vectors: RC4 (the well known Key/Wiki/Secret set), base64
+// (RFC 4648 section 10, decoded with the "\r\n" net_msg_in() appends, as
+// base64decode() drops the last block of an unterminated string that is
+// a multiple of 4 long), and the primed paranoid mode cipher against a
+// fresh re-key of the same pdigest.
+static unsigned int host_crypto_fails;
+
+static void host_crypto_result(const char *name, BOOL ok)
+  {
+  printf("  %-34s %s\n", name, (ok) ? "ok" : "FAIL");
+  if (!ok) host_crypto_fails++;
+  }
+
+static void host_crypto_check(void)
+  {
+  static const struct
+    {
+    const char *key, *text;
+    unsigned char cipher[16];
+    } rc4[] =
+    {
+    { "Key", "Plaintext", { 0xbb,0xf3,0x16,0xe8,0xd9,0x40,0xaf,0x0a,0xd3 } },
+    { "Wiki", "pedia", { 0x10,0x21,0xbf,0x04,0x20 } },
+    { "Secret", "Attack at dawn",
+      { 0x45,0xa0,0x1f,0x64,0x5f,0xc3,0x5b,0x38,0x35,0x52,0x54,0x4b,0x9b,0xf5 } },
+    };
+  static const char *b64[][2] =
+    {
+    { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" }, { "foob", "Zm9vYg==" },
+    { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" },
+    };
+  unsigned char buf[64], enc[64], pm[256], ref[1024+256];
+  RC4_CTX1 c1; RC4_CTX2 c2;
+  char name[40];
+  unsigned int k, len;
+  BOOL ok;
+
+  printf("crypto test vectors:\n");
+  host_crypto_fails = 0;
+
+  for (k = 0; k < sizeof(rc4)/sizeof(rc4[0]); k++)
+    {
+    len = (unsigned int)strlen(rc4[k].text);
+    memcpy(buf, rc4[k].text, len);
+    RC4_setup(&c1, &c2, (const unsigned char *)rc4[k].key, (int)strlen(rc4[k].key));
+    RC4_crypt(&c1, &c2, buf, (int)len);
+    ok = (memcmp(buf, rc4[k].cipher, len) == 0);
+    RC4_setup(&c1, &c2, (const unsigned char *)rc4[k].key, (int)strlen(rc4[k].key));
+    RC4_crypt(&c1, &c2, buf, (int)len);
+    ok = ok && (memcmp(buf, rc4[k].text, len) == 0);
+    sprintf(name, "rc4 \"%s\"", rc4[k].key);
+    host_crypto_result(name, ok);
+    }
+
+  for (k = 0; k < sizeof(b64)/sizeof(b64[0]); k++)
+    {
+    len = (unsigned int)strlen(b64[k][0]);
+    base64encode((BYTE *)b64[k][0], (WORD)len, enc);
+    ok = (strcmp((char *)enc, b64[k][1]) == 0);
+    strcat((char *)enc, "\r\n");
+    memset(buf, 0, sizeof(buf));
+    ok = ok && (base64decode(enc, buf) == (int)len) && (memcmp(buf, b64[k][0], len) == 0);
+    sprintf(name, "base64 \"%s\"", b64[k][0]);
+    host_crypto_result(name, ok);
+    }
+
+  // Paranoid mode: three messages from the primed copy, each must give
+  // the keystream of a fresh re-key with the 1024 byte discard
+  memset(pdigest, 0xa5, MD5_SIZE);
+  RC4_setup(&c1, &c2, (const unsigned char *)pdigest, MD5_SIZE);
+  memset(ref, 0, sizeof(ref));
+  RC4_crypt(&c1, &c2, ref, sizeof(ref));
+#ifdef OVMS_PMPRIMED
+  pm_primed = 0;
+#endif // #ifdef OVMS_PMPRIMED
+  for (ok = TRUE, k = 0; k < 3; k++)
+    {
+    net_msg_pm_setup();
+    memset(pm, 0, sizeof(pm));
+    RC4_crypt(&pm_crypto1, &pm_crypto2, pm, sizeof(pm));
+    ok = ok && (memcmp(pm, ref+1024, sizeof(pm)) == 0);
+    }
+  host_crypto_result("paranoid primed vs re-key", ok);
+#ifdef OVMS_PMPRIMED
+  pm_primed = 0;
+#endif // #ifdef OVMS_PMPRIMED
+
+  printf("  %u failed\n", host_crypto_fails);
+  }
+
+static unsigned long host_bench_msg(unsigned long n)
+  {
+  unsigned long k, tx = host_uart_tx_bytes;
+
+  net_msg_serverok = 1;
+  for (k = 0; k < n; k++)
+    {
+    net_msg_start();
+    net_msgp_stat(0); // Full path: format, encrypt, encode, "send"
+    net_msg_send();
+    net_poll();       // Take the modem's prompt & acknowledgement
+    }
+  net_msg_serverok = 0;
+  return host_uart_tx_bytes - tx;
+  }
+
+// Modem response lines of a SIM908 session: start up and GPRS init,
+// then READY with the periodic AT+CREG?;+CIPSTATUS;+CSQ status poll,
+// internal GPS polls (AT+CGPSINF=2;+CGPSINF=64), data acknowledgements,
+// a USSD reply and an incoming call
+static const char *host_modem_lines[] =
+  {
+  "RDY", "+CFUN: 1", "+CPIN: READY", "Call Ready", "OK",
+  "+CSMINS: 0,1", "OK",
+  "89490200001234567890", "+CPBF: 1,\"+491701234567\",145,\"O-2\"", "+CPIN: READY", "OK",
+  "+IPR: 9600", "OK",
+  "+COPS: 0,1,\"E-Plus\"", "OK",
+  "+CREG: 1", "OK", "OK", "OK", "OK", "10.123.45.67", "OK", "CONNECT OK",
+  "+CREG: 1,1", "OK", "STATE: CONNECT OK", "+CSQ: 18,0", "OK",
+  "2,104512.000,5120.3012,N,00703.1203,E,1,7,1.21,114.2,M,47.1,M,,",
+  "64,217.43,T,,M,0.21,N,0.40,K,A", "OK",
+  "DATA ACCEPT:208",
+  "2,104513.000,5120.3013,N,00703.1201,E,1,7,1.21,114.3,M,47.1,M,,",
+  "64,217.51,T,,M,0.18,N,0.33,K,A", "OK",
+  "DATA ACCEPT:92",
+  "+CREG: 1,1", "OK", "STATE: CONNECT OK", "+CSQ: 17,0", "OK",
+  "+CUSD: 0,\"Guthaben: 12.34 EUR\",15",
+  "+CLIP: \"+491701234567\",145,\"\",,\"\",0", "OK",
+  "DATA ACCEPT:64",
+  "+CSQ: 99,99", "SEND FAIL", "+PDP: DEACT", "CLOSED", "ERROR",
+  };
+#define HOST_MODEM_LINES (sizeof(host_modem_lines)/sizeof(host_modem_lines[0]))
+
+static unsigned long host_bench_urc(unsigned long n)
+  {
+  unsigned long k;
+
+  for (k = 0; k < n; k++)
+    host_sink += net_urc(host_modem_lines[k % HOST_MODEM_LINES]);
+  return n;
+  }
+
+// The if/memcmp cascade net_urc() replaced: one compare per prefix in
+// the order net_state_activity() used to test them in NET_STATE_READY
+static unsigned long host_bench_urccascade(unsigned long n)
+  {
+  static const char *cascade[] =
+    {
+    "+CREG", "+CLIP", "2,", "64,", "CONNECT OK", "STATE: ", "+CSQ:",
+    "SEND OK", "DATA ACCEPT", "CLOSED", "CONNECT FAIL", "SEND FAIL",
+    "+CME ERROR", "+PDP: DEACT", "RDY", "+CFUN:", "+CUSD:"
+    };
+  unsigned long k;
+  unsigned int x;
+  const char *line;
+
+  for (k = 0; k < n; k++)
+    {
+    line = host_modem_lines[k % HOST_MODEM_LINES];
+    for (x = 0; x < sizeof(cascade)/sizeof(cascade[0]); x++)
+      {
+      if (memcmp(line, cascade[x], strlen(cascade[x])) == 0)
+        break;
+      }
+    host_sink += x;
+    }
+  return n;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Internal GPS NMEA parser (net_gps_gga) against the strtok/atoi code it
+// replaced: -n checks both against the corpus, the "gps" and "gpsold"
+// benches parse the same lines.
+
+typedef struct
+  {
+  const char *line;  // AT+CGPSINF=2 response past the "2,"
+  BOOL ok;           // Expected to be stored
+  unsigned char lock;
+  long lat, lon;     // Expected position in 1/1000000 degrees
+  int alt;
+  unsigned char sats;
+  unsigned int hdop; // 1/10
+  unsigned long time;
+  } host_gps_t;
+
+static const host_gps_t host_gps_corpus[] =
+  {
+  { "104512.000,5120.3012,N,00703.1203,E,1,7,1.21,114.2,M,47.1,M,,",
+    TRUE, 1, 51338353, 7052005, 114, 7, 12, 38712 },
+  { "235959.000,3351.8040,S,15112.5200,E,1,9,0.90,38.0,M,22.0,M,,",
+    TRUE, 1, -33863400, 151208666, 38, 9, 9, 86399 },
+  { "000001.000,4042.7680,N,07400.3600,W,1,5,2.50,-3.5,M,-34.2,M,,",
+    TRUE, 1, 40712800, -74006000, -3, 5, 25, 1 },
+  { "060000.000,1730.0000,S,17959.9999,W,1,6,1.0,5.0,M,,M,,",
+    TRUE, 1, -17500000, -179999998, 5, 6, 10, 21600 },
+  { "120000.00,5120.301234,N,00703.120345,E,2,12,0.6,250.9,M,,M,,",
+    TRUE, 1, 51338353, 7052005, 250, 12, 6, 43200 },
+  { "104512.000,,,,,0,0,,,M,,M,,",
+    TRUE, 0, 0, 0, 0, 0, 0, 0 },
+  { "104512.000,5120.3012,N,00703",
+    FALSE },
+  { "104512.000,5175.3012,N,00703.1203,E,1,7,1.21,114.2,M,47.1,M,,",
+    FALSE },
+  { "104512.000,5120.3012,X,00703.1203,E,1,7,1.21,114.2,M,47.1,M,,",
+    FALSE },
+  { "",
+    FALSE },
+  };
+#define HOST_GPS_CORPUS (sizeof(host_gps_corpus)/sizeof(host_gps_corpus[0]))
+
+// The replaced parser, returns TRUE if the data has been stored
+static BOOL host_gps_old(char *line)
+  {
+  long lat = 0, lon = 0;
+  char ns = 0, ew = 0;
+  char fix = 0;
+  int alt = 0;
+  char *b;
+
+  if(( b = strtokpgmram( line, "," ) ))
+      ;                                     // Time
+  if(( b = strtokpgmram( NULL, "," ) ))
+      lat = gps2latlon( b );                // Latitude
+  if(( b = strtokpgmram( NULL, "," ) ))
+      ns = *b;                              // North / South
+  if(( b = strtokpgmram( NULL, "," ) ))
+      lon = gps2latlon( b );                // Longitude
+  if(( b = strtokpgmram( NULL, "," ) ))
+      ew = *b;                              // East / West
+  if(( b = strtokpgmram( NULL, "," ) ))
+      fix = *b;                             // Fix (0/1)
+  if(( b = strtokpgmram( NULL, "," ) ))
+      ;                                     // Satellite count
+  if(( b = strtokpgmram( NULL, "," ) ))
+      ;                                     // HDOP
+  if(( b = strtokpgmram( NULL, "," ) ))
+      alt = atoi( b );                      // Altitude
+
+  if( b )
+    {
+    car_gpslock = fix & 0x01;
+    if( car_gpslock )
+      {
+      if( ns == 'S' ) lat = ~lat;
+      if( ew == 'W' ) lon = ~lon;
+      car_latitude = lat;
+      car_longitude = lon;
+      car_altitude = alt;
+      }
+    }
+  return (b != NULL);
+  }
+
+// Latitude/longitude in 1/1000000 degrees, as stp_latlon() formats it
+static long host_gps_deg6(long latlon)
+  {
+  return (latlon < 0) ? -(long)muldiv(~latlon, 625, 4608) : (long)muldiv(latlon, 625, 4608);
+  }
+
+static unsigned int host_gps_check(BOOL (*parse)(char *line), BOOL extra)
+  {
+  const host_gps_t *g;
+  unsigned int k, errors = 0;
+  BOOL ok;
+
+  for (k = 0; k < HOST_GPS_CORPUS; k++)
+    {
+    g = &host_gps_corpus[k];
+    strcpy(host_buf, g->line);
+    car_gpslock = 0xff;
+    car_latitude = car_longitude = 0x7fffffff;
+    car_altitude = car_gpssats = car_gpshdop = car_gpstime = 0;
+    ok = parse(host_buf);
+    if (g->ok)
+      ok = ok && (car_gpslock == g->lock);
+    else
+      ok = !ok && (car_gpslock == 0xff); // Nothing stored
+    if (ok && g->ok && g->lock)
+      {
+      ok = (labs(host_gps_deg6(car_latitude) - g->lat) <= 1)
+        && (labs(host_gps_deg6(car_longitude) - g->lon) <= 1)
+        && (car_altitude == g->alt);
+      if (extra)
+        ok = ok && (car_gpssats == g->sats) && (car_gpshdop == g->hdop) && (car_gpstime == g->time);
+      }
+    if (!ok)
+      {
+      printf("  failed: \"%s\"\n", g->line);
+      errors++;
+      }
+    }
+  return errors;
+  }
+
+static void host_gps_corpuscheck(void)
+  {
+  unsigned int errors;
+
+  printf("NMEA parser corpus, %u lines:\n", (unsigned int)HOST_GPS_CORPUS);
+  errors = host_gps_check(net_gps_gga, TRUE);
+  printf("net_gps_gga: %u failed\n", errors);
+  errors = host_gps_check(host_gps_old, FALSE);
+  printf("old parser:  %u failed\n", errors);
+  }
+
+static unsigned long host_bench_gps(unsigned long n)
+  {
+  unsigned long k;
+
+  for (k = 0; k < n; k++)
+    {
+    strcpy(host_buf, host_gps_corpus[k % 6].line);
+    host_sink += net_gps_gga(host_buf);
+    }
+  return n;
+  }
+
+static unsigned long host_bench_gpsold(unsigned long n)
+  {
+  unsigned long k;
+
+  for (k = 0; k < n; k++)
+    {
+    strcpy(host_buf, host_gps_corpus[k % 6].line);
+    host_sink += host_gps_old(host_buf);
+    }
+  return n;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Fixed point kernels (utils.c, vehicle_twizy.c) against the float code
+// they replaced: the "fix" and "float" benches run the same inputs, -a
+// reports the errors of both against double precision.
+// Note: the host FPU is no measure of the C18 software float cost.
+
+#ifdef OVMS_TWIZY_BATTMON
+UINT vehicle_twizy_stddev(UINT32 sum, UINT32 sqrsum, UINT n);
+#endif
+
+#define HOST_FIX_INPUTS 256
+
+static long host_fix_latlon[HOST_FIX_INPUTS];
+static char host_fix_gps[HOST_FIX_INPUTS][16];
+static unsigned long host_fix_sum[HOST_FIX_INPUTS], host_fix_sqrsum[HOST_FIX_INPUTS];
+#define HOST_FIX_CELLS 14
+
+static void host_fix_setup(void)
+  {
+  static BOOL done = FALSE;
+  unsigned long rnd = 12345;
+  unsigned int k, c, v;
+
+  if (done)
+    return;
+  for (k = 0; k < HOST_FIX_INPUTS; k++)
+    {
+    rnd = rnd * 1103515245 + 12345;
+    host_fix_latlon[k] = (rnd >> 1) % 1327104000; // 0..180 degrees
+    sprintf(host_fix_gps[k], "%u%02u.%04u",
+      (unsigned int)(rnd % 180), (unsigned int)((rnd >> 8) % 60), (unsigned int)((rnd >> 16) % 10000));
+    host_fix_sum[k] = host_fix_sqrsum[k] = 0;
+    for (c = 0; c < HOST_FIX_CELLS; c++)
+      {
+      rnd = rnd * 1103515245 + 12345;
+      v = 0x0e00 + ((rnd >> 16) % ((k & 1) ? 16 : 256)); // Cell voltages
+      host_fix_sum[k] += v;
+      host_fix_sqrsum[k] += (unsigned long)v * v;
+      }
+    }
+  done = TRUE;
+  }
+
+// The float versions of stp_latlon() (micro degrees), gps2latlon() and
+// the Twizy standard deviation
+static long host_float_latlon(long latlon)
+  {
+  float res;
+
+  res = (float) latlon / 2048 / 3600;
+  return res * 1000000;
+  }
+
+static float host_float_atof(char *src)
+  {
+  long whole, frac, pot;
+  char *s;
+
+  whole = atol(src);
+  if ((s = strchr(src, '.')))
+    {
+    frac = 0;
+    pot = 1;
+    while (*++s)
+      {
+      frac = frac * 10 + (*s - 48);
+      pot = pot * 10;
+      }
+    return (float) whole + (float) frac / pot;
+    }
+  return (float) whole;
+  }
+
+static long host_float_gps2latlon(char *gpscoord)
+  {
+  float f;
+  long d;
+
+  f = host_float_atof(gpscoord);
+  d = (long) (f / 100);
+  f = (float) d + (f - (d * 100)) / 60;
+  return (long) (f * 3600 * 2048);
+  }
+
+static unsigned int host_float_stddev(unsigned long sum, unsigned long sqrsum, unsigned int n)
+  {
+  float f, m;
+
+  m = (float) sum / n;
+  f = ((float) sqrsum / n) - SQR(m);
+  return sqrt(f) + 0.5;
+  }
+
+static unsigned long host_bench_fix(unsigned long n)
+  {
+  unsigned long k;
+  unsigned int x;
+
+  host_fix_setup();
+  for (k = 0; k < n; k++)
+    {
+    x = k % HOST_FIX_INPUTS;
+    host_sink += muldiv(host_fix_latlon[x], 625, 4608);
+    host_sink += gps2latlon(host_fix_gps[x]);
+#ifdef OVMS_TWIZY_BATTMON
+    host_sink += vehicle_twizy_stddev(host_fix_sum[x], host_fix_sqrsum[x], HOST_FIX_CELLS);
+#endif
+    }
+  return n * 3;
+  }
+
+static unsigned long host_bench_float(unsigned long n)
+  {
+  unsigned long k;
+  unsigned int x;
+
+  host_fix_setup();
+  for (k = 0; k < n; k++)
+    {
+    x = k % HOST_FIX_INPUTS;
+    host_sink += host_float_latlon(host_fix_latlon[x]);
+    host_sink += host_float_gps2latlon(host_fix_gps[x]);
+    host_sink += host_float_stddev(host_fix_sum[x], host_fix_sqrsum[x], HOST_FIX_CELLS);
+    }
+  return n * 3;
+  }
+
+static void host_fix_err(double *maxerr, double v, double ref)
+  {
+  if (fabs(v - ref) > *maxerr)
+    *maxerr = fabs(v - ref);
+  }
+
+static void host_fix_accuracy(void)
+  {
+  double efix[5] = { 0 }, eflt[5] = { 0 }, ref, d, f;
+  unsigned int k, soc, adc;
+  unsigned long v;
+
+  host_fix_setup();
+  for (k = 0; k < HOST_FIX_INPUTS; k++)
+    {
+    ref = floor((double)host_fix_latlon[k] * 1e6 / 7372800.0);
+    host_fix_err(&efix[0], muldiv(host_fix_latlon[k], 625, 4608), ref);
+    host_fix_err(&eflt[0], host_float_latlon(host_fix_latlon[k]), ref);
+
+    f = atof(host_fix_gps[k]);
+    d = floor(f / 100);
+    ref = floor((d + (f - d * 100) / 60) * 7372800.0 + 1e-6);
+    host_fix_err(&efix[1], gps2latlon(host_fix_gps[k]), ref);
+    host_fix_err(&eflt[1], host_float_gps2latlon(host_fix_gps[k]), ref);
+
+    v = HOST_FIX_CELLS * host_fix_sqrsum[k] - host_fix_sum[k] * host_fix_sum[k];
+    ref = floor(sqrt((double)v) / HOST_FIX_CELLS + 0.5);
+#ifdef OVMS_TWIZY_BATTMON
+    host_fix_err(&efix[2], vehicle_twizy_stddev(host_fix_sum[k], host_fix_sqrsum[k], HOST_FIX_CELLS), ref);
+#endif
+    host_fix_err(&eflt[2], host_float_stddev(host_fix_sum[k], host_fix_sqrsum[k], HOST_FIX_CELLS), ref);
+    }
+
+  // Think City ranges, SOC 0..255 (the constants are the reference)
+  for (soc = 0; soc < 256; soc++)
+    {
+    ref = floor(111.958773 * soc / 100);
+    host_fix_err(&efix[3], soc + mulq16(soc, 7837), ref);
+    host_fix_err(&eflt[3], (unsigned int)(111.958773f * soc / 100), ref);
+    ref = floor(93.205678 * soc / 100);
+    host_fix_err(&efix[3], mulq16(soc, 61083), ref);
+    host_fix_err(&eflt[3], (unsigned int)(93.205678f * soc / 100), ref);
+    }
+
+  // 12V line in 1/10 V from the 10 bit ADC
+  for (adc = 0; adc < 1024; adc++)
+    {
+    ref = floor(adc * 10 / 47.0);
+    ADRES = adc;
+    host_fix_err(&efix[4], inputs_voltage(), ref);
+    host_fix_err(&eflt[4], (unsigned int)((0.0f + adc) / 47.0f * 10), ref);
+    }
+
+  printf("max error vs double   fixed     float\n");
+  printf("latlon (1e-6 deg) %9.0f %9.0f\n", efix[0], eflt[0]);
+  printf("gps2latlon (raw)  %9.0f %9.0f\n", efix[1], eflt[1]);
+#ifdef OVMS_TWIZY_BATTMON
+  printf("cell stddev       %9.0f %9.0f\n", efix[2], eflt[2]);
+#endif
+  printf("TC range (km)     %9.0f %9.0f\n", efix[3], eflt[3]);
+  printf("12V line (1/10 V) %9.0f %9.0f\n", efix[4], eflt[4]);
+  }
+
+#ifdef OVMS_TWIZY_BATTMON
+////////////////////////////////////////////////////////////////////////
+// Twizy battery monitor: the running sums of vehicle_twizy_battstatus_cell()
+// & _cmod() against vehicle_twizy_battstatus_collect() as it was, which
+// re-summed all cells/cmods per group. Random sensor groups with a
+// growing spread (to reach the watch/alert thresholds) and occasional
+// invalid readings; after each group the pack, cmod & cell structs and
+// car_tbattery must be identical. The structs are as in vehicle_twizy.c.
+// One intended change: min/max are now kept for every valid reading,
+// the old loop stopped at the first invalid one, so the copy below
+// skips invalid readings instead.
+
+typedef struct
+  {
+  UINT volt_act, volt_min, volt_max;
+  UINT volt_watches, volt_alerts, last_volt_alerts;
+  UINT8 temp_watches, temp_alerts, last_temp_alerts;
+  UINT cell_volt_stddev_max;
+  UINT8 cmod_temp_stddev_max;
+  } host_batt_pack_t;
+
+typedef struct
+  {
+  UINT8 temp_act, temp_min, temp_max;
+  INT8 temp_maxdev;
+  } host_batt_cmod_t;
+
+typedef struct
+  {
+  UINT volt_act, volt_min, volt_max;
+  INT volt_maxdev;
+  } host_batt_cell_t;
+
+#define HOST_BATT_CMODS 7
+#define HOST_BATT_CELLS 14
+#define HOST_BATT_GROUPS 200000
+#define HOST_BATT_READY 63 // BATT_SENSORS_READY
+
+extern host_batt_pack_t twizy_batt[1];
+extern host_batt_cmod_t twizy_cmod[HOST_BATT_CMODS];
+extern host_batt_cell_t twizy_cell[HOST_BATT_CELLS];
+extern volatile UINT8 twizy_batt_sensors_state;
+void vehicle_twizy_battstatus_reset(void);
+void vehicle_twizy_battstatus_cell(UINT8 i, UINT volt);
+void vehicle_twizy_battstatus_cmod(UINT8 i, UINT8 temp);
+void vehicle_twizy_battstatus_collect(void);
+INT vehicle_twizy_dev(UINT value, UINT32 sum, UINT n);
+
+static host_batt_pack_t host_batt;
+static host_batt_cmod_t host_batt_cmod[HOST_BATT_CMODS];
+static host_batt_cell_t host_batt_cell[HOST_BATT_CELLS];
+static int host_batt_tbattery;
+
+// The old vehicle_twizy_battstatus_collect() on the host_batt_* copies
+// (thresholds: BATT_DEV_* 3 / 6, BATT_STDDEV_* 2,3 / 3,5)
+static void host_batt_collect(void)
+  {
+  UINT i, n, stddev, absdev;
+  INT dev;
+  UINT32 sum = 0, sqrsum = 0;
+
+  for (i = n = 0; i < HOST_BATT_CMODS; i++)
+    {
+    if ((host_batt_cmod[i].temp_act == 0) || (host_batt_cmod[i].temp_act >= 0x0f0))
+      continue;
+    n++;
+    if ((host_batt_cmod[i].temp_min == 0) || (host_batt_cmod[i].temp_act < host_batt_cmod[i].temp_min))
+      host_batt_cmod[i].temp_min = host_batt_cmod[i].temp_act;
+    if ((host_batt_cmod[i].temp_max == 0) || (host_batt_cmod[i].temp_act > host_batt_cmod[i].temp_max))
+      host_batt_cmod[i].temp_max = host_batt_cmod[i].temp_act;
+    sum += host_batt_cmod[i].temp_act;
+    sqrsum += SQR((UINT32) host_batt_cmod[i].temp_act);
+    }
+  if (n == HOST_BATT_CMODS)
+    {
+    host_batt_tbattery = (INT) ((sum + HOST_BATT_CMODS / 2) / HOST_BATT_CMODS) - 40;
+    stddev = vehicle_twizy_stddev(sum, sqrsum, HOST_BATT_CMODS);
+    if (stddev == 0) stddev = 1;
+    if (stddev > host_batt.cmod_temp_stddev_max)
+      {
+      host_batt.cmod_temp_stddev_max = stddev;
+      if (stddev >= 3) host_batt.temp_alerts = 0x80;
+      else if (stddev >= 2) host_batt.temp_watches = 0x80;
+      }
+    for (i = 0; i < HOST_BATT_CMODS; i++)
+      {
+      dev = vehicle_twizy_dev(host_batt_cmod[i].temp_act, sum, HOST_BATT_CMODS);
+      absdev = ABS(dev);
+      if ((host_batt.temp_alerts & 0x80) && (absdev >= 3)) host_batt.temp_alerts |= (1 << i);
+      else if (absdev >= 3) host_batt.temp_alerts |= (1 << i);
+      else if ((host_batt.temp_watches & 0x80) && (absdev >= 2)) host_batt.temp_watches |= (1 << i);
+      else if (absdev > stddev) host_batt.temp_watches |= (1 << i);
+      if (absdev > ABS(host_batt_cmod[i].temp_maxdev))
+        host_batt_cmod[i].temp_maxdev = (INT8) dev;
+      }
+    }
+
+  if ((host_batt.volt_min == 0) || (host_batt.volt_act < host_batt.volt_min))
+    host_batt.volt_min = host_batt.volt_act;
+  if ((host_batt.volt_max == 0) || (host_batt.volt_act > host_batt.volt_max))
+    host_batt.volt_max = host_batt.volt_act;
+
+  sum = sqrsum = 0;
+  for (i = n = 0; i < HOST_BATT_CELLS; i++)
+    {
+    if ((host_batt_cell[i].volt_act == 0) || (host_batt_cell[i].volt_act >= 0x0f00))
+      continue;
+    n++;
+    if ((host_batt_cell[i].volt_min == 0) || (host_batt_cell[i].volt_act < host_batt_cell[i].volt_min))
+      host_batt_cell[i].volt_min = host_batt_cell[i].volt_act;
+    if ((host_batt_cell[i].volt_max == 0) || (host_batt_cell[i].volt_act > host_batt_cell[i].volt_max))
+      host_batt_cell[i].volt_max = host_batt_cell[i].volt_act;
+    sum += host_batt_cell[i].volt_act;
+    sqrsum += SQR((UINT32) host_batt_cell[i].volt_act);
+    }
+  if (n == HOST_BATT_CELLS)
+    {
+    stddev = vehicle_twizy_stddev(sum, sqrsum, HOST_BATT_CELLS);
+    if (stddev == 0) stddev = 1;
+    if (stddev > host_batt.cell_volt_stddev_max)
+      {
+      host_batt.cell_volt_stddev_max = stddev;
+      if (stddev >= 5) host_batt.volt_alerts = 0x8000;
+      else if (stddev >= 3) host_batt.volt_watches = 0x8000;
+      }
+    for (i = 0; i < HOST_BATT_CELLS; i++)
+      {
+      dev = vehicle_twizy_dev(host_batt_cell[i].volt_act, sum, HOST_BATT_CELLS);
+      absdev = ABS(dev);
+      if ((host_batt.volt_alerts & 0x8000) && (absdev >= 5)) host_batt.volt_alerts |= (1 << i);
+      else if (absdev >= 6) host_batt.volt_alerts |= (1 << i);
+      else if ((host_batt.volt_watches & 0x8000) && (absdev >= 3)) host_batt.volt_watches |= (1 << i);
+      else if (absdev > stddev) host_batt.volt_watches |= (1 << i);
+      if (absdev > ABS(host_batt_cell[i].volt_maxdev))
+        host_batt_cell[i].volt_maxdev = dev;
+      }
+    }
+  }
+
+static void host_batt_check(void)
+  {
+  unsigned long g, fails = 0, alerts = 0;
+  UINT spread, volt;
+  UINT8 i, temp;
+
+  srand(15);
+  for (g = 0; g < HOST_BATT_GROUPS; g++)
+    {
+    if ((g % 500) == 0)
+      { // New charge cycle: reset min/max/maxdev & alerts on both sides
+      twizy_batt_sensors_state = HOST_BATT_READY;
+      vehicle_twizy_battstatus_reset();
+      host_batt = twizy_batt[0];
+      memcpy(host_batt_cmod, twizy_cmod, sizeof(host_batt_cmod));
+      memcpy(host_batt_cell, twizy_cell, sizeof(host_batt_cell));
+      host_batt_tbattery = car_tbattery;
+      }
+    spread = 1 + (UINT)((g / 500) % 40);
+    twizy_batt[0].volt_act = host_batt.volt_act = 0x0d00 * 2 + (UINT)(rand() % 64);
+    for (i = 0; i < HOST_BATT_CELLS; i++)
+      {
+      volt = 0x0d00 + (UINT)(rand() % spread);
+      if ((rand() % 1000) == 0) volt = (rand() & 1) ? 0 : 0x0fff;
+      vehicle_twizy_battstatus_cell(i, volt);
+      host_batt_cell[i].volt_act = volt;
+      }
+    for (i = 0; i < HOST_BATT_CMODS; i++)
+      {
+      temp = (UINT8)(60 + rand() % (1 + spread / 4));
+      if ((rand() % 1000) == 0) temp = 0xff;
+      vehicle_twizy_battstatus_cmod(i, temp);
+      host_batt_cmod[i].temp_act = temp;
+      }
+    twizy_batt_sensors_state = HOST_BATT_READY;
+    vehicle_twizy_battstatus_collect();
+    host_batt_collect();
+
+    if ((memcmp(&host_batt, &twizy_batt[0], sizeof(host_batt)) != 0) ||
+        (memcmp(host_batt_cmod, twizy_cmod, sizeof(host_batt_cmod)) != 0) ||
+        (memcmp(host_batt_cell, twizy_cell, sizeof(host_batt_cell)) != 0) ||
+        (host_batt_tbattery != car_tbattery))
+      {
+      if (fails++ < 10)
+        printf("  MISMATCH group %u: alerts %04x/%02x vs %04x/%02x\n", (unsigned int)g,
+          twizy_batt[0].volt_alerts, twizy_batt[0].temp_alerts, host_batt.volt_alerts, host_batt.temp_alerts);
+      // Resync to keep reporting independent groups
+      host_batt = twizy_batt[0];
+      memcpy(host_batt_cmod, twizy_cmod, sizeof(host_batt_cmod));
+      memcpy(host_batt_cell, twizy_cell, sizeof(host_batt_cell));
+      host_batt_tbattery = car_tbattery;
+      }
+    if (twizy_batt[0].volt_alerts | twizy_batt[0].temp_alerts) alerts++;
+    }
+  printf("battery monitor: %u groups (%u with alerts), %u mismatches\n",
+    (unsigned int)g, (unsigned int)alerts, (unsigned int)fails);
+  }
+#endif // #ifdef OVMS_TWIZY_BATTMON
+
+////////////////////////////////////////////////////////////////////////
+// EEPROM write queue timing: simulated main loop time spent in
+// par_set(), and time until the queued values are in the EEPROM
+
+static BOOL host_par_stored(unsigned char param, const char *value)
+  {
+  return (strncmp((char *)&host_eeprom[param * PARAM_MAX_LENGTH], value, PARAM_MAX_LENGTH) == 0);
+  }
+
+static void host_par_set(unsigned char param, const char *value,
+                         unsigned long *blocked, unsigned long *worst)
+  {
+  unsigned long t0 = host_time_us;
+
+  par_set(param, (char *)value);
+  t0 = host_time_us - t0;
+  *blocked += t0;
+  if (t0 > *worst) *worst = t0;
+  if (strcmp(par_get(param), value) != 0)
+    printf("  par_get(%u) does not return the value set\n", param);
+  }
+
+static void host_par_check(void)
+  {
+  static const char *values[] = { "64.111.70.40", "internet.example.com", "user", "secretpass" };
+  char buf[PARAM_MAX_LENGTH];
+  unsigned long blocked, worst, w0, t0;
+  unsigned int k, ms;
+
+  printf("EEPROM write queue (%u slots, 4ms per cell):\n", PARAM_WQ_SIZE);
+
+  // Single parameters, with main loop passes in between:
+  blocked = worst = 0;
+  w0 = host_ee_writes;
+  for (k = 0; k < 4; k++)
+    {
+    host_par_set(PARAM_SERVERIP + k, values[k], &blocked, &worst);
+    for (ms = 0; !host_par_stored(PARAM_SERVERIP + k, values[k]); ms++)
+      host_mainpass();
+    printf("  par_set #%u: %5u us blocked, %3u ms until stored\n", k, blocked, ms);
+    blocked = 0;
+    }
+
+  // A burst of par_set() calls (i.e. an ACC clear), one more than the
+  // ACC records, so the last one rewrites a queued parameter:
+  blocked = worst = 0;
+  for (k = 0; k < 8; k++)
+    {
+    sprintf(buf, "burst%u", k);
+    host_par_set(PARAM_ACC_S + (k % PARAM_ACC_COUNT), buf, &blocked, &worst);
+    }
+  for (ms = 0; !host_par_stored(PARAM_ACC_S, "burst7"); ms++)
+    host_mainpass();
+  printf("  burst of 8:  %5u us blocked (max %u), %3u ms until stored\n", blocked, worst, ms);
+
+  // Repeated writes of one parameter are coalesced:
+  blocked = worst = 0;
+  w0 = host_ee_writes;
+  for (k = 0; k < 10; k++)
+    {
+    sprintf(buf, "%u", k);
+    host_par_set(PARAM_FEATURE_S, buf, &blocked, &worst);
+    host_mainpass();
+    }
+  for (ms = 0; !host_par_stored(PARAM_FEATURE_S, "9"); ms++)
+    host_mainpass();
+  printf("  10 x same:   %5u us blocked, %u cells written\n", blocked, host_ee_writes - w0);
+
+  // par_flush() before a reset:
+  for (k = 0; k < 3; k++)
+    par_set(PARAM_FEATURE_S + 1 + k, "flush");
+  t0 = host_time_us;
+  par_flush();
+  printf("  par_flush:   %5u us, %s\n", host_time_us - t0,
+    (host_par_stored(PARAM_FEATURE_S + 3, "flush")) ? "stored" : "NOT stored");
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Modem baud rate negotiation: rate reached against modem and link
+// limits, and the resulting serial time for a server message
+
+extern unsigned long net_msg_txbytes, net_msg_txticks;
+
+static void host_baud_run(const char *name, unsigned char state, unsigned long modembaud,
+                          unsigned long maxipr, unsigned long linkbaud)
+  {
+  unsigned long t0 = host_time_us;
+  unsigned long bps;
+  unsigned char resets = 0, laststate = 0xff, k;
+
+  host_modem_at = TRUE;
+  host_modem_baud = modembaud;
+  host_modem_maxipr = maxipr;
+  host_modem_linkbaud = linkbaud;
+  net_baud_max = NET_BAUD_MAX;
+  net_uart_baud(NET_BAUD_9600);
+  net_state_enter(state);
+  while ((net_state < NET_STATE_READY)&&(host_time_us - t0 < 120000000))
+    {
+    if ((net_state == NET_STATE_HARDRESET)&&(laststate != NET_STATE_HARDRESET))
+      {
+      host_modem_baud = 9600; // modem_reboot(): back at the stored rate
+      resets++;
+      }
+    laststate = net_state;
+    host_mainpass();
+    }
+
+  bps = host_uart_baud() / 10; // 8N1
+  printf("  %-22s %6u baud %s%2us, %5u byte/s, 200 byte msg %3lu ms%s\n",
+    name, net_bauds[net_baud],
+    (host_modem_baud == net_bauds[net_baud]) ? "in " : "MISMATCH ",
+    (host_time_us - t0) / 1000000, bps, (200 * 1000UL) / bps,
+    (resets > 0) ? ", after a modem restart" : "");
+
+  // The rate the DIAG reply reports, measured over 200 byte messages:
+  net_state = NET_STATE_READY;
+  net_msg_txbytes = net_msg_txticks = 0;
+  for (k = 0; k < 10; k++)
+    {
+    net_msg_start();
+    net_msg_encode_start();
+    net_msg_encode_rom("MP-0 c");
+    for (bps = 0; bps < 144; bps++)
+      net_msg_encode_putc('x');
+    net_msg_encode_end(); // 200 bytes
+    net_msg_send();
+    host_mainloop(300);
+    }
+  printf("  %-22s %6s      measured %5u byte/s\n", "", "", net_msg_txrate());
+  host_modem_at = FALSE;
+  }
+
+static void host_baud_check(void)
+  {
+  printf("Modem baud rate negotiation:\n");
+  host_baud_run("modem 115200", NET_STATE_DOINIT3, 9600, 115200, 115200);
+  host_baud_run("modem 57600", NET_STATE_DOINIT3, 9600, 57600, 115200);
+  host_baud_run("link 57600", NET_STATE_DOINIT3, 9600, 115200, 57600);
+  host_baud_run("link 9600", NET_STATE_DOINIT3, 9600, 115200, 9600);
+  host_baud_run("cpu reset, modem fast", NET_STATE_START, 115200, 115200, 115200);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Modem data prompt: back-to-back sends within one main loop pass (i.e.
+// the paranoid "ET" reply and the crash report in the server welcome),
+// against a modem that answers at once and one with a response latency.
+// No data may reach the modem before its "> " prompt. The SMS alerts
+// only wait for the modem's responses, not for fixed delays.
+
+static void host_prompt_run(unsigned long delay)
+  {
+  unsigned long t0, t1;
+  unsigned char k;
+
+  host_modem_delay_us = delay;
+  host_modem_early = 0;
+  net_state = NET_STATE_READY;
+  host_mainloop(100);
+  t0 = host_time_us;
+  for (k = 0; k < 3; k++)
+    {
+    net_msg_start();
+    net_puts_rom("MP-0 c4,0");
+    net_msg_send();
+    }
+  net_send_sms_start("+491234");
+  net_puts_rom("SMS text");
+  net_send_sms_finish();
+  t0 = host_time_us - t0;
+  host_mainloop(1000);
+  t1 = host_time_us;
+  net_sms_socalert("+491234");
+  net_sms_12v_alert("+491234");
+  net_msg_start();
+  net_puts_rom("MP-0 c4,0");
+  net_msg_send();
+  t1 = host_time_us - t1;
+  host_mainloop(1000);
+  printf("  latency %3u ms: 3 msgs + SMS in %4u ms, 2 SMS alerts + msg in %4u ms, %u bytes before the prompt%s\n",
+    delay / 1000, t0 / 1000, t1 / 1000, host_modem_early,
+    (host_modem_early > 0) ? " FAIL" : "");
+  host_modem_delay_us = 0;
+  }
+
+// Alerts raised by CAN handlers in the middle of a send (from
+// net_rx_wait()) are queued once the send is done, not lost
+static void host_prompt_alerts(void)
+  {
+  unsigned char q0 = net_msg_qcount, e0 = net_notify_errqn, d0 = net_msg_qdrops[NET_MSG_Q_ALERT];
+
+  net_msg_start();
+  net_msg_alarm();
+  net_msg_12v_alert();
+  net_msg_erroralert(1, 2);
+  net_puts_rom("MP-0 c4,0");
+  net_msg_send();
+  printf("  alerts during a send: %u queued, %u errors pending, %u dropped%s\n",
+    net_msg_qcount - q0, net_notify_errqn - e0, net_msg_qdrops[NET_MSG_Q_ALERT] - d0,
+    ((net_msg_qcount - q0 != 2) || (net_notify_errqn - e0 != 1)) ? " FAIL" : "");
+  host_mainloop(1000);
+  }
+
+static void host_prompt_check(void)
+  {
+  printf("Modem data prompt:\n");
+  host_prompt_run(0);
+  host_prompt_run(30000);
+  host_prompt_run(300000);
+  host_prompt_alerts();
+  }
+
+////////////////////////////////////////////////////////////////////////
+// Streamed status records (net_msg_rec_*) against the old encoder: the
+// record text formatted in full, the CRC guard and delta conversion on
+// the text (net_msg_encode_statdelta() & _delta() as they were), then
+// RC4 and base64 of the whole message (net_msg_encode_puts() as it was,
+// with the paranoid mode conversion). Random car state changes, with
+// and without paranoid mode; the modem output and the CRC / delta state
+// must be identical. The messages are also decoded as ovms_server.pl
+// does (X merged into the last full record, K expanded into fixes) and
+// must give back the car's record / locations.
+
+extern WORD crc_stat, crc_gps, crc_tpms, crc_firmware, crc_environment, crc_group1, crc_capabilities;
+extern WORD delta_stat[], delta_gps[], delta_tpms[], delta_environment[];
+typedef struct
+  {
+  const char *name;
+  char (*fn)(char stat);
+  WORD *crc;
+  WORD *delta;                               // NULL: no delta tracking
+  unsigned char fields;
+  WORD refcrc;                               // Old encoder state
+  WORD refdelta[32];
+  char server[NET_BUF_MAX*2];                // Last full record at the server
+  } host_rec_t;
+
+static char host_rec_group(char stat)
+  {
+  return net_msgp_group(stat, 1, "OVMS-Group");
+  }
+
+static host_rec_t host_recs[] =
+  {
+  { "S", net_msgp_stat, &crc_stat, delta_stat, NET_MSG_DELTA_STAT },
+  { "L", net_msgp_gps, &crc_gps, delta_gps, NET_MSG_DELTA_GPS },
+  { "W", net_msgp_tpms, &crc_tpms, delta_tpms, NET_MSG_DELTA_TPMS },
+  { "D", net_msgp_environment, &crc_environment, delta_environment, NET_MSG_DELTA_ENVIRONMENT },
+  { "F", net_msgp_firmware, &crc_firmware, NULL, 0 },
+  { "V", net_msgp_capabilities, &crc_capabilities, NULL, 0 },
+  { "g", host_rec_group, &crc_group1, NULL, 0 },
+  };
+#define HOST_RECS (sizeof(host_recs)/sizeof(host_recs[0]))
+
+// The old net_msg_encode_delta(): convert text to a delta record if possible
+static void host_rec_olddelta(char *text, char stat, WORD *delta, unsigned char fields)
+  {
+  static char buf[NET_BUF_MAX*2];
+  unsigned long changed = 0;
+  unsigned char f;
+  WORD h;
+  char *p, *e, *s;
+
+  p = text+6;
+  for (f=0; ; f++)
+    {
+    for (e=p; (*e != 0)&&(*e != ','); e++) ;
+    h = crc16(p, e-p);
+    if (f < fields)
+      {
+      if (delta[f+1] != h) changed |= (1UL << f);
+      delta[f+1] = h;
+      }
+    else
+      stat = 0;
+    if (*e == 0) break;
+    p = e+1;
+    }
+
+  if ((stat == 0)||(ptokenmade==1)||(changed == 0)||
+      ((sys_features[FEATURE_OPTIN]&FEATURE_OI_DELTAMSG)==0)||
+      (delta[0] >= NET_MSG_DELTA_FULL))
+    {
+    delta[0] = 0;
+    return;
+    }
+
+  s = stp_rom(buf, "MP-0 X");
+  *s++ = text[5];
+  e = s;
+  s = stp_lx(s, NULL, changed);
+  for (p=e; (*p == '0')&&(p[1] != 0); p++) ;
+  memmove(e, p, s-p+1);
+  s -= p-e;
+  for (p=text+6; changed != 0; changed >>= 1, p = e+1)
+    {
+    for (e=p; (*e != 0)&&(*e != ','); e++) ;
+    if (changed & 1)
+      {
+      *s++ = ',';
+      memcpy(s, p, e-p);
+      s += e-p;
+      }
+    }
+  s = stp_x(s, ",", crc16(text, strlen(text)));
+
+  if ((s - buf) < strlen(text))
+    {
+    strcpy(text, buf);
+    delta[0]++;
+    }
+  else
+    delta[0] = 0;
+  }
+
+// The old net_msg_encode_puts(), into out with tx_crypto ctx
+static unsigned int host_rec_oldencode(char *text, RC4_CTX1 *c1, RC4_CTX2 *c2, char *out)
+  {
+  static char pm[NET_BUF_MAX*2], msg[NET_BUF_MAX*4];
+  int k;
+
+  strcpy(msg, text);
+  if ((ptokenmade==1)&&(msg[5]!='E')&&(msg[5]!='A')&&(msg[5]!='a')&&
+      (msg[5]!='g')&&(msg[5]!='P'))
+    {
+    strcpy(pm, text+6);
+    net_msg_pm_setup();
+    k = strlen(pm);
+    RC4_crypt(&pm_crypto1, &pm_crypto2, pm, k);
+    strcpy(msg, "MP-0 EM");
+    msg[7] = text[5];
+    base64encode(pm, k, msg+8);
+    }
+  k = strlen(msg);
+  RC4_crypt(c1, c2, msg, k);
+  base64encode(msg, k, out);
+  strcat(out, "\r\n");
+  return strlen(out);
+  }
+
+// Change a few random car_* values
+static void host_rec_change(void)
+  {
+  static const char *cops[] = { "E-Plus", "o2 - de", "Vodafone" };
+  unsigned char k, n = rand() % 4;
+
+  for (k = 0; k < n; k++)
+    {
+    switch (rand() % 14)
+      {
+      case 0: car_SOC = rand() % 101; break;
+      case 1: car_chargecurrent = rand() % 70; car_linevoltage = 200 + rand() % 40; break;
+      case 2: car_chargestate = "\x01\x02\x04\x0d\x0f\x15"[rand() % 6]; break;
+      case 3: car_idealrange = rand() % 250; car_estrange = rand() % 230; break;
+      case 4: car_latitude += rand() % 2000 - 1000; car_longitude += rand() % 2000 - 1000; break;
+      case 5: car_direction = rand() % 360; car_speed = rand() % 120; break;
+      case 6: car_altitude = rand() % 900; car_gpslock = rand() & 1; break;
+      case 7: car_tpms_p[rand() % 4] = rand() % 256; car_tpms_t[rand() % 4] = rand() % 100; break;
+      case 8: car_doors1 ^= 1 << (rand() % 8); car_doors3 ^= 1 << (rand() % 8); break;
+      case 9: car_odometer += rand() % 50; car_trip += rand() % 5; break;
+      case 10: car_12vline = 120 + rand() % 30; car_ambient_temp = rand() % 40 - 10; break;
+      case 11: car_tbattery = rand() % 50; car_tpem = rand() % 60; car_tmotor = rand() % 80; break;
+      case 12: strcpy(car_gsmcops, cops[rand() % 3]); net_sq = rand() % 32; break;
+      case 13: car_chargemode = rand() % 5; car_cac100 = 16000 + rand() % 500; break;
+      }
+    }
+  }
+
+// ovms_server.pl: merge a delta message into the last full record, FALSE
+// if the result does not match its CRC
+static BOOL host_rec_merge(char *server, const char *msg)
+  {
+  static char fields[40][NET_BUF_MAX];
+  char *p, *e, *x;
+  unsigned long mask;
+  unsigned char k, n;
+
+  if (server[0] == 0)
+    return FALSE; // No full record
+  for (n = 0, p = server+6; n < 40; p = e+1)
+    {
+    for (e = p; (*e != 0) && (*e != ','); e++) ;
+    memcpy(fields[n], p, e-p);
+    fields[n++][e-p] = 0;
+    if (*e == 0) break;
+    }
+  mask = strtoul(msg+7, &x, 16);
+  for (k = 0; mask != 0; k++, mask >>= 1)
+    {
+    if ((mask & 1) == 0) continue;
+    for (e = ++x; (*e != 0) && (*e != ','); e++) ;
+    if (*e == 0) return FALSE; // The CRC
+    while (n <= k) fields[n++][0] = 0;
+    memcpy(fields[k], x, e-x);
+    fields[k][e-x] = 0;
+    x = e;
+    }
+  p = stp_rom(server, "MP-0 ");
+  *p++ = msg[6];
+  for (k = 0; k < n; k++)
+    p = stp_s(p, (k > 0) ? "," : NULL, fields[k]);
+  return (strtoul(x+1, NULL, 16) == crc16(server, strlen(server)));
+  }
+
+static unsigned int host_rec_run(BOOL paranoid, unsigned int n)
+  {
+  static char text[NET_BUF_MAX*2], full[NET_BUF_MAX*2], out[NET_BUF_MAX*4], ref[NET_BUF_MAX*4];
+  RC4_CTX1 c1;
+  RC4_CTX2 c2;
+  host_rec_t *r;
+  unsigned int k, reflen, fails = 0, sent = 0, deltas = 0, decodefails = 0;
+  unsigned char stat, x, d0;
+  WORD newcrc;
+
+  ptokenmade = paranoid;
+  for (x = 0; x < HOST_RECS; x++)
+    {
+    r = &host_recs[x];
+    r->refcrc = *r->crc;
+    if (r->delta != NULL) memcpy(r->refdelta, r->delta, (r->fields + 1) * sizeof(WORD));
+    r->server[0] = 0;
+    }
+
+  for (k = 0; k < n; k++)
+    {
+    host_rec_change();
+    if ((k % 50) == 0)
+      {
+      net_msg_delta_reset(); // As on a server connect
+      for (x = 0; x < HOST_RECS; x++)
+        host_recs[x].refdelta[0] = NET_MSG_DELTA_FULL;
+      }
+    for (x = 0; x < HOST_RECS; x++)
+      {
+      r = &host_recs[x];
+      stat = ((k % 7) == 0) ? 0 : 1;
+
+      // The record text (diag mode output of a full record):
+      net_state = NET_STATE_DIAGMODE;
+      host_uart_capture = text;
+      host_uart_capturen = 0;
+      newcrc = *r->crc;
+      d0 = (r->delta != NULL) ? r->delta[0] : 0;
+      if (r->delta != NULL) r->delta[0] = NET_MSG_DELTA_FULL;
+      r->fn(0);
+      *r->crc = newcrc;
+      if (r->delta != NULL)
+        {
+        memcpy(r->delta+1, r->refdelta+1, r->fields * sizeof(WORD));
+        r->delta[0] = d0;
+        }
+      text[host_uart_capturen - 2] = 0; // "\r\n"
+      net_state = NET_STATE_READY;
+
+      // Old encoder:
+      reflen = 0;
+      c1 = tx_crypto1;
+      c2 = tx_crypto2;
+      newcrc = crc16(text, strlen(text));
+      if ((stat == 0) || (r->refcrc != newcrc))
+        {
+        r->refcrc = newcrc;
+        strcpy(full, text);
+        if (r->delta != NULL) host_rec_olddelta(text, stat, r->refdelta, r->fields);
+        reflen = host_rec_oldencode(text, &c1, &c2, ref);
+        sent++;
+        if (text[5] == 'X')
+          {
+          deltas++;
+          if ((!host_rec_merge(r->server, text)) || (strcmp(r->server, full) != 0))
+            {
+            if (decodefails++ < 5)
+              printf("  MISMATCH server merge of %s: %s\n", text, r->server);
+            }
+          }
+        strcpy(r->server, full);
+        }
+
+      // Streamed:
+      host_uart_capture = out;
+      host_uart_capturen = 0;
+      r->fn(stat);
+      host_uart_capture = NULL;
+
+      if ((host_uart_capturen != reflen) || (memcmp(out, ref, reflen) != 0) ||
+          (*r->crc != r->refcrc) ||
+          ((r->delta != NULL) && (memcmp(r->delta, r->refdelta, (r->fields + 1) * sizeof(WORD)) != 0)))
+        {
+        if (fails++ < 5)
+          printf("  MISMATCH %s #%u stat %u: %s\n", r->name, k, stat, text);
+        tx_crypto1 = c1; // Resync
+        tx_crypto2 = c2;
+        *r->crc = r->refcrc;
+        if (r->delta != NULL) memcpy(r->delta, r->refdelta, (r->fields + 1) * sizeof(WORD));
+        }
+      }
+    }
+
+  printf("  paranoid %s: %u records, %u sent (%u delta), %u mismatches, %u server merge errors\n",
+    (paranoid) ? "on " : "off", n * (unsigned int)HOST_RECS, sent, deltas, fails, decodefails);
+  ptokenmade = 0;
+  return fails;
+  }
+
+// ovms_server.pl: decode a "MP-0 K" track batch (base64 VLQ deltas),
+// returns the number of values or -1 if invalid
+static int host_track_decode(const char *msg, long *values, int max)
+  {
+  static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const char *p;
+  char *c;
+  unsigned long v = 0;
+  unsigned char shift = 0;
+  int d, n = 0;
+
+  for (p = strchr(msg, ',') + 1; (*p != 0) && (*p != '\r'); p++)
+    {
+    c = strchr(b64, *p);
+    if ((c == NULL) || (n == max))
+      return -1;
+    d = c - b64;
+    v += (unsigned long)(d & 0x1f) << shift;
+    shift += 5;
+    if (d & 0x20) continue;
+    values[n++] = (v & 1) ? -(long)(v >> 1) : (long)(v >> 1);
+    v = shift = 0;
+    }
+  return (atoi(msg + 6) * NET_MSG_TRACK_FIELDS == n) ? n : -1;
+  }
+
+// Random drive through the track batches: every batch must decode (as
+// the server accumulates the deltas) to the fixes added, and make the
+// next "L" record a full one
+static unsigned int host_track_run(unsigned int n)
+  {
+  static char out[NET_BUF_MAX*4];
+  static long fixes[NET_MSG_TRACK_FIXES+1][NET_MSG_TRACK_FIELDS];
+  long values[(NET_MSG_TRACK_FIXES+1) * NET_MSG_TRACK_FIELDS], fix[NET_MSG_TRACK_FIELDS];
+  unsigned int k, batches = 0, fails = 0, bytes = 0;
+  unsigned char nf = 0, f, x;
+  int nv;
+  char *p;
+
+  sys_features[FEATURE_OPTIN] |= FEATURE_OI_TRACKMSG;
+  net_msg_serverok = 1;
+  net_state = NET_STATE_DIAGMODE; // The message text on the "modem"
+  for (k = 0; k <= n; k++)
+    {
+    host_uart_capture = out;
+    host_uart_capturen = 0;
+    if (k < n)
+      {
+      car_time += 1 + rand() % 4;
+      car_latitude += (rand() % 4000) - 2000;
+      car_longitude += (rand() % 4000) - 2000;
+      car_altitude = 100 + rand() % 50;
+      car_direction = (car_direction + 360 + (rand() % 120) - 60) % 360;
+      car_speed = rand() % 130;
+      if (net_msg_track_add() == NET_MSG_TRACK_ADDED)
+        {
+        if (nf > NET_MSG_TRACK_FIXES) nf = 0; // (reported below)
+        fixes[nf][0] = car_time;
+        fixes[nf][1] = car_latitude >> 6;
+        fixes[nf][2] = car_longitude >> 6;
+        fixes[nf][3] = car_altitude;
+        fixes[nf][4] = car_direction;
+        fixes[nf][5] = car_speed;
+        nf++;
+        }
+      }
+    else
+      net_msg_track_send(); // The rest
+    host_uart_capture = NULL;
+    out[host_uart_capturen] = 0;
+    if ((p = strstr(out, "MP-0 K")) == NULL)
+      continue;
+
+    // A batch of the fixes added (the last one may be in the next batch):
+    batches++;
+    bytes += strlen(p);
+    nv = host_track_decode(p, values, sizeof(values)/sizeof(values[0]));
+    f = (nv < 0) ? 0 : nv / NET_MSG_TRACK_FIELDS;
+    if ((nv < 0) || (f > nf) || (delta_gps[0] != NET_MSG_DELTA_FULL))
+      {
+      if (fails++ < 5)
+        printf("  MISMATCH track batch #%u (%u fixes added): %s", batches, nf, p);
+      nf = 0;
+      continue;
+      }
+    memset(fix, 0, sizeof(fix));
+    for (nv = 0; f > 0; f--)
+      {
+      for (x = 0; x < NET_MSG_TRACK_FIELDS; x++)
+        fix[x] += values[nv++];
+      fix[4] = ((fix[4] % 360) + 360) % 360; // Perl %
+      if (memcmp(fix, fixes[nv/NET_MSG_TRACK_FIELDS - 1], sizeof(fix)) != 0)
+        {
+        if (fails++ < 5)
+          printf("  MISMATCH track batch #%u fix %u: %s", batches, nv/NET_MSG_TRACK_FIELDS, p);
+        break;
+        }
+      }
+    f = nv / NET_MSG_TRACK_FIELDS; // Fixes decoded
+    memmove(fixes, fixes[f], (nf - f) * sizeof(fixes[0]));
+    nf -= f;
+    }
+
+  net_state = NET_STATE_READY;
+  net_msg_serverok = 0;
+  sys_features[FEATURE_OPTIN] &= ~FEATURE_OI_TRACKMSG;
+  printf("  track: %u fixes in %u batches, %u bytes, %u mismatches\n",
+    n, batches, bytes, fails);
+  return fails;
+  }
+
+static void host_rec_check(void)
+  {
+  unsigned char k;
+
+  printf("Streamed status records vs the old encoder:\n");
+  sys_features[FEATURE_OPTIN] |= FEATURE_OI_DELTAMSG;
+  for (k = 0; k < MD5_SIZE; k++) pdigest[k] = k * 17;
+  srand(1);
+  host_rec_run(FALSE, 2000);
+  host_rec_run(TRUE, 2000);
+  host_track_run(2000);
+  sys_features[FEATURE_OPTIN] &= ~FEATURE_OI_DELTAMSG;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// ISO-TP engine (OBDII vehicle module, responder 0x7e8 / 0x7e9): single,
+// first & consecutive frames, our flow control (BS) and the peer's
+// (BS/STmin), timeout, overflow, sequence errors, concurrent sessions,
+// and PID poll scheduler replies on a session's rxid reaching the
+// vehicle module.
+
+#define HOST_ISOTP_TX 32
+
+typedef struct
+  {
+  unsigned int  id;
+  unsigned char data[8];
+  unsigned long time_us;
+  } host_isotp_tx_t;
+
+static host_isotp_tx_t host_isotp_tx[HOST_ISOTP_TX];
+static unsigned int host_isotp_txn;
+static unsigned char host_isotp_status[2];
+static unsigned int host_isotp_len[2];
+static unsigned char host_isotp_data[2][256];
+static unsigned char host_isotp_calls[2];
+static unsigned int host_isotp_poll0n;
+static BOOL (*host_isotp_fn_poll0)(void);
+static unsigned int host_isotp_fails;
+
+static void host_isotp_can_tx(unsigned int id, unsigned char len, const unsigned char *data)
+  {
+  if (host_isotp_txn >= HOST_ISOTP_TX) return;
+  host_isotp_tx[host_isotp_txn].id = id;
+  memcpy(host_isotp_tx[host_isotp_txn].data, data, 8);
+  host_isotp_tx[host_isotp_txn].time_us = host_time_us;
+  host_isotp_txn++;
+  }
+
+static void host_isotp_done(unsigned char status, unsigned int rxid, unsigned char *data, unsigned int len)
+  {
+  unsigned char k = rxid & 1; // 0x7e8 / 0x7e9
+
+  host_isotp_status[k] = status;
+  host_isotp_len[k] = len;
+  if (data != NULL) memcpy(host_isotp_data[k], data, len);
+  host_isotp_calls[k]++;
+  }
+
+static BOOL host_isotp_poll0(void)
+  {
+  host_isotp_poll0n++;
+  return host_isotp_fn_poll0();
+  }
+
+static void host_isotp_reset(void)
+  {
+  host_isotp_txn = 0;
+  host_isotp_poll0n = 0;
+  memset(host_isotp_calls, 0, sizeof(host_isotp_calls));
+  memset(host_isotp_len, 0, sizeof(host_isotp_len));
+  memset(host_isotp_status, 0xff, sizeof(host_isotp_status));
+  }
+
+// Receive a frame from the responder & run one main loop pass
+static void host_isotp_rx(unsigned int id, unsigned char b0, unsigned char b1,
+                          unsigned char b2, unsigned char b3, unsigned char b4)
+  {
+  unsigned char d[8] = { b0, b1, b2, b3, b4, 0x55, 0x55, 0x55 };
+
+  host_can_rx(id, 8, d);
+  host_mainpass();
+  }
+
+// Receive a len byte response (service, pid, then byte n = n) from id as
+// first & consecutive frames, starting at sequence number sn0
+static void host_isotp_rxmulti(unsigned int id, unsigned char service, unsigned char pid,
+                               unsigned int len, unsigned char sn0)
+  {
+  unsigned char d[8];
+  unsigned int k, pos;
+
+  d[0] = 0x10 | (len >> 8);
+  d[1] = len;
+  d[2] = service;
+  d[3] = pid;
+  for (k = 4; k < 8; k++) d[k] = k - 2;
+  host_can_rx(id, 8, d);
+  host_mainpass();
+  for (pos = 6; pos < len; pos += 7, sn0++)
+    {
+    d[0] = 0x20 | (sn0 & 0x0f);
+    for (k = 1; k < 8; k++) d[k] = pos + k - 1;
+    host_can_rx(id, 8, d);
+    host_mainpass();
+    }
+  }
+
+// Number of sent frames with id and the PCI type (high nibble of byte 0)
+static unsigned int host_isotp_sent(unsigned int id, unsigned char pci)
+  {
+  unsigned int k, n = 0;
+
+  for (k = 0; k < host_isotp_txn; k++)
+    if ((host_isotp_tx[k].id == id) && ((host_isotp_tx[k].data[0] >> 4) == pci)) n++;
+  return n;
+  }
+
+static void host_isotp_result(const char *name, BOOL ok)
+  {
+  printf("  %-34s %s\n", name, (ok) ? "ok" : "FAIL");
+  if (!ok) host_isotp_fails++;
+  }
+
+// Check session k (rxid & 1) received the host_isotp_rxmulti() response
+static BOOL host_isotp_response(unsigned char k, unsigned char service, unsigned char pid,
+                                unsigned int len)
+  {
+  unsigned int n;
+
+  if ((host_isotp_calls[k] != 1) || (host_isotp_status[k] != ISOTP_OK) ||
+      (host_isotp_len[k] != len) || (host_isotp_data[k][0] != service) ||
+      (host_isotp_data[k][1] != pid))
+    return FALSE;
+  for (n = 2; n < len; n++)
+    if (host_isotp_data[k][n] != (unsigned char)n) return FALSE;
+  return TRUE;
+  }
+
+static void host_isotp_check(void)
+  {
+  static const unsigned char pid0d[] = { 0x01, 0x0d };
+  static const unsigned char vin[] = { 0x09, 0x02 };
+  unsigned char req[27];
+  char vehicletype[PARAM_MAX_LENGTH];
+  unsigned long last, mingap;
+  unsigned int k, n;
+  BOOL ok;
+
+  printf("ISO-TP engine:\n");
+  strcpy(vehicletype, par_get(PARAM_VEHICLETYPE));
+  par_set(PARAM_VEHICLETYPE, "O2");
+  vehicle_initialise();
+  host_isotp_fn_poll0 = vehicle_fn_poll0;
+  vehicle_fn_poll0 = host_isotp_poll0;
+  host_fn_can_tx = host_isotp_can_tx;
+  isotp_fc_bs = 2;
+  isotp_fc_stmin = 0;
+  host_isotp_fails = 0;
+
+  // Single frame response; the scheduler's replies on 0x7e8 in the
+  // meantime still go to the vehicle module:
+  host_isotp_reset();
+  isotp_request(0x7df, 0x7e8, pid0d, 2, host_isotp_done);
+  host_mainpass();
+  host_isotp_rx(0x7e8, 0x03, 0x41, 0x0c, 0x00, 0x00); // Poll reply (RPM)
+  host_isotp_rx(0x7e8, 0x03, 0x41, 0x46, 0x3c, 0x00); // Poll reply (ambient)
+  ok = ((host_isotp_poll0n == 2) && (host_isotp_calls[0] == 0));
+  host_isotp_rx(0x7e8, 0x03, 0x41, 0x0d, 0x37, 0x00);
+  host_isotp_result("single frame + PID poll replies",
+    ok && (host_isotp_poll0n == 2) && (host_isotp_calls[0] == 1) &&
+    (host_isotp_status[0] == ISOTP_OK) && (host_isotp_len[0] == 3) &&
+    (host_isotp_data[0][2] == 0x37) && (host_isotp_sent(0x7df, 0) >= 1));
+
+  // Negative response:
+  host_isotp_reset();
+  isotp_request(0x7df, 0x7e8, pid0d, 2, host_isotp_done);
+  host_isotp_rx(0x7e8, 0x03, 0x7f, 0x01, 0x12, 0x00);
+  host_isotp_result("negative response",
+    (host_isotp_calls[0] == 1) && (host_isotp_data[0][0] == 0x7f) && (host_isotp_poll0n == 0));
+
+  // Multi frame response, flow control to 0x7e0 every isotp_fc_bs frames:
+  host_isotp_reset();
+  isotp_request(0x7df, 0x7e8, vin, 2, host_isotp_done);
+  host_isotp_rxmulti(0x7e8, 0x49, 0x02, 34, 1);
+  host_isotp_result("first + 4 consecutive frames, BS 2",
+    host_isotp_response(0, 0x49, 0x02, 34) && (host_isotp_sent(0x7e0, 3) == 2) &&
+    (host_isotp_poll0n == 0));
+
+  // Multi frame request: the peer's flow control, BS 1 then STmin 10ms:
+  host_isotp_reset();
+  for (k = 0; k < sizeof(req); k++) req[k] = k;
+  req[0] = 0x2e;
+  req[1] = 0xf1;
+  isotp_request(0x7e0, 0x7e8, req, sizeof(req), host_isotp_done);
+  host_mainloop(5);
+  ok = ((host_isotp_sent(0x7e0, 1) == 1) && (host_isotp_sent(0x7e0, 2) == 0));
+  host_isotp_rx(0x7e8, 0x30, 0x01, 0x00, 0x00, 0x00);
+  host_mainloop(5);
+  ok = ok && (host_isotp_sent(0x7e0, 2) == 1);
+  host_isotp_rx(0x7e8, 0x31, 0x00, 0x00, 0x00, 0x00); // Wait
+  host_isotp_rx(0x7e8, 0x30, 0x00, 0x0a, 0x00, 0x00);
+  host_mainloop(100);
+  mingap = 0xffffffff;
+  for (k = 0, n = 0, last = 0; k < host_isotp_txn; k++)
+    {
+    if ((host_isotp_tx[k].id != 0x7e0) || ((host_isotp_tx[k].data[0] >> 4) != 2)) continue;
+    if ((n++ > 1) && ((host_isotp_tx[k].time_us - last) < mingap))
+      mingap = host_isotp_tx[k].time_us - last; // Frames after the STmin flow control
+    last = host_isotp_tx[k].time_us;
+    }
+  host_isotp_rx(0x7e8, 0x03, 0x6e, 0xf1, 0x02, 0x00);
+  printf("  (STmin 10ms: consecutive frames %u ms apart)\n", mingap / 1000);
+  host_isotp_result("request of 27 bytes, BS 1 / STmin 10",
+    ok && (host_isotp_sent(0x7e0, 2) == 3) && (mingap >= 10000) &&
+    (host_isotp_calls[0] == 1) && (host_isotp_status[0] == ISOTP_OK));
+
+  // No response:
+  host_isotp_reset();
+  isotp_request(0x7df, 0x7e8, pid0d, 2, host_isotp_done);
+  host_mainloop(ISOTP_TIMEOUT * 100 + 200);
+  host_isotp_result("timeout",
+    (host_isotp_calls[0] == 1) && (host_isotp_status[0] == ISOTP_ERR_TIMEOUT));
+
+  // Response larger than the pool:
+  host_isotp_reset();
+  isotp_request(0x7df, 0x7e8, vin, 2, host_isotp_done);
+  host_isotp_rx(0x7e8, 0x11, 0x2c, 0x49, 0x02, 0x01); // 300 bytes
+  host_mainpass();
+  for (k = 0; (k < host_isotp_txn) && (host_isotp_tx[k].id != 0x7e0); k++);
+  host_isotp_result("overflow",
+    (host_isotp_calls[0] == 1) && (host_isotp_status[0] == ISOTP_ERR_OVERFLOW) &&
+    (k < host_isotp_txn) && (host_isotp_tx[k].data[0] == 0x32));
+
+  // Consecutive frame lost:
+  host_isotp_reset();
+  isotp_request(0x7df, 0x7e8, vin, 2, host_isotp_done);
+  host_isotp_rxmulti(0x7e8, 0x49, 0x02, 20, 2);
+  host_isotp_result("sequence error",
+    (host_isotp_calls[0] == 1) && (host_isotp_status[0] == ISOTP_ERR_SEQUENCE));
+
+  // Two sessions with interleaved responses:
+  host_isotp_reset();
+  isotp_request(0x7e0, 0x7e8, vin, 2, host_isotp_done);
+  isotp_request(0x7e1, 0x7e9, vin, 2, host_isotp_done);
+  ok = !isotp_request(0x7e0, 0x7e8, vin, 2, host_isotp_done); // Busy
+  host_isotp_rx(0x7e9, 0x10, 0x14, 0x49, 0x02, 0x01);
+  host_isotp_rxmulti(0x7e8, 0x49, 0x02, 20, 1);
+  host_isotp_rx(0x7e9, 0x21, 0x05, 0x06, 0x07, 0x08);
+  host_isotp_rx(0x7e9, 0x22, 0x0c, 0x0d, 0x0e, 0x0f);
+  host_isotp_result("concurrent sessions",
+    ok && host_isotp_response(0, 0x49, 0x02, 20) &&
+    (host_isotp_calls[1] == 1) && (host_isotp_status[1] == ISOTP_OK) && (host_isotp_len[1] == 20) &&
+    (host_isotp_sent(0x7e1, 3) == 1) && (host_isotp_sent(0x7e0, 3) == 1));
+
+  printf("  %u failed\n", host_isotp_fails);
+  host_fn_can_tx = NULL;
+  isotp_fc_bs = 8;
+  par_set(PARAM_VEHICLETYPE, vehicletype);
+  vehicle_initialise();
+  }
+
+static unsigned long host_bench_loop(unsigned long n)
+  {
+  host_mainloop(n);
+  return n;
+  }
+
+static const host_bench_t host_benches[] =
+  {
+  { "can",    host_bench_can,    "frame" },
+  { "replay", host_replay_bench, "frame" },
+  { "stp",    host_bench_stp,    "record" },
+  { "crypto", host_bench_crypto, "byte" },
+  { "pm",     host_bench_pm,     "msg" },
+  { "pmold",  host_bench_pmold,  "msg" },
+  { "msg",    host_bench_msg,    "tx byte" },
+  { "urc",    host_bench_urc,    "line" },
+  { "urcold", host_bench_urccascade, "line" },
+  { "gps",    host_bench_gps,    "line" },
+  { "gpsold", host_bench_gpsold, "line" },
+  { "fix",    host_bench_fix,    "op" },
+  { "float",  host_bench_float,  "op" },
+  { "loop",   host_bench_loop,   "sim ms" },
+  };
+#define HOST_BENCHES (sizeof(host_benches)/sizeof(host_benches[0]))
+
+static void host_bench_run(const host_bench_t *b)
+  {
+  unsigned long n = 1, units = 0;
+  double t0, t = 0;
+
+  // Double the iteration count until the run is long enough to measure
+  while (t < HOST_BENCH_MIN_NS)
+    {
+    n *= 2;
+    t0 = host_now_ns();
+    units = b->fn(n);
+    t = host_now_ns() - t0;
+    if (units == 0)
+      return; // Nothing to measure (e.g. the CAN log is missing)
+    }
+  printf("%-8s %10u iter %10.1f ns/iter %8.2f ns/%s\n",
+    b->name, n, t / n, (units) ? t / units : 0.0, b->unit);
+  }
+
+static void host_usage(const char *prog)
+  {
+  unsigned int k;
+
+  fprintf(stderr, "usage: %s [-v vehicletype] [-e] [-a] [-n] [-p] [-u] [-m] [-o] [-i] [-c] [-b] [bench...]\n", prog);
+  fprintf(stderr, "       %s [-v vehicletype] [-e] [-s scale] [-t trajectory.csv] [-x n [-l us]] -r canlog...\n", prog);
+  fprintf(stderr, "  -v  vehicle type to initialise (default TR)\n");
+  fprintf(stderr, "  -e  echo modem output to stdout\n");
+  fprintf(stderr, "  -a  check the fixed point kernels against float & double\n");
+  fprintf(stderr, "  -n  check the NMEA parsers against the test corpus\n");
+  fprintf(stderr, "  -p  check the EEPROM write queue timing\n");
+  fprintf(stderr, "  -u  check the modem baud rate negotiation\n");
+  fprintf(stderr, "  -m  check the modem data prompt handshake\n");
+  fprintf(stderr, "  -o  check the streamed status records against the old encoder\n");
+  fprintf(stderr, "  -i  check the ISO-TP engine (OBDII responder)\n");
+  fprintf(stderr, "  -b  check the Twizy battery monitor running sums against a recount\n");
+  fprintf(stderr, "  -c  check RC4, base64 and the paranoid mode cipher against test vectors\n");
+  fprintf(stderr, "  -r  replay CAN logs (CANdo .csv or .txt) instead of benchmarks\n");
+  fprintf(stderr, "  -s  replay speed, 1 = log time, 10 = 10x (default 0: unpaced)\n");
+  fprintf(stderr, "  -x  replay overload: frames back to back at n x the bus rate\n");
+  fprintf(stderr, "  -l  replay overload: main loop load, us per pass on top of 1 ms\n");
+  fprintf(stderr, "  -t  write the car_* state trajectory (once per second) as CSV\n");
+  fprintf(stderr, "  benches:");
+  for (k = 0; k < HOST_BENCHES; k++)
+    fprintf(stderr, " %s", host_benches[k].name);
+  fprintf(stderr, " (default: all)\n");
+  exit(1);
+  }
+
+int main(int argc, char **argv)
+  {
+  const char *vehicletype = "TR";
+  const char *trajectory = NULL;
+  double scale = 0;
+  double overload = 0;
+  unsigned int load = 0;
+  BOOL replay = FALSE;
+  BOOL accuracy = FALSE;
+  BOOL nmea = FALSE;
+  BOOL eeprom = FALSE;
+  BOOL baud = FALSE;
+  BOOL prompt = FALSE;
+  BOOL isotp = FALSE;
+  BOOL records = FALSE;
+  BOOL crypto = FALSE;
+  BOOL batt = FALSE;
+  unsigned int k;
+  int a, ran = 0;
+
+  for (a = 1; (a < argc) && (argv[a][0] == '-'); a++)
+    {
+    if ((strcmp(argv[a], "-v") == 0) && (a+1 < argc))
+      vehicletype = argv[++a];
+    else if (strcmp(argv[a], "-e") == 0)
+      host_uart_echo = TRUE;
+    else if (strcmp(argv[a], "-a") == 0)
+      accuracy = TRUE;
+    else if (strcmp(argv[a], "-n") == 0)
+      nmea = TRUE;
+    else if (strcmp(argv[a], "-p") == 0)
+      eeprom = TRUE;
+    else if (strcmp(argv[a], "-u") == 0)
+      baud = TRUE;
+    else if (strcmp(argv[a], "-m") == 0)
+      prompt = TRUE;
+    else if (strcmp(argv[a], "-o") == 0)
+      records = TRUE;
+    else if (strcmp(argv[a], "-i") == 0)
+      isotp = TRUE;
+    else if (strcmp(argv[a], "-c") == 0)
+      crypto = TRUE;
+    else if (strcmp(argv[a], "-b") == 0)
+      batt = TRUE;
+    else if (strcmp(argv[a], "-r") == 0)
+      replay = TRUE;
+    else if ((strcmp(argv[a], "-s") == 0) && (a+1 < argc))
+      scale = atof(argv[++a]);
+    else if ((strcmp(argv[a], "-x") == 0) && (a+1 < argc))
+      overload = atof(argv[++a]);
+    else if ((strcmp(argv[a], "-l") == 0) && (a+1 < argc))
+      load = atoi(argv[++a]);
+    else if ((strcmp(argv[a], "-t") == 0) && (a+1 < argc))
+      trajectory = argv[++a];
+    else
+      host_usage(argv[0]);
+    }
+
+  host_setup(vehicletype);
+  host_mainloop(2000); // Let the vehicle module settle
+
+  if (replay)
+    {
+    if (a == argc)
+      host_usage(argv[0]);
+    if (!host_replay_open(trajectory))
+      return 1;
+    host_replay_load(overload, load);
+    for (; a < argc; a++)
+      {
+      if (!host_replay(argv[a], scale))
+        return 1;
+      }
+    host_replay_report();
+    return 0;
+    }
+
+  if (accuracy)
+    host_fix_accuracy();
+  if (nmea)
+    host_gps_corpuscheck();
+  if (eeprom)
+    host_par_check();
+  if (baud)
+    host_baud_check();
+  if (prompt)
+    host_prompt_check();
+  if (records)
+    host_rec_check();
+  if (isotp)
+    host_isotp_check();
+  if (crypto)
+    host_crypto_check();
+#ifdef OVMS_TWIZY_BATTMON
+  if (batt)
+    host_batt_check();
+#endif
+
+  for (; a < argc; a++)
+    {
+    for (k = 0; (k < HOST_BENCHES) && (strcmp(argv[a], host_benches[k].name) != 0); k++);
+    if (k == HOST_BENCHES)
+      host_usage(argv[0]);
+    host_bench_run(&host_benches[k]);
+    ran++;
+    }
+  if (!ran)
+    {
+    for (k = 0; k < HOST_BENCHES; k++)
+      host_bench_run(&host_benches[k]);
+    }
+
+  printf("car_type=%s SOC=%u ideal=%u speed=%u | eeprom r=%u w=%u | can rx=%u filtered=%u tx=%u | uart tx=%u\n",
+    car_type, car_SOC, car_idealrange, car_speed,
+    host_ee_reads, host_ee_writes,
+    host_can_rx_frames, host_can_rx_filtered, host_can_tx_frames, host_uart_tx_bytes);
+  return (int)(host_sink & 0);
+  }
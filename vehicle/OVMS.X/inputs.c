@@ -84,24 +84,29 @@ unsigned char input_gpi5(void)
 unsigned char output_gpo0(unsigned char onoff)
   {
   PORTCbits.RC0 = onoff;
+  return onoff;
   }
 
 unsigned char output_gpo1(unsigned char onoff)
   {
   PORTCbits.RC1 = onoff;
+  return onoff;
   }
 
 unsigned char output_gpo2(unsigned char onoff)
   {
   PORTCbits.RC2 = onoff;
+  return onoff;
   }
 
 unsigned char output_gpo3(unsigned char onoff)
   {
   PORTCbits.RC3 = onoff;
+  return onoff;
   }
 
-float inputs_voltage(void)
+// 12V line voltage in 1/10 V
+unsigned int inputs_voltage(void)
   {
   ADCON0=0;   //Select ADC Channel #0
   ADCON0bits.ADON=1;  //switch on the adc module
@@ -109,7 +114,7 @@ float inputs_voltage(void)
   while(ADCON0bits.GO); //wait for the conversion to finish
   ADCON0bits.ADON=0;  //switch off adc
 
-  return (0.0+ADRES)/47.0;
+  return (ADRES * 10) / 47;
   }
 
 #endif // #ifdef OVMS_HW_V2
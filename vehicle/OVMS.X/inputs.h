@@ -45,7 +45,7 @@ unsigned char output_gpo1(unsigned char onoff);
 unsigned char output_gpo2(unsigned char onoff);
 unsigned char output_gpo3(unsigned char onoff);
 
-float inputs_voltage(void);
+unsigned int inputs_voltage(void); // 12V line in 1/10 V
 #endif // #ifdef OVMS_HW_V2
 
 #endif // #ifndef __OVMS_LED_H
@@ -47,9 +47,12 @@ signed char logging_pos = -1;
 signed char logging_pending = 0;
 signed char logging_coolingdown = -1;
 
+char *logging_format(signed char ack, struct logging_record *rec);
+
 signed char log_getfreerecord(void)
   {
   unsigned char x;
+  signed char oldest = -1;
 
   for (x=0;x<LOG_RECORDSTORE;x++)
     {
@@ -57,12 +60,30 @@ signed char log_getfreerecord(void)
       return x;
     }
 
+  // Store full: hand the oldest undelivered record over to the outbound
+  // message queue (as an "H" record without ack) and reuse its slot
+  for (x=0;x<LOG_RECORDSTORE;x++)
+    {
+    if (((log_recs[x].type == LOG_TYPE_DRIVE)||(log_recs[x].type == LOG_TYPE_CHARGE))&&
+        ((oldest < 0)||((long)(log_recs[x].start_time - log_recs[oldest].start_time) < 0)))
+      oldest = x;
+    }
+  if (oldest >= 0)
+    {
+    logging_format(-1, &log_recs[oldest]);
+    if (net_msg_queue(NET_MSG_Q_LOG))
+      {
+      if (logging_pending > 0) logging_pending--;
+      memset((void*)&log_recs[oldest],0,sizeof(struct logging_record));
+      return oldest;
+      }
+    }
+
   return -1;
   }
 
 void log_state_enter(unsigned char newstate)
   {
-  char *p;
   struct logging_record *rec;
 
   CHECKPOINT(0x50)
@@ -74,8 +95,11 @@ void log_state_enter(unsigned char newstate)
     case LOG_STATE_DRIVING:
       // A drive has just started...
       CHECKPOINT(0x51)
-      logging_pos = log_getfreerecord();
-      if ((logging_pos < 0)||((sys_features[FEATURE_OPTIN]&FEATURE_OI_LOGDRIVES)==0))
+      if ((sys_features[FEATURE_OPTIN]&FEATURE_OI_LOGDRIVES)==0)
+        logging_pos = -1;
+      else
+        logging_pos = log_getfreerecord();
+      if (logging_pos < 0)
         {
         // Overflow...
         log_state = LOG_STATE_WAITDRIVE_DONE;
@@ -94,8 +118,11 @@ void log_state_enter(unsigned char newstate)
     case LOG_STATE_CHARGING:
       // A charge has just started...
       CHECKPOINT(0x52)
-      logging_pos = log_getfreerecord();
-      if ((logging_pos < 0)||((sys_features[FEATURE_OPTIN]&FEATURE_OI_LOGCHARGE)==0))
+      if ((sys_features[FEATURE_OPTIN]&FEATURE_OI_LOGCHARGE)==0)
+        logging_pos = -1;
+      else
+        logging_pos = log_getfreerecord();
+      if (logging_pos < 0)
         {
         // Overflow...
         log_state = LOG_STATE_WAITCHARGE_DONE;
@@ -119,6 +146,15 @@ void log_state_enter(unsigned char newstate)
 CHECKPOINT(0x50)
   }
 
+// Seconds since rec was started; duration is 16 bit, so a record longer
+// than 18.2 hours (a slow charge) is logged as 65535 rather than wrapped
+unsigned int log_duration(struct logging_record *rec)
+  {
+  unsigned long duration = car_time - rec->start_time;
+
+  return (duration > 0xffff) ? 0xffff : (unsigned int)duration;
+  }
+
 void log_state_ticker1(void)
   {
   struct logging_record *rec;
@@ -157,7 +193,7 @@ void log_state_ticker1(void)
         logging_pos = -1;
         logging_pending++;
         rec->type = LOG_TYPE_DRIVE;
-        rec->duration = car_time - rec->start_time;
+        rec->duration = log_duration(rec);
         rec->record.drive.end_latitude = car_latitude;
         rec->record.drive.end_longitude = car_longitude;
         rec->record.drive.distance = car_odometer - rec->record.drive.distance;
@@ -188,7 +224,7 @@ void log_state_ticker1(void)
         logging_pos = -1;
         logging_pending++;
         rec->type = LOG_TYPE_CHARGE;
-        rec->duration = car_time - rec->start_time;
+        rec->duration = log_duration(rec);
         rec->record.charge.charge_mode = (logging_coolingdown>=0)?5:car_chargemode;
         if (car_chargestate == 4)
           rec->record.charge.charge_result = LOG_CHARGERESULT_OK;
@@ -218,69 +254,86 @@ unsigned char logging_haspending(void)
   return logging_pending;
   }
 
+// Format a log record into net_scratchpad: as an "h" message to be
+// acknowledged with <ack>, or as a plain "H" message if ack < 0.
+// Returns the end of the message.
+char *logging_format(signed char ack, struct logging_record *rec)
+  {
+  char *s;
+
+  if (ack >= 0)
+    {
+    s = stp_i(net_scratchpad, "MP-0 h", ack);
+    s = stp_l(s, ",", rec->start_time - car_time);
+    s = stp_rom(s, ",");
+    }
+  else
+    s = stp_rom(net_scratchpad, "MP-0 H");
+
+  if ((rec->type == LOG_TYPE_DRIVE)||(rec->type == LOG_TYPE_DRIVE_DEL))
+    {
+    s = stp_rom(s, "*-Log-Drive,0,31536000");
+    s = stp_l(s, ",", rec->start_time);
+    s = stp_i(s, ",", rec->duration);
+    s = stp_i(s, ",",rec->record.drive.drive_mode);
+    s = stp_latlon(s, ",", rec->record.drive.start_latitude);
+    s = stp_latlon(s, ",", rec->record.drive.start_longitude);
+    s = stp_latlon(s, ",", rec->record.drive.end_latitude);
+    s = stp_latlon(s, ",", rec->record.drive.end_longitude);
+    s = stp_l2f_h(s, ",", rec->record.drive.distance, 1);
+    s = stp_i(s, ",", rec->record.drive.start_SOC);
+    s = stp_i(s, ",", rec->record.drive.start_idealrange);
+    s = stp_i(s, ",", rec->record.drive.end_SOC);
+    s = stp_i(s, ",", rec->record.drive.end_idealrange);
+    }
+  else
+    {
+    s = stp_rom(s, "*-Log-Charge,0,31536000");
+    s = stp_l(s, ",", rec->start_time);
+    s = stp_i(s, ",", rec->duration);
+    s = stp_i(s, ",",rec->record.charge.charge_mode);
+    s = stp_latlon(s, ",", rec->record.charge.charge_latitude);
+    s = stp_latlon(s, ",", rec->record.charge.charge_longitude);
+    s = stp_i(s, ",", rec->record.charge.charge_voltage);
+    s = stp_i(s, ",", rec->record.charge.charge_current);
+    s = stp_i(s, ",", rec->record.charge.charge_result);
+    s = stp_i(s, ",", rec->record.charge.start_SOC);
+    s = stp_i(s, ",", rec->record.charge.start_idealrange);
+    s = stp_i(s, ",", rec->record.charge.end_SOC);
+    s = stp_i(s, ",", rec->record.charge.end_idealrange);
+    s = stp_l2f(s, ",", (unsigned long)rec->record.charge.end_cac100, 2);
+    }
+
+  return s;
+  }
+
 void logging_sendpending(void)
   {
-  // Send pending log messages
+  // Send pending log messages, as many as fit into the CIPSEND block
 
-  char *s;
   unsigned char x;
+  unsigned int len;
   struct logging_record *rec;
 
   CHECKPOINT(0x57)
+  logging_pending = 0;
   for (x=0;x<LOG_RECORDSTORE;x++)
     {
     rec = &log_recs[x];
-    if ((rec->type == LOG_TYPE_DRIVE)&&
-        (sys_features[FEATURE_OPTIN]&FEATURE_OI_LOGDRIVES))
+    if (((rec->type == LOG_TYPE_DRIVE)&&
+         (sys_features[FEATURE_OPTIN]&FEATURE_OI_LOGDRIVES))||
+        ((rec->type == LOG_TYPE_CHARGE)&&
+         (sys_features[FEATURE_OPTIN]&FEATURE_OI_LOGCHARGE)))
       {
-      s = stp_i(net_scratchpad, "MP-0 h", x);
-      s = stp_l(s, ",", rec->start_time - car_time);
-      s = stp_i(s, ",*-Log-Drive,", 0);
-      s = stp_rom(s, ",31536000");
-      s = stp_l(s, ",", rec->start_time);
-      s = stp_i(s, ",", rec->duration);
-      s = stp_i(s, ",",rec->record.drive.drive_mode);
-      s = stp_latlon(s, ",", rec->record.drive.start_latitude);
-      s = stp_latlon(s, ",", rec->record.drive.start_longitude);
-      s = stp_latlon(s, ",", rec->record.drive.end_latitude);
-      s = stp_latlon(s, ",", rec->record.drive.end_longitude);
-      s = stp_l2f_h(s, ",", rec->record.drive.distance, 1);
-      s = stp_i(s, ",", rec->record.drive.start_SOC);
-      s = stp_i(s, ",", rec->record.drive.start_idealrange);
-      s = stp_i(s, ",", rec->record.drive.end_SOC);
-      s = stp_i(s, ",", rec->record.drive.end_idealrange);
+      len = (unsigned int)(logging_format(x, rec) - net_scratchpad);
+      if ((logging_pending > 0) &&
+          ((net_msg_sendlen + (len+8)*2) > NET_MSG_CIPSEND_MAX))
+        return; // The rest goes with the next block
       net_msg_encode_puts();
-      rec->type = LOG_TYPE_DRIVE_DEL;
+      rec->type = (rec->type == LOG_TYPE_DRIVE) ? LOG_TYPE_DRIVE_DEL : LOG_TYPE_CHARGE_DEL;
       logging_pending = 1;
-      return; // Send one at a time
-      }
-    else if ((rec->type == LOG_TYPE_CHARGE)&&
-             (sys_features[FEATURE_OPTIN]&FEATURE_OI_LOGCHARGE))
-      {
-      s = stp_i(net_scratchpad, "MP-0 h", x);
-      s = stp_l(s, ",", rec->start_time - car_time);
-      s = stp_i(s, ",*-Log-Charge,", 0);
-      s = stp_rom(s, ",31536000");
-      s = stp_l(s, ",", rec->start_time);
-      s = stp_i(s, ",", rec->duration);
-      s = stp_i(s, ",",rec->record.charge.charge_mode);
-      s = stp_latlon(s, ",", rec->record.charge.charge_latitude);
-      s = stp_latlon(s, ",", rec->record.charge.charge_longitude);
-      s = stp_i(s, ",", rec->record.charge.charge_voltage);
-      s = stp_i(s, ",", rec->record.charge.charge_current);
-      s = stp_i(s, ",", rec->record.charge.charge_result);
-      s = stp_i(s, ",", rec->record.charge.start_SOC);
-      s = stp_i(s, ",", rec->record.charge.start_idealrange);
-      s = stp_i(s, ",", rec->record.charge.end_SOC);
-      s = stp_i(s, ",", rec->record.charge.end_idealrange);
-      s = stp_l2f(s, ",", (unsigned long)rec->record.charge.end_cac100, 2);
-      net_msg_encode_puts();
-      rec->type = LOG_TYPE_CHARGE_DEL;
-      logging_pending = 1;
-      return; // Send one at a time
       }
     }
-  logging_pending = 0;
   }
 
 void logging_serverconnect(void)
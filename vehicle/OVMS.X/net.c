@@ -57,6 +57,8 @@ unsigned int  net_granular_tick = 0;        // An internal ticker used to genera
 unsigned int  net_watchdog = 0;             // Second count-down for network connectivity
 unsigned int  net_timeout_rxdata = NET_RXDATA_TIMEOUT; // Second count-down for RX data timeout
 char net_caller[NET_TEL_MAX] = {0};         // The telephone number of the caller
+unsigned char net_baud = NET_BAUD_9600;     // Modem baud rate (NET_BAUD_*)
+unsigned char net_baud_max = NET_BAUD_MAX;  // Fastest rate to negotiate (lowered on failure)
 
 unsigned char net_buf_pos = 0;              // Current position (aka length) in the network buffer
 unsigned char net_buf_mode = NET_BUF_CRLF;  // Mode of the buffer (CRLF, SMS or MSG)
@@ -72,11 +74,26 @@ unsigned char net_socalert_msg = 0;         // SOC Alert (sms) 10min ticks remai
 
 unsigned int  net_notify_errorcode = 0;     // An error code to be notified
 unsigned long net_notify_errordata = 0;     // Ancilliary data
+unsigned int  net_notify_errqcode[NET_NOTIFY_ERRQ]; // Superseded errors awaiting dispatch...
+unsigned long net_notify_errqdata[NET_NOTIFY_ERRQ];
+unsigned char net_notify_errqn = 0;         // ...and how many there are
 unsigned int  net_notify_lasterrorcode = 0; // Last error code to be notified
 unsigned char net_notify_lastcount = 0;     // A counter used to clear error codes
 unsigned int  net_notify = 0;               // Bitmap of notifications outstanding
 unsigned char net_notify_suppresscount = 0; // To suppress STAT notifications (seconds)
 
+long net_stream_lat;                        // Adaptive streaming: last fix sent...
+long net_stream_lon;
+unsigned long net_stream_time = 0;
+unsigned int  net_stream_dir;
+unsigned char net_stream_speed;
+int  net_stream_cos;                        // ...and the cosine of its latitude
+
+#ifdef OVMS_INTERNALGPS
+unsigned char net_gps_nmea_age = 0xff;      // Seconds since the last NMEA position
+unsigned char net_gps_nmea_on = 0;          // NMEA output has been requested
+#endif
+
 #pragma udata NETBUF_SP
 char net_scratchpad[NET_BUF_MAX];           // A general-purpose scratchpad
 #pragma udata
@@ -90,6 +107,8 @@ char net_buf[NET_BUF_MAX];                  // The network buffer itself
 // Using internal SIM908 GPS:
 rom char NET_INIT1[] = "AT+CGPSPWR=1;+CGPSRST=0;+CSMINS?\r";
 rom char NET_REQGPS[] = "AT+CGPSINF=2;+CGPSINF=64;+CGPSPWR=1\r";
+rom char NET_REQGPS_NMEA[] = "AT+CGPSINF=2;+CGPSINF=64;+CGPSPWR=1;+CGPSOUT=" NET_GPS_NMEAMASK "\r";
+rom char NET_GPS_NMEAOFF[] = "AT+CGPSOUT=0\r";
 #else
 // Using external GPS from car:
 rom char NET_INIT1[] = "AT+CSMINS?\r";
@@ -106,6 +125,48 @@ rom char NET_HANGUP[] = "ATH\r";
 rom char NET_CREG_CIPSTATUS[] = "AT+CREG?;+CIPSTATUS;+CSQ\r";
 rom char NET_IPR_SET[] = "AT+IPR=9600\r"; // sets fixed baud rate for the modem
 
+rom unsigned long net_bauds[] = { 9600, 57600, 115200 }; // NET_BAUD_*
+
+// Modem response line prefixes, for net_urc().
+// N.B. This must be kept sorted (ASCII), and no prefix may be the start
+// of another: net_urc() does a binary search on it.
+typedef struct
+  {
+  char prefix[13];
+  unsigned char urc;
+  } net_urc_t;
+
+rom net_urc_t net_urcs[] =
+  {
+  { "+CFUN:",       NET_URC_CFUN },
+  { "+CLIP",        NET_URC_CLIP },
+  { "+CME ERROR",   NET_URC_CMEERROR },
+  { "+COPS:",       NET_URC_COPS },
+  { "+CPBF:",       NET_URC_CPBF },
+  { "+CPIN",        NET_URC_CPIN },
+  { "+CREG",        NET_URC_CREG },
+  { "+CSM",         NET_URC_CSMINS },
+  { "+CSQ:",        NET_URC_CSQ },
+  { "+CUSD:",       NET_URC_CUSD },
+  { "+IPR",         NET_URC_IPR },
+  { "+PDP: DEACT",  NET_URC_PDPDEACT },
+  { "2,",           NET_URC_GPSGGA },
+  { "64,",          NET_URC_GPSVTG },
+  { "CLOSED",       NET_URC_CLOSED },
+  { "CONNECT FAIL", NET_URC_CONNECTFAIL },
+  { "CONNECT OK",   NET_URC_CONNECTOK },
+  { "DATA ACCEPT",  NET_URC_DATAACCEPT },
+  { "ERROR",        NET_URC_ERROR },
+  { "OK",           NET_URC_OK },
+  { "RDY",          NET_URC_RDY },
+  { "SEND FAIL",    NET_URC_SENDFAIL },
+  { "SEND OK",      NET_URC_SENDOK },
+  { "SETUP",        NET_URC_SETUP },
+  { "SHUT OK",      NET_URC_SHUTOK },
+  { "STATE: ",      NET_URC_STATE },
+  };
+#define NET_URCS (sizeof(net_urcs)/sizeof(net_urc_t))
+
 ////////////////////////////////////////////////////////////////////////
 // The Interrupt Service Routine is standard PIC code
 //
@@ -122,13 +183,15 @@ void uart_int_service(void)
   }
 #pragma code
 
-//#pragma	interruptlow low_isr save=section(".tmpdata")
-#pragma	interruptlow low_isr
+// The ISR functions called here use compiler temporaries (.tmpdata),
+// as the main line does: save them, as high_isr() does
+#pragma	interruptlow low_isr save=section(".tmpdata")
 void low_isr(void)
   {
   // call of library module function, MUST
   UARTIntISR();
   led_isr();
+  par_isr();
   }
 
 ////////////////////////////////////////////////////////////////////////
@@ -140,6 +203,43 @@ void net_reset_async(void)
   vUARTIntStatus.UARTIntRxError = 0;
   }
 
+////////////////////////////////////////////////////////////////////////
+// net_uart_baud()
+// Switch the async port to a new baud rate (NET_BAUD_*), once the
+// transmit buffer has been sent at the current rate. The 16 bit baud
+// rate generator keeps the error below 1% at 115200 baud.
+//
+void net_uart_baud(unsigned char baud)
+  {
+  unsigned int brg;
+
+  while (!vUARTIntStatus.UARTIntTxBufferEmpty) ClrWdt();
+  while (!TXSTAbits.TRMT) ClrWdt(); // Last character shifted out
+
+  brg = (unsigned int)(((UART_CLOCK_FREQ/4) + (net_bauds[baud]/2)) / net_bauds[baud]) - 1;
+  RCSTAbits.CREN = 0;
+  BAUDCONbits.BRG16 = 1;
+  TXSTAbits.BRGH = 1;
+  SPBRGH = brg >> 8;
+  SPBRG = brg & 0xff;
+  RCSTAbits.CREN = 1; // (also clears an overrun)
+  net_baud = baud;
+  }
+
+#ifdef OVMS_MODEM_FASTBAUD
+////////////////////////////////////////////////////////////////////////
+// net_baud_next()
+// Try the next lower fast baud rate, else continue at 9600 baud
+//
+void net_baud_next(void)
+  {
+  if (--net_state_vint > NET_BAUD_9600)
+    net_state_enter(NET_STATE_DOINITBAUD);
+  else
+    net_state_enter(NET_STATE_COPS);
+  }
+#endif // #ifdef OVMS_MODEM_FASTBAUD
+
 ////////////////////////////////////////////////////////////////////////
 // net_poll()
 // This function is an entry point from the main() program loop, and
@@ -188,6 +288,21 @@ void net_poll(void)
         CHECKPOINT(0x32)
         net_buf_pos--;
         net_buf[net_buf_pos] = 0; // mark end of string for string search functions.
+#ifdef OVMS_INTERNALGPS
+        if ((net_gps_nmea_on)&&(net_buf_mode==NET_BUF_CRLF)&&
+            (net_buf[0]=='$')&&(net_buf[1]=='G')&&(net_buf[2]=='P')&&
+            (net_state!=NET_STATE_DIAGMODE))
+          {
+          // An NMEA sentence from the internal GPS, not a modem response.
+          // Only while the output is on: an SMS body is read in
+          // NET_BUF_SMS mode and goes to net_sms_in() untouched.
+          net_timeout_rxdata = NET_RXDATA_TIMEOUT;
+          net_gps_nmea(net_buf);
+          net_buf_pos = 0;
+          net_buf[0] = 0;
+          continue;
+          }
+#endif
         if ((net_buf_pos>=4)&&
             (net_buf[0]=='+')&&(net_buf[1]=='C')&&
             (net_buf[2]=='M')&&(net_buf[3]=='T'))
@@ -257,6 +372,35 @@ void net_poll(void)
     }
   }
 
+////////////////////////////////////////////////////////////////////////
+// net_urc()
+// Recognise a modem response line, returns its NET_URC_* code.
+// A binary search on net_urcs[], so any line costs about five prefix
+// compares, whatever its position in the table.
+//
+unsigned char net_urc(const char *line)
+  {
+  unsigned char lo = 0;
+  unsigned char hi = NET_URCS;
+  unsigned char mid;
+  const char *l;
+  const rom char *p;
+
+  while (lo < hi)
+    {
+    mid = (lo + hi) >> 1;
+    for (l = line, p = net_urcs[mid].prefix; (*p != 0) && (*l == *p); l++, p++) ;
+    if (*p == 0)
+      return net_urcs[mid].urc; // The line starts with the prefix
+    else if (*l < *p)
+      hi = mid;
+    else
+      lo = mid + 1;
+    }
+
+  return NET_URC_NONE;
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // net_puts_rom()
 // Transmit zero-terminated character data from ROM to the async port.
@@ -349,9 +493,105 @@ void net_putc_ram(const char data)
   UART_WAIT_PUTC(data)
   }
 
+////////////////////////////////////////////////////////////////////////
+// net_rx_mark()
+// Returns the current async input position, to be passed to
+// net_rx_wait() for a command written after this call.
+//
+unsigned char net_rx_mark(void)
+  {
+  return vUARTIntRxBufWrPtr;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// net_rx_wait()
+// Wait up to n x 100ms for a modem response line starting with <s> to
+// arrive, i.e. the "> " data prompt after AT+CIPSEND or AT+CMGS.
+// Only input received since <mark> (see net_rx_mark()) is searched, so a
+// prompt left over from an earlier command does not match.
+// The input is only inspected, not consumed: net_poll() will process it
+// as usual. Returns TRUE if the response has arrived in time.
+//
+BOOL net_rx_wait(static const rom char *s, unsigned char n, unsigned char mark)
+  {
+  unsigned int t = (unsigned int)n * 20; // 5ms steps
+  unsigned char cnt, pos, m, x;
+  BOOL bol;
+
+  while (1)
+    {
+    // Input since the mark, unless net_poll() has read part of it:
+    pos = vUARTIntRxBufWrPtr;
+    if (pos >= mark)
+      cnt = pos - mark;
+    else
+      cnt = (RX_BUFFER_SIZE - mark) + pos;
+    if (cnt > vUARTIntRxBufDataCnt)
+      cnt = vUARTIntRxBufDataCnt;
+    pos = (pos >= cnt) ? pos - cnt : (RX_BUFFER_SIZE - cnt) + pos;
+
+    bol = TRUE; // The command ended a line
+    m = 0;
+    for (; cnt > 0; cnt--)
+      {
+      x = vUARTIntRxBuffer[pos];
+      if (++pos == RX_BUFFER_SIZE) pos = 0;
+      if ((bol) && (x == s[m]))
+        {
+        if (s[++m] == 0)
+          return TRUE;
+        }
+      else
+        {
+        bol = ((x == '\r') || (x == '\n'));
+        m = 0;
+        }
+      }
+
+    if ((t-- == 0) || (vUARTIntStatus.UARTIntRxBufferFull))
+      return FALSE;
+    delay5b();
+    vehicle_poll(); // Keep decoding CAN frames while we wait
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// net_notify_errq_pop()
+// Remove the oldest superseded error from the pending slot
+void net_notify_errq_pop(void)
+  {
+  unsigned char k;
+
+  for (k=1; k<net_notify_errqn; k++)
+    {
+    net_notify_errqcode[k-1] = net_notify_errqcode[k];
+    net_notify_errqdata[k-1] = net_notify_errqdata[k];
+    }
+  net_notify_errqn--;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// net_notify_errq_push()
+// Keep an error for sending in the pending slot, if the slot is full the
+// oldest error is dropped (and counted as a lost alert)
+void net_notify_errq_push(unsigned int errorcode, unsigned long errordata)
+  {
+  if (net_notify_errqn == NET_NOTIFY_ERRQ)
+    {
+    net_notify_errq_pop();
+    if (net_msg_qdrops[NET_MSG_Q_ALERT] < 0xff) net_msg_qdrops[NET_MSG_Q_ALERT]++;
+    }
+  net_notify_errqcode[net_notify_errqn] = errorcode;
+  net_notify_errqdata[net_notify_errqn] = errordata;
+  net_notify_errqn++;
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // net_req_notification_error()
 // Request notification of an error
+// This may be called from CAN handlers while a message is being sent
+// (vehicle_poll() runs in net_rx_wait()), so it must not touch the
+// modem or net_scratchpad. The alerts are sent by net_notify_dispatch().
 void net_req_notification_error(unsigned int errorcode, unsigned long errordata)
   {
   if (errorcode != 0)
@@ -361,6 +601,11 @@ void net_req_notification_error(unsigned int errorcode, unsigned long errordata)
         ((sys_features[FEATURE_CARBITS]&FEATURE_CB_SVALERTS)==0))
       {
       // This is a new error, so set it and time it out after 60 seconds
+      if (net_notify_errorcode != 0)
+        {
+        // The previous error has not been sent yet, keep it
+        net_notify_errq_push(net_notify_errorcode, net_notify_errordata);
+        }
       net_notify_errorcode = errorcode;
       net_notify_errordata = errordata;
       net_notify_lasterrorcode = errorcode;
@@ -389,13 +634,11 @@ void net_req_notification_error(unsigned int errorcode, unsigned long errordata)
 //
 void net_req_notification(unsigned int notify)
   {
-  char *p,*q;
-  p = par_get(PARAM_NOTIFIES);
-  if (strstrrampgm(p,(char const rom far*)"SMS") != NULL)
+  if (par_notifies & PAR_NOTIFY_SMS)
     {
     net_notify |= (notify<<8); // SMS notification flags are top 8 bits
     }
-  if (strstrrampgm(p,(char const rom far*)"IP") != NULL)
+  if (par_notifies & PAR_NOTIFY_IP)
     {
     net_notify |= notify;      // NET notification flags are bottom 8 bits
     }
@@ -441,6 +684,264 @@ void net_phonebook(char *pb)
     }
   }
 
+#ifdef OVMS_INTERNALGPS
+////////////////////////////////////////////////////////////////////////
+// net_gps_gga()
+// Internal GPS coordinates have arrived (AT+CGPSINF=2, past the "2,")
+// NMEA format $GPGGA: Global Positioning System Fixed Data
+// <Time>,<Lat>,<NS>,<Lon>,<EW>,<Fix>,<SatCnt>,<HDOP>,<Alt>,<Unit>,...
+// The line is parsed in one pass, in place and without float math. Empty
+// fields (no fix) are allowed, lines with missing fields or invalid
+// coordinates are ignored. Returns TRUE if the data has been stored.
+BOOL net_gps_gga(char *s)
+  {
+  unsigned long whole, frac;
+  unsigned long time = 0;
+  long lat = 0, lon = 0;
+  unsigned int hdop = 0;
+  int alt = 0;
+  unsigned char field, fix = 0, sats = 0;
+  char chr, ns = 0, ew = 0;
+
+  for (field = 0; s != NULL; field++)
+    {
+    s = nmea_field(s, &whole, &frac, &chr);
+    switch (field)
+      {
+      case 0: // Time hhmmss.sss
+        time = (whole / 10000) * 3600 + ((whole / 100) % 100) * 60 + (whole % 100);
+        break;
+      case 1: // Latitude DDMM.MMMM
+        if ((whole % 100) >= 60) return FALSE;
+        lat = nmea_latlon(whole, frac);
+        break;
+      case 2: // North / South
+        ns = chr;
+        break;
+      case 3: // Longitude DDDMM.MMMM
+        if ((whole % 100) >= 60) return FALSE;
+        lon = nmea_latlon(whole, frac);
+        break;
+      case 4: // East / West
+        ew = chr;
+        break;
+      case 5: // Fix (0/1/2)
+        fix = (unsigned char)whole;
+        break;
+      case 6: // Satellite count
+        sats = (unsigned char)whole;
+        break;
+      case 7: // HDOP
+        hdop = (unsigned int)(whole * 10 + frac / 100000);
+        break;
+      case 8: // Altitude
+        alt = (chr == '-') ? -(int)whole : (int)whole;
+        break;
+      }
+    }
+
+  if (field < 10)
+    return FALSE; // incomplete
+
+  if (fix != 0) // 1 = GPS, 2 = DGPS, 6 = estimated
+    {
+    if (((ns != 'N') && (ns != 'S')) || (lat > 90L*7372800) ||
+        ((ew != 'E') && (ew != 'W')) || (lon > 180L*7372800))
+      return FALSE;
+    car_gpslock = 1;
+    car_latitude = (ns == 'S') ? -lat : lat;
+    car_longitude = (ew == 'W') ? -lon : lon;
+    car_altitude = alt;
+    car_gpssats = sats;
+    car_gpshdop = hdop;
+    car_gpstime = time;
+    car_stale_gps = 120; // Reset stale indicator
+    }
+  else
+    {
+    car_gpslock = 0;
+    car_gpssats = sats;
+    car_stale_gps = 0;
+    }
+  return TRUE;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// net_gps_vtg()
+// Internal GPS course has arrived (AT+CGPSINF=64, past the "64,")
+// NMEA format $GPVTG: Course over ground
+// <Course>,<Ref>,...
+BOOL net_gps_vtg(char *s)
+  {
+  unsigned long whole, frac;
+  char chr, *next;
+
+  next = nmea_field(s, &whole, &frac, &chr);
+  if ((next == NULL) || (next == s+1) || (chr != 0))
+    return FALSE; // incomplete, empty or invalid
+  if (car_gpslock)
+    car_direction = (unsigned int)((whole + (frac >= 500000)) % 360);
+  return TRUE;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// net_gps_nmea()
+// An NMEA sentence from the internal GPS output (AT+CGPSOUT) has arrived:
+// $GPGGA,<as AT+CGPSINF=2>*<checksum> or $GPVTG,<as AT+CGPSINF=64>*<checksum>
+// Sentences with a bad checksum and other sentence types are ignored.
+void net_gps_nmea(char *s)
+  {
+  unsigned char cs = 0;
+  char *p, hi, lo;
+
+  // The checksum is the XOR of all characters between '$' and '*':
+  for (p = s+1; (*p != 0) && (*p != '*'); p++)
+    cs ^= *p;
+  if (*p != '*')
+    return;
+  hi = (cs >> 4) + '0'; if (hi > '9') hi += 7;
+  lo = (cs & 0x0f) + '0'; if (lo > '9') lo += 7;
+  if ((p[1] != hi) || (p[2] != lo))
+    return;
+  *p = 0;
+
+  if (memcmppgm2ram(s+3, (char const rom far*)"GGA,", 4) == 0)
+    {
+    if (net_gps_gga(s+7))
+      net_gps_nmea_age = 0;
+    }
+  else if (memcmppgm2ram(s+3, (char const rom far*)"VTG,", 4) == 0)
+    {
+    net_gps_vtg(s+7);
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// net_gps_ticker()
+// Called once per second in NET_STATE_READY.
+// While the car is on, the SIM908 sends the GGA & VTG sentences once per
+// second by itself, without a command/response cycle. If they stop (or the
+// modem firmware has no AT+CGPSOUT), the position is polled instead, and
+// the NMEA output requested again every NET_GPS_NMEA_RETRY seconds.
+// With the car off, the output is switched off and the position polled
+// once every minute (to trace theft / transportation).
+void net_gps_ticker(void)
+  {
+  if (net_gps_nmea_age < 0xff)
+    net_gps_nmea_age++;
+
+  if (net_msg_sendpending > 0)
+    return;
+
+  if (car_doors1bits.CarON)
+    {
+    if (net_gps_nmea_age <= NET_GPS_NMEA_TIMEOUT)
+      return; // NMEA output running
+    if ((net_gps_nmea_on == 0) || ((net_granular_tick % NET_GPS_NMEA_RETRY) == 0))
+      {
+      net_puts_rom(NET_REQGPS_NMEA);
+      net_gps_nmea_on = 1;
+      }
+    else
+      net_puts_rom(NET_REQGPS);
+    }
+  else if (net_gps_nmea_on)
+    {
+    net_puts_rom(NET_GPS_NMEAOFF);
+    net_gps_nmea_on = 0;
+    }
+  else if ((net_granular_tick % 60) == 0)
+    {
+    net_puts_rom(NET_REQGPS);
+    }
+  }
+#endif // #ifdef OVMS_INTERNALGPS
+
+////////////////////////////////////////////////////////////////////////
+// net_state_send()
+// Scheduled task: send the modem command of the current state (and
+// NETINIT sub-state). It is posted by net_state_enter() and
+// net_state_activity() to give the modem a short pause before the
+// command, without blocking the main loop.
+//
+void net_state_send(void)
+  {
+  char *p;
+
+  switch (net_state)
+    {
+    case NET_STATE_HARDSTOP:
+      net_puts_rom("AT+CIPSHUT\r");
+      break;
+    case NET_STATE_COPS:
+      p = par_get(PARAM_GSMLOCK);
+      if (*p==0)
+        {
+        net_puts_rom(NET_COPS);
+        }
+      else
+        {
+        net_puts_rom("AT+COPS=1,1,\"");
+        net_puts_ram(p);
+        net_puts_rom("\";+COPS?\r");
+        }
+      break;
+    case NET_STATE_DONETINIT:
+      switch (net_state_vchar)
+        {
+        case NETINIT_START:
+          net_puts_rom("AT+CIPSHUT\r");
+          break;
+        case NETINIT_CGDCONT:
+          net_puts_rom("AT+CGDCONT=1,\"IP\",\"");
+          net_puts_ram(par_get(PARAM_GPRSAPN));
+          net_puts_rom("\"\r");
+          break;
+        case NETINIT_CSTT:
+          net_puts_rom("AT+CSTT=\"");
+          net_puts_ram(par_get(PARAM_GPRSAPN));
+          net_puts_rom("\",\"");
+          net_puts_ram(par_get(PARAM_GPRSUSER));
+          net_puts_rom("\",\"");
+          net_puts_ram(par_get(PARAM_GPRSPASS));
+          net_puts_rom("\"\r");
+          break;
+        case NETINIT_CIICR:
+          led_set(OVMS_LED_GRN,NET_LED_NETAPNOK);
+          net_puts_rom("AT+CIICR\r");
+          break;
+        case NETINIT_CIPHEAD:
+          net_puts_rom("AT+CIPHEAD=1\r");
+          break;
+        case NETINIT_CIFSR:
+          net_puts_rom("AT+CIFSR\r");
+          break;
+        case NETINIT_CLPORT:
+          net_puts_rom("AT+CLPORT=\"TCP\",\"6867\"\r");
+          break;
+        case NETINIT_CIPSTART:
+          led_set(OVMS_LED_GRN,NET_LED_NETCALL);
+          net_puts_rom("AT+CIPSTART=\"TCP\",\"");
+          net_puts_ram(par_get(PARAM_SERVERIP));
+          net_puts_rom("\",\"6867\"\r");
+          break;
+        case NETINIT_CONNECTING:
+          net_state_enter(NET_STATE_READY);
+          break;
+        }
+      break;
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// net_hangup()
+// Scheduled task: reject an incoming call
+//
+void net_hangup(void)
+  {
+  net_puts_rom(NET_HANGUP);
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // net_state_enter(newstate)
 // State Model: A new state has been entered.
@@ -474,6 +975,9 @@ void net_state_enter(unsigned char newstate)
       net_timeout_ticks = 20; // modem cold start takes 5 secs, warm restart takes 2 secs, 3 secs required for autobuad sync, 20 secs should be sufficient for everything
       net_apps_connected = 0;
       net_msg_init();
+#ifdef OVMS_INTERNALGPS
+      net_gps_nmea_on = 0;
+#endif
       break;
     case NET_STATE_SOFTRESET:
       net_timeout_goto = 0;
@@ -483,6 +987,9 @@ void net_state_enter(unsigned char newstate)
       led_set(OVMS_LED_RED,OVMS_LED_ON);
       led_start();
       modem_reboot();
+#ifdef OVMS_MODEM_FASTBAUD
+      net_uart_baud(NET_BAUD_9600); // The modem restarts at 9600 baud
+#endif
       net_timeout_goto = NET_STATE_SOFTRESET;
       net_timeout_ticks = 2;
       net_state_vchar = 0;
@@ -496,8 +1003,7 @@ void net_state_enter(unsigned char newstate)
       net_state_vchar = NETINIT_START;
       net_apps_connected = 0;
       net_msg_disconnected();
-      delay100(10);
-      net_puts_rom("AT+CIPSHUT\r");
+      sched_post(net_state_send, 10); // AT+CIPSHUT
       break;
     case NET_STATE_HARDSTOP2:
       net_timeout_goto = NET_STATE_STOP;
@@ -535,6 +1041,19 @@ void net_state_enter(unsigned char newstate)
       net_state_vchar = 0;
       net_puts_rom(NET_INIT3);
       break;
+#ifdef OVMS_MODEM_FASTBAUD
+    case NET_STATE_DOINITBAUD:
+      // Ask for the rate net_state_vint, still at 9600 baud:
+      led_set(OVMS_LED_GRN,NET_LED_INITSIM3);
+      led_set(OVMS_LED_RED,OVMS_LED_OFF);
+      net_timeout_goto = NET_STATE_COPS; // No answer: carry on at 9600 baud
+      net_timeout_ticks = 5;
+      net_state_vchar = NETBAUD_SET;
+      p = stp_ul(net_scratchpad, "AT+IPR=", net_bauds[net_state_vint]);
+      p = stp_rom(p, "\r");
+      net_puts_ram(net_scratchpad);
+      break;
+#endif // #ifdef OVMS_MODEM_FASTBAUD
     case NET_STATE_NETINITP:
       led_set(OVMS_LED_GRN,NET_LED_NETINIT);
       if (--net_state_vint > 0)
@@ -573,9 +1092,8 @@ void net_state_enter(unsigned char newstate)
       net_state_vchar = NETINIT_CLPORT;
       net_apps_connected = 0;
       net_msg_disconnected();
-      delay100(2);
-      net_puts_rom("AT+CLPORT=\"TCP\",\"6867\"\r");
       net_state = NET_STATE_DONETINIT;
+      sched_post(net_state_send, 2); // AT+CLPORT
       break;
     case NET_STATE_DONETINIT:
       led_set(OVMS_LED_GRN,NET_LED_NETINIT);
@@ -590,8 +1108,7 @@ void net_state_enter(unsigned char newstate)
         net_state_vchar = NETINIT_START;
         net_apps_connected = 0;
         net_msg_disconnected();
-        delay100(2);
-        net_puts_rom("AT+CIPSHUT\r");
+        sched_post(net_state_send, 2); // AT+CIPSHUT
         break;
         }
       else
@@ -601,6 +1118,7 @@ void net_state_enter(unsigned char newstate)
       led_set(OVMS_LED_GRN,NET_LED_READY);
       led_set(OVMS_LED_RED,OVMS_LED_OFF);
       net_msg_sendpending = 0;
+      net_sms_sendpending = 0;
       net_timeout_goto = 0;
       net_state_vchar = 0;
       if ((net_reg != 0x01)&&(net_reg != 0x05))
@@ -611,21 +1129,10 @@ void net_state_enter(unsigned char newstate)
     case NET_STATE_COPS:
       led_set(OVMS_LED_GRN,NET_LED_COPS);
       led_set(OVMS_LED_RED,OVMS_LED_OFF);
-      delay100(2);
       net_timeout_goto = NET_STATE_HARDRESET;
       net_timeout_ticks = 240;
       net_msg_disconnected();
-      p = par_get(PARAM_GSMLOCK);
-      if (*p==0)
-        {
-        net_puts_rom(NET_COPS);
-        }
-      else
-        {
-        net_puts_rom("AT+COPS=1,1,\"");
-        net_puts_ram(p);
-        net_puts_rom("\";+COPS?\r");
-        }
+      sched_post(net_state_send, 2); // AT+COPS
       break;
     case NET_STATE_COPSSETTLE:
       net_timeout_ticks = 10;
@@ -661,6 +1168,7 @@ void net_state_enter(unsigned char newstate)
 void net_state_activity()
   {
   char *b;
+  unsigned char urc;
 
   CHECKPOINT(0x35)
 
@@ -689,19 +1197,20 @@ void net_state_activity()
     return;
     }
 
+  urc = net_urc(net_buf);
+
   switch (net_state)
     {
 #ifdef OVMS_DIAGMODULE
     case NET_STATE_FIRSTRUN:
-      if ((net_buf_pos >= 5)&&
-          (memcmppgm2ram(net_buf, (char const rom far*)"SETUP", 5) == 0))
+      if (urc == NET_URC_SETUP)
         {
         net_state_enter(NET_STATE_DIAGMODE);
         }
       break;
 #endif // #ifdef OVMS_DIAGMODULE
     case NET_STATE_START:
-      if ((net_buf_pos >= 2)&&(net_buf[0] == 'O')&&(net_buf[1] == 'K'))
+      if (urc == NET_URC_OK)
         {
         // OK response from the modem
         led_set(OVMS_LED_RED,OVMS_LED_OFF);
@@ -709,7 +1218,7 @@ void net_state_activity()
         }
       break;
     case NET_STATE_DOINIT:
-      if ((net_buf_pos >= 4)&&(net_buf[0]=='+')&&(net_buf[1]=='C')&&(net_buf[2]=='S')&&(net_buf[3]=='M'))
+      if (urc == NET_URC_CSMINS)
         {
         if (net_buf[strlen(net_buf)-1] != '1')
           {
@@ -718,7 +1227,7 @@ void net_state_activity()
           net_state_vchar = 1;
           }
         }
-      else if ((net_state_vchar==0)&&(net_buf_pos >= 2)&&(net_buf[0] == 'O')&&(net_buf[1] == 'K'))
+      else if ((net_state_vchar==0)&&(urc == NET_URC_OK))
         {
         // The SIM card is inserted
         led_set(OVMS_LED_RED,OVMS_LED_OFF);
@@ -732,12 +1241,11 @@ void net_state_activity()
         strncpy(net_iccid,net_buf,MAX_ICCID);
         net_iccid[MAX_ICCID-1] = 0;
         }
-      else if ((net_buf_pos >= 8)&&(net_buf[0]=='+')&&(net_buf[1]=='C')&&(net_buf[2]=='P')&&
-               (net_buf[3]=='B')&&(net_buf[4]=='F')&&(net_buf[5]==':'))
+      else if ((urc == NET_URC_CPBF)&&(net_buf_pos >= 8))
         {
         net_phonebook(net_buf);
         }
-      else if ((net_buf_pos >= 8)&&(net_buf[0]=='+')&&(net_buf[1]=='C')&&(net_buf[2]=='P')&&(net_buf[3]=='I'))
+      else if ((urc == NET_URC_CPIN)&&(net_buf_pos >= 8))
         {
         if (net_buf[7] != 'R')
           {
@@ -746,7 +1254,7 @@ void net_state_activity()
           net_state_vchar = 1;
           }
         }
-      else if ((net_state_vchar==0)&&(net_buf_pos >= 2)&&(net_buf[0] == 'O')&&(net_buf[1] == 'K'))
+      else if ((net_state_vchar==0)&&(urc == NET_URC_OK))
         {
         // The SIM card has no pin lock
         led_set(OVMS_LED_RED,OVMS_LED_OFF);
@@ -754,31 +1262,71 @@ void net_state_activity()
         }
       break;
     case NET_STATE_DOINIT3:
-      if ((net_buf_pos >= 6)&&(net_buf[0] == '+')&&(net_buf[1] == 'I')&&(net_buf[2] == 'P')&&(net_buf[3] == 'R')&&(net_buf[6] != '9'))
+      if ((urc == NET_URC_IPR)&&(net_buf_pos >= 6)&&(net_buf[6] != '9')&&
+          (net_baud == NET_BAUD_9600))
         {
         // +IPR != 9600
         // SET IPR (baudrate)
         net_puts_rom(NET_IPR_SET);
         }
-      else if ((net_buf_pos >= 2)&&(net_buf[0] == 'O')&&(net_buf[1] == 'K'))
+      else if (urc == NET_URC_OK)
         {
         led_set(OVMS_LED_RED,OVMS_LED_OFF);
-        net_state_enter(NET_STATE_COPS);
+#ifdef OVMS_MODEM_FASTBAUD
+        if ((net_baud == NET_BAUD_9600)&&(net_baud_max > NET_BAUD_9600))
+          {
+          net_state_vint = net_baud_max; // Try the fastest rate first
+          net_state_enter(NET_STATE_DOINITBAUD);
+          }
+        else
+#endif // #ifdef OVMS_MODEM_FASTBAUD
+          net_state_enter(NET_STATE_COPS);
         }
       break;
+#ifdef OVMS_MODEM_FASTBAUD
+    case NET_STATE_DOINITBAUD:
+      if (urc == NET_URC_OK)
+        {
+        if (net_state_vchar == NETBAUD_SET)
+          {
+          // The modem switches after this OK, follow it and check:
+          net_uart_baud(net_state_vint);
+          net_state_vchar = NETBAUD_CHECK;
+          net_timeout_goto = NET_STATE_HARDRESET;
+          net_timeout_ticks = 4;
+          net_puts_rom(NET_WAKEUP);
+          }
+        else if (net_state_vchar == NETBAUD_CHECK)
+          {
+          // The link works at the new rate
+          net_state_enter(NET_STATE_COPS);
+          }
+        else
+          {
+          // Back at 9600 baud
+          net_baud_next();
+          }
+        }
+      else if ((net_state_vchar == NETBAUD_SET)&&
+               ((urc == NET_URC_ERROR)||(urc == NET_URC_CMEERROR)))
+        {
+        // Rate not supported by the modem
+        net_baud_next();
+        }
+      break;
+#endif // #ifdef OVMS_MODEM_FASTBAUD
     case NET_STATE_COPS:
-      if ((net_buf_pos >= 2)&&(net_buf[0] == 'O')&&(net_buf[1] == 'K'))
+      if (urc == NET_URC_OK)
         {
         net_state_vint = NET_GPRS_RETRIES; // Count-down for DONETINIT attempts
         net_cops_tries = 0; // Successfully out of COPS
         net_state_enter(NET_STATE_COPSSETTLE); // COPS reconnect was OK
         }
-      else if ( ((net_buf_pos >= 5)&&(net_buf[0] == 'E')&&(net_buf[1] == 'R')) ||
-              (memcmppgm2ram(net_buf, (char const rom far*)"+CME ERROR", 10) == 0) )
+      else if ((urc == NET_URC_ERROR)||(urc == NET_URC_CMEERROR))
         {
         net_state_enter(NET_STATE_COPSWAIT); // Try to wait a bit to see if we get a CREG
         }
-      else if (memcmppgm2ram(net_buf, (char const rom far*)"+COPS:", 6) == 0)
+      else if (urc == NET_URC_COPS)
         {
         // COPS network registration
         b = strtokpgmram(net_buf,"\"");
@@ -794,7 +1342,7 @@ void net_state_activity()
         }
       break;
     case NET_STATE_COPSWAIT:
-      if (memcmppgm2ram(net_buf, (char const rom far*)"+CREG", 5) == 0)
+      if (urc == NET_URC_CREG)
         { // "+CREG" Network registration
         if (net_buf[8]==',')
           net_reg = net_buf[9]&0x07; // +CREG: 1,x
@@ -809,9 +1357,7 @@ void net_state_activity()
         }
       break;
     case NET_STATE_DONETINIT:
-      if ((net_buf_pos >= 2)&&
-               (net_buf[0] == 'E')&&
-               (net_buf[1] == 'R'))
+      if (urc == NET_URC_ERROR)
         {
         if ((net_state_vchar == NETINIT_CSTT)||
                 (net_state_vchar == NETINIT_CIICR))// ERROR response to AT+CSTT OR AT+CIICR
@@ -826,67 +1372,27 @@ void net_state_activity()
           net_state_enter(NET_STATE_HARDRESET);
           }
         }
-      else if ((net_buf_pos >= 2)&&
-          (((net_buf[0] == 'O')&&(net_buf[1] == 'K')))|| // OK
-          (((net_buf[0] == 'S')&&(net_buf[1] == 'H')))||  // SHUT OK
-          (net_state_vchar == NETINIT_CIFSR)) // Local IP address
+      else if ((urc == NET_URC_OK)||
+               (urc == NET_URC_SHUTOK)||
+               (net_state_vchar == NETINIT_CIFSR)) // Local IP address
         {
         net_buf_pos = 0;
         net_timeout_ticks = 30;
         net_link = 0;
-        delay100(2);
-        switch (++net_state_vchar)
-          {
-          case NETINIT_CGDCONT:
-            net_puts_rom("AT+CGDCONT=1,\"IP\",\"");
-            net_puts_ram(par_get(PARAM_GPRSAPN));
-            net_puts_rom("\"\r");
-            break;
-          case NETINIT_CSTT:
-            net_puts_rom("AT+CSTT=\"");
-            net_puts_ram(par_get(PARAM_GPRSAPN));
-            net_puts_rom("\",\"");
-            net_puts_ram(par_get(PARAM_GPRSUSER));
-            net_puts_rom("\",\"");
-            net_puts_ram(par_get(PARAM_GPRSPASS));
-            net_puts_rom("\"\r");
-            break;
-          case NETINIT_CIICR:
-            led_set(OVMS_LED_GRN,NET_LED_NETAPNOK);
-            net_puts_rom("AT+CIICR\r");
-            break;
-          case NETINIT_CIPHEAD:
-            net_puts_rom("AT+CIPHEAD=1\r");
-            break;
-          case NETINIT_CIFSR:
-            net_puts_rom("AT+CIFSR\r");
-            break;
-          case NETINIT_CLPORT:
-            net_puts_rom("AT+CLPORT=\"TCP\",\"6867\"\r");
-            break;
-          case NETINIT_CIPSTART:
-            led_set(OVMS_LED_GRN,NET_LED_NETCALL);
-            net_puts_rom("AT+CIPSTART=\"TCP\",\"");
-            net_puts_ram(par_get(PARAM_SERVERIP));
-            net_puts_rom("\",\"6867\"\r");
-            break;
-          case NETINIT_CONNECTING:
-            net_state_enter(NET_STATE_READY);
-            break;
-          }
+        net_state_vchar++;
+        sched_post(net_state_send, 2); // Next NETINIT command
         }
-      else if ((net_buf_pos>=7)&&
-               (memcmppgm2ram(net_buf, (char const rom far*)"+CREG: 0", 8) == 0))
+      else if ((urc == NET_URC_CREG)&&(net_buf_pos >= 8)&&(net_buf[7] == '0'))
         { // Lost network connectivity during NETINIT
         net_state_enter(NET_STATE_SOFTRESET);
         }
-      else if (memcmppgm2ram(net_buf, (char const rom far*)"+PDP: DEACT", 11) == 0)
+      else if (urc == NET_URC_PDPDEACT)
         { // PDP couldn't be activated - try again...
         net_state_enter(NET_STATE_SOFTRESET);
         }
       break;
     case NET_STATE_READY:
-      if (memcmppgm2ram(net_buf, (char const rom far*)"+CREG", 5) == 0)
+      if (urc == NET_URC_CREG)
         { // "+CREG" Network registration
         if (net_buf[8]==',')
           net_reg = net_buf[9]&0x07; // +CREG: 1,x
@@ -903,7 +1409,7 @@ void net_state_activity()
           led_set(OVMS_LED_RED,NET_LED_ERRLOSTSIG);
           }
         }
-      else if (memcmppgm2ram(net_buf, (char const rom far*)"+CLIP", 5) == 0)
+      else if (urc == NET_URC_CLIP)
         { // Incoming CALL
         if ((net_reg != 0x01)&&(net_reg != 0x05))
           { // Treat this as a network registration
@@ -911,91 +1417,19 @@ void net_state_activity()
           net_reg = 0x05;
           led_set(OVMS_LED_RED,OVMS_LED_OFF);
           }
-        delay100(1);
-        net_puts_rom(NET_HANGUP);
+        sched_post(net_hangup, 1);
         }
 #ifdef OVMS_INTERNALGPS
-      else if ((memcmppgm2ram(net_buf, (char const rom far*)"2,", 2) == 0)&&
-               ((net_fnbits & NET_FN_INTERNALGPS)>0))
-        {
-        // Incoming GPS coordinates
-        // NMEA format $GPGGA: Global Positioning System Fixed Data
-        // 2,<Time>,<Lat>,<NS>,<Lon>,<EW>,<Fix>,<SatCnt>,<HDOP>,<Alt>,<Unit>,...
-
-        long lat, lon;
-        char ns, ew;
-        char fix;
-        int alt;
-
-        // Parse string:
-        if( b = strtokpgmram( net_buf+2, "," ) )
-            ;                                     // Time
-        if( b = strtokpgmram( NULL, "," ) )
-            lat = gps2latlon( b );                // Latitude
-        if( b = strtokpgmram( NULL, "," ) )
-            ns = *b;                              // North / South
-        if( b = strtokpgmram( NULL, "," ) )
-            lon = gps2latlon( b );                // Longitude
-        if( b = strtokpgmram( NULL, "," ) )
-            ew = *b;                              // East / West
-        if( b = strtokpgmram( NULL, "," ) )
-            fix = *b;                             // Fix (0/1)
-        if( b = strtokpgmram( NULL, "," ) )
-            ;                                     // Satellite count
-        if( b = strtokpgmram( NULL, "," ) )
-            ;                                     // HDOP
-        if( b = strtokpgmram( NULL, "," ) )
-            alt = atoi( b );                      // Altitude
-
-        if( b )
-          {
-          // data set complete, store:
-
-          car_gpslock = fix & 0x01;
-
-          if( car_gpslock )
-            {
-            if( ns == 'S' ) lat = ~lat;
-            if( ew == 'W' ) lon = ~lon;
-
-            car_latitude = lat;
-            car_longitude = lon;
-            car_altitude = alt;
-
-            car_stale_gps = 120; // Reset stale indicator
-            }
-          else
-            {
-            car_stale_gps = 0;
-            }
-         }
-
-      }
-    else if ((memcmppgm2ram(net_buf, (char const rom far*)"64,", 3) == 0)&&
-             ((net_fnbits & NET_FN_INTERNALGPS)>0))
-      {
-      // Incoming GPS coordinates
-      // NMEA format $GPVTG: Course over ground
-      // 64,<Course>,<Ref>,...
-
-      int dir;
-
-      // Parse string:
-      if( b = strtokpgmram( net_buf+3, "," ) )
-        dir = atoi( b );                      // Course
-
-      if( b )
+      else if ((urc == NET_URC_GPSGGA)&&((net_fnbits & NET_FN_INTERNALGPS)>0))
         {
-        // data set complete, store:
-        if( car_gpslock )
-          {
-          car_direction = dir;
-          }
+        net_gps_gga(net_buf+2);
+        }
+      else if ((urc == NET_URC_GPSVTG)&&((net_fnbits & NET_FN_INTERNALGPS)>0))
+        {
+        net_gps_vtg(net_buf+3);
         }
-
-      }
 #endif
-      else if (memcmppgm2ram(net_buf, (char const rom far*)"CONNECT OK", 10) == 0)
+      else if (urc == NET_URC_CONNECTOK)
         {
         if (net_link == 0)
           {
@@ -1006,7 +1440,7 @@ void net_state_activity()
           }
         net_link = 1;
         }
-      else if (memcmppgm2ram(net_buf, (char const rom far*)"STATE: ", 7) == 0)
+      else if (urc == NET_URC_STATE)
         { // Incoming CIPSTATUS
         if (memcmppgm2ram(net_buf, (char const rom far*)"STATE: CONNECT OK", 17) == 0)
           {
@@ -1042,14 +1476,14 @@ void net_state_activity()
             }
           }
         }
-      else if (memcmppgm2ram(net_buf, (char const rom far*)"+CSQ:", 5) == 0)
+      else if (urc == NET_URC_CSQ)
         {
         // Signal Quality
           if (net_buf[8]==',')  // two digits
              net_sq = (net_buf[6]&0x07)*10 + (net_buf[7]&0x07);
           else net_sq = net_buf[6]&0x07;
         }
-      else if (memcmppgm2ram(net_buf, (char const rom far*)"SEND OK", 7) == 0)
+      else if (urc == NET_URC_SENDOK)
         {
         // CIPSEND success response in QSEND=0 mode
         //net_msg_sendpending = 0;
@@ -1058,34 +1492,44 @@ void net_state_activity()
         net_msg_disconnected();
         net_state_enter(NET_STATE_START);
         }
-      else if (memcmppgm2ram(net_buf, (char const rom far*)"DATA ACCEPT", 11) == 0)
+      else if (urc == NET_URC_DATAACCEPT)
         {
-        // CIPSEND success response in QSEND=1 mode
+        // CIPSEND success response in QSEND=1 mode: DATA ACCEPT:<n>
+        if ((net_buf[11] == ':') && (atoi(net_buf+12) < net_msg_sendlen))
+          {
+          // The modem has not taken the whole block
+          if (net_msg_txshort < 0xff) net_msg_txshort++;
+          }
+        net_msg_txtime();
         net_msg_sendpending = 0;
+        // The modem is ready again: send queued messages right away
+        if ((net_msg_qcount > 0) && (!sched_pending(net_notify_dispatch)))
+          sched_post(net_notify_dispatch, 1);
         }
-      else if ( (memcmppgm2ram(net_buf, (char const rom far*)"CLOSED", 6) == 0) ||
-              (memcmppgm2ram(net_buf, (char const rom far*)"CONNECT FAIL", 12) == 0) )
+      else if ((urc == NET_URC_CLOSED)||(urc == NET_URC_CONNECTFAIL))
         {
         // Re-initialize TCP socket, after short pause
         net_msg_disconnected();
         net_state_enter(NET_STATE_NETINITCP);
         }
-      else if ( (memcmppgm2ram(net_buf, (char const rom far*)"SEND FAIL", 9) == 0)||
-                (memcmppgm2ram(net_buf, (char const rom far*)"+CME ERROR", 10) == 0)||
-                (memcmppgm2ram(net_buf, (char const rom far*)"+PDP: DEACT", 11) == 0) )
+      else if ((urc == NET_URC_SENDFAIL)||(urc == NET_URC_CMEERROR)||(urc == NET_URC_PDPDEACT))
         { // Various GPRS error results
         // Re-initialize GPRS network and TCP socket, after short pause
         net_msg_disconnected();
         net_state_enter(NET_STATE_NETINITP);
         }
-      else if ( (memcmppgm2ram(net_buf, (char const rom far*)"RDY", 4) == 0)||
-                (memcmppgm2ram(net_buf, (char const rom far*)"+CFUN:", 6) == 0) )
+      else if ((urc == NET_URC_RDY)||(urc == NET_URC_CFUN))
         {
         // Modem crash/reset: do full re-init
         net_msg_disconnected();
         net_state_enter(NET_STATE_START);
         }
-      else if (memcmppgm2ram(net_buf, (char const rom far*)"+CUSD:", 6) == 0)
+      else if (urc == NET_URC_OK)
+        {
+        // The end of an SMS send, or of another command: the modem is idle
+        net_sms_sendpending = 0;
+        }
+      else if (urc == NET_URC_CUSD)
       {
         // reply MMI/USSD command result:
         net_msg_reply_ussd(net_buf, net_buf_pos);
@@ -1099,6 +1543,147 @@ void net_state_activity()
     }
   }
 
+////////////////////////////////////////////////////////////////////////
+// net_notify_dispatch()
+// Scheduled task: issue the next outstanding notification.
+// This is posted by net_state_ticker1() to give the modem a one second
+// breather before the notification is sent, without blocking the main
+// loop. Conditions are re-checked here, as they may have changed since.
+//
+void net_notify_dispatch(void)
+  {
+  char stat;
+  char *p;
+  unsigned int code;
+  unsigned long data;
+
+  if ((net_state != NET_STATE_READY) || ((net_reg != 0x01)&&(net_reg != 0x05)))
+    return;
+
+  if (((net_notify_errqn>0)||(net_notify_errorcode>0))
+          && (net_msg_serverok==1) && (net_msg_sendpending==0))
+    {
+    if (net_notify_errqn > 0)
+      {
+      // Superseded errors first, oldest first
+      code = net_notify_errqcode[0];
+      data = net_notify_errqdata[0];
+      net_notify_errq_pop();
+      net_msg_erroralert(code, data);
+      }
+    else
+      {
+      net_msg_erroralert(net_notify_errorcode, net_notify_errordata);
+      net_notify_errorcode = 0;
+      net_notify_errordata = 0;
+      }
+    return;
+    }
+
+  // Messages queued while the server was not available:
+  if (net_msg_queue_send())
+    return;
+
+  if (((net_notify & NET_NOTIFY_NETPART)>0)
+          && (net_msg_serverok==1) && (net_msg_sendpending==0))
+    {
+    if ((net_notify & NET_NOTIFY_NET_ALARM)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_NET_ALARM); // Clear notification flag
+      net_msg_alarm();
+      return;
+      }
+    else if ((net_notify & NET_NOTIFY_NET_CHARGE)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_NET_CHARGE); // Clear notification flag
+      if (net_notify_suppresscount==0)
+        {
+        // execute CHARGE ALERT command:
+        net_msg_cmd_code = 6;
+        net_msg_cmd_msg[0] = 0;
+        net_msg_cmd_do();
+        }
+      return;
+      }
+    else if ((net_notify & NET_NOTIFY_NET_12VLOW)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_NET_12VLOW); // Clear notification flag
+      if (net_fnbits & NET_FN_12VMONITOR) net_msg_12v_alert();
+      return;
+      }
+    else if ((net_notify & NET_NOTIFY_NET_TRUNK)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_NET_TRUNK); // Clear notification flag
+      net_msg_valettrunk();
+      return;
+      }
+    else if ((net_notify & NET_NOTIFY_NET_STAT)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_NET_STAT); // Clear notification flag
+      if (net_msgp_stat(2) != 2)
+        net_msg_send();
+      return;
+      }
+    else if ((net_notify & NET_NOTIFY_NET_ENV)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_NET_ENV); // Clear notification flag
+      // A bit of a kludge, but only notify environment if an app connected
+      if ((net_apps_connected>0))
+        {
+        stat = 2;
+        stat = net_msgp_environment(stat);
+        stat = net_msgp_stat(stat);
+        if (stat != 2)
+          net_msg_send();
+        return;
+        }
+      }
+    } // if NET_NOTIFY_NETPART
+
+  if ((net_notify & NET_NOTIFY_SMSPART)>0)
+    {
+    p = par_get(PARAM_REGPHONE);
+    if ((net_notify & NET_NOTIFY_SMS_ALARM)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_SMS_ALARM); // Clear notification flag
+      net_sms_alarm(p);
+      return;
+      }
+    else if ((net_notify & NET_NOTIFY_SMS_CHARGE)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_SMS_CHARGE); // Clear notification flag
+      if (net_notify_suppresscount==0)
+        {
+          char cmd[5];
+          strcpypgm2ram(cmd, "STAT");
+          net_sms_in(p, cmd, 4);
+        }
+      return;
+      }
+    else if ((net_notify & NET_NOTIFY_SMS_12VLOW)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_SMS_12VLOW); // Clear notification flag
+      if (net_fnbits & NET_FN_12VMONITOR) net_sms_12v_alert(p);
+      return;
+      }
+    else if ((net_notify & NET_NOTIFY_SMS_TRUNK)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_SMS_TRUNK); // Clear notification flag
+      net_sms_valettrunk(p);
+      return;
+      }
+    else if ((net_notify & NET_NOTIFY_SMS_STAT)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_SMS_STAT); // Clear notification flag
+      }
+    else if ((net_notify & NET_NOTIFY_SMS_ENV)>0)
+      {
+      net_notify &= ~(NET_NOTIFY_SMS_ENV); // Clear notification flag
+      return;
+      }
+    } // if NET_NOTIFY_SMSPART
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // net_state_ticker1()
 // State Model: Per-second ticker
@@ -1107,8 +1692,6 @@ void net_state_activity()
 //
 void net_state_ticker1(void)
   {
-  char stat;
-  char *p;
 
   CHECKPOINT(0x38)
 
@@ -1130,6 +1713,12 @@ void net_state_ticker1(void)
         // We are about to timeout, so let's set the error code...
         led_set(OVMS_LED_RED,NET_LED_ERRMODEM);
         }
+#ifdef OVMS_MODEM_FASTBAUD
+      // The modem may be at another rate (i.e. after a processor reset),
+      // so after a first try at the current rate probe each rate in turn:
+      if (net_timeout_ticks < 19)
+        net_uart_baud((net_baud+1) % (NET_BAUD_MAX+1));
+#endif
       net_puts_rom(NET_WAKEUP);
       break;
     case NET_STATE_DOINIT:
@@ -1144,6 +1733,23 @@ void net_state_ticker1(void)
       if ((net_timeout_ticks % 3)==0)
         net_puts_rom(NET_INIT3);
       break;
+#ifdef OVMS_MODEM_FASTBAUD
+    case NET_STATE_DOINITBAUD:
+      if ((net_state_vchar == NETBAUD_CHECK)&&(net_timeout_ticks == 1))
+        {
+        // No answer at the new rate: don't negotiate it again, set the
+        // modem back to 9600 baud (it may well understand us), and check
+        // at 9600 baud. If not, the HARDRESET restarts the modem.
+        net_baud_max = net_state_vint - 1;
+        net_puts_rom(NET_IPR_SET);
+        net_uart_baud(NET_BAUD_9600);
+        net_state_vchar = NETBAUD_REVERT;
+        net_timeout_ticks = 4;
+        }
+      if (net_state_vchar != NETBAUD_SET)
+        net_puts_rom(NET_WAKEUP);
+      break;
+#endif // #ifdef OVMS_MODEM_FASTBAUD
     case NET_STATE_COPS:
       if (net_timeout_ticks < 20)
         {
@@ -1203,149 +1809,54 @@ void net_state_ticker1(void)
           return;
           }
 
-        if ((net_notify_errorcode>0)
+        // Notifications are issued by a scheduled task, one second from now
+        if (((((net_notify_errorcode>0)||(net_notify_errqn>0)||((net_notify & NET_NOTIFY_NETPART)>0)||(net_msg_qcount>0))
                 && (net_msg_serverok==1) && (net_msg_sendpending==0))
+              || ((net_notify & NET_NOTIFY_SMSPART)>0))
+            && (!sched_pending(net_notify_dispatch)))
           {
-          delay100(10);
-          if (net_notify_errorcode > 0)
-            {
-            net_msg_erroralert(net_notify_errorcode, net_notify_errordata);
-            }
-          net_notify_errorcode = 0;
-          net_notify_errordata = 0;
-          return;
+          sched_post(net_notify_dispatch, 10);
           }
 
-        if (((net_notify & NET_NOTIFY_NETPART)>0)
-                && (net_msg_serverok==1) && (net_msg_sendpending==0))
-          {
-          delay100(10);
-          if ((net_notify & NET_NOTIFY_NET_ALARM)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_NET_ALARM); // Clear notification flag
-            net_msg_alarm();
-            return;
-            }
-          else if ((net_notify & NET_NOTIFY_NET_CHARGE)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_NET_CHARGE); // Clear notification flag
-            if (net_notify_suppresscount==0)
-              {
-              // execute CHARGE ALERT command:
-              net_msg_cmd_code = 6;
-              net_msg_cmd_msg[0] = 0;
-              net_msg_cmd_do();
-              }
-            return;
-            }
-          else if ((net_notify & NET_NOTIFY_NET_12VLOW)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_NET_12VLOW); // Clear notification flag
-            if (net_fnbits & NET_FN_12VMONITOR) net_msg_12v_alert();
-            return;
-            }
-          else if ((net_notify & NET_NOTIFY_NET_TRUNK)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_NET_TRUNK); // Clear notification flag
-            net_msg_valettrunk();
-            return;
-            }
-          else if ((net_notify & NET_NOTIFY_NET_STAT)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_NET_STAT); // Clear notification flag
-            delay100(10);
-            if (net_msgp_stat(2) != 2);
-              net_msg_send();
-            return;
-            }
-          else if ((net_notify & NET_NOTIFY_NET_ENV)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_NET_ENV); // Clear notification flag
-            // A bit of a kludge, but only notify environment if an app connected
-            if ((net_apps_connected>0))
-              {
-              stat = 2;
-              delay100(10);
-              stat = net_msgp_environment(stat);
-              stat = net_msgp_stat(stat);
-              if (stat != 2)
-                net_msg_send();
-              return;
-              }
-            }
-          } // if NET_NOTIFY_NETPART
-
-        if ((net_notify & NET_NOTIFY_SMSPART)>0)
+        // GPS location streaming:
+        if ((car_speed>0) &&
+            (sys_features[FEATURE_STREAM]&FEATURE_ST_LOCATION) &&
+            (net_apps_connected>0))
           {
-          delay100(10);
-          p = par_get(PARAM_REGPHONE);
-          if ((net_notify & NET_NOTIFY_SMS_ALARM)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_SMS_ALARM); // Clear notification flag
-            net_sms_alarm(p);
-            return;
-            }
-          else if ((net_notify & NET_NOTIFY_SMS_CHARGE)>0)
+          // Car moving, and streaming on, apps connected
+          if ((((net_fnbits & NET_FN_INTERNALGPS) == 0)
+                || ((net_granular_tick % 2) == 0)) &&
+              (net_stream_due()))
             {
-            net_notify &= ~(NET_NOTIFY_SMS_CHARGE); // Clear notification flag
-            if (net_notify_suppresscount==0)
+            switch (net_msg_track_add())
               {
-                char cmd[5];
-                strcpypgm2ram(cmd, "STAT");
-                net_sms_in(p, cmd, 4);
+              case NET_MSG_TRACK_ADDED:
+                net_stream_sent();
+                break;
+              case NET_MSG_TRACK_OFF:
+                if (net_msg_sendpending==0)
+                  {
+                  if (net_msgp_gps(2) != 2)
+                    net_msg_send();
+                  net_stream_sent();
+                  }
+                break;
+              // NET_MSG_TRACK_SKIPPED: try again on the next tick
               }
-            return;
             }
-          else if ((net_notify & NET_NOTIFY_SMS_12VLOW)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_SMS_12VLOW); // Clear notification flag
-            if (net_fnbits & NET_FN_12VMONITOR) net_sms_12v_alert(p);
-            return;
-            }
-          else if ((net_notify & NET_NOTIFY_SMS_TRUNK)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_SMS_TRUNK); // Clear notification flag
-            net_sms_valettrunk(p);
-            return;
-            }
-          else if ((net_notify & NET_NOTIFY_SMS_STAT)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_SMS_STAT); // Clear notification flag
-            }
-          else if ((net_notify & NET_NOTIFY_SMS_ENV)>0)
-            {
-            net_notify &= ~(NET_NOTIFY_SMS_ENV); // Clear notification flag
-            return;
-            }
-          } // if NET_NOTIFY_SMSPART
-
-        // GPS location streaming:
-        if ((car_speed>0) &&
-            (sys_features[FEATURE_STREAM]&1) &&
-            (net_msg_sendpending==0) &&
-            (net_apps_connected>0) &&
-            ( ((net_fnbits & NET_FN_INTERNALGPS) == 0)
-              || ((net_granular_tick % 2) == 0) ))
+          }
+        else if ((net_msg_track_n > 0) && (net_msg_sendpending==0))
           {
-          // Car moving, and streaming on, apps connected, and not sending
-          //delay100(2); // necessary? net_msg_start() delays too
-          if (net_msgp_gps(2) != 2)
-            net_msg_send();
+          // Streaming has stopped, send the rest of the track
+          net_msg_track_send();
           }
 
         } // if ((net_reg == 0x01)||(net_reg == 0x05))
 
 #ifdef OVMS_INTERNALGPS
-        // Request internal SIM908 GPS coordinates
-        // once per second while car is on,
-        // else once every minute (to trace theft / transportation)
-        if ((car_doors1bits.CarON || ((net_granular_tick % 60) == 0))
-                && (net_msg_sendpending==0)
-                && ((net_fnbits & NET_FN_INTERNALGPS) > 0))
-        {
-          net_puts_rom(NET_REQGPS);
-          delay100(1); // to get modem reply on next net_poll()
-        }
+        // Internal SIM908 GPS coordinates: NMEA output or polling
+        if ((net_fnbits & NET_FN_INTERNALGPS) > 0)
+          net_gps_ticker();
 #endif
 
       break;
@@ -1358,6 +1869,71 @@ void net_state_ticker1(void)
     }
   }
 
+////////////////////////////////////////////////////////////////////////
+// net_stream_due()
+// Adaptive location streaming (FEATURE_ST_ADAPTIVE): returns TRUE if a
+// new location should be sent in the stream.
+//
+// The apps extrapolate the track from the last location sent, at its speed
+// and direction. A new location is only due if the car deviates from that
+// prediction by more than FEATURE_STREAMDEV meters, or FEATURE_STREAMMAX
+// seconds have passed. Straight driving at constant speed is thereby
+// reduced to one location per max interval.
+//
+BOOL net_stream_due(void)
+  {
+  unsigned char maxdev, maxint;
+  unsigned long secs, dist;
+  long dlat, dlong, dnorth, deast;
+
+  if ((sys_features[FEATURE_STREAM] & FEATURE_ST_ADAPTIVE) == 0)
+    return TRUE;
+
+  maxdev = sys_features[FEATURE_STREAMDEV];
+  if (maxdev == 0) maxdev = NET_STREAM_DEV;
+  maxint = sys_features[FEATURE_STREAMMAX];
+  if (maxint == 0) maxint = NET_STREAM_MAXINT;
+
+  secs = car_time - net_stream_time;
+  if (secs >= maxint)
+    return TRUE;
+
+  // Distance (m) in the last direction at the last speed:
+  if (can_mileskm == 'K')
+    dist = muldiv(net_stream_speed * secs, 5, 18);
+  else
+    dist = muldiv(net_stream_speed * secs, 1609, 3600);
+
+  // Actual distance (m) north & east, 1 m = ~66 / 2048 arc seconds:
+  dlat = (car_latitude - net_stream_lat) / 66;
+  dlong = (car_longitude - net_stream_lon) / 66;
+  if ((ABS(dlat) > 32767) || (ABS(dlong) > 32767))
+    return TRUE; // Location jump (or crossing 180 degrees longitude)
+  dlong = (dlong * net_stream_cos) >> 14;
+
+  // Deviation from the prediction:
+  dnorth = dlat - (((long)dist * IntCosineDeg14(net_stream_dir)) >> 14);
+  deast = dlong - (((long)dist * IntCosineDeg14(90 - (int)net_stream_dir)) >> 14);
+  if ((ABS(dnorth) > maxdev) || (ABS(deast) > maxdev))
+    return TRUE;
+  return (dnorth * dnorth + deast * deast > (long)maxdev * maxdev);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// net_stream_sent()
+// The current location has been sent: make it the prediction base for
+// net_stream_due().
+//
+void net_stream_sent(void)
+  {
+  net_stream_time = car_time;
+  net_stream_lat = car_latitude;
+  net_stream_lon = car_longitude;
+  net_stream_dir = car_direction;
+  net_stream_speed = car_speed;
+  net_stream_cos = IntCosineLat14(car_latitude);
+  }
+
 ////////////////////////////////////////////////////////////////////////
 // net_state_ticker30()
 // State Model: 30-second ticker
@@ -1378,10 +1954,7 @@ void net_state_ticker30(void)
         }
       if ((net_granular_tick % 60) != 0)
         {
-        delay100(2);
         net_puts_rom(NET_CREG_CIPSTATUS);
-        while(vUARTIntTxBufDataCnt>0) { delay100(1); } // Wait for TX flush
-        delay100(2); // Wait for stable result
         }
       break;
     }
@@ -1408,16 +1981,16 @@ void net_state_ticker60(void)
   if (car_12vline == 0)
   {
     // first reading:
-    car_12vline = inputs_voltage()*10;
+    car_12vline = inputs_voltage();
     car_12vline_ref = 0;
   }
   else
   {
     // filter peaks/misreadings:
-    car_12vline = ((int)car_12vline + (int)(inputs_voltage()*10) + 1) / 2;
+    car_12vline = ((int)car_12vline + (int)inputs_voltage() + 1) / 2;
 
     // OR direct reading to test A/D converter fix: (failed...)
-    //car_12vline = inputs_voltage()*10;
+    //car_12vline = inputs_voltage();
   }
 
   // Calibration: take reference voltage after charging
@@ -1485,7 +2058,6 @@ void net_state_ticker60(void)
 #ifdef OVMS_LOGGINGMODULE
       if ((net_link==1)&&(logging_haspending() > 0))
         {
-        delay100(10);
         net_msg_start();
         logging_sendpending();
         net_msg_send();
@@ -1494,7 +2066,6 @@ void net_state_ticker60(void)
 #endif // #ifdef OVMS_LOGGINGMODULE
       if ((net_link==1)&&(net_apps_connected>0))
         {
-        delay100(10);
         stat = 2;
         p = par_get(PARAM_S_GROUP1);
         if (*p != 0) stat = net_msgp_group(stat,1,p);
@@ -1553,11 +2124,9 @@ void net_state_ticker600(void)
         {
         if (net_socalert_msg==0)
           {
-          if ((net_link==1)&&(net_msg_sendpending==0))
-            {
-            if (net_fnbits & NET_FN_SOCMONITOR) net_msg_socalert();
-            net_socalert_msg = 72; // 72x10mins = 12hours
-            }
+          // Sent or queued until the server is available:
+          if (net_fnbits & NET_FN_SOCMONITOR) net_msg_socalert();
+          net_socalert_msg = 72; // 72x10mins = 12hours
           }
         else
           net_socalert_msg--;
@@ -1662,6 +2231,7 @@ void net_ticker(void)
 
   if (net_notify_suppresscount>0) net_notify_suppresscount--;
   net_granular_tick++;
+  if (net_msg_sendsecs < 0xff) net_msg_sendsecs++;
   if ((net_timeout_goto > 0)&&(net_timeout_ticks-- == 0))
     {
     net_state_enter(net_timeout_goto);
@@ -1716,6 +2286,7 @@ void net_initialise(void)
   // I/O configuration PORT C
   TRISC = 0x80; // Port C RC0-6 output, RC7 input
   UARTIntInit();
+  net_uart_baud(NET_BAUD_9600);
 
   net_reg = 0;
   net_state_enter(NET_STATE_FIRSTRUN);
@@ -35,6 +35,13 @@
 #define NET_TEL_MAX 20
 #define NET_GPRS_RETRIES 10
 #define NET_RXDATA_TIMEOUT 1800
+#define NET_STREAM_DEV 25     // Default max deviation from the predicted track (m)
+#define NET_STREAM_MAXINT 30  // Default max location streaming interval (s)
+
+// Internal GPS NMEA output (AT+CGPSOUT), sentence mask as for AT+CGPSINF:
+#define NET_GPS_NMEAMASK "66" // GGA (2) + VTG (64), once per second
+#define NET_GPS_NMEA_TIMEOUT 3 // Poll if no NMEA position for N seconds
+#define NET_GPS_NMEA_RETRY 30 // Request the NMEA output again every N seconds
 
 // NET_BUF_MODES
 #define NET_BUF_IPD          0xfd  // net_buf is waiting on IPD data
@@ -53,6 +60,7 @@
 #define NET_STATE_DOINIT     0x10  // Initialise the GSM network - SIM card check
 #define NET_STATE_DOINIT2    0x11  // Initialise the GSM network - SIM PIN check
 #define NET_STATE_DOINIT3    0x12  // Initialise the GSM network - Full Init
+#define NET_STATE_DOINITBAUD 0x13  // Initialise the GSM network - Fast baud rate
 #define NET_STATE_READY      0x20  // READY and handling calls
 #define NET_STATE_COPS       0x21  // GSM COPS carrier selection
 #define NET_STATE_COPSSETTLE 0x22  // GSM COPS wait for settle after lock
@@ -98,6 +106,46 @@
 #define NETINIT_CIPSTART     7
 #define NETINIT_CONNECTING   8
 
+// Modem baud rates (net_baud), see net_bauds[] in net.c
+#define NET_BAUD_9600        0     // Start up rate, and fallback
+#define NET_BAUD_57600       1
+#define NET_BAUD_115200      2
+#define NET_BAUD_MAX         NET_BAUD_115200
+
+// DOINITBAUD sub-states
+#define NETBAUD_SET          0     // AT+IPR=<rate> sent at 9600 baud
+#define NETBAUD_CHECK        1     // AT sent at the new rate
+#define NETBAUD_REVERT       2     // AT+IPR=9600 sent blind, AT sent at 9600 baud
+
+// Modem response lines recognised by net_urc(), see net_urcs[] in net.c
+#define NET_URC_NONE         0     // Anything else
+#define NET_URC_CFUN         1     // +CFUN:
+#define NET_URC_CLIP         2     // +CLIP
+#define NET_URC_CMEERROR     3     // +CME ERROR
+#define NET_URC_COPS         4     // +COPS:
+#define NET_URC_CPBF         5     // +CPBF:
+#define NET_URC_CPIN         6     // +CPIN
+#define NET_URC_CREG         7     // +CREG
+#define NET_URC_CSMINS       8     // +CSM(INS)
+#define NET_URC_CSQ          9     // +CSQ:
+#define NET_URC_CUSD         10    // +CUSD:
+#define NET_URC_IPR          11    // +IPR
+#define NET_URC_PDPDEACT     12    // +PDP: DEACT
+#define NET_URC_GPSGGA       13    // 2, (AT+CGPSINF=2)
+#define NET_URC_GPSVTG       14    // 64, (AT+CGPSINF=64)
+#define NET_URC_CLOSED       15    // CLOSED
+#define NET_URC_CONNECTFAIL  16    // CONNECT FAIL
+#define NET_URC_CONNECTOK    17    // CONNECT OK
+#define NET_URC_DATAACCEPT   18    // DATA ACCEPT
+#define NET_URC_ERROR        19    // ERROR
+#define NET_URC_OK           20    // OK
+#define NET_URC_RDY          21    // RDY
+#define NET_URC_SENDFAIL     22    // SEND FAIL
+#define NET_URC_SENDOK       23    // SEND OK
+#define NET_URC_SETUP        24    // SETUP (DIAG mode request)
+#define NET_URC_SHUTOK       25    // SHUT OK
+#define NET_URC_STATE        26    // STATE: (AT+CIPSTATUS)
+
 // NET data
 extern unsigned char net_state;                // The current state
 extern unsigned char net_state_vchar;          //   A per-state CHAR variable
@@ -109,6 +157,9 @@ extern unsigned int  net_granular_tick;        // An internal ticker used to gen
 extern unsigned int  net_watchdog;             // Second count-down for network connectivity
 extern unsigned int  net_timeout_rxdata;       // Second count-down for RX data timeout
 extern char net_caller[NET_TEL_MAX];           // The telephone number of the caller
+extern unsigned char net_baud;                 // Modem baud rate (NET_BAUD_*)
+extern rom unsigned long net_bauds[];          // ...in baud
+extern unsigned char net_baud_max;             // Fastest rate to negotiate
 
 extern unsigned char net_buf_pos;              // Current position (aka length) in the network buffer
 extern unsigned char net_buf_mode;             // Mode of the buffer (CRLF, SMS or MSG)
@@ -132,6 +183,10 @@ extern unsigned char net_fnbits;               // Net functionality bits
 // The idea is that requesters set these bits, and notifiers clear them.
 extern unsigned int  net_notify_errorcode;     // An error code to be notified
 extern unsigned long net_notify_errordata;     // Ancilliary data
+#define NET_NOTIFY_ERRQ 2                      // Superseded errors kept for dispatch
+extern unsigned int  net_notify_errqcode[NET_NOTIFY_ERRQ];
+extern unsigned long net_notify_errqdata[NET_NOTIFY_ERRQ];
+extern unsigned char net_notify_errqn;
 extern unsigned int  net_notify_lasterrorcode; // Last error code to be notified
 extern unsigned char net_notify_lastcount;     // A counter used to clear error codes
 extern unsigned int  net_notify;               // Bitmap of notifications outstanding
@@ -164,13 +219,17 @@ extern unsigned char net_notify_suppresscount; // To suppress STAT notifications
 
 extern char net_scratchpad[NET_BUF_MAX];
 
+unsigned char net_urc(const char *line);
 void net_puts_rom(static const rom char *data);
 void net_puts_ram(const char *data);
 void net_putc_ram(const char data);
+unsigned char net_rx_mark(void);
+BOOL net_rx_wait(static const rom char *s, unsigned char n, unsigned char mark);
 
 void net_initialise(void);
 void net_poll(void);
 void net_reset_async(void);
+void net_uart_baud(unsigned char baud);
 void net_ticker(void);
 void net_ticker10th(void);
 
@@ -178,7 +237,18 @@ void net_state_enter(unsigned char);
 void net_state_activity(void);
 void net_state_ticker(void);
 
+void net_notify_errq_pop(void);
+void net_notify_errq_push(unsigned int errorcode, unsigned long errordata);
 void net_req_notification_error(unsigned int errorcode, unsigned long errordata);
 void net_req_notification(unsigned int notify);
+void net_notify_dispatch(void);
+BOOL net_stream_due(void);
+void net_stream_sent(void);
+#ifdef OVMS_INTERNALGPS
+BOOL net_gps_gga(char *s);
+BOOL net_gps_vtg(char *s);
+void net_gps_nmea(char *s);
+void net_gps_ticker(void);
+#endif
 
 #endif // #ifndef __OVMS_NET_H
\ No newline at end of file
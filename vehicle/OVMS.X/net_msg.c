@@ -51,6 +51,16 @@
 #pragma udata
 char net_msg_serverok = 0;
 char net_msg_sendpending = 0;
+char net_msg_sending = 0;            // Between net_msg_start() and net_msg_send()
+unsigned char net_msg_deferred = 0;  // Alerts raised during a send (NET_MSG_DEFER_*)
+unsigned char net_msg_sendmark = 0;  // Async input position at the last Ctrl-Z
+unsigned int net_msg_sendlen = 0;    // Bytes sent in the current CIPSEND block
+unsigned char net_msg_txshort = 0;   // CIPSEND blocks not fully accepted by the modem
+unsigned int net_msg_sendtime = 0;   // TMR0 at the data prompt of the current block
+unsigned char net_msg_sendsecs = 0;  // TMR0 resets (seconds) since net_msg_sendtime
+unsigned char net_msg_sendskip = 0;  // A DATA ACCEPT of an earlier block is due
+unsigned long net_msg_txbytes = 0;   // Link rate measurement: bytes...
+unsigned long net_msg_txticks = 0;   // ...and their time, prompt to DATA ACCEPT (TMR0)
 char token[23] = {0};
 char ptoken[23] = {0};
 char ptokenmade = 0;
@@ -65,9 +75,65 @@ WORD crc_group1 = 0;
 WORD crc_group2 = 0;
 WORD crc_capabilities = 0;
 
+// Delta status messages (FEATURE_OI_DELTAMSG): per record, [0] is the
+// number of deltas sent since the last full record, followed by the
+// CRC16 of each field as last sent.
+#pragma udata NETMSG_DELTA
+WORD delta_stat[NET_MSG_DELTA_STAT+1];
+WORD delta_gps[NET_MSG_DELTA_GPS+1];
+WORD delta_tpms[NET_MSG_DELTA_TPMS+1];
+WORD delta_environment[NET_MSG_DELTA_ENVIRONMENT+1];
+#pragma udata
+
+// Outbound message queue (OVMS_MSGQUEUE): net_msg_q holds net_msg_qcount
+// entries of [length][priority][message without "MP-0 "], oldest first.
+unsigned char net_msg_qcount = 0;                 // Entries queued
+unsigned char net_msg_qused = 0;                  // Bytes used
+unsigned char net_msg_qhighwater = 0;             // Max bytes used since last report
+unsigned char net_msg_qdrops[NET_MSG_Q_PRIOS];    // Messages lost, per priority
+
+// GPS track batch (FEATURE_OI_TRACKMSG): net_msg_track_n fixes encoded
+// in net_msg_track, net_msg_track_last holds the last fix as delta base.
+unsigned char net_msg_track_n = 0;
+unsigned char net_msg_track_len = 0;
+long net_msg_track_last[NET_MSG_TRACK_FIELDS];
+#pragma udata NETMSG_TRK
+char net_msg_track[NET_MSG_TRACK_SIZE+1];
+#pragma udata
+
 #pragma udata NETMSG_SP
 char net_msg_scratchpad[NET_BUF_MAX];
 #pragma udata
+#ifdef OVMS_MSGQUEUE
+#pragma udata NETMSG_Q
+unsigned char net_msg_q[NET_MSG_Q_SIZE];
+#pragma udata
+#endif // #ifdef OVMS_MSGQUEUE
+
+// Streaming encoder state (net_msg_encode_*)
+unsigned char net_msg_enc_pos;                    // Message bytes seen, up to the code
+unsigned char net_msg_enc_n;                      // Bytes in net_msg_enc_in
+unsigned char net_msg_enc_in[3], net_msg_enc_out[4];
+unsigned char net_msg_enc_pm;                     // 1 = paranoid conversion active
+unsigned char net_msg_enc_pm_n;                   // Bytes in net_msg_enc_pm_in
+unsigned char net_msg_enc_pm_in[3], net_msg_enc_pm_out[4];
+
+// Streamed record state (net_msg_rec_*)
+char net_msg_rec[NET_MSG_REC_MAX];                // Piece of the record
+char net_msg_rec_stat;                            // Result <stat> of the record
+unsigned char net_msg_rec_pass = 0;               // NET_MSG_REC_*
+WORD *net_msg_rec_oldcrc;                         // Record CRC as last sent
+WORD *net_msg_rec_delta;                          // Delta tracking (NULL = none)
+unsigned char net_msg_rec_fields;                 // Fields tracked in net_msg_rec_delta
+unsigned long net_msg_rec_changed;                // Fields changed (bits)
+unsigned int net_msg_rec_len;                     // Record length
+unsigned int net_msg_rec_dlen;                    // Length of the changed fields
+unsigned char net_msg_rec_dirty;                  // Scan: send in full, else: resend
+WORD net_msg_rec_crc;                             // Record CRC so far
+WORD net_msg_rec_fcrc;                            // Field CRC so far
+unsigned int net_msg_rec_flen;                    // Field length so far
+unsigned char net_msg_rec_f;                      // Field number
+char net_msg_rec_code;                            // Record code ("MP-0 <code>")
 
 #pragma udata Q_CMD
 int  net_msg_cmd_code = 0;
@@ -79,10 +145,18 @@ RC4_CTX2 tx_crypto2;
 RC4_CTX2 rx_crypto2;
 #pragma udata PM_CRYPTO
 RC4_CTX2 pm_crypto2;
+#ifdef OVMS_PMPRIMED
+#pragma udata PM_PRIMED
+RC4_CTX2 pm_primed2;
+#endif // #ifdef OVMS_PMPRIMED
 #pragma udata
 RC4_CTX1 tx_crypto1;
 RC4_CTX1 rx_crypto1;
 RC4_CTX1 pm_crypto1;
+#ifdef OVMS_PMPRIMED
+RC4_CTX1 pm_primed1;
+char pm_primed = 0;  // 1 = pm_primed holds the primed cipher for pdigest
+#endif // #ifdef OVMS_PMPRIMED
 
 rom char NET_MSG_CMDRESP[] = "MP-0 c";
 rom char NET_MSG_CMDOK[] = ",0";
@@ -102,91 +176,438 @@ void net_msg_init(void)
 void net_msg_disconnected(void)
   {
   net_msg_serverok = 0;
+  net_msg_sending = 0;
+  }
+
+// If the last block has not been acknowledged yet, give the modem up
+// to 500ms to accept it before the next command. Its DATA ACCEPT is
+// then not taken for the next block by net_msg_txtime().
+void net_msg_wait(void)
+  {
+  if (net_msg_sendpending > 0)
+    {
+    net_rx_wait("DATA ACCEPT", 5, net_msg_sendmark);
+    net_msg_sendskip = 1;
+    }
   }
 
 // Start to send a net msg
 void net_msg_start(void)
   {
+  unsigned char mark, x;
+
   if (net_state == NET_STATE_DIAGMODE)
     {
     net_puts_rom("# ");
     }
   else
     {
+    // Let the modem finish the last block or SMS, then wait (max 1s)
+    // for the data prompt
+    net_msg_wait();
+    net_sms_wait();
     net_msg_sendpending = 1;
-    delay100(5);
+    net_msg_sending = 1;
+    net_msg_sendlen = 0;
+    mark = net_rx_mark();
     net_puts_rom("AT+CIPSEND\r");
-    delay100(10);
+    net_rx_wait(">", 10, mark);
+    x = TMR0L; // Read TMR0L first to latch TMR0H
+    net_msg_sendtime = ((unsigned int)TMR0H << 8) + x;
+    net_msg_sendsecs = 0;
     }
   }
 
+// The modem has accepted the current block (DATA ACCEPT): add it to
+// the link rate measurement, unless it took more than a second
+void net_msg_txtime(void)
+  {
+  unsigned int now;
+  unsigned long t;
+  unsigned char x;
+
+  if (net_msg_sendskip)
+    {
+    net_msg_sendskip = 0; // The DATA ACCEPT of an earlier block
+    return;
+    }
+  x = TMR0L; // Read TMR0L first to latch TMR0H
+  now = ((unsigned int)TMR0H << 8) + x;
+  if ((net_msg_sendsecs > 1)||((net_msg_sendsecs == 0)&&(now < net_msg_sendtime)))
+    return;
+  t = (unsigned long)net_msg_sendsecs * 0x4c00 + now; // TMR0 is reset at 0x4c00
+  t -= net_msg_sendtime;
+  net_msg_txbytes += net_msg_sendlen;
+  net_msg_txticks += (t > 0) ? t : 1;
+  if (net_msg_txbytes > 20000)
+    {
+    // Let older blocks fade out
+    net_msg_txbytes >>= 1;
+    net_msg_txticks >>= 1;
+    }
+  }
+
+// Measured modem link rate in byte/s, 0 = no block measured yet
+unsigned int net_msg_txrate(void)
+  {
+  if (net_msg_txticks == 0)
+    return 0;
+  return (unsigned int)((net_msg_txbytes * 19531) / net_msg_txticks); // 51.2uS ticks
+  }
+
 // Finish sending a net msg
 void net_msg_send(void)
   {
+  unsigned char deferred;
+
   if (net_state == NET_STATE_DIAGMODE)
     {
     net_puts_rom("\r\n");
     }
   else
     {
+    net_msg_sendmark = net_rx_mark();
     net_puts_rom("\x1a");
     }
+  net_msg_sending = 0;
+
+  // Queue the alerts raised during the send (net_msg_sendpending is set):
+  deferred = net_msg_deferred;
+  net_msg_deferred = 0;
+  if (deferred & NET_MSG_DEFER_ALARM) net_msg_alarm();
+  if (deferred & NET_MSG_DEFER_VALETTRUNK) net_msg_valettrunk();
+  if (deferred & NET_MSG_DEFER_SOCALERT) net_msg_socalert();
+  if (deferred & NET_MSG_DEFER_12VALERT) net_msg_12v_alert();
   }
 
-// Encode the message in net_scratchpad and start the send process
-void net_msg_encode_puts(void)
+#ifdef OVMS_MSGQUEUE
+// Remove the queue entry at offset pos
+void net_msg_queue_remove(unsigned char pos)
+  {
+  unsigned char len = net_msg_q[pos] + 2;
+
+  memmove(net_msg_q+pos, net_msg_q+pos+len, net_msg_qused-pos-len);
+  net_msg_qused -= len;
+  net_msg_qcount--;
+  }
+#endif // #ifdef OVMS_MSGQUEUE
+
+// Queue the message in net_scratchpad ("MP-0 ..." form, not yet encoded),
+// to be sent by net_msg_queue_send() once the server is available.
+// If the queue is full, the oldest entries of the lowest evictable priority
+// below prio make room, else the message is dropped. Returns FALSE if the
+// message has been dropped.
+BOOL net_msg_queue(unsigned char prio)
+  {
+#ifdef OVMS_MSGQUEUE
+  unsigned char pos, victim, vprio;
+  unsigned int len = strlen(net_scratchpad+5);
+
+  if ((len+2) <= NET_MSG_Q_SIZE)
+    {
+    while ((net_msg_qused+len+2) > NET_MSG_Q_SIZE)
+      {
+      victim = 0xff;
+      vprio = NET_MSG_Q_LOG;
+      for (pos=0; pos<net_msg_qused; pos+=net_msg_q[pos]+2)
+        {
+        if ((net_msg_q[pos+1] < vprio) && (net_msg_q[pos+1] < prio))
+          {
+          vprio = net_msg_q[pos+1];
+          victim = pos;
+          }
+        }
+      if (victim == 0xff)
+        break; // Nothing we may evict
+      if (net_msg_qdrops[vprio] < 0xff) net_msg_qdrops[vprio]++;
+      net_msg_queue_remove(victim);
+      }
+
+    if ((net_msg_qused+len+2) <= NET_MSG_Q_SIZE)
+      {
+      pos = net_msg_qused;
+      net_msg_q[pos] = len;
+      net_msg_q[pos+1] = prio;
+      memcpy(net_msg_q+pos+2, net_scratchpad+5, len);
+      net_msg_qused += len+2;
+      net_msg_qcount++;
+      if (net_msg_qused > net_msg_qhighwater)
+        net_msg_qhighwater = net_msg_qused;
+      return TRUE;
+      }
+    }
+#endif // #ifdef OVMS_MSGQUEUE
+
+  if (net_msg_qdrops[prio] < 0xff) net_msg_qdrops[prio]++;
+  return FALSE;
+  }
+
+// Send the queued messages, highest priority first (oldest first within
+// a priority), if the server is available. As many as fit are coalesced
+// into one CIPSEND block. Returns TRUE if messages have been sent.
+BOOL net_msg_queue_send(void)
+  {
+#ifdef OVMS_MSGQUEUE
+  unsigned char pos, best, len;
+
+  if ((net_msg_qcount == 0) || (net_msg_serverok == 0) || (net_msg_sendpending > 0)
+      || (net_msg_sending))
+    return FALSE;
+
+  net_msg_start();
+  while (net_msg_qcount > 0)
+    {
+    best = 0;
+    for (pos=net_msg_q[0]+2; pos<net_msg_qused; pos+=net_msg_q[pos]+2)
+      {
+      if (net_msg_q[pos+1] > net_msg_q[best+1])
+        best = pos;
+      }
+
+    // Worst case encoded size (paranoid mode: base64 twice) must fit:
+    len = net_msg_q[best];
+    if ((net_msg_sendlen > 0) &&
+        ((net_msg_sendlen + ((unsigned int)len+8)*2) > NET_MSG_CIPSEND_MAX))
+      break;
+
+    net_msg_encode_start();
+    net_msg_encode_rom("MP-0 ");
+    for (pos=best+2; len>0; len--)
+      net_msg_encode_putc(net_msg_q[pos++]);
+    net_msg_encode_end();
+    net_msg_queue_remove(best);
+    }
+  net_msg_send();
+  return TRUE;
+#else
+  return FALSE;
+#endif // #ifdef OVMS_MSGQUEUE
+  }
+
+/* Queue statistics, queued once per server connection if the queue has
+ * been used or messages have been lost since the last report:
+ *
+ * MP-0 H*-OVM-MsgQueue,0,2592000,<entries>,<bytes>,<max bytes>
+ *  ,<lost alerts>,<lost logs>,<lost status>,<lost stream>
+ */
+void net_msg_queue_report(void)
+  {
+#ifdef OVMS_MSGQUEUE
+  char *s;
+  unsigned char x, lost = 0;
+
+  for (x=0; x<NET_MSG_Q_PRIOS; x++)
+    lost |= net_msg_qdrops[x];
+  if ((net_msg_qhighwater == 0) && (lost == 0))
+    return;
+
+  s = stp_i(net_scratchpad, "MP-0 H*-OVM-MsgQueue,0,2592000,", net_msg_qcount);
+  s = stp_i(s, ",", net_msg_qused);
+  s = stp_i(s, ",", net_msg_qhighwater);
+  for (x=NET_MSG_Q_PRIOS; x>0; x--)
+    s = stp_i(s, ",", net_msg_qdrops[x-1]);
+
+  if (net_msg_queue(NET_MSG_Q_STATUS))
+    {
+    net_msg_qhighwater = 0;
+    memset(net_msg_qdrops, 0, sizeof(net_msg_qdrops));
+    }
+#endif // #ifdef OVMS_MSGQUEUE
+  }
+
+// Send the message in net_scratchpad now if the server is available and
+// nothing is queued before it, else queue it. Returns FALSE if dropped.
+// The alert builders do not run while net_msg_sending is set: CAN
+// handlers run from net_rx_wait() in the middle of a send, and anything
+// they formatted would overwrite the message in net_scratchpad. They
+// are deferred (net_msg_deferred) and queued by net_msg_send().
+BOOL net_msg_post(unsigned char prio)
+  {
+  if ((net_msg_serverok == 1) && (net_msg_sendpending == 0) && (net_msg_qcount == 0))
+    {
+    net_msg_start();
+    net_msg_encode_puts();
+    net_msg_send();
+    return TRUE;
+    }
+
+  return net_msg_queue(prio);
+  }
+
+// Prepare pm_crypto for a new paranoid mode message: RC4 keyed with
+// pdigest and the first 1024 bytes of keystream discarded.
+// With OVMS_PMPRIMED, this is done once per pdigest and then restored
+// from the primed copy.
+void net_msg_pm_setup(void)
   {
   int k;
-  char code;
+  unsigned char discard;
+
+#ifdef OVMS_PMPRIMED
+  if (pm_primed)
+    {
+    pm_crypto1 = pm_primed1;
+    memcpy((void*)&pm_crypto2, (void*)&pm_primed2, sizeof(RC4_CTX2));
+    return;
+    }
+#endif // #ifdef OVMS_PMPRIMED
+
+  RC4_setup(&pm_crypto1, &pm_crypto2, pdigest, MD5_SIZE);
+  for (k=0;k<1024;k++)
+    {
+    discard = 0;
+    RC4_crypt(&pm_crypto1, &pm_crypto2, &discard, 1);
+    }
 
+#ifdef OVMS_PMPRIMED
+  pm_primed1 = pm_crypto1;
+  memcpy((void*)&pm_primed2, (void*)&pm_crypto2, sizeof(RC4_CTX2));
+  pm_primed = 1;
+#endif // #ifdef OVMS_PMPRIMED
+  }
+
+// Streaming message encoder:
+// The message text ("MP-0 X...") is passed through in one go: the paranoid
+// mode conversion (RC4 pm_crypto, base64) if needed, then RC4 tx_crypto
+// and base64 straight to the modem, three bytes at a time. There's no
+// intermediate buffer, so there's no limit on the message length other
+// than the CIPSEND block size.
+//   net_msg_encode_start();
+//   net_msg_encode_rom("MP-0 ...") / _ram() / _putc() ...
+//   net_msg_encode_end();
+
+// Outer stage: encrypt with tx_crypto, base64 encode & output, per block
+void net_msg_encode_tx(unsigned char c)
+  {
+  unsigned char k;
+
+  net_msg_enc_in[net_msg_enc_n++] = c;
+  if (net_msg_enc_n == 3)
+    {
+    RC4_crypt(&tx_crypto1, &tx_crypto2, net_msg_enc_in, 3);
+    encodeblock(net_msg_enc_in, net_msg_enc_out, 3);
+    for (k=0;k<4;k++) net_putc_ram(net_msg_enc_out[k]);
+    net_msg_sendlen += 4;
+    net_msg_enc_n = 0;
+    }
+  }
+
+// Inner stage (paranoid mode): encrypt with pm_crypto, base64 encode
+// into the outer stage, per block
+void net_msg_encode_pm(unsigned char c)
+  {
+  unsigned char k;
+
+  net_msg_enc_pm_in[net_msg_enc_pm_n++] = c;
+  if (net_msg_enc_pm_n == 3)
+    {
+    RC4_crypt(&pm_crypto1, &pm_crypto2, net_msg_enc_pm_in, 3);
+    encodeblock(net_msg_enc_pm_in, net_msg_enc_pm_out, 3);
+    for (k=0;k<4;k++) net_msg_encode_tx(net_msg_enc_pm_out[k]);
+    net_msg_enc_pm_n = 0;
+    }
+  }
+
+void net_msg_encode_start(void)
+  {
+  net_msg_enc_pos = 0;
+  net_msg_enc_n = 0;
+  net_msg_enc_pm = 0;
+  net_msg_enc_pm_n = 0;
+  }
+
+void net_msg_encode_putc(char c)
+  {
   if (net_state == NET_STATE_DIAGMODE)
     {
-    net_puts_ram(net_scratchpad);
+    net_putc_ram(c);
+    return;
     }
-  else
+
+  if (net_msg_enc_pm)
+    {
+    net_msg_encode_pm(c);
+    return;
+    }
+
+  if (net_msg_enc_pos < 5)
+    net_msg_enc_pos++;
+  else if (net_msg_enc_pos == 5)
     {
+    // This is the message code of "MP-0 X..."
+    net_msg_enc_pos++;
     if ((ptokenmade==1)&&
-        (net_scratchpad[5]!='E')&&
-        (net_scratchpad[5]!='A')&&
-        (net_scratchpad[5]!='a')&&
-        (net_scratchpad[5]!='g')&&
-        (net_scratchpad[5]!='P'))
+        (c!='E')&&
+        (c!='A')&&
+        (c!='a')&&
+        (c!='g')&&
+        (c!='P'))
       {
-      // We must convert the message to a paranoid one...
-      // The message in net_scratchpad is of the form MP-0 X...
-      // Where X is the code and ... is the (optional) data
-      // Let's rebuild it in the net_msg_scratchpad...
-      code = net_scratchpad[5];
-      strcpy(net_msg_scratchpad,net_scratchpad+6);
-
-      // Paranoid encrypt the message part of the transaction
-      RC4_setup(&pm_crypto1, &pm_crypto2, pdigest, MD5_SIZE);
-      for (k=0;k<1024;k++)
-        {
-        net_scratchpad[0] = 0;
-        RC4_crypt(&pm_crypto1, &pm_crypto2, net_scratchpad, 1);
-        }
-      k=strlen(net_msg_scratchpad);
-      RC4_crypt(&pm_crypto1, &pm_crypto2, net_msg_scratchpad, k);
-
-      strcpypgm2ram(net_scratchpad,(char const rom far*)"MP-0 EM");
-      net_scratchpad[7] = code;
-      base64encode(net_msg_scratchpad,k,net_scratchpad+8);
-      // The messdage is now in paranoid mode...
+      // We must convert the message to a paranoid one:
+      // "MP-0 EM" X base64(pm_crypto(...))
+      net_msg_encode_tx('E');
+      net_msg_encode_tx('M');
+      net_msg_encode_tx(c);
+      net_msg_pm_setup();
+      net_msg_enc_pm = 1;
+      return;
       }
+    }
+
+  net_msg_encode_tx(c);
+  }
+
+void net_msg_encode_ram(const char *s)
+  {
+  while (*s != 0)
+    net_msg_encode_putc(*s++);
+  }
+
+void net_msg_encode_rom(static const rom char *s)
+  {
+  while (*s != 0)
+    net_msg_encode_putc(*s++);
+  }
+
+void net_msg_encode_end(void)
+  {
+  unsigned char k;
 
-    k=strlen(net_scratchpad);
-    RC4_crypt(&tx_crypto1, &tx_crypto2, net_scratchpad, k);
-    base64encodesend(net_scratchpad,k);
+  if (net_state != NET_STATE_DIAGMODE)
+    {
+    if ((net_msg_enc_pm)&&(net_msg_enc_pm_n > 0))
+      {
+      RC4_crypt(&pm_crypto1, &pm_crypto2, net_msg_enc_pm_in, net_msg_enc_pm_n);
+      for (k=net_msg_enc_pm_n;k<3;k++) net_msg_enc_pm_in[k] = 0;
+      encodeblock(net_msg_enc_pm_in, net_msg_enc_pm_out, net_msg_enc_pm_n);
+      for (k=0;k<4;k++) net_msg_encode_tx(net_msg_enc_pm_out[k]);
+      }
+    if (net_msg_enc_n > 0)
+      {
+      RC4_crypt(&tx_crypto1, &tx_crypto2, net_msg_enc_in, net_msg_enc_n);
+      for (k=net_msg_enc_n;k<3;k++) net_msg_enc_in[k] = 0;
+      encodeblock(net_msg_enc_in, net_msg_enc_out, net_msg_enc_n);
+      for (k=0;k<4;k++) net_putc_ram(net_msg_enc_out[k]);
+      net_msg_sendlen += 4;
+      }
+    net_msg_sendlen += 2;
     }
 
   net_puts_rom("\r\n");
   }
 
+// Encode the message in net_scratchpad and start the send process
+void net_msg_encode_puts(void)
+  {
+  net_msg_encode_start();
+  net_msg_encode_ram(net_scratchpad);
+  net_msg_encode_end();
+  }
+
 // Register to the NET OVMS server
 void net_msg_register(void)
   {
-  char k;
+  unsigned char k;
   char *p;
   unsigned int sr;
 
@@ -268,107 +689,461 @@ char net_msg_encode_statputs(char stat, WORD *oldcrc)
   return stat;
 }
 
+// Delta status messages
+//
+// With FEATURE_OI_DELTAMSG set, a changed S/L/W/D record is sent as
+//   MP-0 X<code><bitmap>,<field>,<field>...,<crc>
+// where <bitmap> is the hex mask of the fields that have changed (bit 0 =
+// first field) and only those fields follow. The server merges them into
+// its last full record, and checks the result against <crc>, the crc16()
+// of the full record "MP-0 <code>..." (4 hex digits): a changed field with
+// an unchanged CRC would otherwise go unnoticed. A full record is sent
+// instead when it is explicitly requested (stat=0), in paranoid mode (the
+// server can't merge), after a (re)connect or a track batch (the server
+// updates the location from it), every NET_MSG_DELTA_FULL deltas, or if
+// it is shorter anyway.
+
+// Mark all records to be sent in full next time (e.g. on server connect)
+void net_msg_delta_reset(void)
+  {
+  delta_stat[0] = NET_MSG_DELTA_FULL;
+  delta_gps[0] = NET_MSG_DELTA_FULL;
+  delta_tpms[0] = NET_MSG_DELTA_FULL;
+  delta_environment[0] = NET_MSG_DELTA_FULL;
+  }
+
+// Streamed records
+//
+// The net_msgp_* builders format their record piecewise into net_msg_rec
+// (max NET_MSG_REC_MAX-1 characters per piece) and pass each piece to
+// net_msg_rec_put(), which returns net_msg_rec for the next one:
+//
+//   net_msg_rec_start(stat, &crc, delta, fields);
+//   do
+//     {
+//     s = stp_i(net_msg_rec, "MP-0 S", car_SOC);
+//     s = stp_i(s, ",", ...);
+//     s = net_msg_rec_put(s);
+//     ...
+//     net_msg_rec_put(s);
+//     } while (net_msg_rec_next());
+//   return net_msg_rec_stat;
+//
+// The first pass only computes the record CRC (and the field CRCs for a
+// delta tracked record, delta != NULL). If the record is to be sent, the
+// second pass streams it to the encoder: in full, or as a delta record
+// with just the changed fields. There's no limit on the record length.
+// Outside of a record, net_msg_rec_put() passes the piece to the encoder
+// as is, so one-off messages can be streamed the same way between
+// net_msg_encode_start() and net_msg_encode_end().
+
+#define NET_MSG_REC_PLAIN   0            // Not in a record: pass through
+#define NET_MSG_REC_SCAN    1            // First pass: CRCs only
+#define NET_MSG_REC_FULL    2            // Second pass: full record
+#define NET_MSG_REC_DELTA   3            // Second pass: changed fields only
+
+// End of field net_msg_rec_f: note / store its CRC
+void net_msg_rec_field(void)
+  {
+  unsigned char f = net_msg_rec_f++;
+  BOOL changed;
+
+  if (net_msg_rec_delta == NULL)
+    return;
+  if (f >= net_msg_rec_fields)
+    {
+    if (net_msg_rec_pass != NET_MSG_REC_FULL)
+      net_msg_rec_dirty = 1; // Record too long to track
+    return;
+    }
+
+  changed = (net_msg_rec_delta[f+1] != net_msg_rec_fcrc);
+  if (net_msg_rec_pass == NET_MSG_REC_SCAN)
+    {
+    if (changed)
+      {
+      net_msg_rec_changed |= (1UL << f);
+      net_msg_rec_dlen += net_msg_rec_flen + 1;
+      }
+    }
+  else if ((net_msg_rec_pass == NET_MSG_REC_FULL) || (net_msg_rec_changed & (1UL << f)))
+    net_msg_rec_delta[f+1] = net_msg_rec_fcrc;
+  else if (changed)
+    net_msg_rec_dirty = 1; // Changed since the first pass, but not sent
+  }
+
+void net_msg_rec_start(char stat, WORD *oldcrc, WORD *delta, unsigned char fields)
+  {
+  net_msg_rec_stat = stat;
+  net_msg_rec_oldcrc = oldcrc;
+  net_msg_rec_delta = delta;
+  net_msg_rec_fields = fields;
+  net_msg_rec_pass = NET_MSG_REC_SCAN;
+  net_msg_rec_changed = 0;
+  net_msg_rec_dlen = 0;
+  net_msg_rec_len = 0;
+  net_msg_rec_dirty = 0;
+  net_msg_rec_crc = 0xffff;
+  net_msg_rec_fcrc = 0xffff;
+  net_msg_rec_flen = 0;
+  net_msg_rec_f = 0;
+  }
+
+char *net_msg_rec_put(char *s)
+  {
+  char *p, c;
+
+  *s = 0;
+  for (p = net_msg_rec; (c = *p) != 0; p++)
+    {
+    if (net_msg_rec_pass == NET_MSG_REC_PLAIN)
+      {
+      net_msg_encode_putc(c);
+      continue;
+      }
+    if (net_msg_rec_pass == NET_MSG_REC_FULL)
+      net_msg_encode_putc(c);
+    net_msg_rec_crc = crc16_update(net_msg_rec_crc, c);
+    if (++net_msg_rec_len <= 6)
+      {
+      if (net_msg_rec_len < 6) continue;
+      net_msg_rec_code = c; // "MP-0 X"
+      if ((net_msg_rec_pass == NET_MSG_REC_DELTA) && (net_msg_rec_changed & 1))
+        net_msg_encode_putc(',');
+      continue;
+      }
+    if (c == ',')
+      {
+      net_msg_rec_field();
+      net_msg_rec_fcrc = 0xffff;
+      net_msg_rec_flen = 0;
+      if ((net_msg_rec_pass == NET_MSG_REC_DELTA) && (net_msg_rec_changed & (1UL << net_msg_rec_f)))
+        net_msg_encode_putc(',');
+      continue;
+      }
+    net_msg_rec_fcrc = crc16_update(net_msg_rec_fcrc, c);
+    net_msg_rec_flen++;
+    if ((net_msg_rec_pass == NET_MSG_REC_DELTA) && (net_msg_rec_changed & (1UL << net_msg_rec_f)))
+      net_msg_encode_putc(c);
+    }
+
+  return net_msg_rec;
+  }
+
+BOOL net_msg_rec_next(void)
+  {
+  char *s, *p;
+
+  net_msg_rec_field(); // The last field
+
+  if (net_msg_rec_pass != NET_MSG_REC_SCAN)
+    {
+    // Record sent:
+    if (net_msg_rec_pass == NET_MSG_REC_DELTA)
+      {
+      s = stp_x(net_msg_rec, ",", net_msg_rec_crc);
+      net_msg_encode_ram(net_msg_rec);
+      }
+    net_msg_encode_end();
+    *net_msg_rec_oldcrc = (net_msg_rec_dirty) ? ~net_msg_rec_crc : net_msg_rec_crc;
+    if (net_msg_rec_delta != NULL)
+      {
+      if (net_msg_rec_pass == NET_MSG_REC_FULL)
+        net_msg_rec_delta[0] = 0;
+      else if (net_msg_rec_dirty)
+        net_msg_rec_delta[0] = NET_MSG_DELTA_FULL; // The server can't merge it
+      else
+        net_msg_rec_delta[0]++;
+      }
+    net_msg_rec_pass = NET_MSG_REC_PLAIN;
+    return FALSE;
+    }
+
+  if ((net_msg_rec_stat != 0) && (*net_msg_rec_oldcrc == net_msg_rec_crc))
+    {
+    // Guarded output, unchanged
+    net_msg_rec_pass = NET_MSG_REC_PLAIN;
+    return FALSE;
+    }
+
+  if (net_msg_rec_stat == 2)
+    {
+    // Guarded output, but net_msg_start() has not yet been sent
+    net_msg_start();
+    net_msg_rec_stat = 1;
+    }
+
+  // Delta record "MP-0 X<code><bitmap>" if possible and shorter:
+  net_msg_rec_pass = NET_MSG_REC_FULL;
+  if ((net_msg_rec_delta != NULL) && (net_msg_rec_stat != 0) && (ptokenmade != 1) &&
+      (net_msg_rec_changed != 0) && (net_msg_rec_dirty == 0) &&
+      ((sys_features[FEATURE_OPTIN]&FEATURE_OI_DELTAMSG) != 0) &&
+      (net_msg_rec_delta[0] < NET_MSG_DELTA_FULL))
+    {
+    s = stp_lx(net_msg_rec, NULL, net_msg_rec_changed);
+    for (p = net_msg_rec; (*p == '0') && (p[1] != 0); p++) ; // Drop leading zeros
+    if ((7 + (s - p) + net_msg_rec_dlen + 5) < net_msg_rec_len)
+      {
+      net_msg_rec_pass = NET_MSG_REC_DELTA;
+      net_msg_encode_start();
+      net_msg_encode_rom("MP-0 X");
+      net_msg_encode_putc(net_msg_rec_code);
+      net_msg_encode_ram(p);
+      }
+    }
+  if (net_msg_rec_pass == NET_MSG_REC_FULL)
+    net_msg_encode_start();
+
+  net_msg_rec_len = 0;
+  net_msg_rec_dirty = 0;
+  net_msg_rec_crc = 0xffff;
+  net_msg_rec_fcrc = 0xffff;
+  net_msg_rec_flen = 0;
+  net_msg_rec_f = 0;
+  return TRUE;
+  }
+
 char net_msgp_stat(char stat)
 {
   char *p, *s;
 
   p = par_get(PARAM_MILESKM);
 
-  s = stp_i(net_scratchpad, "MP-0 S", car_SOC);
-  s = stp_s(s, ",", p);
-  s = stp_i(s, ",", car_linevoltage);
-  s = stp_i(s, ",", car_chargecurrent);
+  net_msg_rec_start(stat, &crc_stat, delta_stat, NET_MSG_DELTA_STAT);
+  do
+  {
+    s = stp_i(net_msg_rec, "MP-0 S", car_SOC);
+    s = stp_s(s, ",", p);
+    s = stp_i(s, ",", car_linevoltage);
+    s = stp_i(s, ",", car_chargecurrent);
+    s = net_msg_rec_put(s);
+
+    switch (car_chargestate)
+    {
+    case 0x01:
+      s = stp_rom(s, ",charging");
+      break;
+    case 0x02:
+      s = stp_rom(s, ",topoff");
+      break;
+    case 0x04:
+      s = stp_rom(s, ",done");
+      break;
+    case 0x0d:
+      s = stp_rom(s, ",prepare");
+      break;
+    case 0x0f:
+      s = stp_rom(s, ",heating");
+      break;
+    default:
+      s = stp_rom(s, ",stopped");
+    }
+
+    switch (car_chargemode)
+    {
+    case 0x00:
+      s = stp_rom(s, ",standard");
+      break;
+    case 0x01:
+      s = stp_rom(s, ",storage");
+      break;
+    case 0x03:
+      s = stp_rom(s, ",range");
+      break;
+    case 0x04:
+      s = stp_rom(s, ",performance");
+      break;
+    default:
+      s = stp_rom(s, ",");
+    }
+    s = net_msg_rec_put(s);
+
+    if (*p == 'M') // Kmh or Miles
+    {
+      s = stp_i(s, ",", car_idealrange);
+      s = stp_i(s, ",", car_estrange);
+    }
+    else
+    {
+      s = stp_i(s, ",", (int)KmFromMi(car_idealrange));
+      s = stp_i(s, ",", (int)KmFromMi(car_estrange));
+    }
+
+    s = stp_i(s, ",", car_chargelimit);
+    s = stp_i(s, ",", car_chargeduration);
+    s = stp_i(s, ",", car_charge_b4);
+    s = net_msg_rec_put(s);
+    s = stp_i(s, ",", car_chargekwh);
+    s = stp_i(s, ",", car_chargesubstate);
+    s = stp_i(s, ",", car_chargestate);
+    s = stp_i(s, ",", car_chargemode);
+    s = stp_i(s, ",", car_timermode);
+    s = net_msg_rec_put(s);
+    s = stp_i(s, ",", car_timerstart);
+    s = stp_i(s, ",", car_stale_timer);
+    s = stp_l2f(s, ",", (unsigned long)car_cac100, 2);
+    s = stp_i(s, ",", car_chargefull_minsremaining);
+    s = net_msg_rec_put(s);
+    s = stp_i(s, ",", car_chargelimit_minsremaining);
+    s = stp_i(s, ",", car_chargelimit_rangelimit);
+    s = stp_i(s, ",", car_chargelimit_soclimit);
+    s = stp_i(s, ",", car_coolingdown);
+    s = stp_i(s, ",", car_cooldown_tbattery);
+    s = net_msg_rec_put(s);
+    s = stp_i(s, ",", car_cooldown_timelimit);
+    s = stp_i(s, ",", car_chargeestimate);
+    net_msg_rec_put(s);
+  } while (net_msg_rec_next());
+
+  return net_msg_rec_stat;
+}
 
-  switch (car_chargestate)
+char net_msgp_gps(char stat)
+{
+  char *s;
+
+  net_msg_rec_start(stat, &crc_gps, delta_gps, NET_MSG_DELTA_GPS);
+  do
   {
-  case 0x01:
-    s = stp_rom(s, ",charging");
-    break;
-  case 0x02:
-    s = stp_rom(s, ",topoff");
-    break;
-  case 0x04:
-    s = stp_rom(s, ",done");
-    break;
-  case 0x0d:
-    s = stp_rom(s, ",prepare");
-    break;
-  case 0x0f:
-    s = stp_rom(s, ",heating");
-    break;
-  default:
-    s = stp_rom(s, ",stopped");
-  }
+    s = stp_latlon(net_msg_rec, "MP-0 L", car_latitude);
+    s = stp_latlon(s, ",", car_longitude);
+    s = net_msg_rec_put(s);
+    s = stp_i(s, ",", car_direction);
+    s = stp_i(s, ",", car_altitude);
+    s = stp_i(s, ",", car_gpslock);
+    s = stp_i(s, ",", car_stale_gps);
+    net_msg_rec_put(s);
+  } while (net_msg_rec_next());
+
+  return net_msg_rec_stat;
+}
 
-  switch (car_chargemode)
+// GPS track batches
+//
+// With FEATURE_OI_TRACKMSG set, streamed locations are collected and sent
+// as one message per NET_MSG_TRACK_FIXES fixes:
+//   MP-0 K<fixes>,<values>
+// Each fix is time, latitude, longitude (both in 1/32 arc seconds, ~1 m),
+// altitude, direction & speed, each encoded as the difference to the value
+// of the previous fix in the batch (the first fix of a batch: to 0) in
+// base64 VLQ: 5 bits per character, least significant first, bit 5 set if
+// another character follows, bit 0 of the value is the sign. The server
+// stores the fixes as "*-GPS-Track" historical records and updates the
+// location ("L") from the last one.
+
+char *net_msg_track_vlq(char *s, long val)
+{
+  unsigned long v;
+  unsigned char c;
+
+  if (val < 0)
+    v = ((unsigned long) -val << 1) | 1;
+  else
+    v = (unsigned long) val << 1;
+
+  do
   {
-  case 0x00:
-    s = stp_rom(s, ",standard");
-    break;
-  case 0x01:
-    s = stp_rom(s, ",storage");
-    break;
-  case 0x03:
-    s = stp_rom(s, ",range");
-    break;
-  case 0x04:
-    s = stp_rom(s, ",performance");
-    break;
-  default:
-    s = stp_rom(s, ",");
-  }
+    c = v & 0x1f;
+    v >>= 5;
+    if (v != 0)
+      c |= 0x20;
+    *s++ = cb64[c];
+  } while (v != 0);
+
+  return s;
+}
+
+// Add the current location to the track, sending the batch when complete.
+// Returns NET_MSG_TRACK_OFF if the location needs to be sent as an "L"
+// message instead (not opted in, or paranoid mode: the server can't
+// expand the batch), NET_MSG_TRACK_SKIPPED if the batch is full and not
+// yet sent, so the fix could not be added.
 
-  if (*p == 'M') // Kmh or Miles
+unsigned char net_msg_track_add(void)
+{
+  long fix[NET_MSG_TRACK_FIELDS];
+  long d;
+  unsigned char k;
+  char *s;
+
+  if (((sys_features[FEATURE_OPTIN] & FEATURE_OI_TRACKMSG) == 0) || (ptokenmade == 1))
+    return NET_MSG_TRACK_OFF;
+
+  if (net_msg_track_len + NET_MSG_TRACK_FIXMAX > NET_MSG_TRACK_SIZE)
   {
-    s = stp_i(s, ",", car_idealrange);
-    s = stp_i(s, ",", car_estrange);
+    if (net_msg_sendpending > 0)
+      return NET_MSG_TRACK_SKIPPED; // Batch full & not yet sent
+    net_msg_track_send();
   }
-  else
+
+  fix[0] = car_time;
+  fix[1] = car_latitude >> 6;
+  fix[2] = car_longitude >> 6;
+  fix[3] = car_altitude;
+  fix[4] = car_direction;
+  fix[5] = car_speed;
+
+  s = net_msg_track + net_msg_track_len;
+  for (k = 0; k < NET_MSG_TRACK_FIELDS; k++)
   {
-    s = stp_i(s, ",", KmFromMi(car_idealrange));
-    s = stp_i(s, ",", KmFromMi(car_estrange));
+    d = fix[k];
+    if (net_msg_track_n > 0)
+      d -= net_msg_track_last[k];
+    if ((k == 4) && (d > 180))
+      d -= 360; // Direction wraps around
+    else if ((k == 4) && (d < -180))
+      d += 360;
+    s = net_msg_track_vlq(s, d);
+    net_msg_track_last[k] = fix[k];
   }
+  *s = 0;
+  net_msg_track_len = (unsigned char)(s - net_msg_track);
+  net_msg_track_n++;
+
+  if ((net_msg_track_n >= NET_MSG_TRACK_FIXES) && (net_msg_sendpending == 0))
+    net_msg_track_send();
 
-  s = stp_i(s, ",", car_chargelimit);
-  s = stp_i(s, ",", car_chargeduration);
-  s = stp_i(s, ",", car_charge_b4);
-  s = stp_i(s, ",", car_chargekwh);
-  s = stp_i(s, ",", car_chargesubstate);
-  s = stp_i(s, ",", car_chargestate);
-  s = stp_i(s, ",", car_chargemode);
-  s = stp_i(s, ",", car_timermode);
-  s = stp_i(s, ",", car_timerstart);
-  s = stp_i(s, ",", car_stale_timer);
-  s = stp_l2f(s, ",", (unsigned long)car_cac100, 2);
-  s = stp_i(s, ",", car_chargefull_minsremaining);
-  s = stp_i(s, ",", car_chargelimit_minsremaining);
-  s = stp_i(s, ",", car_chargelimit_rangelimit);
-  s = stp_i(s, ",", car_chargelimit_soclimit);
-  s = stp_i(s, ",", car_coolingdown);
-  s = stp_i(s, ",", car_cooldown_tbattery);
-  s = stp_i(s, ",", car_cooldown_timelimit);
-  s = stp_i(s, ",", car_chargeestimate);
-
-  return net_msg_encode_statputs(stat, &crc_stat);
+  return NET_MSG_TRACK_ADDED;
 }
 
-char net_msgp_gps(char stat)
+// Send the track batch collected so far, streamed from net_msg_track,
+// or queue it (as net_msg_post() would)
+
+void net_msg_track_send(void)
 {
   char *s;
 
-  s = stp_latlon(net_scratchpad, "MP-0 L", car_latitude);
-  s = stp_latlon(s, ",", car_longitude);
-  s = stp_i(s, ",", car_direction);
-  s = stp_i(s, ",", car_altitude);
-  s = stp_i(s, ",", car_gpslock);
-  s = stp_i(s, ",", car_stale_gps);
+  if ((net_msg_track_n == 0) || (net_msg_sending))
+    return;
+
+  if ((net_msg_serverok == 1) && (net_msg_sendpending == 0) && (net_msg_qcount == 0))
+  {
+    net_msg_start();
+    net_msg_encode_start();
+    s = stp_i(net_msg_rec, "MP-0 K", net_msg_track_n);
+    s = stp_rom(s, ",");
+    net_msg_rec_put(s);
+    net_msg_encode_ram(net_msg_track);
+    net_msg_encode_end();
+    net_msg_send();
+  }
+  else
+  {
+    s = stp_i(net_scratchpad, "MP-0 K", net_msg_track_n);
+    *s++ = ',';
+    memcpy(s, net_msg_track, net_msg_track_len + 1);
+    net_msg_queue(NET_MSG_Q_STREAM);
+  }
 
-  return net_msg_encode_statputs(stat, &crc_gps);
+  net_msg_track_n = 0;
+  net_msg_track_len = 0;
+  delta_gps[0] = NET_MSG_DELTA_FULL; // The server's "L" is from the batch now
 }
 
 char net_msgp_tpms(char stat)
 {
-  char k, *s;
+  unsigned char k;
+  char *s;
   long p;
 
 #if 0
@@ -378,24 +1153,30 @@ char net_msgp_tpms(char stat)
   // ...new stat fn: No TMPS = one report with stale=-1
 #endif
 
-  s = stp_rom(net_scratchpad, "MP-0 W");
-  for (k = 0; k < 4; k++)
+  net_msg_rec_start(stat, &crc_tpms, delta_tpms, NET_MSG_DELTA_TPMS);
+  do
   {
-    if (car_tpms_t[k] > 0)
-    {
-      p = (long) ((float) car_tpms_p[k] / 0.2755);
-      s = stp_l2f(s, NULL, p, 1);
-      s = stp_i(s, ",", car_tpms_t[k] - 40);
-      s = stp_rom(s, ",");
-    }
-    else
+    s = stp_rom(net_msg_rec, "MP-0 W");
+    for (k = 0; k < 4; k++)
     {
-      s = stp_rom(s, "0,0,");
+      if (car_tpms_t[k] > 0)
+      {
+        p = (long) ((float) car_tpms_p[k] / 0.2755);
+        s = stp_l2f(s, NULL, p, 1);
+        s = stp_i(s, ",", car_tpms_t[k] - 40);
+        s = stp_rom(s, ",");
+      }
+      else
+      {
+        s = stp_rom(s, "0,0,");
+      }
+      s = net_msg_rec_put(s);
     }
-  }
-  s = stp_i(s, NULL, car_stale_tpms);
+    s = stp_i(s, NULL, car_stale_tpms);
+    net_msg_rec_put(s);
+  } while (net_msg_rec_next());
 
-  return net_msg_encode_statputs(stat, &crc_tpms);
+  return net_msg_rec_stat;
 }
 
 char net_msgp_firmware(char stat)
@@ -407,18 +1188,26 @@ char net_msgp_firmware(char stat)
   hwv = 2;
 #endif
 
-  s = stp_i(net_scratchpad, "MP-0 F", ovms_firmware[0]);
-  s = stp_i(s, ".", ovms_firmware[1]);
-  s = stp_i(s, ".", ovms_firmware[2]);
-  s = stp_s(s, "/", par_get(PARAM_VEHICLETYPE));
-  s = stp_i(s, "/V", hwv);
-  s = stp_s(s, ",", car_vin);
-  s = stp_i(s, ",", net_sq);
-  s = stp_i(s, ",", sys_features[FEATURE_CANWRITE]);
-  s = stp_s(s, ",", car_type);
-  s = stp_s(s, ",", car_gsmcops);
-
-  return net_msg_encode_statputs(stat, &crc_firmware);
+  net_msg_rec_start(stat, &crc_firmware, NULL, 0);
+  do
+  {
+    s = stp_i(net_msg_rec, "MP-0 F", ovms_firmware[0]);
+    s = stp_i(s, ".", ovms_firmware[1]);
+    s = stp_i(s, ".", ovms_firmware[2]);
+    s = net_msg_rec_put(s);
+    s = stp_s(s, "/", par_get(PARAM_VEHICLETYPE));
+    s = stp_i(s, "/V", hwv);
+    s = net_msg_rec_put(s);
+    s = stp_s(s, ",", car_vin);
+    s = stp_i(s, ",", net_sq);
+    s = stp_i(s, ",", sys_features[FEATURE_CANWRITE]);
+    s = net_msg_rec_put(s);
+    s = stp_s(s, ",", car_type);
+    s = stp_s(s, ",", car_gsmcops);
+    net_msg_rec_put(s);
+  } while (net_msg_rec_next());
+
+  return net_msg_rec_stat;
 }
 
 char net_msgp_environment(char stat)
@@ -431,61 +1220,80 @@ char net_msgp_environment(char stat)
   else
     park = car_time - car_parktime;
 
-  s = stp_i(net_scratchpad, "MP-0 D", car_doors1);
-  s = stp_i(s, ",", car_doors2);
-  s = stp_i(s, ",", car_lockstate);
-  s = stp_i(s, ",", car_tpem);
-  s = stp_i(s, ",", car_tmotor);
-  s = stp_i(s, ",", car_tbattery);
-  s = stp_i(s, ",", car_trip);
-  s = stp_ul(s, ",", car_odometer);
-  s = stp_i(s, ",", car_speed);
-  s = stp_ul(s, ",", park);
-  s = stp_i(s, ",", car_ambient_temp);
-  s = stp_i(s, ",", car_doors3);
-  s = stp_i(s, ",", car_stale_temps);
-  s = stp_i(s, ",", car_stale_ambient);
-  s = stp_l2f(s, ",", car_12vline, 1);
-  s = stp_i(s, ",", car_doors4);
-  s = stp_l2f(s, ",", car_12vline_ref, 1);
-  s = stp_i(s, ",", car_doors5);
-
-  return net_msg_encode_statputs(stat, &crc_environment);
+  net_msg_rec_start(stat, &crc_environment, delta_environment, NET_MSG_DELTA_ENVIRONMENT);
+  do
+  {
+    s = stp_i(net_msg_rec, "MP-0 D", car_doors1);
+    s = stp_i(s, ",", car_doors2);
+    s = stp_i(s, ",", car_lockstate);
+    s = stp_i(s, ",", car_tpem);
+    s = stp_i(s, ",", car_tmotor);
+    s = net_msg_rec_put(s);
+    s = stp_i(s, ",", car_tbattery);
+    s = stp_i(s, ",", car_trip);
+    s = stp_ul(s, ",", car_odometer);
+    s = stp_i(s, ",", car_speed);
+    s = net_msg_rec_put(s);
+    s = stp_ul(s, ",", park);
+    s = stp_i(s, ",", car_ambient_temp);
+    s = stp_i(s, ",", car_doors3);
+    s = stp_i(s, ",", car_stale_temps);
+    s = net_msg_rec_put(s);
+    s = stp_i(s, ",", car_stale_ambient);
+    s = stp_l2f(s, ",", car_12vline, 1);
+    s = stp_i(s, ",", car_doors4);
+    s = stp_l2f(s, ",", car_12vline_ref, 1);
+    s = stp_i(s, ",", car_doors5);
+    net_msg_rec_put(s);
+  } while (net_msg_rec_next());
+
+  return net_msg_rec_stat;
 }
 
 char net_msgp_capabilities(char stat)
 {
   char *s;
 
-  s = stp_rom(net_scratchpad, "MP-0 V");
-  if ((can_capabilities != NULL) && (can_capabilities[0] != 0))
+  net_msg_rec_start(stat, &crc_capabilities, NULL, 0);
+  do
   {
-    s = stp_rom(s, can_capabilities);
-    s = stp_rom(s, ",");
-  }
-  s = stp_rom(s, "C1-6,C40-41,C49");
+    s = stp_rom(net_msg_rec, "MP-0 V");
+    s = net_msg_rec_put(s);
+    if ((can_capabilities != NULL) && (can_capabilities[0] != 0))
+    {
+      s = stp_rom(s, can_capabilities);
+      s = stp_rom(s, ",");
+      s = net_msg_rec_put(s);
+    }
+    s = stp_rom(s, "C1-6,C40-41,C49");
+    net_msg_rec_put(s);
+  } while (net_msg_rec_next());
 
-  return net_msg_encode_statputs(stat, &crc_capabilities);
+  return net_msg_rec_stat;
 }
 
 char net_msgp_group(char stat, char groupnumber, char *groupname)
 {
   char *s;
 
-  s = stp_s(net_scratchpad, "MP-0 g", groupname);
-  s = stp_i(s, ",", car_SOC);
-  s = stp_i(s, ",", car_speed);
-  s = stp_i(s, ",", car_direction);
-  s = stp_i(s, ",", car_altitude);
-  s = stp_i(s, ",", car_gpslock);
-  s = stp_i(s, ",", car_stale_gps);
-  s = stp_latlon(s, ",", car_latitude);
-  s = stp_latlon(s, ",", car_longitude);
-
-  if (groupnumber == 1)
-    return net_msg_encode_statputs(stat, &crc_group1);
-  else
-    return net_msg_encode_statputs(stat, &crc_group2);
+  net_msg_rec_start(stat, (groupnumber == 1) ? &crc_group1 : &crc_group2, NULL, 0);
+  do
+  {
+    s = stp_s(net_msg_rec, "MP-0 g", groupname);
+    s = net_msg_rec_put(s);
+    s = stp_i(s, ",", car_SOC);
+    s = stp_i(s, ",", car_speed);
+    s = stp_i(s, ",", car_direction);
+    s = stp_i(s, ",", car_altitude);
+    s = stp_i(s, ",", car_gpslock);
+    s = stp_i(s, ",", car_stale_gps);
+    s = net_msg_rec_put(s);
+    s = stp_latlon(s, ",", car_latitude);
+    s = stp_latlon(s, ",", car_longitude);
+    net_msg_rec_put(s);
+  } while (net_msg_rec_next());
+
+  return net_msg_rec_stat;
 }
 
 void net_msg_server_welcome(char *msg)
@@ -538,6 +1346,7 @@ void net_msg_server_welcome(char *msg)
     }
 
   net_msg_serverok = 1;
+  net_msg_delta_reset(); // The server needs full records first
 
   p = par_get(PARAM_PARANOID);
   if (*p == 'P')
@@ -565,6 +1374,9 @@ void net_msg_server_welcome(char *msg)
     // And calculate the pdigest for future use
     p = par_get(PARAM_MODULEPASS);
     hmac_md5(ptoken, strlen(ptoken), p, strlen(p), pdigest);
+#ifdef OVMS_PMPRIMED
+    pm_primed = 0; // pdigest has changed, re-prime on next use
+#endif // #ifdef OVMS_PMPRIMED
     }
   else
     {
@@ -594,7 +1406,6 @@ void net_msg_server_welcome(char *msg)
     s = stp_x(s, ",", debug_crashreason);
     s = stp_i(s, ",", debug_checkpoint);
 
-    delay100(20);
     net_msg_start();
     net_msg_encode_puts();
     net_msg_send();
@@ -602,13 +1413,13 @@ void net_msg_server_welcome(char *msg)
 #ifdef OVMS_LOGGINGMODULE
   logging_serverconnect();
 #endif // #ifdef OVMS_LOGGINGMODULE
+  net_msg_queue_report();
 }
 
 // Receive a NET msg from the OVMS server
 void net_msg_in(char* msg)
   {
   int k;
-  char s;
 
   if (net_msg_serverok == 0)
     {
@@ -651,12 +1462,7 @@ void net_msg_in(char* msg)
     msg += 2; // Now pointing to the code just before encrypted paranoid message
     strcatpgm2ram(msg,(char const rom far*)"\r\n");
     k = base64decode(msg+1,net_msg_scratchpad+1);
-    RC4_setup(&pm_crypto1, &pm_crypto2, pdigest, MD5_SIZE);
-    for (k=0;k<1024;k++)
-      {
-      net_scratchpad[0] = 0;
-      RC4_crypt(&pm_crypto1, &pm_crypto2, net_scratchpad, 1);
-      }
+    net_msg_pm_setup();
     RC4_crypt(&pm_crypto1, &pm_crypto2, net_msg_scratchpad+1, k);
     net_msg_scratchpad[0] = *msg; // The code
     // The message is now out of paranoid mode...
@@ -711,7 +1517,6 @@ void net_msg_cmd_in(char* msg)
   {
   // We have received a command message (pointed to by <msg>)
   char *d;
-  int k;
 
   for (d=msg;(*d != 0)&&(*d != ',');d++) ;
   if (*d == ',')
@@ -725,8 +1530,7 @@ BOOL net_msg_cmd_exec(void)
   {
   int k;
   char *p, *s;
-
-  delay100(2);
+  unsigned char mark;
 
   CHECKPOINT(0x43)
 
@@ -828,9 +1632,8 @@ BOOL net_msg_cmd_exec(void)
         // At this point, <net_msg_cmd_msg> points to the phone number, and <p> to the SMS message
         net_send_sms_start(net_msg_cmd_msg);
         net_puts_ram(p);
-        net_puts_rom("\x1a");
-        delay100(5);
-        net_msg_start();
+        net_send_sms_finish();
+        net_msg_start(); // (after the modem has sent the SMS)
         STP_OK(net_scratchpad, net_msg_cmd_code);
         }
       else
@@ -839,30 +1642,29 @@ BOOL net_msg_cmd_exec(void)
         STP_INVALIDSYNTAX(net_scratchpad, net_msg_cmd_code);
         }
       net_msg_encode_puts();
-      delay100(2);
       break;
 
     case 41: // Send MMI/USSD Codes (param: USSD_CODE)
+      mark = net_rx_mark();
       net_puts_rom("AT+CUSD=1,\"");
       net_puts_ram(net_msg_cmd_msg);
       net_puts_rom("\",15\r");
-      // cmd reply #1 to acknowledge command:
-      delay100(5);
+      // cmd reply #1 to acknowledge command, after the modem's OK:
+      net_rx_wait("OK", 5, mark);
       net_msg_start();
       STP_OK(net_scratchpad, net_msg_cmd_code);
       net_msg_encode_puts();
-      delay100(2);
       // cmd reply #2 sent on USSD response, see net_msg_reply_ussd()
       break;
       
     case 49: // Send raw AT command (param: raw AT command)
+      mark = net_rx_mark();
       net_puts_ram(net_msg_cmd_msg);
       net_puts_rom("\r");
-      delay100(5);
+      net_rx_wait("OK", 5, mark); // (max 500ms, i.e. on ERROR)
       net_msg_start();
       STP_OK(net_scratchpad, net_msg_cmd_code);
       net_msg_encode_puts();
-      delay100(2);
       break;
     default:
       return FALSE;
@@ -874,7 +1676,6 @@ BOOL net_msg_cmd_exec(void)
 void net_msg_cmd_do(void)
   {
   CHECKPOINT(0x44)
-  delay100(2);
 
   // commands 40-49 are special AT commands, thus, disable net_msg here
   if ((net_msg_cmd_code < 40) || (net_msg_cmd_code > 49))
@@ -903,23 +1704,22 @@ void net_msg_cmd_do(void)
 
 void net_msg_forward_sms(char *caller, char *SMS)
   {
-  //Server not ready, stop sending
-  //TODO: store this message inside buffer, resend it when server is connected
-  if ((net_msg_serverok == 0)||(net_msg_sendpending)>0)
-    return;
-
   CHECKPOINT(0x45)
 
-  delay100(2);
-  net_msg_start();
+  if (net_msg_sending)
+    {
+    // Only called from net_poll(), never during a send: lost if it is
+    if (net_msg_qdrops[NET_MSG_Q_ALERT] < 0xff) net_msg_qdrops[NET_MSG_Q_ALERT]++;
+    return;
+    }
+
   strcpypgm2ram(net_scratchpad,(char const rom far*)"MP-0 PA");
   strcatpgm2ram(net_scratchpad,(char const rom far*)"SMS FROM: ");
   strcat(net_scratchpad, caller);
   strcatpgm2ram(net_scratchpad,(char const rom far*)" - MSG: ");
   SMS[170]=0; // Hacky limit on the max size of an SMS forwarded
   strcat(net_scratchpad, SMS);
-  net_msg_encode_puts();
-  net_msg_send();
+  net_msg_post(NET_MSG_Q_ALERT); // Queued if the server is not ready
 }
 
 void net_msg_reply_ussd(char *buf, unsigned char buflen)
@@ -929,16 +1729,20 @@ void net_msg_reply_ussd(char *buf, unsigned char buflen)
   // parse and return as command reply:
   char *s, *t = NULL;
 
-  // Server not ready? abort
-  // TODO: store, resend when server is connected
-  if ((!net_msg_serverok) || (!buf) || (!buflen))
+  if ((!buf) || (!buflen))
+    return;
+  if (net_msg_sending)
+    {
+    // Only called from net_poll(), never during a send: lost if it is
+    if (net_msg_qdrops[NET_MSG_Q_STATUS] < 0xff) net_msg_qdrops[NET_MSG_Q_STATUS]++;
     return;
+    }
 
   // isolate USSD reply text
-  if (t = memchr((void *) buf, '"', buflen))
+  if ((t = memchr((void *) buf, '"', buflen)))
   {
     ++t;
-    buflen -= (t - buf);
+    buflen -= (unsigned char)(t - buf);
     buf = t; // start of USSD string
     while ((*t) && (*t != '"') && ((t - buf) < buflen))
     {
@@ -956,20 +1760,8 @@ void net_msg_reply_ussd(char *buf, unsigned char buflen)
   else
     s = stp_rom(s, ",1,Invalid USSD result");
 
-  // send reply:
-
-  if (net_msg_sendpending > 0)
-  {
-    delay100(20); // HACK... should buffer & retry later... but RAM is precious
-    s = NULL; // flag
-  }
-
-  net_msg_start();
-  net_msg_encode_puts();
-  net_msg_send();
-
-  if (!s)
-    delay100(20); // HACK: give modem additional time if there was sendpending>0
+  // send reply, or queue it if the server is not ready:
+  net_msg_post(NET_MSG_Q_STATUS);
 }
 
 char *net_prep_stat(char *s)
@@ -981,8 +1773,8 @@ char *net_prep_stat(char *s)
   const rom char *unit = " mi";
   if (can_mileskm == 'K')
   {
-    estrange = KmFromMi(estrange);
-    idealrange = KmFromMi(idealrange);
+    estrange = (unsigned int)KmFromMi(estrange);
+    idealrange = (unsigned int)KmFromMi(idealrange);
     odometer = KmFromMi(odometer);
     unit = " km";
   }
@@ -1056,7 +1848,7 @@ char *net_prep_stat(char *s)
         }
       if (car_chargelimit_rangelimit > 0)
         {
-        s = stp_i(s, "\r ", (can_mileskm == 'K')?KmFromMi(car_chargelimit_rangelimit):car_chargelimit_rangelimit);
+        s = stp_i(s, "\r ", (can_mileskm == 'K')?(int)KmFromMi(car_chargelimit_rangelimit):car_chargelimit_rangelimit);
         s = stp_rom(s, unit);
         s = stp_i(s,": ",car_chargelimit_minsremaining);
         s = stp_rom(s," mins");
@@ -1098,71 +1890,80 @@ void net_msg_alert(void)
 {
   char *s;
 
-  delay100(2);
-
   s = stp_rom(net_scratchpad, "MP-0 PA");
   net_prep_stat(s);
 }
 
 void net_msg_alarm(void)
   {
-  char *p;
+  if (net_msg_sending)
+    {
+    net_msg_deferred |= NET_MSG_DEFER_ALARM;
+    return;
+    }
 
-  delay100(2);
-  net_msg_start();
   strcpypgm2ram(net_scratchpad,(char const rom far*)"MP-0 PAVehicle alarm is sounding!");
-  net_msg_encode_puts();
-  net_msg_send();
+  net_msg_post(NET_MSG_Q_ALERT);
   }
 
 void net_msg_valettrunk(void)
   {
-  char *p;
+  if (net_msg_sending)
+    {
+    net_msg_deferred |= NET_MSG_DEFER_VALETTRUNK;
+    return;
+    }
 
-  delay100(2);
-  net_msg_start();
   strcpypgm2ram(net_scratchpad,(char const rom far*)"MP-0 PATrunk has been opened (valet mode).");
-  net_msg_encode_puts();
-  net_msg_send();
+  net_msg_post(NET_MSG_Q_ALERT);
   }
 
 void net_msg_socalert(void)
   {
   char *s;
 
-  delay100(2);
-  net_msg_start();
+  if (net_msg_sending)
+    {
+    net_msg_deferred |= NET_MSG_DEFER_SOCALERT;
+    return;
+    }
+
   s = stp_i(net_scratchpad, "MP-0 PAALERT!!! CRITICAL SOC LEVEL APPROACHED (", car_SOC); // 95%
   s = stp_rom(s, "% SOC)");
-  net_msg_encode_puts();
-  net_msg_send();
+  net_msg_post(NET_MSG_Q_ALERT);
   }
 
 void net_msg_12v_alert(void)
   {
   char *s;
 
-  delay100(2);
-  net_msg_start();
+  if (net_msg_sending)
+    {
+    net_msg_deferred |= NET_MSG_DEFER_12VALERT;
+    return;
+    }
+
   if (can_minSOCnotified & CAN_MINSOC_ALERT_12V)
     s = stp_l2f(net_scratchpad, "MP-0 PAALERT!!! 12V BATTERY CRITICAL (", car_12vline, 1);
   else
     s = stp_l2f(net_scratchpad, "MP-0 PA12V BATTERY OK (", car_12vline, 1);
   s = stp_l2f(s, "V, ref=", car_12vline_ref, 1);
   s = stp_rom(s, "V)");
-  net_msg_encode_puts();
-  net_msg_send();
+  net_msg_post(NET_MSG_Q_ALERT);
   }
 
 void net_msg_erroralert(unsigned int errorcode, unsigned long errordata)
   {
   char *s;
 
-  delay100(2);
-  net_msg_start();
+  if (net_msg_sending)
+    {
+    net_notify_errq_push(errorcode, errordata); // Sent by net_notify_dispatch()
+    return;
+    }
+
   s = stp_s(net_scratchpad, "MP-0 PE", car_type);
   s = stp_ul(s, ",", (unsigned long)errorcode);
   s = stp_ul(s, ",", (unsigned long)errordata);
-  net_msg_encode_puts();
-  net_msg_send();
+  net_msg_post(NET_MSG_Q_ALERT);
   }
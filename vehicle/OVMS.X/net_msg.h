@@ -50,22 +50,91 @@ extern rom char NET_MSG_CMDUNIMPLEMENTED[];
 #define STP_NOCANSTOPCHARGE(buf,cmd)  stp_rom(stp_i(buf, NET_MSG_CMDRESP, cmd), NET_MSG_CMDNOCANSTOPCHARGE)
 #define STP_UNIMPLEMENTED(buf,cmd)    stp_rom(stp_i(buf, NET_MSG_CMDRESP, cmd), NET_MSG_CMDUNIMPLEMENTED)
 
+// Delta status messages: max fields tracked per record (<= 32)
+#define NET_MSG_DELTA_STAT         28
+#define NET_MSG_DELTA_GPS          6
+#define NET_MSG_DELTA_TPMS         9
+#define NET_MSG_DELTA_ENVIRONMENT  18
+#define NET_MSG_DELTA_FULL         10  // Send a full record after this many deltas
+
+// Outbound message queue (OVMS_MSGQUEUE): priorities, highest first.
+// ALERT and LOG entries are never evicted, STATUS and STREAM entries
+// make room for anything of a higher priority.
+#define NET_MSG_Q_STREAM           0
+#define NET_MSG_Q_STATUS           1
+#define NET_MSG_Q_LOG              2
+#define NET_MSG_Q_ALERT            3
+#define NET_MSG_Q_PRIOS            4
+#define NET_MSG_Q_SIZE             250 // Bytes, each entry takes 2 + message length
+
+#define NET_MSG_CIPSEND_MAX        1000 // Max bytes per AT+CIPSEND block (QSEND=1)
+
+#define NET_MSG_REC_MAX            48   // Bytes per streamed record piece (net_msg_rec)
+
+// Alerts raised while a message was being sent, queued by net_msg_send():
+#define NET_MSG_DEFER_ALARM        0x01
+#define NET_MSG_DEFER_VALETTRUNK   0x02
+#define NET_MSG_DEFER_SOCALERT     0x04
+#define NET_MSG_DEFER_12VALERT     0x08
+
+// GPS track batches (FEATURE_OI_TRACKMSG):
+#define NET_MSG_TRACK_FIELDS       6    // time, lat, lon, altitude, direction, speed
+#define NET_MSG_TRACK_FIXES        20   // Send a batch after this many fixes
+#define NET_MSG_TRACK_SIZE         180  // Bytes of encoded fixes per batch
+#define NET_MSG_TRACK_FIXMAX       26   // Max bytes per encoded fix
+
+// net_msg_track_add() results:
+#define NET_MSG_TRACK_OFF          0    // Not tracking, send an "L" message
+#define NET_MSG_TRACK_ADDED        1    // Fix added to the batch
+#define NET_MSG_TRACK_SKIPPED      2    // Batch full & unsent, try again later
+
 extern char net_msg_serverok;
 extern char net_msg_sendpending;
+extern char net_msg_sending;
+extern unsigned char net_msg_deferred;
+extern unsigned int net_msg_sendlen;
+extern unsigned char net_msg_txshort;
+extern unsigned char net_msg_sendsecs;
 extern int  net_msg_cmd_code;
 extern char* net_msg_cmd_msg;
 extern char net_msg_scratchpad[NET_BUF_MAX];
+extern char net_msg_rec[NET_MSG_REC_MAX];
+extern char net_msg_rec_stat;
+extern unsigned char net_msg_qcount;
+extern unsigned char net_msg_qused;
+extern unsigned char net_msg_qhighwater;
+extern unsigned char net_msg_qdrops[NET_MSG_Q_PRIOS];
+extern unsigned char net_msg_track_n;
 
 void net_msg_init(void);
 void net_msg_disconnected(void);
+void net_msg_wait(void);
 void net_msg_start(void);
 void net_msg_send(void);
+void net_msg_txtime(void);
+unsigned int net_msg_txrate(void);
+void net_msg_pm_setup(void);
+void net_msg_encode_start(void);
+void net_msg_encode_putc(char c);
+void net_msg_encode_ram(const char *s);
+void net_msg_encode_rom(static const rom char *s);
+void net_msg_encode_end(void);
 void net_msg_encode_puts(void);
 void net_msg_register(void);
 char net_msg_encode_statputs(char stat, WORD *oldcrc);
+void net_msg_rec_start(char stat, WORD *oldcrc, WORD *delta, unsigned char fields);
+char *net_msg_rec_put(char *s);
+BOOL net_msg_rec_next(void);
+void net_msg_delta_reset(void);
+BOOL net_msg_queue(unsigned char prio);
+BOOL net_msg_queue_send(void);
+void net_msg_queue_report(void);
+BOOL net_msg_post(unsigned char prio);
 
 char net_msgp_stat(char stat);
 char net_msgp_gps(char stat);
+unsigned char net_msg_track_add(void);
+void net_msg_track_send(void);
 char net_msgp_tpms(char stat);
 char net_msgp_firmware(char stat);
 char net_msgp_environment(char stat);
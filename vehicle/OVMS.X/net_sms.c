@@ -43,6 +43,8 @@
 
 #pragma udata
 char *net_sms_argend;
+unsigned char net_sms_sendpending = 0;  // The modem is sending an SMS
+unsigned char net_sms_sendmark = 0;     // Async input position at its Ctrl-Z
 
 rom char NET_MSG_DENIED[] = "Permission denied";
 rom char NET_MSG_REGISTERED[] = "Your phone has been registered as the owner.";
@@ -65,18 +67,32 @@ rom char NET_MSG_GOOGLEMAPS[] = "Car location:\r\nhttps://maps.google.com/maps?q
 
 
 
+// Wait (max 2s) for the modem to finish sending the last SMS ("OK"),
+// before the next command
+void net_sms_wait(void)
+  {
+  if (net_sms_sendpending)
+    net_rx_wait("OK", 20, net_sms_sendmark);
+  net_sms_sendpending = 0;
+  }
+
 void net_send_sms_start(char* number)
   {
+  unsigned char mark;
+
   if (net_state == NET_STATE_DIAGMODE)
     {
     net_puts_rom("# ");
     }
   else
     {
+    net_msg_wait();
+    net_sms_wait();
+    mark = net_rx_mark();
     net_puts_rom("AT+CMGS=\"");
     net_puts_ram(number);
     net_puts_rom("\"\r\n");
-    delay100(2);
+    net_rx_wait(">", 4, mark); // Wait for the text prompt
     }
   }
 
@@ -88,6 +104,8 @@ void net_send_sms_finish(void)
     }
   else
     {
+    net_sms_sendmark = net_rx_mark();
+    net_sms_sendpending = 1;
     net_puts_rom("\x1a");
     }
   }
@@ -112,11 +130,8 @@ void net_send_sms_ram(char* number, static const char* message)
 
 BOOL net_sms_stat(char* number)
   {
-  char *p;
-
   if (sys_features[FEATURE_CARBITS]&FEATURE_CB_SOUT_SMS) return FALSE;
 
-  delay100(2);
   net_send_sms_start(number);
   
   net_prep_stat(net_scratchpad);
@@ -128,11 +143,8 @@ BOOL net_sms_stat(char* number)
 
 void net_sms_alarm(char* number)
   {
-  char *p;
-
   if (sys_features[FEATURE_CARBITS]&FEATURE_CB_SOUT_SMS) return;
 
-  delay100(2);
   net_send_sms_start(number);
   net_puts_rom(NET_MSG_ALARM);
   net_send_sms_finish();
@@ -140,11 +152,8 @@ void net_sms_alarm(char* number)
 
 void net_sms_valettrunk(char* number)
   {
-  char *p;
-
   if (sys_features[FEATURE_CARBITS]&FEATURE_CB_SOUT_SMS) return;
 
-  delay100(2);
   net_send_sms_start(number);
   net_puts_rom(NET_MSG_VALETTRUNK);
   net_send_sms_finish();
@@ -154,7 +163,6 @@ void net_sms_socalert(char* number)
   {
   char *s;
 
-  delay100(10);
   net_send_sms_start(number);
 
   s = stp_i(net_scratchpad, "ALERT!!! CRITICAL SOC LEVEL APPROACHED (", car_SOC); // 95%
@@ -162,14 +170,12 @@ void net_sms_socalert(char* number)
   net_puts_ram(net_scratchpad);
 
   net_send_sms_finish();
-  delay100(5);
   }
 
 void net_sms_12v_alert(char* number)
   {
   char *s;
 
-  delay100(10);
   net_send_sms_start(number);
 
   if (can_minSOCnotified & CAN_MINSOC_ALERT_12V)
@@ -181,7 +187,6 @@ void net_sms_12v_alert(char* number)
   net_puts_ram(net_scratchpad);
 
   net_send_sms_finish();
-  delay100(5);
   }
 
 // SMS Command Handlers
@@ -304,7 +309,6 @@ BOOL net_sms_handle_gps(char *caller, char *command, char *arguments)
 
   if (sys_features[FEATURE_CARBITS]&FEATURE_CB_SOUT_SMS) return FALSE;
 
-  delay100(2);
   net_send_sms_start(caller);
   
   s = stp_latlon(net_scratchpad, NET_MSG_GOOGLEMAPS, car_latitude);
@@ -337,12 +341,11 @@ BOOL net_sms_handle_paramsq(char *caller, char *command, char *arguments)
       {
       s = stp_i(net_scratchpad, "\n", k);
       s = stp_s(s, ":", p);
-      splen = s - net_scratchpad;
+      splen = (unsigned char)(s - net_scratchpad);
       if((msglen+splen) > 160)
         {
           // SMS becomes too long, finish & start next:
           net_send_sms_finish();
-          delay100(20);
           net_send_sms_start(caller);
           net_puts_rom("Params:");
           msglen=7+splen;
@@ -381,7 +384,6 @@ BOOL net_sms_handle_params(char *caller, char *command, char *arguments)
 BOOL net_sms_handle_ap(char *caller, char *command, char *arguments)
   {
   unsigned char d = 0;
-  char *p = par_get(PARAM_MODULEPASS);
 
   while ((d < PARAM_MAX)&&(arguments != NULL))
     {
@@ -642,6 +644,9 @@ BOOL net_sms_handle_diag(char *caller, char *command, char *arguments)
   s = stp_i(s, "\n RED Led:", led_code[OVMS_LED_RED]);
   s = stp_i(s, "\n GRN Led:", led_code[OVMS_LED_GRN]);
   s = stp_x(s, "\n NET State:0x", net_state);
+  s = stp_ul(s, "\n Modem:", net_bauds[net_baud]);
+  s = stp_i(s, " baud, ", net_msg_txrate()); // Measured, 0 = no data sent yet
+  s = stp_rom(s, " byte/s");
 
   if (car_12vline > 0)
   {
@@ -839,8 +844,6 @@ BOOL net_sms_handle_version(char *caller, char *command, char *arguments)
 
 BOOL net_sms_handle_reset(char *caller, char *command, char *arguments)
   {
-  char *p;
-
   net_state_enter(NET_STATE_HARDSTOP);
   return FALSE;
   }
@@ -871,6 +874,8 @@ BOOL net_sms_handle_help(char *caller, char *command, char *arguments);
 // is a list of command strings (left match, all upper case). The second are
 // the command handler function pointers. The command string table array is
 // terminated by an empty "" command.
+// The command strings are kept in ASCII order (ignoring the security flag),
+// see net_sms_cmdfind(). Keep both tables in sync when adding commands.
 // The function pointes are BOOL return. A true result requests the framework
 // to issue the net_send_sms_finish() to complete a transmitted SMS.
 // The command strings are prefixed with a security control flag:
@@ -880,89 +885,128 @@ BOOL net_sms_handle_help(char *caller, char *command, char *arguments);
 //   3:     the caller must be the registered telephone, or first argument the module password
 
 rom char sms_cmdtable[][NET_SMS_CMDWIDTH] =
-  { "3REGISTER?",
-    "1REGISTER",
-    "3PASS?",
-    "2PASS ",
-    "3GPS",
-    "3STAT",
-    "3PARAMS?",
-    "2PARAMS ",
+  {
+#ifdef OVMS_ACCMODULE
+    "2ACC ",
+#endif
     "1AP ",
-    "3MODULE?",
-    "2MODULE ",
-    "3VEHICLE?",
-    "2VEHICLE ",
-    "3GPRS?",
-    "2GPRS ",
-    "3GSMLOCK?",
-    "2GSMLOCK",
-    "3SERVER?",
-    "2SERVER ",
+    "2CHARGEMODE ",
+    "2CHARGESTART",
+    "2CHARGESTOP",
+    "2COOLDOWN",
     "3DIAG",
-    "3FEATURES?",
     "2FEATURE ",
+    "3FEATURES?",
+    "2GPRS ",
+    "3GPRS?",
+    "3GPS",
+    "2GSMLOCK",
+    "3GSMLOCK?",
+    "3HELP",
     "2HOMELINK ",
     "2LOCK ",
+    "2MODULE ",
+    "3MODULE?",
+    "2PARAMS ",
+    "3PARAMS?",
+    "2PASS ",
+    "3PASS?",
+    "1REGISTER",
+    "3REGISTER?",
+    "3RESET",
+    "2SERVER ",
+    "3SERVER?",
+    "3STAT",
+    "3TEMPS",
     "2UNLOCK ",
-    "2VALET ",
     "2UNVALET ",
-    "2CHARGEMODE ",
-    "2CHARGESTART",
-    "2CHARGESTOP",
-    "2COOLDOWN",
+    "2VALET ",
+    "2VEHICLE ",
+    "3VEHICLE?",
     "3VERSION",
-    "3RESET",
-    "3TEMPS",
-#ifdef OVMS_ACCMODULE
-    "2ACC ",
-#endif
-    "3HELP",
     "" };
 
 rom BOOL (*sms_hfntable[])(char *caller, char *command, char *arguments) =
   {
-  &net_sms_handle_registerq,
-  &net_sms_handle_register,
-  &net_sms_handle_passq,
-  &net_sms_handle_pass,
-  &net_sms_handle_gps,
-  &net_sms_handle_stat,
-  &net_sms_handle_paramsq,
-  &net_sms_handle_params,
+#ifdef OVMS_ACCMODULE
+  &acc_handle_sms,
+#endif
   &net_sms_handle_ap,
-  &net_sms_handle_moduleq,
-  &net_sms_handle_module,
-  &net_sms_handle_vehicleq,
-  &net_sms_handle_vehicle,
-  &net_sms_handle_gprsq,
-  &net_sms_handle_gprs,
-  &net_sms_handle_gsmlockq,
-  &net_sms_handle_gsmlock,
-  &net_sms_handle_serverq,
-  &net_sms_handle_server,
-  &net_sms_handle_diag,
-  &net_sms_handle_featuresq,
-  &net_sms_handle_feature,
-  &net_sms_handle_homelink,
-  &net_sms_handle_lock,
-  &net_sms_handle_unlock,
-  &net_sms_handle_valet,
-  &net_sms_handle_unvalet,
   &net_sms_handle_chargemode,
   &net_sms_handle_chargestart,
   &net_sms_handle_chargestop,
   &net_sms_handle_cooldown,
-  &net_sms_handle_version,
+  &net_sms_handle_diag,
+  &net_sms_handle_feature,
+  &net_sms_handle_featuresq,
+  &net_sms_handle_gprs,
+  &net_sms_handle_gprsq,
+  &net_sms_handle_gps,
+  &net_sms_handle_gsmlock,
+  &net_sms_handle_gsmlockq,
+  &net_sms_handle_help,
+  &net_sms_handle_homelink,
+  &net_sms_handle_lock,
+  &net_sms_handle_module,
+  &net_sms_handle_moduleq,
+  &net_sms_handle_params,
+  &net_sms_handle_paramsq,
+  &net_sms_handle_pass,
+  &net_sms_handle_passq,
+  &net_sms_handle_register,
+  &net_sms_handle_registerq,
   &net_sms_handle_reset,
+  &net_sms_handle_server,
+  &net_sms_handle_serverq,
+  &net_sms_handle_stat,
   &net_sms_handle_temps,
-#ifdef OVMS_ACCMODULE
-  &acc_handle_sms,
-#endif
-  &net_sms_handle_help
+  &net_sms_handle_unlock,
+  &net_sms_handle_unvalet,
+  &net_sms_handle_valet,
+  &net_sms_handle_vehicle,
+  &net_sms_handle_vehicleq,
+  &net_sms_handle_version
   };
 
 
+// net_sms_cmdfind: look up a command in a sorted command table
+//   table: first entry, width: entry size, count: entries (without the "")
+//   skip: leading flag chars per entry (1 = auth mode, 0 = none)
+// Returns the index of the longest entry that is a prefix of command,
+// or -1. The binary search finds the last entry <= command, any prefix
+// of command must be at or before that, sharing its first char.
+signed char net_sms_cmdfind(char const rom far *table, unsigned char width,
+                            unsigned char count, unsigned char skip, char *command)
+  {
+  unsigned char lo = 0, hi = count, mid;
+  char const rom far *e;
+  char *c;
+
+  while (lo < hi)
+    {
+    mid = (lo + hi) >> 1;
+    e = table + (unsigned int)mid * width + skip;
+    for (c = command; ((*e != 0) && (*e == *c)); e++, c++) ;
+    if ((*e == 0) || (*e < *c))
+      lo = mid + 1; // entry <= command
+    else
+      hi = mid;
+    }
+
+  while (lo-- > 0)
+    {
+    e = table + (unsigned int)lo * width + skip;
+    if (*e != *command)
+      break;
+    for (c = command; ((*e != 0) && (*e == *c)); e++, c++) ;
+    if (*e == 0)
+      return lo;
+    }
+
+  return -1;
+  }
+
+
 // net_sms_checkauth: check SMS caller & first argument
 //   according to auth mode
 BOOL net_sms_checkauth(char authmode, char *caller, char **arguments)
@@ -1004,47 +1048,54 @@ void net_sms_in(char *caller, char *buf, unsigned char pos)
   {
   // The buf contains an SMS command
   // and caller contains the caller telephone number
-  char *p;
-  int k;
+  char *p, *arguments;
+  signed char k, v = -1;
 
   // Convert SMS command (first word) to upper-case
   for (p=buf; ((*p!=0)&&(*p!=' ')); p++)
   	if ((*p > 0x60) && (*p < 0x7b)) *p=*p-0x20;
   if (*p==' ') p++;
 
-  // Command parsing...
-  for (k=0; sms_cmdtable[k][0] != 0; k++)
-    {
-    if (memcmppgm2ram(buf, (char const rom far*)sms_cmdtable[k]+1, strlenpgm((char const rom far*)sms_cmdtable[k])-1) == 0)
-      {
-      BOOL result = FALSE;
-      char *arguments = net_sms_initargs(p);
+  // Command parsing, one lookup in the standard and one in the vehicle table...
+  k = net_sms_cmdfind(sms_cmdtable[0], NET_SMS_CMDWIDTH,
+                      sizeof(sms_cmdtable)/NET_SMS_CMDWIDTH - 1, 1, buf);
+  if (vehicle_sms_cmdtable != NULL)
+    v = net_sms_cmdfind(vehicle_sms_cmdtable, NET_SMS_CMDWIDTH,
+                        vehicle_sms_cmds, 1, buf);
 
-      if (!net_sms_checkauth(sms_cmdtable[k][0], caller, &arguments))
-          return;
-
-      if (vehicle_fn_smshandler != NULL)
-        {
-        if (vehicle_fn_smshandler(TRUE, caller, buf, arguments))
-          return;
-        }
+  if (k >= 0)
+    {
+    arguments = net_sms_initargs(p);
+    if (!net_sms_checkauth(sms_cmdtable[k][0], caller, &arguments))
+        return;
 
-      result = (*sms_hfntable[k])(caller, buf, arguments);
-      if (result)
-        {
-        if (vehicle_fn_smshandler != NULL)
-          vehicle_fn_smshandler(FALSE, caller, buf, arguments);
-        net_send_sms_finish();
-        }
+    // The vehicle module may replace the standard handler...
+    if ((v >= 0) && (vehicle_fn_smscmd(v, TRUE, caller, buf, arguments)))
+      {
+      net_send_sms_finish();
       return;
       }
+
+    if ((*sms_hfntable[k])(caller, buf, arguments))
+      {
+      // ...or extend its output
+      if (v >= 0)
+        vehicle_fn_smscmd(v, FALSE, caller, buf, arguments);
+      net_send_sms_finish();
+      }
+    return;
     }
 
-  if (vehicle_fn_smsextensions != NULL)
+  if (v >= 0)
     {
-    // Try passing the command to the vehicle module for handling...
-    if (vehicle_fn_smsextensions(caller, buf, p))
+    // A vehicle specific command
+    arguments = net_sms_initargs(p);
+    if ((net_sms_checkauth(vehicle_sms_cmdtable[(unsigned int)v * NET_SMS_CMDWIDTH], caller, &arguments))
+        && (vehicle_fn_smscmd(v, TRUE, caller, buf, arguments)))
+      {
+      net_send_sms_finish();
       return;
+      }
     }
 
   // SMS didn't match any command pattern, forward to user via net msg
@@ -35,6 +35,9 @@
 
 #define NET_SMS_CMDWIDTH    16
 
+extern unsigned char net_sms_sendpending;
+
+void net_sms_wait(void);
 void net_send_sms_start(char* number);
 void net_send_sms_finish(void);
 void net_send_sms_rom(char* number, static const rom char* message);
@@ -46,6 +49,8 @@ BOOL net_sms_stat(char* number);
 void net_sms_alarm(char* number);
 void net_sms_valettrunk(char* number);
 BOOL net_sms_checkauth(char authmode, char *caller, char **arguments);
+signed char net_sms_cmdfind(char const rom far *table, unsigned char width,
+                            unsigned char count, unsigned char skip, char *command);
 void net_sms_in(char *caller, char *buf, unsigned char pos);
 void net_sms_socalert(char* number);
 void net_sms_12v_alert(char* number);
@@ -110,6 +110,9 @@ signed int car_altitude = 0; // GPS altitude of the car
 signed char car_timermode = 0; // Timer mode (0=onplugin, 1=timer)
 unsigned int car_timerstart = 0; // Timer start
 unsigned char car_gpslock = 0; // GPS lock status
+unsigned char car_gpssats = 0; // GPS satellites in use (internal GPS)
+unsigned int car_gpshdop = 0; // GPS HDOP * 10 (internal GPS)
+unsigned long car_gpstime = 0; // GPS fix time, seconds since midnight UTC (internal GPS)
 signed char car_stale_ambient = -1; // 0 = Ambient temperature is stale
 signed char car_stale_temps = -1; // 0 = Powertrain temperatures are stale
 signed char car_stale_gps = -1; // 0 = gps is stale
@@ -141,10 +144,17 @@ unsigned char car_SOCalertlimit = 5;           // Limit of SOC at which alert sh
 UINT8 debug_crashcnt;           // crash counter, cleared on normal power up
 UINT8 debug_crashreason;        // last saved reset reason (bit set)
 UINT8 debug_checkpoint;         // number of last checkpoint before crash
+unsigned int debug_loophist[LOOPHIST_MAX]; // main loop time histogram
+
+// Main loop time histogram bucket limits, in TMR0 ticks (51.2uS):
+// <1ms, <2ms, <5ms, <10ms, <20ms, <50ms, <100ms, (the rest)
+rom unsigned int debug_loophist_limit[LOOPHIST_MAX-1] =
+  { 20, 39, 98, 195, 391, 977, 1953 };
 
 void main(void)
 {
   unsigned char x, y;
+  unsigned int loop_start, t;
 
   // DEBUG / QA stats: get last reset reason:
   x = (~RCON) & 0x1f;
@@ -232,7 +242,7 @@ void main(void)
   led_start();
 
 #ifdef OVMS_HW_V2
-  car_12vline = inputs_voltage()*10;
+  car_12vline = inputs_voltage();
   car_12vline_ref = 0;
 #endif
 
@@ -244,6 +254,9 @@ void main(void)
   y = 0; // Last TMR0H
   while (1) // Main Loop
   {
+    x = TMR0L; // Read TMR0L first to latch TMR0H
+    loop_start = ((unsigned int)TMR0H << 8) + x;
+
     CHECKPOINT(0x22)
     if ((vUARTIntStatus.UARTIntRxError) ||
             (vUARTIntStatus.UARTIntRxOverFlow))
@@ -256,13 +269,16 @@ void main(void)
     }
 
     CHECKPOINT(0x24)
+    vehicle_poll();
     vehicle_idlepoll();
+    sched_poll();
 
     ClrWdt(); // Clear Watchdog Timer
 
     x = TMR0L;
     if (TMR0H >= 0x4c) // Timout ~1sec (actually 996ms)
     {
+      loop_start -= ((unsigned int)TMR0H << 8) + x; // Carry elapsed time over the reset
       TMR0H = 0;
       TMR0L = 0; // Reset timer
       CHECKPOINT(0x25)
@@ -288,7 +304,15 @@ void main(void)
         vehicle_ticker10th();
         CHECKPOINT(0x2B)
       }
+      if ((TMR0H % 0x08) == 0)
+        sched_ticker10th(); // ~100ms (TMR0H 0x00..0x48: 10x per second)
       y = TMR0H;
     }
+
+    // Main loop time histogram:
+    x = TMR0L;
+    t = (((unsigned int)TMR0H << 8) + x) - loop_start;
+    for (x = 0; (x < LOOPHIST_MAX-1) && (t >= debug_loophist_limit[x]); x++);
+    if (debug_loophist[x] < 0xffff) debug_loophist[x]++;
   }
 }
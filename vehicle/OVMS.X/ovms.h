@@ -47,18 +47,30 @@
 
 #define FEATURES_MAX 16
 #define FEATURES_MAP_PARAM 8
+#define FEATURE_STREAMDEV    0x06 // Adaptive streaming: max deviation (m, 0=25)
+#define FEATURE_STREAMMAX    0x07 // Adaptive streaming: max interval (s, 0=30)
 #define FEATURE_STREAM       0x08 // Location streaming feature
 #define FEATURE_MINSOC       0x09 // Minimum SOC feature
 #define FEATURE_OPTIN        0x0D // Features to opt-in to
 #define FEATURE_CARBITS      0x0E // Various ON/OFF features (bitmap)
 #define FEATURE_CANWRITE     0x0F // CAN bus can be written to
 
+// The FEATURE_STREAM feature is a set of bits:
+#define FEATURE_ST_LOCATION  0x01 // Set to 1 to stream locations to the apps
+#define FEATURE_ST_GPSLOG    0x02 // Set to 1 for the Twizy GPS log stream
+#define FEATURE_ST_ADAPTIVE  0x04 // Set to 1 to stream locations on deviation
+                                  // from the predicted track only (max
+                                  // deviation & interval: FEATURE_STREAMDEV
+                                  // & FEATURE_STREAMMAX)
+
 // The FEATURE_OPTIN feature is a set of ON/OFF bits to control different
 // miscelaneous aspects of the system that must be opted in to. The following
 // bits are defined:
 #define FEATURE_OI_SPEEDO    0x01 // Set to 1 to enable digital speedo
 #define FEATURE_OI_LOGDRIVES 0x02 // Set to 1 to enable logging of drives
 #define FEATURE_OI_LOGCHARGE 0x04 // Set to 1 to enable logging of charges
+#define FEATURE_OI_DELTAMSG  0x08 // Set to 1 to send changed status fields only
+#define FEATURE_OI_TRACKMSG  0x10 // Set to 1 to stream locations as track batches
 
 // The FEATURE_CARBITS feature is a set of ON/OFF bits to control different
 // miscelaneous aspects of the system. The following bits are defined:
@@ -188,6 +200,9 @@ extern signed int car_altitude; // GPS altitude of the car
 extern signed char car_timermode; // Timer mode (0=onplugin, 1=timer)
 extern unsigned int car_timerstart; // Timer start
 extern unsigned char car_gpslock; // GPS lock status
+extern unsigned char car_gpssats; // GPS satellites in use (internal GPS)
+extern unsigned int car_gpshdop; // GPS HDOP * 10 (internal GPS)
+extern unsigned long car_gpstime; // GPS fix time, seconds since midnight UTC (internal GPS)
 extern signed char car_stale_ambient; // 0 = Ambient temperature is stale
 extern signed char car_stale_temps; // 0 = Powertrain temperatures are stale
 extern signed char car_stale_gps; // 0 = gps is stale
@@ -226,6 +241,8 @@ extern unsigned char car_SOCalertlimit;          // Limit of SOC at which alert
 extern UINT8 debug_crashcnt;           // crash counter, cleared on normal power up
 extern UINT8 debug_crashreason;        // last saved reset reason (bit set)
 extern UINT8 debug_checkpoint;         // number of last checkpoint before crash
+#define LOOPHIST_MAX 8
+extern unsigned int debug_loophist[LOOPHIST_MAX]; // main loop time histogram
 #define CHECKPOINT(n) if ((debug_crashreason & 0x80)==0) debug_checkpoint = n;
 
 #endif
@@ -31,6 +31,9 @@
 #include <string.h>
 #include "ovms.h"
 #include "crypt_base64.h"
+#ifdef OVMS_ACCMODULE
+#include "acc.h"
+#endif
 
 // EEprom data
 // The following data can be changed by sending SMS commands, and will survive a reboot
@@ -46,17 +49,91 @@ rom char EEparam[PARAM_MAX][PARAM_MAX_LENGTH]
 
 #pragma udata
 char par_value[PARAM_MAX_LENGTH];
+unsigned char par_notifies = 0;   // Decoded PARAM_NOTIFIES (PAR_NOTIFY_*)
+int par_timezone = 0;             // Decoded PARAM_TIMEZONE (minutes)
+unsigned int par_ee_writes = 0;   // Number of EEprom cells written
+volatile unsigned char par_wq_tail = 0; // Write queue slot being programmed (par_wq_service)
+volatile unsigned char par_wq_n = 0;    // Write queue slots in use
+
+typedef struct
+  {
+  unsigned char param;              // Parameter number
+  unsigned char pos;                // Next cell to check
+  char data[PARAM_MAX_LENGTH];      // New value
+  } par_wq_t;
+
+#pragma udata PAR_WQ
+par_wq_t par_wq[PARAM_WQ_SIZE];     // EEprom write queue
+#pragma udata
+
+#if PARAM_WQ_SIZE < PARAM_ACC_COUNT
+#error "PARAM_WQ_SIZE: an ACC clear must not block"
+#endif
+
+#define PAR_WQ_NEXT(k) (((k)+1 < PARAM_WQ_SIZE) ? (k)+1 : 0)
+
+// Update the decoded RAM copy of a frequently used parameter
+void par_decode(unsigned char param)
+  {
+  char *p;
+
+  switch (param)
+    {
+    case PARAM_NOTIFIES:
+      p = par_get(PARAM_NOTIFIES);
+      par_notifies = 0;
+      if (strstrrampgm(p,(char const rom far*)"SMS") != NULL)
+        par_notifies |= PAR_NOTIFY_SMS;
+      if (strstrrampgm(p,(char const rom far*)"IP") != NULL)
+        par_notifies |= PAR_NOTIFY_IP;
+      break;
+    case PARAM_TIMEZONE:
+      par_timezone = timestring_to_mins(par_get(PARAM_TIMEZONE));
+      break;
+    case PARAM_MILESKM:
+      can_mileskm = *par_get(PARAM_MILESKM);
+      break;
+#ifdef OVMS_ACCMODULE
+    default:
+      if ((param >= PARAM_ACC_S) && (param < PARAM_ACC_S + PARAM_ACC_COUNT))
+        acc_index_update(param - PARAM_ACC_S);
+      break;
+#endif
+    }
+  }
 
 void par_initialise(void)
   {
+  IPR2bits.EEIP = 0; // Low priority interrupt
+  PIR2bits.EEIF = 0;
+  PIE2bits.EEIE = 1; // Enable write complete interrupt
+
+  par_decode(PARAM_NOTIFIES);
+  par_decode(PARAM_TIMEZONE);
+  par_decode(PARAM_MILESKM);
   }
 
 char* par_get(unsigned char param)
   {
   int k;
+  unsigned char n;
   unsigned int eeaddress;
 
+  PIE2bits.EEIE = 0; // par_wq_service() may not run now
+
+  // Return a queued value:
+  for (n=par_wq_n, k=par_wq_tail; n>0; n--, k=PAR_WQ_NEXT(k))
+    {
+    if (par_wq[k].param == param)
+      {
+      memcpy(par_value,par_wq[k].data,PARAM_MAX_LENGTH);
+      PIE2bits.EEIE = 1;
+      return par_value;
+      }
+    }
+
   // Read parameter from EEprom
+  while (EECON1bits.WR); // No reads while a cell is written
   EECON1 = 0; // select EEprom memory not Flash
   eeaddress = (int)param;
   eeaddress = eeaddress*PARAM_MAX_LENGTH;
@@ -69,35 +146,121 @@ char* par_get(unsigned char param)
     EEADR++;
     }
 
+  PIE2bits.EEIE = 1;
   return par_value;
   }
 
-void par_write(unsigned char param)
+////////////////////////////////////////////////////////////////////////
+// par_wq_service()
+// Start programming the next changed cell of the write queue, unless a
+// write is in progress. Called by par_isr() on write completion, or by
+// the main loop with EEIE disabled.
+//
+void par_wq_service(void)
   {
-  int k = 0;
+  unsigned char tail;
   char savint;
   unsigned int eeaddress;
+  par_wq_t *w;
 
-  // Write parameter to EEprom
-  eeaddress = (int)param;
-  eeaddress = eeaddress*PARAM_MAX_LENGTH;
-  EEADRH = eeaddress >> 8;
-  EEADR = eeaddress & 0x00ff;
-  for (k=0;k<PARAM_MAX_LENGTH;k++)
+  if (EECON1bits.WR) return; // Busy, EEIF will call again
+
+  for (tail=par_wq_tail; par_wq_n>0; par_wq_n--, tail=PAR_WQ_NEXT(tail))
+    {
+    w = &par_wq[tail];
+    eeaddress = (unsigned int)w->param*PARAM_MAX_LENGTH + w->pos;
+    EEADRH = eeaddress >> 8;
+    for (; w->pos<PARAM_MAX_LENGTH; w->pos++, eeaddress++)
+      {
+      EEADR = eeaddress & 0x00ff;
+      EECON1 = 0; //ensure CFGS=0 and EEPGD=0
+      EECON1bits.RD = 1;
+      if (EEDATA == w->data[w->pos])
+        continue; // Cell is unchanged, save the write cycle
+      par_ee_writes++;
+      EECON1bits.WREN = 1; //enable write to EEPROM
+      EEDATA = w->data[w->pos]; // and data
+      savint = INTCON; // Save interrupts state
+      INTCONbits.GIE=0; // Disable interrupts
+      EECON2 = 0x55; // required sequence #1
+      EECON2 = 0xAA; // #2
+      EECON1bits.WR = 1; // #3 = actual write
+      INTCON = savint; // Restore interrupts
+      w->pos++;
+      par_wq_tail = tail;
+      return;
+      }
+    // Slot complete (its last write has finished)
+    }
+  par_wq_tail = tail;
+  EECON1bits.WREN = 0; // disable write to EEPROM
+  }
+
+////////////////////////////////////////////////////////////////////////
+// par_isr()
+// Called from low_isr(): EEprom write complete
+//
+void par_isr(void)
+  {
+  if (PIR2bits.EEIF)
+    {
+    PIR2bits.EEIF = 0;
+    par_wq_service();
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// par_write()
+// Queue par_value for writing to the EEprom. A queued value of the same
+// parameter is replaced, if the queue is full wait for a slot.
+//
+void par_write(unsigned char param)
+  {
+  unsigned char k, n;
+
+  PIE2bits.EEIE = 0; // par_wq_service() may not run now
+
+  for (n=par_wq_n, k=par_wq_tail; n>0; n--, k=PAR_WQ_NEXT(k))
+    {
+    if (par_wq[k].param == param) break;
+    }
+  if (n == 0)
+    {
+    while (par_wq_n == PARAM_WQ_SIZE)
+      {
+      // Queue full, program the oldest slot here:
+      while (EECON1bits.WR);
+      PIR2bits.EEIF = 0;
+      par_wq_service();
+      }
+    k = par_wq_tail + par_wq_n;
+    if (k >= PARAM_WQ_SIZE) k -= PARAM_WQ_SIZE;
+    par_wq[k].param = param;
+    par_wq_n++;
+    }
+  memcpy(par_wq[k].data,par_value,PARAM_MAX_LENGTH);
+  par_wq[k].pos = 0; // (Re-)check all cells
+
+  par_wq_service(); // Start, unless busy
+  PIE2bits.EEIE = 1;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// par_flush()
+// Wait for all queued EEprom writes to complete (i.e. before a reset)
+//
+void par_flush(void)
+  {
+  PIE2bits.EEIE = 0;
+  while (par_wq_n > 0)
     {
-    EEADR = (char)&EEparam[param][k];
-    EECON1 = 0; //ensure CFGS=0 and EEPGD=0
-    EECON1bits.WREN = 1; //enable write to EEPROM
-    EEDATA = par_value[k]; // and data
-    savint = INTCON; // Save interrupts state
-    INTCONbits.GIE=0; // Disable interrupts
-    EECON2 = 0x55; // required sequence #1
-    EECON2 = 0xAA; // #2
-    EECON1bits.WR = 1; // #3 = actual write
-    INTCON = savint; // Restore interrupts
-    while (EECON1bits.WR);
-    EECON1bits.WREN = 0; // disable write to EEPROM
+    while (EECON1bits.WR) ClrWdt();
+    PIR2bits.EEIF = 0;
+    par_wq_service();
     }
+  while (EECON1bits.WR) ClrWdt();
+  PIR2bits.EEIF = 0;
+  PIE2bits.EEIE = 1;
   }
 
 void par_set(unsigned char param, char* value)
@@ -113,6 +276,7 @@ void par_set(unsigned char param, char* value)
       par_value[0] = 0;
 
   par_write(param);
+  par_decode(param);
   }
 
 void par_getbase64(unsigned char param, void* dest, size_t length)
@@ -124,6 +288,8 @@ void par_getbase64(unsigned char param, void* dest, size_t length)
 
 void par_setbase64(unsigned char param, void* source, size_t length)
   {
+  memset(par_value,0,PARAM_MAX_LENGTH); // Don't write stale bytes after the end
   base64encode(source, length, par_value);
   par_write(param);
+  par_decode(param);
   }
\ No newline at end of file
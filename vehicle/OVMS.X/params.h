@@ -54,11 +54,14 @@
 #define PARAM_COOLDOWN    0x0F
 
 #define PARAM_ACC_S       0x10
-#define PARAM_ACC_COUNT   4
+#define PARAM_ACC_COUNT   7
 #define PARAM_ACC_1       0x10
 #define PARAM_ACC_2       0x11
 #define PARAM_ACC_3       0x12
 #define PARAM_ACC_4       0x13
+#define PARAM_ACC_5       0x14
+#define PARAM_ACC_6       0x15
+#define PARAM_ACC_7       0x16
 
 #define PARAM_TIMEZONE    0x17
 
@@ -73,10 +76,35 @@
 #define PARAM_FEATURE14   0x1E
 #define PARAM_FEATURE15   0x1F
 
+// Decoded RAM copies of frequently used parameters, updated by par_set():
+extern unsigned char par_notifies;  // PARAM_NOTIFIES
+#define PAR_NOTIFY_SMS    0x01
+#define PAR_NOTIFY_IP     0x02
+extern int par_timezone;            // PARAM_TIMEZONE (minutes)
+// (PARAM_MILESKM is decoded into can_mileskm)
+// (PARAM_ACC_* are decoded into the ACC geofence index, see acc.c)
+
+extern unsigned int par_ee_writes;  // Number of EEprom cells written
+
+// EEprom write queue:
+// par_set() queues the parameter and returns at once, the EEIF interrupt
+// (low priority) programs one changed cell per write completion (~4ms).
+// par_get() returns queued values, par_flush() waits for all writes to
+// complete (i.e. before a reset).
+// Limit: all PARAM_WQ_SIZE slots are usable, a queued parameter written
+// again reuses its slot. A burst of more than PARAM_WQ_SIZE different
+// parameters (i.e. setting all params by SMS "AP" or MP-0 C4) blocks in
+// par_set() for ~4ms per changed cell of the oldest slot. The ACC clear
+// (PARAM_ACC_COUNT) and feature saves fit without blocking.
+#define PARAM_WQ_SIZE 7                     // Queue slots (34 bytes each, one RAM bank max)
+
 void par_initialise(void);
+void par_decode(unsigned char param);
 char* par_get(unsigned char param);
 void par_set(unsigned char param, char* value);
 void par_getbase64(unsigned char param, void* dest, size_t length);
 void par_setbase64(unsigned char param, void* source, size_t length);
+void par_flush(void);
+void par_isr(void);
 
 #endif // #ifndef __OVMS_PARAMS_H
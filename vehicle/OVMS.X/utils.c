@@ -41,6 +41,7 @@
 // Reset the cpu
 void reset_cpu(void)
   {
+  par_flush(); // Complete queued EEprom writes
   _asm reset _endasm
   }
 
@@ -68,7 +69,8 @@ void delay100b(void)
   PR2=255;
   while (count<122)
     {
-    while (!PIR1bits.TMR2IF);
+    while (!PIR1bits.TMR2IF)
+      vehicle_poll(); // Keep decoding CAN frames while we wait
     PIR1bits.TMR2IF=0;
     count++;
     }
@@ -85,6 +87,100 @@ void delay100(unsigned char n)
     }
   }
 
+////////////////////////////////////////////////////////////////////////
+// Deferred task scheduler
+//
+// A task is a void function posted to run N x 100ms from now. Due tasks
+// are called from the main loop by sched_poll(), so they must not block.
+// A task may re-post itself to form a paced sequence (e.g. one CAN poll
+// request per 100ms) without busy-waiting in delay100().
+//
+
+#pragma udata
+sched_task_t sched_tasks[SCHED_MAX];  // Task slots (fn==NULL: free)
+unsigned char sched_tick = 0;         // Free running 100ms tick counter
+
+// Post fn to be called in ticks x 100ms (0 = next main loop pass).
+// If fn is already posted, it is re-armed with the new delay.
+// Returns FALSE if all task slots are in use.
+BOOL sched_post(void (*fn)(void), unsigned char ticks)
+  {
+  unsigned char k, free = SCHED_MAX;
+
+  for (k=0; k<SCHED_MAX; k++)
+    {
+    if (sched_tasks[k].fn == fn)
+      {
+      sched_tasks[k].ticks = ticks;
+      return TRUE;
+      }
+    if ((sched_tasks[k].fn == NULL) && (free == SCHED_MAX))
+      free = k;
+    }
+
+  if (free == SCHED_MAX)
+    return FALSE;
+
+  sched_tasks[free].ticks = ticks;
+  sched_tasks[free].fn = fn;
+  return TRUE;
+  }
+
+// Remove fn from the task list (if posted)
+void sched_cancel(void (*fn)(void))
+  {
+  unsigned char k;
+
+  for (k=0; k<SCHED_MAX; k++)
+    {
+    if (sched_tasks[k].fn == fn)
+      sched_tasks[k].fn = NULL;
+    }
+  }
+
+// Check if fn is posted and not yet run
+BOOL sched_pending(void (*fn)(void))
+  {
+  unsigned char k;
+
+  for (k=0; k<SCHED_MAX; k++)
+    {
+    if (sched_tasks[k].fn == fn)
+      return TRUE;
+    }
+  return FALSE;
+  }
+
+// Called from the main loop every 100ms: count down the posted tasks
+void sched_ticker10th(void)
+  {
+  unsigned char k;
+
+  sched_tick++;
+  for (k=0; k<SCHED_MAX; k++)
+    {
+    if ((sched_tasks[k].fn != NULL) && (sched_tasks[k].ticks > 0))
+      sched_tasks[k].ticks--;
+    }
+  }
+
+// Called from the main loop: run all tasks that are due
+void sched_poll(void)
+  {
+  unsigned char k;
+  void (*fn)(void);
+
+  for (k=0; k<SCHED_MAX; k++)
+    {
+    if ((sched_tasks[k].fn != NULL) && (sched_tasks[k].ticks == 0))
+      {
+      fn = sched_tasks[k].fn;
+      sched_tasks[k].fn = NULL; // Free the slot first, so fn may re-post
+      fn();
+      }
+    }
+  }
+
 // Set the status of the NET (GREEN) led
 void led_net(unsigned char led)
   {
@@ -171,46 +267,104 @@ unsigned long MiFromKm(unsigned long km)
  return (high * 40722) + ((low * 40722 + km/6 + 0x7FFF) >> 16);
 }
 
-// builtin atof() does not work... returns strange values
+// Fixed point arithmetic
+// C18 software float is slow and has a 24 bit mantissa only, so scaled
+// integer values are used instead: Q16 factors (f * 65536) for constant
+// multipliers, muldiv() for exact ratios.
 
-float myatof(char *src)
+// x * mul / div rounded down, without a 32 bit overflow as long as
+// (x / div) * mul fits
+unsigned long muldiv(unsigned long x, unsigned int mul, unsigned int div)
 {
-  long whole, frac, pot;
-  char *s;
+  return (x / div) * mul + ((x % div) * mul) / div;
+}
 
-  whole = atol(src);
+// x * q / 65536 rounded down, i.e. x times the Q16 factor q (< 1.0)
+unsigned long mulq16(unsigned long x, unsigned int q)
+{
+  return (x >> 16) * q + (((x & 0xFFFF) * q) >> 16);
+}
 
-  if (s = strchr(src, '.'))
-  {
-    frac = 0;
-    pot = 1;
+// Integer square root, rounded down
+unsigned int isqrt(unsigned long x)
+{
+  unsigned long r = 0, b = 0x40000000;
 
-    while (*++s)
+  while (b > x)
+    b >>= 2;
+  while (b != 0)
+  {
+    if (x >= r + b)
     {
-      frac = frac * 10 + (*s - 48);
-      pot = pot * 10;
+      x -= r + b;
+      r = (r >> 1) + b;
     }
-
-    return (float) whole + (float) frac / pot;
+    else
+      r >>= 1;
+    b >>= 2;
   }
-  else
+  return (unsigned int) r;
+}
+
+
+// Parse the NMEA field at s (up to the next ',' or the end of the line):
+// whole = integer part, frac = fraction in 1/1000000 (decimals beyond the
+// 6th are ignored), chr = the last non-numeric character (0 if none, i.e.
+// '-' for a negative number or 'N' for a direction letter).
+// Returns the start of the next field, or NULL if this was the last one.
+
+char *nmea_field(char *s, unsigned long *whole, unsigned long *frac, char *chr)
+{
+  unsigned long w = 0, f = 0;
+  unsigned char digits = 0;
+  BOOL dot = FALSE;
+  char c, ch = 0;
+
+  for (c = *s; (c != ',') && (c != 0); c = *++s)
   {
-    return (float) whole;
+    if ((c >= '0') && (c <= '9'))
+    {
+      if (!dot)
+        w = w * 10 + (c - '0');
+      else if (digits < 6)
+      {
+        f = f * 10 + (c - '0');
+        digits++;
+      }
+    }
+    else if (c == '.')
+      dot = TRUE;
+    else
+      ch = c;
   }
+  for (; digits < 6; digits++)
+    f *= 10;
+
+  *whole = w;
+  *frac = f;
+  *chr = ch;
+  return (c == ',') ? s + 1 : NULL;
 }
 
+// Convert GPS coordinate DDDMM.MMMMMM (whole DDDMM, frac 1/1000000 minutes)
+// to internal latlon value (1/2048 arc seconds)
+
+long nmea_latlon(unsigned long whole, unsigned long frac)
+{
+  // degrees * 3600 * 2048 + 1/1000000 minutes * 60 * 2048 / 1000000:
+  return (whole / 100) * 7372800
+          + muldiv((whole % 100) * 1000000 + frac, 384, 3125);
+}
 
 // Convert GPS coordinate form DDDMM.MMMMMM to internal latlon value
 
 long gps2latlon(char *gpscoord)
 {
-  float f;
-  long d;
+  unsigned long whole, frac;
+  char chr;
 
-  f = myatof(gpscoord);
-  d = (long) (f / 100); // extract degrees
-  f = (float) d + (f - (d * 100)) / 60; // convert to decimal format
-  return (long) (f * 3600 * 2048); // convert to raw format
+  nmea_field(gpscoord, &whole, &frac, &chr);
+  return nmea_latlon(whole, frac);
 }
 
 
@@ -237,6 +391,22 @@ WORD crc16(char *data, int length)
   return crc;
 }
 
+// Add one byte to a crc16() CRC (start with 0xffff)
+WORD crc16_update(WORD crc, char c)
+  {
+  unsigned char k;
+
+  crc ^= (BYTE)c;
+  for (k = 0; k < 8; ++k)
+    {
+    if (crc & 1)
+      crc = (crc >> 1) ^ 0xA001;
+    else
+      crc = (crc >> 1);
+    }
+  return crc;
+  }
+
 
 // cr2lf: replace \r by \n in s (to convert msg text to sms)
 
@@ -254,7 +424,7 @@ void cr2lf(char *s)
 
 char *stp_rom(char *dst, const rom char *val)
 {
-  while (*dst = *val++) dst++;
+  while ((*dst = *val++)) dst++;
   return dst;
 }
 
@@ -262,7 +432,7 @@ char *stp_rom(char *dst, const rom char *val)
 
 char *stp_ram(char *dst, const char *val)
 {
-  while (*dst = *val++) dst++;
+  while ((*dst = *val++)) dst++;
   return dst;
 }
 
@@ -423,7 +593,7 @@ char *stp_l2f_h(char *dst, const rom char *prefix, unsigned long val, int cdecim
 		*dst++ = chSeparator;
 
     // peel off the next digit
-    *dst++ = '0' + (val % 10);
+    *dst++ = (char)('0' + (val % 10));
     val /= 10;
 
     // write out the decimal point when needed
@@ -447,8 +617,6 @@ char *stp_l2f_h(char *dst, const rom char *prefix, unsigned long val, int cdecim
 
 char *stp_latlon(char *dst, const rom char *prefix, long latlon)
 {
-  float res;
-
   if (prefix)
     dst = stp_rom(dst, prefix);
 
@@ -457,8 +625,8 @@ char *stp_latlon(char *dst, const rom char *prefix, long latlon)
     *dst++ = '-';
     latlon = ~latlon; // and invert value
   }
-  res = (float) latlon / 2048 / 3600; // Tesla specific GPS conversion
-  return stp_l2f(dst, NULL, res * 1000000, 6);
+  // Tesla specific GPS conversion, 1/2048 arc seconds to 1/1000000 degrees:
+  return stp_l2f(dst, NULL, muldiv(latlon, 625, 4608), 6);
 }
 
 char *stp_time(char *dst, const rom char *prefix, unsigned long timestamp)
@@ -476,9 +644,9 @@ char *stp_time(char *dst, const rom char *prefix, unsigned long timestamp)
       *dst++ = ':';
     if (k==2)
       timestamp %= 24;
-    *dst++ = '0' + (timestamp % 10);
+    *dst++ = (char)('0' + (timestamp % 10));
     timestamp /= 10;
-    *dst++ = '0' + (timestamp % 6);
+    *dst++ = (char)('0' + (timestamp % 6));
     timestamp /= 6;
   }
   end = dst - 1;
@@ -517,10 +685,35 @@ char *stp_mode(char *dst, const rom char *prefix, unsigned char mode)
 
 int IntCosine14(int rad);
 
+int IntCosineLat14(long lat)
+{
+  return IntCosine14(Rad14FromGPS(lat));
+}
+
+int IntCosineDeg14(int deg)
+{
+  deg %= 360;
+  if (deg < 0)
+    deg = -deg;
+  if (deg > 180)
+    deg = 360 - deg;
+
+  // radians * 2^14 = deg * 285.94
+  if (deg > 90)
+    return -IntCosine14((int)(((long)(180 - deg) * 9150 + 16) >> 5));
+  else
+    return IntCosine14((int)(((long)deg * 9150 + 16) >> 5));
+}
+
 int FIsLatLongClose(long lat1, long long1, long lat2, long long2, int meterClose)
+{
+  return FIsLatLongCloseCos(lat1, long1, -1, lat2, long2, meterClose);
+}
+
+// sCosine: IntCosineLat14(lat1) if known (i.e. cached), else -1
+int FIsLatLongCloseCos(long lat1, long long1, int sCosine, long lat2, long long2, int meterClose)
 {
   long dlong;
-  int sCosine;
   long distLong;
   long dlat = ABS(lat2 - lat1);
 
@@ -556,7 +749,8 @@ int FIsLatLongClose(long lat1, long long1, long lat2, long long2, int meterClose
     return 0;
 
   // no easy out, we have to do some math; compute cosine(lat1) * 2^14
-  sCosine = IntCosine14(Rad14FromGPS(lat1));
+  if (sCosine < 0)
+    sCosine = IntCosine14(Rad14FromGPS(lat1));
 
   // distLong = dlong * cosine(lat1) / 66; done carefully to preserve precision
   distLong = ((((dlong & 0x3FFF) * sCosine) >> 14) + ((dlong >> 14) * sCosine)) / 66;
@@ -596,5 +790,5 @@ int IntCosine14(int rad)
    cos = (((long)cos * cos + (1L << 12)) >> 13) - (1L << 14);
  }
 
- return cos;
+ return (int)cos;
 }
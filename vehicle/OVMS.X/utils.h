@@ -41,6 +41,20 @@ void reset_cpu(void);              // Reset the cpu
 void delay5b(void);                // Delay 5ms
 void delay100b(void);              // Delay 100ms
 void delay100(unsigned char n);    // Delay in 100ms increments
+
+// Deferred task scheduler (100ms resolution), see utils.c:
+#define SCHED_MAX 8                 // Max number of posted tasks
+typedef struct
+  {
+  void (*fn)(void);                 // Task function (NULL = free slot)
+  unsigned char ticks;              // 100ms ticks until fn is due
+  } sched_task_t;
+extern unsigned char sched_tick;   // Free running 100ms tick counter
+BOOL sched_post(void (*fn)(void), unsigned char ticks); // Call fn in ticks x 100ms
+void sched_cancel(void (*fn)(void)); // Remove a posted task
+BOOL sched_pending(void (*fn)(void)); // Is fn posted?
+void sched_ticker10th(void);       // Count down posted tasks (main loop, 100ms)
+void sched_poll(void);             // Run due tasks (main loop)
 void led_net(unsigned char led);   // Change NET led
 void led_act(unsigned char led);   // Change ACT led
 void modem_reboot(void);           // Reboot modem
@@ -49,15 +63,22 @@ int timestring_to_mins(char* arg); // Convert a time string to minutes
 
 //void format_latlon(long latlon, char* dest);  // Format latitude/longitude string
 #define format_latlon(latlon,dest) stp_latlon(dest,NULL,latlon)
-float myatof(char *s);             // builtin atof() does not work
 long gps2latlon(char *gpscoord);   // convert GPS coordinate to latlon value
+char *nmea_field(char *s, unsigned long *whole, unsigned long *frac, char *chr); // parse NMEA field
+long nmea_latlon(unsigned long whole, unsigned long frac); // DDDMM.MMMMMM to latlon value
 WORD crc16(char *data, int length);  // Calculate a 16bit CRC and return it
+WORD crc16_update(WORD crc, char c); // Add one byte to a crc16() CRC
 void cr2lf(char *s);                // replace \r by \n in s (to convert msg text to sms)
 
 // convert miles to kilometers and vice-versa, using factor 1.609344
 unsigned long KmFromMi(unsigned long miles);
 unsigned long MiFromKm(unsigned long km);
 
+// fixed point arithmetic
+unsigned long muldiv(unsigned long x, unsigned int mul, unsigned int div); // x * mul / div
+unsigned long mulq16(unsigned long x, unsigned int q); // x * q / 65536
+unsigned int isqrt(unsigned long x); // integer square root
+
 // sprintf replacement utils: stp string print
 char *stp_rom(char *dst, const rom char *val);
 char *stp_ram(char *dst, const char *val);
@@ -78,5 +99,8 @@ char *stp_mode(char *dst, const rom char *prefix, unsigned char mode);
 
 // longitude/latitude math
 int FIsLatLongClose(long lat1, long long1, long lat2, long long2, int meterClose);
+int FIsLatLongCloseCos(long lat1, long long1, int sCosine, long lat2, long long2, int meterClose);
+int IntCosineLat14(long lat);     // cosine(lat) * 2^14
+int IntCosineDeg14(int deg);      // cosine(deg) * 2^14
 
 #endif // #ifndef __OVMS_UTILS_H
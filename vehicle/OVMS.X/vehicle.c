@@ -38,6 +38,89 @@ unsigned char can_datalength;                // The number of valid bytes in the
 unsigned char can_databuffer[8];             // A buffer to store the current CAN message
 unsigned char can_minSOCnotified = 0;        // minSOC notified flag
 unsigned char can_mileskm = 'M';             // Miles of Kilometers
+volatile unsigned char can_rxq_head = 0;     // Next CAN RX queue slot to fill (ISR)
+volatile unsigned char can_rxq_tail = 0;     // Next CAN RX queue slot to decode (main loop)
+unsigned char can_rxq_highwater = 0;         // Max CAN RX queue fill level seen
+unsigned int  can_rxq_drops = 0;             // CAN frames lost (queue full or RXBnOVFL)
+unsigned char can_rxq_busy = 0;              // vehicle_poll() is running
+volatile unsigned char can_txq_head = 0;     // Next CAN TX queue slot to fill (main loop)
+volatile unsigned char can_txq_tail = 0;     // Oldest CAN TX queue slot not yet loaded
+unsigned char can_tx_pending = 0;            // Priorities pending in the TX buffers (bits)
+unsigned char can_txb_prio[3] = {0,0,0};     // Priority bit of the frame in TXB0..2 (0 = free)
+unsigned char can_txb_age[3];                // Seconds the frame in TXB0..2 is pending
+unsigned char can_tx_errstate = 0;           // Last COMSTAT TXBO|TXBP state
+unsigned int  can_tx_queued = 0;             // CAN frames accepted by can_tx_enqueue()
+unsigned int  can_tx_sent = 0;               // CAN frames sent
+unsigned int  can_tx_aborted = 0;            // CAN frames lost (queue full, not in TX mode, timeout)
+unsigned int  can_tx_errpassive = 0;         // Entries into TX error-passive / bus-off state
+unsigned char isotp_fc_bs = 8;               // ISO-TP flow control block size (half the RX queue)
+unsigned char isotp_fc_stmin = 0;            // ISO-TP flow control separation time
+unsigned char isotp_active = 0;              // ISO-TP sessions in use
+unsigned char isotp_pool_used = 0;           // ISO-TP pool blocks in use (bits)
+const rom vehicle_poll_t *vehicle_poll_list = NULL; // Registered PID poll list
+unsigned char vehicle_poll_count = 0;        // Entries in vehicle_poll_list
+unsigned char vehicle_poll_state = 0;        // Current VEHICLE_POLL_* state
+unsigned char vehicle_poll_tick;             // Last sched_tick seen
+unsigned long vehicle_poll_pending = 0;      // List entries due to be sent (bits)
+unsigned char vehicle_poll_current;          // List entry waiting for its reply
+unsigned char vehicle_poll_wait = 0;         // 100ms ticks until the reply timeout (0 = idle)
+unsigned int  vehicle_poll_txtime;           // TMR0 when the request was sent
+unsigned int  vehicle_poll_sent = 0;         // PID requests sent
+unsigned int  vehicle_poll_missed = 0;       // PID requests not answered or skipped
+
+#pragma udata CAN_RXQ
+can_frame_t can_rxq[CAN_RXQ_SIZE];           // CAN receive queue
+#pragma udata CAN_TXQ
+can_txframe_t can_txq[CAN_TXQ_SIZE];         // CAN transmit queue
+#pragma udata ISOTP_POOL
+unsigned char isotp_pool[ISOTP_POOL_BLOCKS*ISOTP_BLOCK_SIZE]; // ISO-TP message buffers
+#pragma udata VEHICLE_POLL
+vehicle_pollstat_t vehicle_pollstats[VEHICLE_POLL_MAX]; // PID poll schedule & statistics
+#pragma udata
+
+// PIR3/PIE3/IPR3 CAN interrupt bits:
+#define CAN_TXB_IF      0b00011100           // TXB2IF, TXB1IF, TXB0IF
+#define CAN_RXB_IF      0b00000011           // RXB1IF, RXB0IF
+#define CAN_ERR_IF      0b00100000           // ERRIF
+
+#define CAN_TXQ_LOADED  0x80                 // can_txframe_t.prio flag: in a TX buffer
+
+// ISO-TP session states:
+#define ISOTP_FREE      0                    // Session unused
+#define ISOTP_WAIT_FC   1                    // First frame sent, waiting for flow control
+#define ISOTP_TX        2                    // Sending consecutive frames
+#define ISOTP_WAIT_RX   3                    // Request sent, waiting for the response
+#define ISOTP_RX        4                    // Receiving consecutive frames
+
+typedef struct
+  {
+  unsigned char state;                       // ISOTP_FREE etc.
+  unsigned int  txid;                        // Request CAN ID
+  unsigned int  rxid;                        // Response CAN ID
+  unsigned char *buf;                        // Pool buffer (NULL for single frames)
+  unsigned char blocks;                      // Pool blocks of buf (bits)
+  unsigned int  len;                         // Message length
+  unsigned int  pos;                         // Bytes sent / received
+  unsigned char sn;                          // Next sequence number
+  unsigned char bs;                          // Frames left in this block (0 = no limit)
+  unsigned int  stmin;                       // Peer separation time (TMR0 ticks)
+  unsigned int  txtime;                      // TMR0 at the last consecutive frame sent
+  unsigned char timer;                       // 100ms ticks until timeout
+  unsigned char match;                       // Response bytes to match (0..2)
+  unsigned char service;                     // Request service (response service | 0x40)
+  unsigned char pid;                         // Expected response PID (request byte 1)
+  isotp_fn_t    done;                        // Completion function
+  } isotp_session_t;
+
+isotp_session_t isotp_sessions[ISOTP_SESSIONS];
+
+void can_tx_service(void);
+BOOL isotp_match(isotp_session_t *s, unsigned char *d, unsigned char n);
+BOOL isotp_rx(void);
+void isotp_poll(void);
+void isotp_ticker10th(void);
+void vehicle_poll_reply(void);
+void vehicle_poll_run(void);
 
 rom unsigned char* vehicle_version = NULL;       // Vehicle module version
 rom unsigned char* can_capabilities = NULL;      // Vehicle capabilities
@@ -54,9 +137,10 @@ rom BOOL (*vehicle_fn_ticker)(void) = NULL;
 rom BOOL (*vehicle_fn_ticker10th)(void) = NULL;
 rom BOOL (*vehicle_fn_idlepoll)(void) = NULL;
 rom BOOL (*vehicle_fn_commandhandler)(BOOL msgmode, int code, char* msg);
-rom BOOL (*vehicle_fn_smshandler)(BOOL premsg, char *caller, char *command, char *arguments);
-rom BOOL (*vehicle_fn_smsextensions)(char *caller, char *command, char *arguments);
+rom BOOL (*vehicle_fn_smscmd)(unsigned char k, BOOL premsg, char *caller, char *command, char *arguments);
 rom int  (*vehicle_fn_minutestocharge)(unsigned char chgmod, int wAvail, int ixEnd, int pctEnd);
+char const rom far *vehicle_sms_cmdtable = NULL;
+unsigned char vehicle_sms_cmds = 0;
 
 ////////////////////////////////////////////////////////////////////////
 // vehicle_initialise()
@@ -79,9 +163,12 @@ void vehicle_initialise(void)
   vehicle_fn_ticker10th = NULL;
   vehicle_fn_idlepoll = NULL;
   vehicle_fn_commandhandler = NULL;
-  vehicle_fn_smshandler = NULL;
-  vehicle_fn_smsextensions = NULL;
+  vehicle_fn_smscmd = NULL;
+  vehicle_sms_cmdtable = NULL;
+  vehicle_sms_cmds = 0;
   vehicle_fn_minutestocharge = NULL;
+  vehicle_poll_setlist(NULL);
+  vehicle_poll_state = 0;
 
   // Clear the internal GPS flag, unless specifically requested by the module
   net_fnbits &= ~(NET_FN_INTERNALGPS);
@@ -176,10 +263,126 @@ void vehicle_initialise(void)
   RCONbits.IPEN = 1; // Enable Interrupt Priority
   PIE3bits.RXB1IE = 1; // CAN Receive Buffer 1 Interrupt Enable bit
   PIE3bits.RXB0IE = 1; // CAN Receive Buffer 0 Interrupt Enable bit
-  IPR3 = 0b00000011; // high priority interrupts for Buffers 0 and 1
+  IPR3 = 0b00111111; // high priority interrupts for RX & TX Buffers and errors
 
   p = par_get(PARAM_MILESKM);
   can_mileskm = *p;
+
+  // Discard frames queued & ISO-TP sessions of the previous vehicle module
+  can_rxq_tail = can_rxq_head;
+  memset(isotp_sessions, 0, sizeof(isotp_sessions));
+  isotp_active = 0;
+  isotp_pool_used = 0;
+  isotp_fc_bs = 8;
+  isotp_fc_stmin = 0;
+  PIE3 &= ~CAN_TXB_IF;
+  can_txq_tail = can_txq_head;
+  can_tx_service(); // Reap TX buffers aborted by the CAN mode change
+  PIE3 |= CAN_TXB_IF | CAN_ERR_IF; // TX Buffer 0..2 & error Interrupt Enable bits
+  }
+
+////////////////////////////////////////////////////////////////////////
+// can_tx_enqueue()
+// Queue a CAN frame for transmission, frames of the same priority are
+// sent in order. Returns FALSE (and counts the frame as aborted) if the
+// queue is full or the CAN controller is not in normal (TX) mode.
+//
+BOOL can_tx_enqueue(unsigned int id, unsigned char dlc, const unsigned char *data, unsigned char priority)
+  {
+  unsigned char next;
+  can_txframe_t *f;
+
+  next = (can_txq_head + 1) & (CAN_TXQ_SIZE-1);
+  if ((next == can_txq_tail) || ((CANSTAT & 0xE0) != 0))
+    {
+    can_tx_aborted++; // Queue full, or listen only / config mode
+    return FALSE;
+    }
+
+  f = &can_txq[can_txq_head];
+  f->id = id;
+  f->prio = priority & 0x03;
+  f->datalength = (dlc > 8) ? 8 : dlc;
+  memcpy(f->data, data, f->datalength);
+  can_tx_queued++;
+
+  PIE3 &= ~CAN_TXB_IF;
+  can_txq_head = next; // Publish frame to can_tx_service()
+  can_tx_service();
+  PIE3 |= CAN_TXB_IF;
+
+  return TRUE;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// can_tx_service()
+// Reap the TX buffers the controller is done with, and load the oldest
+// queued frames into the free TX buffers. At most one frame per priority
+// is pending in hardware (the PIC sends equal priority buffers highest
+// buffer number first), so later frames of a pending priority wait.
+// Called from high_isr() or with the TX interrupts disabled.
+//
+
+// Reap TX buffer n once TXREQ is clear: sent, or aborted (TXABT)
+#define CAN_TXB_REAP(n) \
+  if ((can_txb_prio[n] != 0) && ((TXB##n##CON & 0x08) == 0)) \
+    { \
+    if (TXB##n##CON & 0x40) can_tx_aborted++; else can_tx_sent++; \
+    can_tx_pending &= ~can_txb_prio[n]; \
+    can_txb_prio[n] = 0; \
+    }
+
+// Load frame f into TX buffer n & request transmission
+#define CAN_TXB_LOAD(n) \
+  { \
+  TXB##n##SIDH = f->id >> 3; \
+  TXB##n##SIDL = (f->id & 0x07) << 5; \
+  TXB##n##DLC = f->datalength; \
+  TXB##n##D0 = f->data[0]; \
+  TXB##n##D1 = f->data[1]; \
+  TXB##n##D2 = f->data[2]; \
+  TXB##n##D3 = f->data[3]; \
+  TXB##n##D4 = f->data[4]; \
+  TXB##n##D5 = f->data[5]; \
+  TXB##n##D6 = f->data[6]; \
+  TXB##n##D7 = f->data[7]; \
+  TXB##n##CON = 0b00001000 | f->prio; /* TXREQ + TXPRI */ \
+  can_txb_prio[n] = prio; \
+  can_txb_age[n] = 0; \
+  }
+
+void can_tx_service(void)
+  {
+  unsigned char k, prio;
+  can_txframe_t *f;
+
+  CAN_TXB_REAP(0);
+  CAN_TXB_REAP(1);
+  CAN_TXB_REAP(2);
+
+  for (k = can_txq_tail; k != can_txq_head; k = (k + 1) & (CAN_TXQ_SIZE-1))
+    {
+    f = &can_txq[k];
+    if (f->prio & CAN_TXQ_LOADED) continue;
+    prio = 1 << f->prio;
+    if (can_tx_pending & prio) continue; // Keep the order within a priority
+    if (can_txb_prio[0] == 0)
+      CAN_TXB_LOAD(0)
+    else if (can_txb_prio[1] == 0)
+      CAN_TXB_LOAD(1)
+    else if (can_txb_prio[2] == 0)
+      CAN_TXB_LOAD(2)
+    else
+      break; // All TX buffers busy
+    can_tx_pending |= prio;
+    f->prio |= CAN_TXQ_LOADED;
+    }
+
+  // Release the loaded slots at the queue tail:
+  k = can_txq_tail;
+  while ((k != can_txq_head) && (can_txq[k].prio & CAN_TXQ_LOADED))
+    k = (k + 1) & (CAN_TXQ_SIZE-1);
+  can_txq_tail = k;
   }
 
 ////////////////////////////////////////////////////////////////////////
@@ -187,6 +390,13 @@ void vehicle_initialise(void)
 //
 // Interupts here will interrupt Uart Interrupts
 //
+// The ISR only copies the received frames into the can_rxq[] queue, the
+// vehicle module decoders are called from the main loop by vehicle_poll().
+// If the queue is full, the frame is dropped and counted in can_rxq_drops.
+//
+// TX complete interrupts reap the TX buffers and load the next frames from
+// can_txq[], error interrupts count the entries into TX error-passive.
+//
 
 void high_isr(void);
 
@@ -197,51 +407,800 @@ void can_int_service(void)
   }
 
 #pragma code
-#pragma	interrupt high_isr
+#pragma	interrupt high_isr save=section(".tmpdata")
 void high_isr(void)
   {
-  // High priority CAN interrupt
-  if ((RXB0CONbits.RXFUL)&&(vehicle_fn_poll0 != NULL))
-    {
-    can_id = ((unsigned int)RXB0SIDL >>5)
-           + ((unsigned int)RXB0SIDH <<3);
-    can_filter = RXB0CON & 0x01;
-    can_datalength = RXB0DLC & 0x0F; // number of received bytes
-    can_databuffer[0] = RXB0D0;
-    can_databuffer[1] = RXB0D1;
-    can_databuffer[2] = RXB0D2;
-    can_databuffer[3] = RXB0D3;
-    can_databuffer[4] = RXB0D4;
-    can_databuffer[5] = RXB0D5;
-    can_databuffer[6] = RXB0D6;
-    can_databuffer[7] = RXB0D7;
+  unsigned char next;
+  can_frame_t *f;
+
+  // TX buffer(s) done: (the flags of disabled TX interrupts are kept, the
+  // main loop is in can_tx_service() then)
+  if (PIR3 & PIE3 & CAN_TXB_IF)
+    {
+    PIR3 &= ~CAN_TXB_IF;
+    can_tx_service();
+    }
+
+  // CAN error state changed:
+  if (PIR3 & CAN_ERR_IF)
+    {
+    next = COMSTAT & 0b00110000; // TXBO, TXBP
+    if (next & ~can_tx_errstate) can_tx_errpassive++;
+    can_tx_errstate = next;
+    }
+
+  // High priority CAN interrupt: (not while vehicle_ticker() has masked
+  // the RX interrupts, i.e. on a TX or error interrupt, as it updates
+  // can_rxq_drops then)
+  if ((PIE3bits.RXB0IE)&&(RXB0CONbits.RXFUL)&&(vehicle_fn_poll0 != NULL))
+    {
+    next = (can_rxq_head + 1) & (CAN_RXQ_SIZE-1);
+    if (next == can_rxq_tail)
+      {
+      can_rxq_drops++; // Queue full, frame is lost
+      }
+    else
+      {
+      f = &can_rxq[can_rxq_head];
+      f->id = ((unsigned int)RXB0SIDL >>5)
+            + ((unsigned int)RXB0SIDH <<3);
+      f->filter = RXB0CON & 0x01;
+      f->datalength = RXB0DLC & 0x0F; // number of received bytes
+      f->data[0] = RXB0D0;
+      f->data[1] = RXB0D1;
+      f->data[2] = RXB0D2;
+      f->data[3] = RXB0D3;
+      f->data[4] = RXB0D4;
+      f->data[5] = RXB0D5;
+      f->data[6] = RXB0D6;
+      f->data[7] = RXB0D7;
+      can_rxq_head = next; // Publish frame to vehicle_poll()
+      }
     RXB0CONbits.RXFUL = 0; // All bytes read, Clear flag
-    vehicle_fn_poll0();
-    }
-  if ((RXB1CONbits.RXFUL)&&(vehicle_fn_poll1 != NULL))
-    {
-    can_id = ((unsigned int)RXB1SIDL >>5)
-           + ((unsigned int)RXB1SIDH <<3);
-    can_filter = RXB1CON & 0x07;
-    can_datalength = RXB1DLC & 0x0F; // number of received bytes
-    can_databuffer[0] = RXB1D0;
-    can_databuffer[1] = RXB1D1;
-    can_databuffer[2] = RXB1D2;
-    can_databuffer[3] = RXB1D3;
-    can_databuffer[4] = RXB1D4;
-    can_databuffer[5] = RXB1D5;
-    can_databuffer[6] = RXB1D6;
-    can_databuffer[7] = RXB1D7;
+    }
+  if ((PIE3bits.RXB1IE)&&(RXB1CONbits.RXFUL)&&(vehicle_fn_poll1 != NULL))
+    {
+    next = (can_rxq_head + 1) & (CAN_RXQ_SIZE-1);
+    if (next == can_rxq_tail)
+      {
+      can_rxq_drops++; // Queue full, frame is lost
+      }
+    else
+      {
+      f = &can_rxq[can_rxq_head];
+      f->id = ((unsigned int)RXB1SIDL >>5)
+            + ((unsigned int)RXB1SIDH <<3);
+      f->filter = (RXB1CON & 0x07) | CAN_RXQ_RXB1;
+      f->datalength = RXB1DLC & 0x0F; // number of received bytes
+      f->data[0] = RXB1D0;
+      f->data[1] = RXB1D1;
+      f->data[2] = RXB1D2;
+      f->data[3] = RXB1D3;
+      f->data[4] = RXB1D4;
+      f->data[5] = RXB1D5;
+      f->data[6] = RXB1D6;
+      f->data[7] = RXB1D7;
+      can_rxq_head = next; // Publish frame to vehicle_poll()
+      }
     RXB1CONbits.RXFUL = 0;        // All bytes read, Clear flag
-    vehicle_fn_poll1();
     }
-  PIR3=0;     // Clear Interrupt flags
+  PIR3 &= (CAN_TXB_IF | (CAN_RXB_IF & ~PIE3)); // Clear RX (unless masked) & error flags
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vehicle_poll()
+// This function is an entry point from the main() program loop (and
+// from the delay100b() busy-wait), and passes the queued CAN frames to
+// the vehicle module, one by one, via can_id/can_filter/can_datalength/
+// can_databuffer and vehicle_fn_poll0/1.
+//
+void vehicle_poll(void)
+  {
+  unsigned char tail, level, filter;
+  can_frame_t *f;
+
+  if (can_rxq_busy) return; // A decoder is waiting in delay100b()
+  can_rxq_busy = 1;
+
+  tail = can_rxq_tail;
+  level = (can_rxq_head - tail) & (CAN_RXQ_SIZE-1);
+  if (level > can_rxq_highwater) can_rxq_highwater = level;
+
+  while (tail != can_rxq_head)
+    {
+    f = &can_rxq[tail];
+    can_id = f->id;
+    filter = f->filter;
+    can_filter = filter & 0x07;
+    can_datalength = f->datalength;
+    memcpy(can_databuffer, f->data, 8);
+    tail = (tail + 1) & (CAN_RXQ_SIZE-1);
+    can_rxq_tail = tail; // Slot may now be re-used by the ISR
+
+    if (vehicle_poll_wait > 0)
+      vehicle_poll_reply(); // Check for the reply to the PID request
+
+    if ((isotp_active > 0) && (isotp_rx()))
+      continue; // Frame of an ISO-TP session
+
+    if (filter & CAN_RXQ_RXB1)
+      {
+      if (vehicle_fn_poll1 != NULL) vehicle_fn_poll1();
+      }
+    else
+      {
+      if (vehicle_fn_poll0 != NULL) vehicle_fn_poll0();
+      }
+    }
+
+  if (isotp_active > 0) isotp_poll();
+  if (vehicle_poll_count > 0) vehicle_poll_run();
+
+  can_rxq_busy = 0;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vehicle_can_dispatch()
+// Call the decoder for can_id (and mux can_databuffer[0]) from a
+// vehicle_can_handler_t table, sorted by id then mux. Returns FALSE if
+// the table has no entry for the frame.
+//
+BOOL vehicle_can_dispatch(const rom vehicle_can_handler_t *table, unsigned char count)
+  {
+  unsigned char lo = 0, hi = count, mid;
+  const rom vehicle_can_handler_t *e;
+
+  while (lo < hi)
+    {
+    mid = (lo + hi) >> 1;
+    e = &table[mid];
+    if (e->id == (can_id & e->mask))
+      {
+      if ((e->mux == VEHICLE_CAN_ANYMUX) || (e->mux == can_databuffer[0]))
+        {
+        if (e->stale != NULL) *e->stale = e->staleticks;
+        return e->handler();
+        }
+      else if (e->mux < can_databuffer[0])
+        lo = mid + 1;
+      else
+        hi = mid;
+      }
+    else if (e->id < can_id)
+      lo = mid + 1;
+    else
+      hi = mid;
+    }
+
+  return FALSE;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vehicle_can_mask()
+// Find the tightest mask that lets nfilters filters cover all table IDs
+// of the given RX buffer, by dropping low ID bits until the masked IDs
+// fit. The filter values are stored in f[0..nfilters-1], unused filters
+// duplicate f[0]. Returns the mask.
+//
+unsigned int vehicle_can_mask(const rom vehicle_can_handler_t *table, unsigned char count,
+                              unsigned char buffer, unsigned char nfilters, unsigned int *f)
+  {
+  unsigned int mask = 0x7ff;
+  unsigned int id;
+  unsigned char k, j, n;
+
+  for (k=0; k<count; k++)
+    {
+    if (table[k].buffer == buffer)
+      mask &= table[k].mask; // ID ranges need the wider mask anyway
+    }
+
+  for (;;)
+    {
+    n = 0;
+    for (k=0; k<count; k++)
+      {
+      if (table[k].buffer != buffer) continue;
+      id = table[k].id & mask;
+      for (j=0; (j<n)&&(f[j]!=id); j++) ;
+      if (j == n)
+        {
+        if (n == nfilters) break; // Too many, widen the mask
+        f[n++] = id;
+        }
+      }
+    if (k == count) break;
+    mask = (mask << 1) & 0x7ff;
+    }
+
+  if (n == 0) f[n++] = 0;
+  for (; n<nfilters; n++) f[n] = f[0];
+
+  return mask;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vehicle_can_filters()
+// Set the RX buffer 0 (RXM0, RXF0/1) and buffer 1 (RXM1, RXF2..5)
+// acceptance masks and filters for the IDs of a vehicle_can_handler_t
+// table. Must be called in CAN configuration mode.
+//
+// Filters: low byte bits 7..5 are the low 3 bits of the filter, and bits 4..0 are all zeros
+//          high byte bits 7..0 are the high 8 bits of the filter
+//
+void vehicle_can_filters(const rom vehicle_can_handler_t *table, unsigned char count)
+  {
+  unsigned int mask;
+  unsigned int f[4];
+
+  mask = vehicle_can_mask(table, count, 0, 2, f);
+  RXM0SIDH = mask >> 3;
+  RXM0SIDL = (mask & 0x07) << 5;
+  RXF0SIDH = f[0] >> 3;
+  RXF0SIDL = (f[0] & 0x07) << 5;
+  RXF1SIDH = f[1] >> 3;
+  RXF1SIDL = (f[1] & 0x07) << 5;
+
+  mask = vehicle_can_mask(table, count, 1, 4, f);
+  RXM1SIDH = mask >> 3;
+  RXM1SIDL = (mask & 0x07) << 5;
+  RXF2SIDH = f[0] >> 3;
+  RXF2SIDL = (f[0] & 0x07) << 5;
+  RXF3SIDH = f[1] >> 3;
+  RXF3SIDL = (f[1] & 0x07) << 5;
+  RXF4SIDH = f[2] >> 3;
+  RXF4SIDL = (f[2] & 0x07) << 5;
+  RXF5SIDH = f[3] >> 3;
+  RXF5SIDL = (f[3] & 0x07) << 5;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// ISO-TP transport
+//
+// Single frame:      0L dd dd dd dd dd dd dd    (L = length 1..7)
+// First frame:       1L LL dd dd dd dd dd dd    (LLL = length 8..4095)
+// Consecutive frame: 2N dd dd dd dd dd dd dd    (N = sequence number)
+// Flow control:      3S BS ST                   (S: 0=CTS 1=WAIT 2=OVFL)
+//
+// All frames are sent with 8 data bytes, zero padded.
+//
+
+// Allocate a pool buffer of len bytes for session s, NULL if none free
+unsigned char *isotp_alloc(isotp_session_t *s, unsigned int len)
+  {
+  unsigned char k, n;
+  unsigned int mask;
+
+  n = (len + ISOTP_BLOCK_SIZE - 1) / ISOTP_BLOCK_SIZE;
+  if (n > ISOTP_POOL_BLOCKS) return NULL;
+  mask = (1 << n) - 1;
+  for (k = 0; (k + n) <= ISOTP_POOL_BLOCKS; k++, mask <<= 1)
+    {
+    if ((isotp_pool_used & mask) == 0)
+      {
+      isotp_pool_used |= mask;
+      s->blocks = mask;
+      return &isotp_pool[k * ISOTP_BLOCK_SIZE];
+      }
+    }
+  return NULL;
+  }
+
+// End session s and pass the result to its done() function
+void isotp_done(isotp_session_t *s, unsigned char status, unsigned char *data, unsigned int len)
+  {
+  unsigned char blocks = s->blocks;
+
+  s->state = ISOTP_FREE; // The done() function may start a new session
+  s->blocks = 0;
+  isotp_active--;
+  if (s->done != NULL) s->done(status, s->rxid, data, len);
+  isotp_pool_used &= ~blocks; // data is valid until here
+  }
+
+// Send a flow control frame for session s
+void isotp_fc(isotp_session_t *s, unsigned char fs)
+  {
+  unsigned char frame[8];
+  unsigned int id = s->txid;
+
+  if (id == ISOTP_FUNCTIONAL_ID) id = s->rxid - 8; // Flow control to the responder
+  memset(frame, 0, 8);
+  frame[0] = 0x30 | fs;
+  frame[1] = isotp_fc_bs;
+  frame[2] = isotp_fc_stmin;
+  can_tx_enqueue(id, 8, frame, CAN_TX_PRIO_NORMAL);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// isotp_request()
+// Start a session: send len bytes of data to txid and wait for the
+// response from rxid (len 0: just wait). Returns FALSE if rxid has a
+// session already, or no session, pool buffer or TX queue slot is free.
+//
+BOOL isotp_request(unsigned int txid, unsigned int rxid, const unsigned char *data, unsigned int len, isotp_fn_t done)
+  {
+  unsigned char k;
+  unsigned char frame[8];
+  isotp_session_t *s = NULL;
+
+  for (k = 0; k < ISOTP_SESSIONS; k++)
+    {
+    if (isotp_sessions[k].state == ISOTP_FREE)
+      {
+      if (s == NULL) s = &isotp_sessions[k];
+      }
+    else if (isotp_sessions[k].rxid == rxid)
+      return FALSE; // Busy
+    }
+  if (s == NULL) return FALSE;
+
+  s->txid = txid;
+  s->rxid = rxid;
+  s->done = done;
+  s->buf = NULL;
+  s->blocks = 0;
+  s->match = (len > 2) ? 2 : len;
+  if (len > 0) s->service = data[0];
+  if (len > 1) s->pid = data[1];
+  memset(frame, 0, 8);
+  if (len <= 7)
+    {
+    frame[0] = len;
+    memcpy(&frame[1], data, len);
+    if ((len > 0) && (!can_tx_enqueue(txid, 8, frame, CAN_TX_PRIO_LOW)))
+      return FALSE;
+    s->state = ISOTP_WAIT_RX;
+    }
+  else
+    {
+    s->buf = isotp_alloc(s, len);
+    if (s->buf == NULL) return FALSE;
+    memcpy(s->buf, data, len);
+    frame[0] = 0x10 | (len >> 8);
+    frame[1] = len & 0xff;
+    memcpy(&frame[2], data, 6);
+    if (!can_tx_enqueue(txid, 8, frame, CAN_TX_PRIO_LOW))
+      {
+      isotp_pool_used &= ~s->blocks;
+      return FALSE;
+      }
+    s->len = len;
+    s->pos = 6;
+    s->sn = 1;
+    s->state = ISOTP_WAIT_FC;
+    }
+  s->timer = ISOTP_TIMEOUT;
+  isotp_active++;
+
+  return TRUE;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// isotp_cancel()
+// End the session for rxid (if any) without calling its done() function.
+//
+void isotp_cancel(unsigned int rxid)
+  {
+  unsigned char k;
+  isotp_session_t *s;
+
+  for (k = 0; k < ISOTP_SESSIONS; k++)
+    {
+    s = &isotp_sessions[k];
+    if ((s->state != ISOTP_FREE) && (s->rxid == rxid))
+      {
+      s->done = NULL;
+      isotp_done(s, ISOTP_ERR_ABORT, NULL, 0);
+      }
+    }
+  }
+
+// Check the first n response bytes d of a single or first frame are the
+// response to the request of session s (positive or 7F negative), so
+// replies to other requests on the same rxid (i.e. the PID poll
+// scheduler's) still reach the vehicle module.
+BOOL isotp_match(isotp_session_t *s, unsigned char *d, unsigned char n)
+  {
+  if (s->match == 0) return TRUE;
+  if ((n > 0) && (d[0] == 0x7f))
+    return ((n > 1) && (d[1] == s->service)); // Negative response
+  if ((n < s->match) || (d[0] != (s->service | 0x40))) return FALSE;
+  return ((s->match < 2) || (d[1] == s->pid));
+  }
+
+////////////////////////////////////////////////////////////////////////
+// isotp_rx()
+// Called by vehicle_poll() for each received frame while sessions are
+// active. Returns TRUE if the frame in can_* belongs to a session: the
+// next frame the session's state expects, and for single and first
+// frames the response to its request.
+//
+BOOL isotp_rx(void)
+  {
+  unsigned char k, n;
+  unsigned int len;
+  isotp_session_t *s;
+
+  for (k = 0; k < ISOTP_SESSIONS; k++)
+    {
+    s = &isotp_sessions[k];
+    if ((s->state != ISOTP_FREE) && (s->rxid == can_id)) break;
+    }
+  if (k == ISOTP_SESSIONS) return FALSE;
+
+  switch (can_databuffer[0] >> 4)
+    {
+    case 0: // Single frame
+      if (s->state != ISOTP_WAIT_RX) return FALSE;
+      len = can_databuffer[0] & 0x0f;
+      if ((len < 8) && (len < can_datalength) &&
+          (!isotp_match(s, &can_databuffer[1], len))) return FALSE;
+      if ((len == 0) || (len > 7) || (len >= can_datalength))
+        isotp_done(s, ISOTP_ERR_ABORT, NULL, 0);
+      else
+        isotp_done(s, ISOTP_OK, &can_databuffer[1], len);
+      break;
+
+    case 1: // First frame
+      if ((s->state != ISOTP_WAIT_RX) ||
+          (!isotp_match(s, &can_databuffer[2], 6))) return FALSE;
+      len = ((unsigned int)(can_databuffer[0] & 0x0f) << 8) + can_databuffer[1];
+      s->buf = isotp_alloc(s, len);
+      if ((len < 8) || (s->buf == NULL))
+        {
+        isotp_fc(s, 2); // Overflow
+        isotp_done(s, ISOTP_ERR_OVERFLOW, NULL, len);
+        break;
+        }
+      memcpy(s->buf, &can_databuffer[2], 6);
+      s->len = len;
+      s->pos = 6;
+      s->sn = 1;
+      s->bs = isotp_fc_bs;
+      s->state = ISOTP_RX;
+      isotp_fc(s, 0); // Clear to send
+      break;
+
+    case 2: // Consecutive frame
+      if (s->state != ISOTP_RX) return FALSE;
+      if ((can_databuffer[0] & 0x0f) != s->sn)
+        {
+        isotp_done(s, ISOTP_ERR_SEQUENCE, NULL, s->pos);
+        break;
+        }
+      n = s->len - s->pos;
+      if (n > 7) n = 7;
+      memcpy(s->buf + s->pos, &can_databuffer[1], n);
+      s->pos += n;
+      s->sn = (s->sn + 1) & 0x0f;
+      if (s->pos >= s->len)
+        isotp_done(s, ISOTP_OK, s->buf, s->len);
+      else if ((s->bs > 0) && (--s->bs == 0))
+        {
+        s->bs = isotp_fc_bs;
+        isotp_fc(s, 0); // Next block
+        }
+      break;
+
+    case 3: // Flow control
+      if ((s->state != ISOTP_WAIT_FC) && (s->state != ISOTP_TX)) return FALSE;
+      n = can_databuffer[0] & 0x0f;
+      if (n == 0)
+        {
+        // Clear to send, STmin to TMR0 ticks (51.2uS):
+        s->bs = can_databuffer[1];
+        n = can_databuffer[2];
+        if (n <= 0x7f)
+          s->stmin = (unsigned int)n * 20;
+        else if ((n >= 0xf1) && (n <= 0xf9))
+          s->stmin = (n - 0xf0) * 2;
+        else
+          s->stmin = 127 * 20;
+        s->txtime = 0;
+        s->state = ISOTP_TX;
+        }
+      else if (n != 1) // Not WAIT: overflow or invalid
+        isotp_done(s, ISOTP_ERR_ABORT, NULL, 0);
+      break;
+
+    default:
+      return FALSE;
+    }
+
+  s->timer = ISOTP_TIMEOUT; // (Harmless if the session has ended)
+  return TRUE;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// isotp_poll()
+// Called by vehicle_poll() while sessions are active: send the due
+// consecutive frames, leaving TX queue room for other senders.
+//
+void isotp_poll(void)
+  {
+  unsigned char k, n, x;
+  unsigned char frame[8];
+  unsigned int now;
+  isotp_session_t *s;
+
+  for (k = 0; k < ISOTP_SESSIONS; k++)
+    {
+    s = &isotp_sessions[k];
+    while ((s->state == ISOTP_TX) && (CAN_TXQ_LEVEL() < (CAN_TXQ_SIZE-2)))
+      {
+      if (s->stmin > 0)
+        {
+        x = TMR0L; // Read TMR0L first to latch TMR0H
+        now = ((unsigned int)TMR0H << 8) + x;
+        if ((s->txtime != 0) && ((now - s->txtime) < s->stmin))
+          break; // Not yet (TMR0 is reset each second: now < txtime passes)
+        s->txtime = now | 1;
+        }
+      n = s->len - s->pos;
+      if (n > 7) n = 7;
+      memset(frame, 0, 8);
+      frame[0] = 0x20 | s->sn;
+      memcpy(&frame[1], s->buf + s->pos, n);
+      if (!can_tx_enqueue(s->txid, 8, frame, CAN_TX_PRIO_LOW)) break;
+      s->pos += n;
+      s->sn = (s->sn + 1) & 0x0f;
+      s->timer = ISOTP_TIMEOUT;
+      if (s->pos >= s->len)
+        {
+        // Request sent, release the buffer & wait for the response:
+        isotp_pool_used &= ~s->blocks;
+        s->blocks = 0;
+        s->buf = NULL;
+        s->state = ISOTP_WAIT_RX;
+        }
+      else if ((s->bs > 0) && (--s->bs == 0))
+        s->state = ISOTP_WAIT_FC;
+      if (s->stmin > 0) break;
+      }
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// isotp_ticker10th()
+// Called by vehicle_ticker10th() while sessions are active: time out
+// sessions the peer does not answer.
+//
+void isotp_ticker10th(void)
+  {
+  unsigned char k;
+  isotp_session_t *s;
+
+  for (k = 0; k < ISOTP_SESSIONS; k++)
+    {
+    s = &isotp_sessions[k];
+    if ((s->state != ISOTP_FREE) && (--s->timer == 0))
+      isotp_done(s, ISOTP_ERR_TIMEOUT, NULL, s->pos);
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// PID poll scheduler
+//
+
+////////////////////////////////////////////////////////////////////////
+// vehicle_poll_setlist()
+// Register the PID poll list of the vehicle module (NULL = none), and
+// spread the entries of each period evenly over it.
+//
+void vehicle_poll_setlist(const rom vehicle_poll_t *list)
+  {
+  unsigned char k, j, n, rank;
+
+  vehicle_poll_list = list;
+  vehicle_poll_count = 0;
+  vehicle_poll_pending = 0;
+  vehicle_poll_wait = 0;
+  vehicle_poll_tick = sched_tick;
+  if (list == NULL) return;
+
+  while ((list[vehicle_poll_count].txid != 0) && (vehicle_poll_count < VEHICLE_POLL_MAX))
+    vehicle_poll_count++;
+
+  memset(vehicle_pollstats, 0, sizeof(vehicle_pollstats));
+  for (k = 0; k < vehicle_poll_count; k++)
+    {
+    n = 0;
+    rank = 0;
+    for (j = 0; j < vehicle_poll_count; j++)
+      {
+      if (list[j].polltime == list[k].polltime)
+        {
+        if (j < k) rank++;
+        n++;
+        }
+      }
+    vehicle_pollstats[k].due = 1 + ((unsigned int)list[k].polltime * 10 * rank) / n;
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vehicle_poll_setstate()
+// Select the list entries to poll: those with the state in their
+// states mask. State 0 stops polling (i.e. the bus is asleep).
+//
+void vehicle_poll_setstate(unsigned char state)
+  {
+  unsigned char k;
+  unsigned long bit;
+
+  if (state == vehicle_poll_state) return;
+  vehicle_poll_state = state;
+
+  // Drop the requests due that are not polled in the new state:
+  for (k = 0, bit = 1; k < vehicle_poll_count; k++, bit <<= 1)
+    {
+    if ((vehicle_poll_list[k].states & state) == 0)
+      vehicle_poll_pending &= ~bit;
+    }
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vehicle_poll_reply()
+// Called by vehicle_poll() for each received frame while a request is
+// waiting for its reply. The frame is passed on to the vehicle module
+// in any case, this only records the reply time.
+//
+void vehicle_poll_reply(void)
+  {
+  unsigned char x;
+  unsigned int now;
+  const rom vehicle_poll_t *e = &vehicle_poll_list[vehicle_poll_current];
+  vehicle_pollstat_t *s = &vehicle_pollstats[vehicle_poll_current];
+
+  if (e->txid == ISOTP_FUNCTIONAL_ID)
+    {
+    if ((can_id & 0x7f8) != 0x7e8) return;
+    }
+  else if (can_id != e->rxid) return;
+
+  switch (e->type)
+    {
+    case VEHICLE_POLL_TYPE_OBDII:
+      if ((can_databuffer[1] == 0x7f) && (can_databuffer[2] == e->service))
+        break; // Negative response
+      if ((can_databuffer[1] != (e->service | 0x40))
+        || (can_databuffer[2] != (unsigned char)e->pid))
+        return;
+      break;
+    case VEHICLE_POLL_TYPE_OBDIIEXT:
+      if ((can_databuffer[1] == 0x7f) && (can_databuffer[2] == e->service))
+        break; // Negative response
+      if ((can_databuffer[1] != (e->service | 0x40))
+        || (can_databuffer[2] != (unsigned char)(e->pid >> 8))
+        || (can_databuffer[3] != (unsigned char)e->pid))
+        return;
+      break;
+    case VEHICLE_POLL_TYPE_SDO:
+      if ((can_databuffer[1] != (unsigned char)e->pid)
+        || (can_databuffer[2] != (unsigned char)(e->pid >> 8)))
+        return;
+      break;
+    case VEHICLE_POLL_TYPE_ADDRESSED:
+      if ((can_databuffer[1] != (e->service | 0x80))
+        || (can_databuffer[2] != (unsigned char)(e->pid >> 8))
+        || (can_databuffer[3] != (unsigned char)e->pid))
+        return;
+      break;
+    }
+
+  // Latency in 2ms units (39 TMR0 ticks), the timeout is shorter than
+  // the TMR0 reset period (0x4c00 ticks), so it wraps at most once:
+  x = TMR0L; // Read TMR0L first to latch TMR0H
+  now = ((unsigned int)TMR0H << 8) + x;
+  if (now < vehicle_poll_txtime) now += 0x4c00;
+  now = (now - vehicle_poll_txtime) / 39;
+  s->latency = (now > 255) ? 255 : now;
+  if (s->latency > s->maxlatency) s->maxlatency = s->latency;
+  vehicle_poll_wait = 0;
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vehicle_poll_run()
+// Called by vehicle_poll() while a list is registered: count down the
+// schedule in 100ms ticks, time out the pending reply, and send the
+// next request due.
+//
+void vehicle_poll_run(void)
+  {
+  unsigned char k, x;
+  unsigned long bit;
+  unsigned char data[8];
+  const rom vehicle_poll_t *e;
+  vehicle_pollstat_t *s;
+
+  while (vehicle_poll_tick != sched_tick)
+    {
+    vehicle_poll_tick++;
+    if ((vehicle_poll_wait > 0) && (--vehicle_poll_wait == 0))
+      {
+      // No reply:
+      s = &vehicle_pollstats[vehicle_poll_current];
+      if (s->misses < 255) s->misses++;
+      vehicle_poll_missed++;
+      }
+    for (k = 0, bit = 1; k < vehicle_poll_count; k++, bit <<= 1)
+      {
+      s = &vehicle_pollstats[k];
+      if (--s->due > 0) continue;
+      e = &vehicle_poll_list[k];
+      s->due = (unsigned int)e->polltime * 10;
+      if ((e->states & vehicle_poll_state) == 0) continue;
+      if (vehicle_poll_pending & bit)
+        {
+        // Still not sent since the last period:
+        if (s->misses < 255) s->misses++;
+        vehicle_poll_missed++;
+        }
+      vehicle_poll_pending |= bit;
+      }
+    }
+
+  if ((vehicle_poll_wait > 0) || (vehicle_poll_pending == 0))
+    return;
+  if (sys_features[FEATURE_CANWRITE] == 0)
+    {
+    vehicle_poll_pending = 0;
+    return;
+    }
+  if (CAN_TXQ_LEVEL() >= (CAN_TXQ_SIZE-2))
+    return; // Leave TX queue room for commands
+
+  for (k = 0, bit = 1; (vehicle_poll_pending & bit) == 0; k++, bit <<= 1);
+  e = &vehicle_poll_list[k];
+
+  memset(data, 0, 8);
+  switch (e->type)
+    {
+    case VEHICLE_POLL_TYPE_OBDII:
+      data[0] = 0x02;
+      data[1] = e->service;
+      data[2] = e->pid;
+      break;
+    case VEHICLE_POLL_TYPE_OBDIIEXT:
+      data[0] = 0x03;
+      data[1] = e->service;
+      data[2] = e->pid >> 8;
+      data[3] = e->pid;
+      break;
+    case VEHICLE_POLL_TYPE_SDO:
+      data[0] = e->service;
+      data[1] = e->pid;
+      data[2] = e->pid >> 8;
+      break;
+    case VEHICLE_POLL_TYPE_ADDRESSED:
+      data[0] = e->rxid;
+      data[1] = e->service;
+      data[2] = e->pid >> 8;
+      data[3] = e->pid;
+      break;
+    }
+  if (!can_tx_enqueue(e->txid, e->dlc, data, CAN_TX_PRIO_LOW))
+    return;
+
+  vehicle_poll_pending &= ~bit;
+  vehicle_poll_current = k;
+  vehicle_poll_wait = VEHICLE_POLL_TIMEOUT + 1; // The next tick may be due at once
+  x = TMR0L; // Read TMR0L first to latch TMR0H
+  vehicle_poll_txtime = ((unsigned int)TMR0H << 8) + x;
+  vehicle_poll_sent++;
   }
 
 ////////////////////////////////////////////////////////////////////////
 // Vehicle Public Hooks
 //
 
+// Request abort of TX buffer n if it is pending too long, can_tx_service()
+// reaps it when the controller has cleared TXREQ
+#define CAN_TXB_AGE(n) \
+  if ((can_txb_prio[n] != 0) && (++can_txb_age[n] > CAN_TX_TIMEOUT)) \
+    TXB##n##CON &= ~0b00001000
+
 void vehicle_ticker(void)
   {
   // This ticker is called once every second
@@ -265,19 +1224,34 @@ void vehicle_ticker(void)
          indicate the overflow condition.
          >>> This bit must be cleared by the MCU. <<< !!!
    * ...to be sure we're clearing all relevant flags...
+   * (high_isr() also counts can_rxq_drops, the RX interrupts are masked
+   * as the 16 bit increment is not atomic)
    */
+    PIE3 &= ~CAN_RXB_IF;
     if( COMSTATbits.RXB0OVFL )
       {
+      can_rxq_drops++;
       RXB0CONbits.RXFUL = 0; // clear buffer full flag
       PIR3bits.RXB0IF = 0; // clear interrupt flag
       COMSTATbits.RXB0OVFL = 0; // clear buffer overflow bit
       }
     if( COMSTATbits.RXB1OVFL )
       {
+      can_rxq_drops++;
       RXB1CONbits.RXFUL = 0; // clear buffer full flag
       PIR3bits.RXB1IF = 0; // clear interrupt flag
       COMSTATbits.RXB1OVFL = 0; // clear buffer overflow bit
       }
+    PIE3 |= CAN_RXB_IF;
+
+  // Abort TX frames pending for more than CAN_TX_TIMEOUT seconds (i.e.
+  // no other node acknowledges them), so the queue does not stall:
+  PIE3 &= ~CAN_TXB_IF;
+  CAN_TXB_AGE(0);
+  CAN_TXB_AGE(1);
+  CAN_TXB_AGE(2);
+  can_tx_service();
+  PIE3 |= CAN_TXB_IF;
 
   // And give the vehicle module a chance...
   if (vehicle_fn_ticker1 != NULL)
@@ -337,6 +1311,7 @@ void vehicle_ticker(void)
 
 void vehicle_ticker10th(void)
   {
+  if (isotp_active > 0) isotp_ticker10th();
   if (vehicle_fn_ticker10th != NULL) vehicle_fn_ticker10th();
   }
 
@@ -46,6 +46,169 @@ extern unsigned char  can_databuffer[8];         // CAN message bytes
 // please note: MPLAB C18 does not optimize CAN_NIB(loopvar)
 //   as good as CAN_NIBL/H used separately
 
+// CAN receive queue:
+// high_isr() copies each received frame into can_rxq[] and returns at once,
+// the frames are decoded later from the main loop by vehicle_poll(). The
+// queue is single-producer (ISR) / single-consumer (vehicle_poll), so it
+// needs no locking: only the ISR writes can_rxq_head, only the main loop
+// writes can_rxq_tail.
+#define CAN_RXQ_SIZE    16                       // Queue slots (power of 2)
+#define CAN_RXQ_RXB1    0x80                     // filter flag: frame came from RXB1
+
+typedef struct
+  {
+  unsigned int  id;                              // CAN ID
+  unsigned char filter;                          // Filter hit + CAN_RXQ_RXB1 flag
+  unsigned char datalength;                      // Number of valid data bytes
+  unsigned char data[8];                         // CAN message bytes
+  } can_frame_t;
+
+extern volatile unsigned char can_rxq_head;      // Next slot to fill (ISR)
+extern volatile unsigned char can_rxq_tail;      // Next slot to decode (main loop)
+extern unsigned char  can_rxq_highwater;         // Max queue fill level seen
+extern unsigned int   can_rxq_drops;             // Frames lost (queue full or RXBnOVFL)
+
+// CAN transmit queue:
+// can_tx_enqueue() copies a frame into can_txq[] and returns at once, the
+// frames are loaded into the three TX buffers from the caller and from the
+// TX complete interrupt. The PIC sends buffers of equal TXPRI by buffer
+// number, not in load order, so at most one frame per priority is pending
+// in hardware: frames of the same priority are sent in enqueue order.
+// Only the main loop writes can_txq_head, only can_tx_service() (called
+// with the TX interrupts disabled or from the ISR) writes can_txq_tail.
+#define CAN_TXQ_SIZE    8                        // Queue slots (power of 2)
+#define CAN_TXQ_LEVEL() ((can_txq_head - can_txq_tail) & (CAN_TXQ_SIZE-1))
+#define CAN_TX_TIMEOUT  2                        // Seconds until a pending TX buffer is aborted
+
+#define CAN_TX_PRIO_LOW      0                   // Polls & diagnostic requests
+#define CAN_TX_PRIO_NORMAL   1                   // Commands
+#define CAN_TX_PRIO_HIGH     2                   // Time critical (i.e. dash display updates)
+#define CAN_TX_PRIO_URGENT   3
+
+typedef struct
+  {
+  unsigned int  id;                              // CAN ID
+  unsigned char prio;                            // TXPRI + CAN_TXQ_LOADED flag
+  unsigned char datalength;                      // Number of data bytes
+  unsigned char data[8];                         // CAN message bytes
+  } can_txframe_t;
+
+extern volatile unsigned char can_txq_head;      // Next slot to fill (main loop)
+extern volatile unsigned char can_txq_tail;      // Oldest slot not yet loaded (can_tx_service)
+extern unsigned int   can_tx_queued;             // Frames accepted by can_tx_enqueue()
+extern unsigned int   can_tx_sent;               // Frames sent
+extern unsigned int   can_tx_aborted;            // Frames lost (queue full, not in TX mode, timeout)
+extern unsigned int   can_tx_errpassive;         // Entries into TX error-passive / bus-off state
+
+BOOL can_tx_enqueue(unsigned int id, unsigned char dlc, const unsigned char *data, unsigned char priority);
+
+// ISO-TP (ISO 15765-2) transport:
+// isotp_request() sends a request of any length (segmented into first &
+// consecutive frames as needed) and reassembles the response frames from
+// rxid. vehicle_poll() passes the frames of active sessions to the ISO-TP
+// engine instead of the vehicle module, and calls the session's done()
+// function with the complete response (or an error status). The data
+// buffers come from a fixed pool, the data pointer is only valid during
+// the done() call. Nothing blocks: consecutive frames are queued from the
+// main loop as the TX queue and the receiver's flow control allow.
+#define ISOTP_SESSIONS       3                   // Concurrent sessions (one per rxid)
+#define ISOTP_BLOCK_SIZE     32                  // Pool block size
+#define ISOTP_POOL_BLOCKS    8                   // Pool blocks (max 8): max message length 256
+#define ISOTP_TIMEOUT        10                  // N_Bs/N_Cr & response timeout (100ms ticks)
+#define ISOTP_FUNCTIONAL_ID  0x7df               // OBDII functional request ID (flow control to rxid-8)
+
+#define ISOTP_OK             0                   // done() status: response complete
+#define ISOTP_ERR_TIMEOUT    1                   // No (more) frames from the peer
+#define ISOTP_ERR_OVERFLOW   2                   // Message does not fit into the pool
+#define ISOTP_ERR_SEQUENCE   3                   // Consecutive frame lost
+#define ISOTP_ERR_ABORT      4                   // Peer flow control overflow / invalid frame
+
+typedef void (*isotp_fn_t)(unsigned char status, unsigned int rxid, unsigned char *data, unsigned int len);
+
+extern unsigned char  isotp_fc_bs;               // Our flow control: block size (0 = no limit)
+extern unsigned char  isotp_fc_stmin;            // Our flow control: separation time (ISO-TP STmin)
+
+BOOL isotp_request(unsigned int txid, unsigned int rxid, const unsigned char *data, unsigned int len, isotp_fn_t done);
+void isotp_cancel(unsigned int rxid);
+
+// PID poll scheduler:
+// A vehicle module describes its periodic requests as a rom list and
+// registers it by vehicle_poll_setlist(). The requests of each period
+// are spread evenly over it and sent one at a time from vehicle_poll(),
+// the next one only after the reply (or VEHICLE_POLL_TIMEOUT). The
+// replies still go to the vehicle module for decoding. The module
+// selects the list entries to poll by vehicle_poll_setstate().
+#define VEHICLE_POLL_MAX      20                 // Max list entries
+#define VEHICLE_POLL_TIMEOUT  5                  // Reply timeout (100ms ticks)
+
+#define VEHICLE_POLL_ON       0x01               // State: car on
+#define VEHICLE_POLL_CHARGING 0x02               // State: car charging
+#define VEHICLE_POLL_OFF      0x04               // State: car off (bus awake)
+#define VEHICLE_POLL_ALWAYS   0x07
+
+#define VEHICLE_POLL_TYPE_OBDII     1            // {02,service,pid}, reply service+0x40 / 7F
+#define VEHICLE_POLL_TYPE_OBDIIEXT  2            // {03,service,pidH,pidL}, reply service+0x40 / 7F
+#define VEHICLE_POLL_TYPE_SDO       3            // CANopen SDO upload {service,pidL,pidH,0}
+#define VEHICLE_POLL_TYPE_ADDRESSED 4            // {rxid,service,pidH,pidL}, reply service+0x80
+
+typedef struct
+  {
+  unsigned int  txid;                            // Request CAN ID (0 = end of list)
+  unsigned int  rxid;                            // Reply CAN ID (0x7e8..0x7ef for txid 0x7df)
+  unsigned char type;                            // VEHICLE_POLL_TYPE_*
+  unsigned char service;                         // Service / command byte
+  unsigned int  pid;                             // PID / object index
+  unsigned char dlc;                             // Request frame length
+  unsigned char polltime;                        // Period (seconds, 1..255)
+  unsigned char states;                          // VEHICLE_POLL_ON etc. to poll in
+  } vehicle_poll_t;
+
+typedef struct
+  {
+  unsigned int  due;                             // 100ms ticks until the next request
+  unsigned char latency;                         // Last reply latency (2ms units)
+  unsigned char maxlatency;                      // Max reply latency (2ms units)
+  unsigned char misses;                          // Requests not answered (saturating)
+  } vehicle_pollstat_t;
+
+extern const rom vehicle_poll_t *vehicle_poll_list; // Registered list (NULL = none)
+extern unsigned char  vehicle_poll_count;        // Entries in vehicle_poll_list
+extern vehicle_pollstat_t vehicle_pollstats[VEHICLE_POLL_MAX];
+extern unsigned int   vehicle_poll_sent;         // Requests sent
+extern unsigned int   vehicle_poll_missed;       // Requests not answered or skipped
+
+void vehicle_poll_setlist(const rom vehicle_poll_t *list);
+void vehicle_poll_setstate(unsigned char state); // VEHICLE_POLL_ON etc. (0 = stop polling)
+
+// CAN ID dispatch tables:
+// A vehicle module may describe its decoders as a rom table of CAN IDs,
+// sorted by ascending id, then mux. vehicle_can_dispatch() finds the
+// decoder for can_id (and data byte 0) by binary search, and
+// vehicle_can_filters() derives the RX acceptance masks and filters from
+// the same table, so the hardware filters always match the decoders.
+// - mask: entries with a mask below 0x7ff cover an ID range (id is the
+//   range base), the ranges must not overlap other entries
+// - mux: an ID either has a single VEHICLE_CAN_ANYMUX entry, or one
+//   entry per data byte 0 value it decodes
+// - stale: if set, this stale indicator is reset to staleticks before
+//   the decoder is called
+typedef struct
+  {
+  unsigned int  id;                              // CAN ID
+  unsigned int  mask;                            // ID bits to match (0x7ff: id only)
+  unsigned int  mux;                             // Data byte 0 value, or VEHICLE_CAN_ANYMUX
+  unsigned char buffer;                          // RX buffer to accept into (0/1)
+  rom BOOL (*handler)(void);                     // Decoder for the frame in can_*
+  signed char   *stale;                          // Stale indicator to reset, or NULL
+  signed char   staleticks;                      // ...to this value
+  } vehicle_can_handler_t;
+
+#define VEHICLE_CAN_ID       0x7ff               // mask: match id only
+#define VEHICLE_CAN_ANYMUX   0x100               // mux: any data byte 0
+
+BOOL vehicle_can_dispatch(const rom vehicle_can_handler_t *table, unsigned char count);
+void vehicle_can_filters(const rom vehicle_can_handler_t *table, unsigned char count);
+
 extern unsigned char  can_minSOCnotified;        // minSOC notified flags
 #define CAN_MINSOC_ALERT_MAIN    1               // minSOC notify flag for main battery
 #define CAN_MINSOC_ALERT_12V     2               // minSOC notify flag for 12V battery
@@ -73,12 +236,17 @@ extern rom BOOL (*vehicle_fn_ticker)(void);
 extern rom BOOL (*vehicle_fn_ticker10th)(void);
 extern rom BOOL (*vehicle_fn_idlepoll)(void);
 extern rom BOOL (*vehicle_fn_commandhandler)(BOOL msgmode, int code, char* msg);
-extern rom BOOL (*vehicle_fn_smshandler)(BOOL premsg, char *caller, char *command, char *arguments);
-extern rom BOOL (*vehicle_fn_smsextensions)(char *caller, char *command, char *arguments);
+extern rom BOOL (*vehicle_fn_smscmd)(unsigned char k, BOOL premsg, char *caller, char *command, char *arguments);
 extern rom int  (*vehicle_fn_minutestocharge)(unsigned char chgmod, int wAvail, int ixEnd, int pctEnd);
 
+// Vehicle SMS commands, a sorted table as net_sms::sms_cmdtable, dispatched
+// by index through vehicle_fn_smscmd() (premsg: TRUE=may replace, FALSE=may extend):
+extern char const rom far *vehicle_sms_cmdtable;
+extern unsigned char vehicle_sms_cmds;
+
 void vehicle_initialise(void);
 
+void vehicle_poll(void);
 void vehicle_ticker(void);
 void vehicle_ticker10th(void);
 void vehicle_idlepoll(void);
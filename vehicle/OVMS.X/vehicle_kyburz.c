@@ -45,17 +45,12 @@ BOOL kd_bus_is_active;           // Indicates recent activity on the bus
 // vehicle_kyburz_polls
 // This rom table records the extended PIDs that need to be polled
 
-rom struct
-  {
-  unsigned int moduleid;
-  unsigned char polltime;
-  unsigned int pid;
-  } vehicle_kyburz_polls[]
+rom vehicle_poll_t vehicle_kyburz_polls[]
   =
   {
-    { 0x0626, 10, 0x3405 },  // SOC
-    { 0x0626, 60, 0x33E7 },  // Charging current
-    { 0x0000, 0,  0x0000 }
+    { 0x0626, 0x05A6, VEHICLE_POLL_TYPE_SDO, 0x42, 0x3405, 4, 10, VEHICLE_POLL_ALWAYS },  // SOC
+    { 0x0626, 0x05A6, VEHICLE_POLL_TYPE_SDO, 0x42, 0x33E7, 4, 60, VEHICLE_POLL_ALWAYS },  // Charging current
+    { 0 }
   };
 
 ////////////////////////////////////////////////////////////////////////
@@ -65,9 +60,6 @@ rom struct
 //
 BOOL vehicle_kyburz_ticker1(void)
   {
-  int k;
-  BOOL doneone = FALSE;
-
   if (kd_candata_timer>0)
     {
     if (--kd_candata_timer == 0)
@@ -111,38 +103,9 @@ BOOL vehicle_kyburz_ticker1(void)
   ////////////////////////////////////////////////////////////////////////
 
   // bus_is_active indicates we've recently seen a message on the can bus
-  // Quick exit if bus is recently not active
-  if (!kd_bus_is_active) return FALSE;
+  // Stop polling if bus is recently not active
+  vehicle_poll_setstate((kd_bus_is_active) ? VEHICLE_POLL_ON : 0);
 
-  // Also, we need CAN_WRITE enabled, so return if not
-  if (sys_features[FEATURE_CANWRITE]==0) return FALSE;
-
-  // Let's run through and see if we have to poll for any data..
-  for (k=0;vehicle_kyburz_polls[k].moduleid != 0; k++)
-    {
-    if ((can_granular_tick % vehicle_kyburz_polls[k].polltime) == 0)
-      {
-      // OK. Let's send it...
-      if (doneone)
-        delay100b(); // Delay a little... (100ms, approx)
-
-      while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-      TXB0CON = 0;
-      TXB0SIDL = (vehicle_kyburz_polls[k].moduleid & 0x07)<<5;
-      TXB0SIDH = (vehicle_kyburz_polls[k].moduleid>>3);
-      TXB0D0 = 0x42;        // Read Expedited
-      TXB0D1 = vehicle_kyburz_polls[k].pid & 0xff;
-      TXB0D2 = vehicle_kyburz_polls[k].pid >> 8;
-      TXB0D3 = 0x00;        // Sub-index: 0
-      TXB0D4 = 0x00;
-      TXB0D5 = 0x00;
-      TXB0D6 = 0x00;
-      TXB0D7 = 0x00;
-      TXB0DLC = 0b00000100; // data length (4)
-      TXB0CON = 0b00001000; // mark for transmission
-      doneone = TRUE;
-      }
-    }
   // Assume the bus is not active, so we won't poll any more until we see
   // activity on the bus
   kd_bus_is_active = FALSE;
@@ -158,9 +121,7 @@ BOOL vehicle_kyburz_ticker1(void)
 BOOL vehicle_kyburz_poll0(void)
   {
   unsigned int pid;
-  unsigned char k;
   unsigned int value16;
-  unsigned char value8;
 
   kd_candata_timer = 60;   // Reset the timer
 
@@ -214,8 +175,6 @@ BOOL vehicle_kyburz_poll0(void)
 //
 BOOL vehicle_kyburz_initialise(void)
   {
-  char *p;
-
   car_type[0] = 'K'; // Car is type KD - Kyburz DXP
   car_type[1] = 'D';
   car_type[2] = 0;
@@ -270,6 +229,7 @@ BOOL vehicle_kyburz_initialise(void)
   // Hook in...
   vehicle_fn_poll0 = &vehicle_kyburz_poll0;
   vehicle_fn_ticker1 = &vehicle_kyburz_ticker1;
+  vehicle_poll_setlist(vehicle_kyburz_polls);
 
   net_fnbits |= NET_FN_INTERNALGPS;   // Require internal GPS
   net_fnbits |= NET_FN_12VMONITOR;    // Require 12v monitor
@@ -482,7 +482,6 @@ BOOL vehicle_mitsubishi_poll1(void)
 //
 BOOL vehicle_mitsubishi_initialise(void)
   {
-  char *p;
   int i;
   
   car_type[0] = 'M'; // Car is type MI - Mitsubishi iMiev
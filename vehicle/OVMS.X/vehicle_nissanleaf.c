@@ -65,8 +65,6 @@ BOOL vehicle_nissanleaf_poll1(void)
 //
 BOOL vehicle_nissanleaf_initialise(void)
   {
-  char *p;
-
   car_type[0] = 'N'; // Car is type NL - Nissan Leaf
   car_type[1] = 'L';
   car_type[2] = 0;
@@ -41,8 +41,6 @@
 //
 BOOL vehicle_none_initialise(void)
   {
-  char *p;
-
   car_type[0] = 'N'; // Car is type NONE
   car_type[1] = 'O';
   car_type[2] = 'N';
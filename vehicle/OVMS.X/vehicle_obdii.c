@@ -34,12 +34,13 @@
 // OBDII state variables
 
 #pragma udata overlay vehicle_overlay_data
-BOOL obdii_bus_is_active;           // Indicates recent activity on the bus
 unsigned char obdii_candata_timer;  // A per-second timer for CAN bus data
 
 unsigned char obdii_expect_pid;  // OBDII expected PID
 BOOL obdii_expect_waiting;      // OBDII expected waiting for response
-char obdii_expect_buf[64];      // Space for a response
+unsigned int obdii_expect_id;   // Response CAN ID
+unsigned int obdii_expect_len;  // Response length
+unsigned char obdii_expect_data[40]; // Space for a response (the first 40 bytes)
 
 #pragma udata
 
@@ -47,22 +48,17 @@ char obdii_expect_buf[64];      // Space for a response
 // vehicle_obdii_polls
 // This rom table records the PIDs that need to be polled
 
-rom struct
-  {
-  unsigned char polltime;
-  unsigned char service;
-  unsigned char pid;
-  } vehicle_obdii_polls[]
+rom vehicle_poll_t vehicle_obdii_polls[]
   =
   {
-    { 30, 0x01, 0x46 },
-    { 10, 0x01, 0x0d },
-    { 30, 0x01, 0x2f },
-    { 10, 0x01, 0x0c },
-    { 10, 0x01, 0x05 },
-    { 10, 0x01, 0x0f },
-    { 10, 0x01, 0x5c },
-    { 0,  0x00, 0x00 }
+    { 0x7df, 0x7e8, VEHICLE_POLL_TYPE_OBDII, 0x01, 0x46, 8, 30, VEHICLE_POLL_ON },
+    { 0x7df, 0x7e8, VEHICLE_POLL_TYPE_OBDII, 0x01, 0x0d, 8, 10, VEHICLE_POLL_ON },
+    { 0x7df, 0x7e8, VEHICLE_POLL_TYPE_OBDII, 0x01, 0x2f, 8, 30, VEHICLE_POLL_ON },
+    { 0x7df, 0x7e8, VEHICLE_POLL_TYPE_OBDII, 0x01, 0x0c, 8, 10, VEHICLE_POLL_ON },
+    { 0x7df, 0x7e8, VEHICLE_POLL_TYPE_OBDII, 0x01, 0x05, 8, 10, VEHICLE_POLL_ON },
+    { 0x7df, 0x7e8, VEHICLE_POLL_TYPE_OBDII, 0x01, 0x0f, 8, 10, VEHICLE_POLL_ON },
+    { 0x7df, 0x7e8, VEHICLE_POLL_TYPE_OBDII, 0x01, 0x5c, 8, 10, VEHICLE_POLL_ON },
+    { 0 }
   };
 
 ////////////////////////////////////////////////////////////////////////
@@ -72,8 +68,8 @@ rom struct
 //
 BOOL vehicle_obdii_ticker1(void)
   {
-  int k;
-  BOOL doneone = FALSE;
+  unsigned char k;
+  char *p;
 
   ////////////////////////////////////////////////////////////////////////
   // Stale tickers
@@ -96,10 +92,16 @@ BOOL vehicle_obdii_ticker1(void)
   ////////////////////////////////////////////////////////////////////////
   if (obdii_expect_waiting)
     {
-    delay100(1);
     net_msg_start();
-    strcpy(net_scratchpad,obdii_expect_buf);
+    p = stp_rom(net_scratchpad, "MP-0 ");
+    p = stp_i(p, "c", 45);
+    p = stp_i(p, ",0,", obdii_expect_id);
+    p = stp_i(p, ",", obdii_expect_pid);
+    p = stp_i(p, ",", obdii_expect_len);
+    for (k=0; (k<obdii_expect_len)&&(k<sizeof(obdii_expect_data)); k++)
+      p = stp_i(p, ",", obdii_expect_data[k]);
     net_msg_encode_puts();
+    net_msg_send();
     obdii_expect_waiting = FALSE;
     }
 
@@ -107,42 +109,9 @@ BOOL vehicle_obdii_ticker1(void)
   // OBDII PID polling
   ////////////////////////////////////////////////////////////////////////
 
-  // obdii_bus_is_active indicates we've recently seen a message on the can bus
-  // Quick exit if bus is recently not active
-  if (!obdii_bus_is_active) return FALSE;
-
-  // Also, we need CAN_WRITE enabled, so return if not
-  if (sys_features[FEATURE_CANWRITE]==0) return FALSE;
-
-  // Let's run through and see if we have to poll for any data..
-  for (k=0;vehicle_obdii_polls[k].polltime != 0; k++)
-    {
-    if ((can_granular_tick % vehicle_obdii_polls[k].polltime) == 0)
-      {
-      // OK. Let's send it...
-      if (doneone)
-        delay100b(); // Delay a little... (100ms, approx)
-
-      while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-      TXB0CON = 0;
-      TXB0SIDL = 0b11100000;  // 0x07df
-      TXB0SIDH = 0b11111011;
-      TXB0D0 = 0x02;
-      TXB0D1 = vehicle_obdii_polls[k].service;
-      TXB0D2 = vehicle_obdii_polls[k].pid;
-      TXB0D3 = 0x00;
-      TXB0D4 = 0x00;
-      TXB0D5 = 0x00;
-      TXB0D6 = 0x00;
-      TXB0D7 = 0x00;
-      TXB0DLC = 0b00001000; // data length (8)
-      TXB0CON = 0b00001000; // mark for transmission
-      doneone = TRUE;
-      }
-    }
-  // Assume the bus is not active, so we won't poll any more until we see
-  // activity on the bus
-  obdii_bus_is_active = FALSE;
+  // We only receive the replies, so poll while the car is awake (replies
+  // seen within the last minute), stop polling when it has gone to sleep
+  vehicle_poll_setstate((obdii_candata_timer>0) ? VEHICLE_POLL_ON : 0);
   return FALSE;
   }
 
@@ -154,31 +123,14 @@ BOOL vehicle_obdii_ticker1(void)
 BOOL vehicle_obdii_poll0(void)
   {
   unsigned int pid;
-  unsigned char k;
   unsigned char value1;
   unsigned int value2;
-  char *p;
 
-  obdii_bus_is_active = TRUE; // Activity has been seen on the bus
   obdii_candata_timer = 60;   // Reset the timer
 
   pid = can_databuffer[2];
   value1 = can_databuffer[3];
-  value2 = (unsigned int)can_databuffer[3]<<8 + (unsigned int)can_databuffer[4];
-
-  // First check for net_msg 45 (OBDII pid request)
-  if ((pid == obdii_expect_pid)&&(!obdii_expect_waiting))
-    {
-    // This is the response we were looking for
-    p = stp_rom(obdii_expect_buf, "MP-0 ");
-    p = stp_i(p, "c", 45);
-    p = stp_i(p, ",0,",can_id);
-    p = stp_i(p, ",", pid);
-    for (k=0;k<8;k++)
-      p = stp_i(p, ",", can_databuffer[k]);
-    obdii_expect_waiting = TRUE;
-    obdii_expect_pid = 0;
-    }
+  value2 = ((unsigned int)can_databuffer[3]<<8) + (unsigned int)can_databuffer[4];
 
   if ((can_databuffer[1] < 0x40)||
       (can_databuffer[1] > 0x4a)) return TRUE; // Check the return code
@@ -240,9 +192,27 @@ BOOL vehicle_obdii_poll0(void)
   return TRUE;
   }
 
+////////////////////////////////////////////////////////////////////////
+// vehicle_obdii_isotp_done()
+// ISO-TP completion of a net_msg 45 PID request: keep the response for
+// vehicle_obdii_ticker1() to send (single & multi frame responses).
+//
+void vehicle_obdii_isotp_done(unsigned char status, unsigned int rxid, unsigned char *data, unsigned int len)
+  {
+  if ((status != ISOTP_OK)||(obdii_expect_waiting))
+    return;
+
+  obdii_expect_id = rxid;
+  obdii_expect_len = len;
+  if (len > sizeof(obdii_expect_data)) len = sizeof(obdii_expect_data);
+  memcpy(obdii_expect_data, data, len);
+  obdii_expect_waiting = TRUE;
+  }
+
 BOOL vehicle_obdii_fn_commandhandler(BOOL msgmode, int cmd, char *msg)
   {
   unsigned int service;
+  unsigned char data[2];
 
   switch (cmd)
     {
@@ -257,22 +227,11 @@ BOOL vehicle_obdii_fn_commandhandler(BOOL msgmode, int cmd, char *msg)
 
       obdii_expect_waiting = FALSE;
 
-      delay100b(); // Delay a little... (100ms, approx)
-
-      while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-      TXB0CON = 0;
-      TXB0SIDL = 0b11100000;  // 0x07df
-      TXB0SIDH = 0b11111011;
-      TXB0D0 = 0x02;
-      TXB0D1 = service;
-      TXB0D2 = obdii_expect_pid;
-      TXB0D3 = 0x00;
-      TXB0D4 = 0x00;
-      TXB0D5 = 0x00;
-      TXB0D6 = 0x00;
-      TXB0D7 = 0x00;
-      TXB0DLC = 0b00001000; // data length (8)
-      TXB0CON = 0b00001000; // mark for transmission
+      // Request from all ECUs, the engine ECU (0x7e8) response may be multi frame:
+      data[0] = service;
+      data[1] = obdii_expect_pid;
+      isotp_cancel(0x7e8);
+      isotp_request(0x7df, 0x7e8, data, 2, vehicle_obdii_isotp_done);
 
       return TRUE;
     }
@@ -289,8 +248,6 @@ BOOL vehicle_obdii_fn_commandhandler(BOOL msgmode, int cmd, char *msg)
 //
 BOOL vehicle_obdii_initialise(void)
   {
-  char *p;
-
   car_type[0] = 'O'; // Car is type OBDII
   car_type[1] = '2';
   car_type[2] = 0;
@@ -298,7 +255,6 @@ BOOL vehicle_obdii_initialise(void)
   car_type[4] = 0;
 
   // Vehicle specific data initialisation
-  obdii_bus_is_active = FALSE;       // Indicates recent activity on the bus
   obdii_candata_timer = 0;
   obdii_expect_pid = 0;
   obdii_expect_waiting = FALSE;
@@ -343,6 +299,7 @@ BOOL vehicle_obdii_initialise(void)
   vehicle_fn_poll0 = &vehicle_obdii_poll0;
   vehicle_fn_ticker1 = &vehicle_obdii_ticker1;
   vehicle_fn_commandhandler = &vehicle_obdii_fn_commandhandler;
+  vehicle_poll_setlist(vehicle_obdii_polls);
 
   net_fnbits |= NET_FN_INTERNALGPS;   // Require internal GPS
   net_fnbits |= NET_FN_12VMONITOR;    // Require 12v monitor
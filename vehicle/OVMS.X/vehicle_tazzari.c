@@ -45,32 +45,27 @@ BOOL tz_bus_is_active;           // Indicates recent activity on the bus
 // vehicle_tazzari_polls
 // This rom table records the extended PIDs that need to be polled
 
-rom struct
-  {
-  unsigned int moduleid;
-  unsigned char polltime;
-  unsigned int pid;
-  } vehicle_tazzari_polls[]
+rom vehicle_poll_t vehicle_tazzari_polls[]
   =
   {
-    { 0x078A, 10, 0xF9EF },  // SOC
-    { 0x078A, 60, 0xF29F },  // Battery temperature
-    { 0x078A, 60, 0xF9A7 },  // Battery capacity
-    { 0x078A, 10, 0xF6E0 },  // Charge status
-    { 0x078A, 10, 0xF6D8 },  // Drive mode
-    { 0x078A, 60, 0x4E39 },  // Serial number of the handheld
-    { 0x078A, 60, 0x55F0 },  // EEPROM error check
-    { 0x078A, 60, 0x55F4 },  // SPI comms check
-    { 0x078A, 60, 0x55F2 },  // BMS params check
-    { 0x078A, 60, 0xFD84 },  // BMS error check
-    { 0x078A, 60, 0xF5B5 },  // Total voltage of the pack
-    { 0x078A, 60, 0xF5BF },  // Highest cell voltage
-    { 0x078A, 60, 0xF5C4 },  // Lowest cell voltage
-    { 0x078A, 60, 0xF5B6 },  // Average cell voltage
-    { 0x078A, 60, 0xF5B7 },  // SD of cell voltages
-    { 0x078A, 10, 0xF2A9 },  // Pack current
-    { 0x078A, 10, 0xF9B1 },  // Total Ah in the batteries
-    { 0x0000, 0,  0x0000 }
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF9EF, 4, 10, VEHICLE_POLL_ALWAYS },  // SOC
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF29F, 4, 60, VEHICLE_POLL_ALWAYS },  // Battery temperature
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF9A7, 4, 60, VEHICLE_POLL_ALWAYS },  // Battery capacity
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF6E0, 4, 10, VEHICLE_POLL_ALWAYS },  // Charge status
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF6D8, 4, 10, VEHICLE_POLL_ALWAYS },  // Drive mode
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0x4E39, 4, 60, VEHICLE_POLL_ALWAYS },  // Serial number of the handheld
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0x55F0, 4, 60, VEHICLE_POLL_ALWAYS },  // EEPROM error check
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0x55F4, 4, 60, VEHICLE_POLL_ALWAYS },  // SPI comms check
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0x55F2, 4, 60, VEHICLE_POLL_ALWAYS },  // BMS params check
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xFD84, 4, 60, VEHICLE_POLL_ALWAYS },  // BMS error check
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF5B5, 4, 60, VEHICLE_POLL_ALWAYS },  // Total voltage of the pack
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF5BF, 4, 60, VEHICLE_POLL_ALWAYS },  // Highest cell voltage
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF5C4, 4, 60, VEHICLE_POLL_ALWAYS },  // Lowest cell voltage
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF5B6, 4, 60, VEHICLE_POLL_ALWAYS },  // Average cell voltage
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF5B7, 4, 60, VEHICLE_POLL_ALWAYS },  // SD of cell voltages
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF2A9, 4, 10, VEHICLE_POLL_ALWAYS },  // Pack current
+    { 0x078A, 0x0775, VEHICLE_POLL_TYPE_ADDRESSED, 0x21, 0xF9B1, 4, 10, VEHICLE_POLL_ALWAYS },  // Total Ah in the batteries
+    { 0 }
   };
 
 ////////////////////////////////////////////////////////////////////////
@@ -80,9 +75,6 @@ rom struct
 //
 BOOL vehicle_tazzari_ticker1(void)
   {
-  int k;
-  BOOL doneone = FALSE;
-
   if (tz_candata_timer>0)
     {
     if (--tz_candata_timer == 0)
@@ -126,38 +118,9 @@ BOOL vehicle_tazzari_ticker1(void)
   ////////////////////////////////////////////////////////////////////////
 
   // bus_is_active indicates we've recently seen a message on the can bus
-  // Quick exit if bus is recently not active
-  if (!tz_bus_is_active) return FALSE;
+  // Stop polling if bus is recently not active
+  vehicle_poll_setstate((tz_bus_is_active) ? VEHICLE_POLL_ON : 0);
 
-  // Also, we need CAN_WRITE enabled, so return if not
-  if (sys_features[FEATURE_CANWRITE]==0) return FALSE;
-
-  // Let's run through and see if we have to poll for any data..
-  for (k=0;vehicle_tazzari_polls[k].moduleid != 0; k++)
-    {
-    if ((can_granular_tick % vehicle_tazzari_polls[k].polltime) == 0)
-      {
-      // OK. Let's send it...
-      if (doneone)
-        delay100b(); // Delay a little... (100ms, approx)
-
-      while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-      TXB0CON = 0;
-      TXB0SIDL = (vehicle_tazzari_polls[k].moduleid & 0x07)<<5;
-      TXB0SIDH = (vehicle_tazzari_polls[k].moduleid>>3);
-      TXB0D0 = 0x75;
-      TXB0D1 = 0x21;        // Get extended PID
-      TXB0D2 = vehicle_tazzari_polls[k].pid >> 8;
-      TXB0D3 = vehicle_tazzari_polls[k].pid & 0xff;
-      TXB0D4 = 0x00;
-      TXB0D5 = 0x00;
-      TXB0D6 = 0x00;
-      TXB0D7 = 0x00;
-      TXB0DLC = 0b00000100; // data length (4)
-      TXB0CON = 0b00001000; // mark for transmission
-      doneone = TRUE;
-      }
-    }
   // Assume the bus is not active, so we won't poll any more until we see
   // activity on the bus
   tz_bus_is_active = FALSE;
@@ -173,7 +136,6 @@ BOOL vehicle_tazzari_ticker1(void)
 BOOL vehicle_tazzari_poll0(void)
   {
   unsigned int pid;
-  unsigned char k;
   unsigned int value16;
   unsigned char value8;
 
@@ -291,8 +253,6 @@ BOOL vehicle_tazzari_poll1(void)
 //
 BOOL vehicle_tazzari_initialise(void)
   {
-  char *p;
-
   car_type[0] = 'T'; // Car is type TZ - Tazzari Zero
   car_type[1] = 'Z';
   car_type[2] = 'Z';
@@ -354,6 +314,7 @@ BOOL vehicle_tazzari_initialise(void)
   vehicle_fn_poll0 = &vehicle_tazzari_poll0;
   vehicle_fn_poll1 = &vehicle_tazzari_poll1;
   vehicle_fn_ticker1 = &vehicle_tazzari_ticker1;
+  vehicle_poll_setlist(vehicle_tazzari_polls);
 
   net_fnbits |= NET_FN_INTERNALGPS;   // Require internal GPS
   net_fnbits |= NET_FN_12VMONITOR;    // Require 12v monitor
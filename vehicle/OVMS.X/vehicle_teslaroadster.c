@@ -52,6 +52,7 @@ rom char teslaroadster_capabilities[] = "C10-12,C15-24";
 
 #pragma udata overlay vehicle_overlay_data
 signed char tr_cooldown_recycle;             // Ticker counter for cooldown recycle
+unsigned char tr_cooldown_step;              // Cooldown start sequence step
 unsigned char can_lastspeedmsg[8];           // A buffer to store the last speed message
 unsigned char can_lastspeedrpt;              // A mechanism to repeat the tx of last speed message
 unsigned char tr_requestcac;                 // Request CAC
@@ -61,335 +62,424 @@ unsigned char tr_requestcac;                 // Request CAC
 BOOL vehicle_teslaroadster_ticker60(void);
 
 ////////////////////////////////////////////////////////////////////////
-// can_poll()
-// This function is an entry point from the main() program loop, and
-// gives the CAN framework an opportunity to poll for data.
+// CAN frame decoders, called via vehicle_can_dispatch()
+// ID 0x100 and 0x102 (buffer 0) carry the VMS messages, multiplexed by
+// data byte 0, one decoder per message type.
 //
-BOOL vehicle_teslaroadster_poll0(void)                // CAN ID 100 and 102
+
+// CAN ID 0x100 0x06: Charge timer mode
+BOOL vehicle_teslaroadster_can100_06(void)
   {
-  unsigned char k;
-  unsigned int k1;
-  unsigned long k2;
+  if (can_databuffer[1] == 0x1b)
+    {
+    car_timermode = can_databuffer[4];
+    car_stale_timer = 1; // Reset stale indicator
+    }
+  else if (can_databuffer[1] == 0x1a)
+    {
+    car_timerstart = (can_databuffer[4]<<8)+can_databuffer[5];
+    car_stale_timer = 1; // Reset stale indicator
+    }
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x80: Range / State of Charge
+BOOL vehicle_teslaroadster_can100_80(void)
+  {
+  car_SOC = can_databuffer[1];
+  car_idealrange = can_databuffer[2]+((unsigned int) can_databuffer[3] << 8);
+  car_estrange = can_databuffer[6]+((unsigned int) can_databuffer[7] << 8);
+  if (car_idealrange>6000) car_idealrange=0; // Sanity check (limit rng->std)
+  if (car_estrange>6000)   car_estrange=0; // Sanity check (limit rng->std)
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x81: Time/ Date UTC
+BOOL vehicle_teslaroadster_can100_81(void)
+  {
+  car_time = can_databuffer[4]
+             + ((unsigned long) can_databuffer[5] << 8)
+             + ((unsigned long) can_databuffer[6] << 16)
+             + ((unsigned long) can_databuffer[7] << 24);
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x82: Ambient Temperature
+BOOL vehicle_teslaroadster_can100_82(void)
+  {
+  car_ambient_temp = (signed char)can_databuffer[1];
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x83: GPS Latitude
+BOOL vehicle_teslaroadster_can100_83(void)
+  {
+  car_latitude = can_databuffer[4]
+                 + ((unsigned long) can_databuffer[5] << 8)
+                 + ((unsigned long) can_databuffer[6] << 16)
+                 + ((unsigned long) can_databuffer[7] << 24);
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x84: GPS Longitude
+BOOL vehicle_teslaroadster_can100_84(void)
+  {
+  car_longitude = can_databuffer[4]
+                  + ((unsigned long) can_databuffer[5] << 8)
+                  + ((unsigned long) can_databuffer[6] << 16)
+                  + ((unsigned long) can_databuffer[7] << 24);
+  return TRUE;
+  }
 
-  if (can_id == 0x100)
+// CAN ID 0x100 0x85: GPS direction and altitude
+BOOL vehicle_teslaroadster_can100_85(void)
+  {
+  car_gpslock = can_databuffer[1];
+  if (car_gpslock)
     {
-    switch (can_databuffer[0])
-      {
-      case 0x06: // Charge timer mode
-        if (can_databuffer[1] == 0x1b)
-          {
-          car_timermode = can_databuffer[4];
-          car_stale_timer = 1; // Reset stale indicator
-          }
-        else if (can_databuffer[1] == 0x1a)
-          {
-          car_timerstart = (can_databuffer[4]<<8)+can_databuffer[5];
-          car_stale_timer = 1; // Reset stale indicator
-          }
-        break;
-      case 0x80: // Range / State of Charge
-        car_SOC = can_databuffer[1];
-        car_idealrange = can_databuffer[2]+((unsigned int) can_databuffer[3] << 8);
-        car_estrange = can_databuffer[6]+((unsigned int) can_databuffer[7] << 8);
-        if (car_idealrange>6000) car_idealrange=0; // Sanity check (limit rng->std)
-        if (car_estrange>6000)   car_estrange=0; // Sanity check (limit rng->std)
-        break;
-      case 0x81: // Time/ Date UTC
-        car_time = can_databuffer[4]
-                   + ((unsigned long) can_databuffer[5] << 8)
-                   + ((unsigned long) can_databuffer[6] << 16)
-                   + ((unsigned long) can_databuffer[7] << 24);
-        break;
-      case 0x82: // Ambient Temperature
-        car_ambient_temp = (signed char)can_databuffer[1];
-        car_stale_ambient = 120; // Reset stale indicator
-        break;
-      case 0x83: // GPS Latitude
-        car_latitude = can_databuffer[4]
-                       + ((unsigned long) can_databuffer[5] << 8)
-                       + ((unsigned long) can_databuffer[6] << 16)
-                       + ((unsigned long) can_databuffer[7] << 24);
-        break;
-      case 0x84: // GPS Longitude
-        car_longitude = can_databuffer[4]
-                        + ((unsigned long) can_databuffer[5] << 8)
-                        + ((unsigned long) can_databuffer[6] << 16)
-                        + ((unsigned long) can_databuffer[7] << 24);
-        break;
-      case 0x85: // GPS direction and altitude
-        car_gpslock = can_databuffer[1];
-        if (car_gpslock)
-          {
-          car_direction = ((unsigned int)can_databuffer[3]<<8)+(can_databuffer[2]);
-          if (car_direction==360) car_direction=0; // Bug-fix for Tesla VMS bug
-          if (can_databuffer[5]&0xf0)
-            car_altitude = 0;
-          else
-            car_altitude = ((unsigned int)can_databuffer[5]<<8)+(can_databuffer[4]);
-          car_stale_gps = 120; // Reset stale indicator
-          }
-        else
-          {
-          car_stale_gps = 0; // Reset stale indicator
-          }
-        break;
-      case 0x88: // Charging Current / Duration
-        if (can_databuffer[6] != car_chargelimit)
-          { // If the charge limit has changed, notify it
-          net_req_notification(NET_NOTIFY_STAT);
-          }
-        car_chargecurrent = can_databuffer[1];
-        car_chargelimit = can_databuffer[6];
-        car_chargeduration = ((unsigned int)can_databuffer[3]<<8)+(can_databuffer[2]);
-        break;
-      case 0x89: // Charging Voltage / Iavailable
-        if (can_mileskm=='M')
-          car_speed = can_databuffer[1];     // speed in miles/hour
-        else
-          car_speed = (unsigned char) ((((unsigned long)can_databuffer[1] * 1609)+500)/1000);     // speed in km/hour
-        car_linevoltage = can_databuffer[2]
-                          + ((unsigned int) can_databuffer[3] << 8);
-        break;
-      case 0x93: // VDS Vehicle Error
-        k = can_databuffer[1];
-        k1 = ((unsigned int)can_databuffer[3]<<8)+(can_databuffer[2]);
-        k2 = (((unsigned long)can_databuffer[7]<<24) +
-              ((unsigned long)can_databuffer[6]<<16) +
-              ((unsigned long)can_databuffer[5]<<8) +
-              (can_databuffer[4]));
-        if (k1 != 0xffff)
-          {
-          if ((k == 0x14)&&(k1 == 25))
-            {
-            // Special case of 100% vehicle logs
-            net_req_notification_error(0, 0);
-            net_req_notification_error(k1, k2); // Notify the 100%
-            }
-          else if (k & 0x01)
-            {
-            // An error code is being raised
-            net_req_notification_error(k1, k2);
-            }
-          else
-            {
-            // An error code is being cleared
-            net_req_notification_error(0, 0);
-            }
-          }
-        break;
-      case 0x8F: // HVAC#1 message
-        k1 = ((unsigned int)can_databuffer[7]<<8)+(can_databuffer[6]);
-        if (k1 > 0)
-          {
-          car_doors5bits.HVAC = 1;
-          tr_cooldown_recycle = -1;  // Stop the recycle attempts
-          }
-        else
-          {
-          if ((car_coolingdown>=0)&&(car_doors5bits.HVAC))
-            {
-            // Car is cooling down, and HVAC has just gone off - end of a cycle
-            car_coolingdown++;
-            tr_cooldown_recycle = 60;  // Try to recycle cooling in 60 seconds
-            net_req_notification(NET_NOTIFY_STAT);
-            }
-          car_doors5bits.HVAC = 0;
-          }
-        break;
-      case 0x95: // Charging mode
-        if ((can_databuffer[1] != car_chargestate)&&            // Charge state has changed AND
-            ((car_chargestate<=2)||(car_chargestate==0x0f))&&   // was (Charging or Heating) AND
-            (can_databuffer[1]!=0x04))                          // new state is not done
-          {
-          // We've moved from charging/heating to something other than DONE
-          // Let's treat this as a notifiable alert
-          net_req_notification(NET_NOTIFY_CHARGE);
-          }
-        if ((can_databuffer[1] != car_chargestate)||
-            (can_databuffer[2] != car_chargesubstate))
-          { // If the state or sub-state has changed, notify it
-          net_req_notification(NET_NOTIFY_STAT);
-          if (can_databuffer[1]==1)
-            tr_requestcac=2; // Request CAC when charge starts
-          }
-        car_chargestate = can_databuffer[1];
-        car_chargesubstate = can_databuffer[2];
-        if (sys_features[FEATURE_CARBITS]&FEATURE_CB_2008) // A 2010+ roadster?
-          k = (can_databuffer[4]) & 0x0F;  // for 2008 roadsters
-        else
-          k = (can_databuffer[5] >> 4) & 0x0F; // for 2010 roadsters
-        if (k != car_chargemode)
-          { // If the charge mode has changed, notify it
-          car_chargemode = k;
-          net_req_notification(NET_NOTIFY_STAT);
-          }
-        car_charge_b4 = can_databuffer[3];
-        car_chargekwh = can_databuffer[7];
-        break;
-      case 0x96: // Doors / Charging yes/no
-        if (car_chargestate == 0x0f) can_databuffer[1] |= 0x10; // Fudge for heating state, to be charging=on
-        if ((car_doors1 != can_databuffer[1])||
-            (car_doors2 != can_databuffer[2])||
-            (car_doors3 != can_databuffer[3])||
-            (car_doors4 != can_databuffer[4]))
-          net_req_notification(NET_NOTIFY_ENV);
-
-        if (((car_doors2&0x80)==0)&&(can_databuffer[2]&0x80)&&(can_databuffer[2]&0x10))
-          net_req_notification(NET_NOTIFY_TRUNK); // Valet mode is active, and trunk was opened
-
-        if (((car_doors4&0x02)==0)&&((can_databuffer[4]&0x02)!=0))
-          net_req_notification(NET_NOTIFY_ALARM); // Alarm has been triggered
-
-        car_doors1 = can_databuffer[1]; // Doors #1
-        car_doors2 = can_databuffer[2]; // Doors #2
-        car_doors3 = can_databuffer[3]; // Doors #3
-        car_doors4 = can_databuffer[4]; // Doors #4
-        if (((car_doors1 & 0x80)==0)&&  // Car is not ON
-            (car_parktime == 0)&&       // Parktime was not previously set
-            (car_time != 0))            // We know the car time
-          {
-          tr_requestcac=2; // Request CAC when car stops
-          car_parktime = car_time-1;    // Record it as 1 second ago, so non zero report
-          net_req_notification(NET_NOTIFY_ENV);
-          }
-        else if ((car_doors1 & 0x80)&&  // Car is ON
-                 (car_parktime != 0))   // Parktime was previously set
-          {
-          tr_requestcac=2; // Request CAC when car starts
-          car_parktime = 0;
-          net_req_notification(NET_NOTIFY_ENV);
-          }
-        break;
-      case 0x9E: // CAC
-        if (tr_requestcac == 1)
-          tr_requestcac = 3; // Turn off CAC streaming
-        car_cac100 = ((unsigned int)can_databuffer[3]*100)+
-                     ((((unsigned int)can_databuffer[2]*100)+128)/256);
-        break;
-      case 0xA3: // Temperatures
-        car_tpem = (signed char)can_databuffer[1]; // Tpem
-        car_tmotor = (unsigned char)can_databuffer[2]; // Tmotor
-        car_tbattery = (signed int)can_databuffer[6]; // Tbattery
-        car_stale_temps = 120; // Reset stale indicator
-        break;
-      case 0xA4: // 7 VIN bytes i.e. "SFZRE2B"
-        for (k=0;k<7;k++)
-          car_vin[k] = can_databuffer[k+1];
-        break;
-      case 0xA5: // 7 VIN bytes i.e. "39A3000"
-        for (k=0;k<7;k++)
-          car_vin[k+7] = can_databuffer[k+1];
-        if ((can_databuffer[3] == 'A')||(can_databuffer[3] == 'B'))
-          car_type[2] = '2';
-        else
-          car_type[2] = '1';
-        if (can_databuffer[3] == '8')
-          sys_features[FEATURE_CARBITS] |= FEATURE_CB_2008; // Auto-enable 1.5 support
-        if (can_databuffer[1] == '3')
-          car_type[3] = 'S';
-        else
-          car_type[3] = 'N';
-        break;
-      case 0xA6: // 3 VIN bytes i.e. "359"
-        car_vin[14] = can_databuffer[1];
-        car_vin[15] = can_databuffer[2];
-        car_vin[16] = can_databuffer[3];
-        break;
-      }
+    car_direction = ((unsigned int)can_databuffer[3]<<8)+(can_databuffer[2]);
+    if (car_direction==360) car_direction=0; // Bug-fix for Tesla VMS bug
+    if (can_databuffer[5]&0xf0)
+      car_altitude = 0;
+    else
+      car_altitude = ((unsigned int)can_databuffer[5]<<8)+(can_databuffer[4]);
+    car_stale_gps = 120; // Reset stale indicator
     }
-  else if (can_id == 0x102)
+  else
     {
-    switch (can_databuffer[0])
-      {
-      case 0x0E: // Lock/Unlock state on ID#102
-        if (car_lockstate != can_databuffer[1])
-          net_req_notification(NET_NOTIFY_ENV);
-        car_lockstate = can_databuffer[1];
-        break;
-      }
+    car_stale_gps = 0; // Reset stale indicator
+    }
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x88: Charging Current / Duration
+BOOL vehicle_teslaroadster_can100_88(void)
+  {
+  if (can_databuffer[6] != car_chargelimit)
+    { // If the charge limit has changed, notify it
+    net_req_notification(NET_NOTIFY_STAT);
     }
+  car_chargecurrent = can_databuffer[1];
+  car_chargelimit = can_databuffer[6];
+  car_chargeduration = ((unsigned int)can_databuffer[3]<<8)+(can_databuffer[2]);
+  return TRUE;
+  }
 
+// CAN ID 0x100 0x89: Charging Voltage / Iavailable
+BOOL vehicle_teslaroadster_can100_89(void)
+  {
+  if (can_mileskm=='M')
+    car_speed = can_databuffer[1];     // speed in miles/hour
+  else
+    car_speed = (unsigned char) ((((unsigned long)can_databuffer[1] * 1609)+500)/1000);     // speed in km/hour
+  car_linevoltage = can_databuffer[2]
+                    + ((unsigned int) can_databuffer[3] << 8);
   return TRUE;
   }
 
-BOOL vehicle_teslaroadster_poll1(void)                // CAN ID 344 and 402
-{
-  if (can_id == 0x400)
+// CAN ID 0x100 0x8F: HVAC#1 message
+BOOL vehicle_teslaroadster_can100_8f(void)
+  {
+  unsigned int k1;
+
+  k1 = ((unsigned int)can_databuffer[7]<<8)+(can_databuffer[6]);
+  if (k1 > 0)
     {
-    // Speedometer feature - replace Range->Dash with speed
-    if ((can_databuffer[0]==0x02)&&         // The SPEEDO AMPS message
-        (sys_features[FEATURE_OPTIN]&FEATURE_OI_SPEEDO)&& // Digital speedo
-        ((sys_features[FEATURE_CARBITS]&FEATURE_CB_2008)==0)&& // A 2010+ roadster?
-        (car_doors1 & 0x80)&&               // The car is on
-        (car_speed != can_databuffer[2])&&  // The speed != Amps
-        (sys_features[FEATURE_CANWRITE]>0)) // The CAN bus can be written to
-      {
-      can_lastspeedmsg[0] = can_databuffer[0];
-      can_lastspeedmsg[1] = can_databuffer[1];
-      can_lastspeedmsg[2] = car_speed;
-      can_lastspeedmsg[3] = can_databuffer[3] & 0xf0; // Mask lower nibble (speed always <256)
-      can_lastspeedmsg[4] = can_databuffer[4];
-      can_lastspeedmsg[5] = can_databuffer[5];
-      can_lastspeedmsg[6] = can_databuffer[6];
-      can_lastspeedmsg[7] = can_databuffer[7];
-      while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-      TXB0CON = 0;
-      TXB0SIDL = 0b00000000; // Setup Filter and Mask so that only CAN ID 0x100 will be accepted
-      TXB0SIDH = 0b10000000; // Set Filter to 0x400
-      TXB0D0 = can_lastspeedmsg[0];
-      TXB0D1 = can_lastspeedmsg[1];
-      TXB0D2 = can_lastspeedmsg[2];
-      TXB0D3 = can_lastspeedmsg[3];
-      TXB0D4 = can_lastspeedmsg[4];
-      TXB0D5 = can_lastspeedmsg[5];
-      TXB0D6 = can_lastspeedmsg[6];
-      TXB0D7 = can_lastspeedmsg[7];
-      TXB0DLC = 0b00001000; // data length (8)
-      TXB0CON = 0b00001000; // mark for transmission
-      can_lastspeedrpt = FEATURE_SPEEDO_REPEATS; // Force re-transmissions
-      if (can_lastspeedrpt>10) can_lastspeedrpt=10;
-      }
+    car_doors5bits.HVAC = 1;
+    tr_cooldown_recycle = -1;  // Stop the recycle attempts
     }
-  else if (can_id == 0x344)
+  else
     {
-    // TPMS code here
-    if (can_databuffer[3]>0) // front-right
+    if ((car_coolingdown>=0)&&(car_doors5bits.HVAC))
       {
-      car_tpms_p[0] = can_databuffer[2];
-      car_tpms_t[0] = (signed char)can_databuffer[3];
+      // Car is cooling down, and HVAC has just gone off - end of a cycle
+      car_coolingdown++;
+      tr_cooldown_recycle = 60;  // Try to recycle cooling in 60 seconds
+      net_req_notification(NET_NOTIFY_STAT);
       }
-    if (can_databuffer[7]>0) // rear-right
+    car_doors5bits.HVAC = 0;
+    }
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x93: VDS Vehicle Error
+BOOL vehicle_teslaroadster_can100_93(void)
+  {
+  unsigned char k;
+  unsigned int k1;
+  unsigned long k2;
+
+  k = can_databuffer[1];
+  k1 = ((unsigned int)can_databuffer[3]<<8)+(can_databuffer[2]);
+  k2 = (((unsigned long)can_databuffer[7]<<24) +
+        ((unsigned long)can_databuffer[6]<<16) +
+        ((unsigned long)can_databuffer[5]<<8) +
+        (can_databuffer[4]));
+  if (k1 != 0xffff)
+    {
+    if ((k == 0x14)&&(k1 == 25))
       {
-      car_tpms_p[1] = can_databuffer[6];
-      car_tpms_t[1] = (signed char)can_databuffer[7];
+      // Special case of 100% vehicle logs
+      net_req_notification_error(0, 0);
+      net_req_notification_error(k1, k2); // Notify the 100%
       }
-    if (can_databuffer[1]>0) // front-left
+    else if (k & 0x01)
       {
-      car_tpms_p[2] = can_databuffer[0];
-      car_tpms_t[2] = (signed char)can_databuffer[1];
+      // An error code is being raised
+      net_req_notification_error(k1, k2);
       }
-    if (can_databuffer[5]>0)
+    else
       {
-      car_tpms_p[3] = can_databuffer[4];
-      car_tpms_t[3] = (signed char)can_databuffer[5];
+      // An error code is being cleared
+      net_req_notification_error(0, 0);
       }
-    car_stale_tpms = 120; // Reset stale indicator
     }
-  else if (can_id == 0x402)
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x95: Charging mode
+BOOL vehicle_teslaroadster_can100_95(void)
+  {
+  unsigned char k;
+
+  if ((can_databuffer[1] != car_chargestate)&&            // Charge state has changed AND
+      ((car_chargestate<=2)||(car_chargestate==0x0f))&&   // was (Charging or Heating) AND
+      (can_databuffer[1]!=0x04))                          // new state is not done
     {
-    switch (can_databuffer[0])
-      {
-      case 0xFA:			// ODOMETER
-        car_odometer = can_databuffer[3]
-		+ ((unsigned long) can_databuffer[4] << 8)
-                + ((unsigned long) can_databuffer[5] << 16);		// Miles /10
-	car_trip = can_databuffer[6] + ((unsigned int) can_databuffer[7] << 8);	// Miles /10
-	break;
-      }
+    // We've moved from charging/heating to something other than DONE
+    // Let's treat this as a notifiable alert
+    net_req_notification(NET_NOTIFY_CHARGE);
+    }
+  if ((can_databuffer[1] != car_chargestate)||
+      (can_databuffer[2] != car_chargesubstate))
+    { // If the state or sub-state has changed, notify it
+    net_req_notification(NET_NOTIFY_STAT);
+    if (can_databuffer[1]==1)
+      tr_requestcac=2; // Request CAC when charge starts
+    }
+  car_chargestate = can_databuffer[1];
+  car_chargesubstate = can_databuffer[2];
+  if (sys_features[FEATURE_CARBITS]&FEATURE_CB_2008) // A 2010+ roadster?
+    k = (can_databuffer[4]) & 0x0F;  // for 2008 roadsters
+  else
+    k = (can_databuffer[5] >> 4) & 0x0F; // for 2010 roadsters
+  if (k != car_chargemode)
+    { // If the charge mode has changed, notify it
+    car_chargemode = k;
+    net_req_notification(NET_NOTIFY_STAT);
     }
+  car_charge_b4 = can_databuffer[3];
+  car_chargekwh = can_databuffer[7];
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x96: Doors / Charging yes/no
+BOOL vehicle_teslaroadster_can100_96(void)
+  {
+  if (car_chargestate == 0x0f) can_databuffer[1] |= 0x10; // Fudge for heating state, to be charging=on
+  if ((car_doors1 != can_databuffer[1])||
+      (car_doors2 != can_databuffer[2])||
+      (car_doors3 != can_databuffer[3])||
+      (car_doors4 != can_databuffer[4]))
+    net_req_notification(NET_NOTIFY_ENV);
+
+  if (((car_doors2&0x80)==0)&&(can_databuffer[2]&0x80)&&(can_databuffer[2]&0x10))
+    net_req_notification(NET_NOTIFY_TRUNK); // Valet mode is active, and trunk was opened
+
+  if (((car_doors4&0x02)==0)&&((can_databuffer[4]&0x02)!=0))
+    net_req_notification(NET_NOTIFY_ALARM); // Alarm has been triggered
+
+  car_doors1 = can_databuffer[1]; // Doors #1
+  car_doors2 = can_databuffer[2]; // Doors #2
+  car_doors3 = can_databuffer[3]; // Doors #3
+  car_doors4 = can_databuffer[4]; // Doors #4
+  if (((car_doors1 & 0x80)==0)&&  // Car is not ON
+      (car_parktime == 0)&&       // Parktime was not previously set
+      (car_time != 0))            // We know the car time
+    {
+    tr_requestcac=2; // Request CAC when car stops
+    car_parktime = car_time-1;    // Record it as 1 second ago, so non zero report
+    net_req_notification(NET_NOTIFY_ENV);
+    }
+  else if ((car_doors1 & 0x80)&&  // Car is ON
+           (car_parktime != 0))   // Parktime was previously set
+    {
+    tr_requestcac=2; // Request CAC when car starts
+    car_parktime = 0;
+    net_req_notification(NET_NOTIFY_ENV);
+    }
+  return TRUE;
+  }
+
+// CAN ID 0x100 0x9E: CAC
+BOOL vehicle_teslaroadster_can100_9e(void)
+  {
+  if (tr_requestcac == 1)
+    tr_requestcac = 3; // Turn off CAC streaming
+  car_cac100 = ((unsigned int)can_databuffer[3]*100)+
+               ((((unsigned int)can_databuffer[2]*100)+128)/256);
+  return TRUE;
+  }
+
+// CAN ID 0x100 0xA3: Temperatures
+BOOL vehicle_teslaroadster_can100_a3(void)
+  {
+  car_tpem = (signed char)can_databuffer[1]; // Tpem
+  car_tmotor = (unsigned char)can_databuffer[2]; // Tmotor
+  car_tbattery = (signed int)can_databuffer[6]; // Tbattery
+  return TRUE;
+  }
+
+// CAN ID 0x100 0xA4: 7 VIN bytes i.e. "SFZRE2B"
+BOOL vehicle_teslaroadster_can100_a4(void)
+  {
+  unsigned char k;
+
+  for (k=0;k<7;k++)
+    car_vin[k] = can_databuffer[k+1];
+  return TRUE;
+  }
+
+// CAN ID 0x100 0xA5: 7 VIN bytes i.e. "39A3000"
+BOOL vehicle_teslaroadster_can100_a5(void)
+  {
+  unsigned char k;
+
+  for (k=0;k<7;k++)
+    car_vin[k+7] = can_databuffer[k+1];
+  if ((can_databuffer[3] == 'A')||(can_databuffer[3] == 'B'))
+    car_type[2] = '2';
+  else
+    car_type[2] = '1';
+  if (can_databuffer[3] == '8')
+    sys_features[FEATURE_CARBITS] |= FEATURE_CB_2008; // Auto-enable 1.5 support
+  if (can_databuffer[1] == '3')
+    car_type[3] = 'S';
+  else
+    car_type[3] = 'N';
+  return TRUE;
+  }
+
+// CAN ID 0x100 0xA6: 3 VIN bytes i.e. "359"
+BOOL vehicle_teslaroadster_can100_a6(void)
+  {
+  car_vin[14] = can_databuffer[1];
+  car_vin[15] = can_databuffer[2];
+  car_vin[16] = can_databuffer[3];
+  return TRUE;
+  }
+
+// CAN ID 0x102 0x0E: Lock/Unlock state
+BOOL vehicle_teslaroadster_can102_0e(void)
+  {
+  if (car_lockstate != can_databuffer[1])
+    net_req_notification(NET_NOTIFY_ENV);
+  car_lockstate = can_databuffer[1];
+  return TRUE;
+  }
 
+// CAN ID 0x344: TPMS
+BOOL vehicle_teslaroadster_can344(void)
+  {
+  if (can_databuffer[3]>0) // front-right
+    {
+    car_tpms_p[0] = can_databuffer[2];
+    car_tpms_t[0] = (signed char)can_databuffer[3];
+    }
+  if (can_databuffer[7]>0) // rear-right
+    {
+    car_tpms_p[1] = can_databuffer[6];
+    car_tpms_t[1] = (signed char)can_databuffer[7];
+    }
+  if (can_databuffer[1]>0) // front-left
+    {
+    car_tpms_p[2] = can_databuffer[0];
+    car_tpms_t[2] = (signed char)can_databuffer[1];
+    }
+  if (can_databuffer[5]>0)
+    {
+    car_tpms_p[3] = can_databuffer[4];
+    car_tpms_t[3] = (signed char)can_databuffer[5];
+    }
   return TRUE;
-}
+  }
+
+// CAN ID 0x400 0x02: SPEEDO AMPS
+BOOL vehicle_teslaroadster_can400_02(void)
+  {
+  // Speedometer feature - replace Range->Dash with speed
+  if ((sys_features[FEATURE_OPTIN]&FEATURE_OI_SPEEDO)&& // Digital speedo
+      ((sys_features[FEATURE_CARBITS]&FEATURE_CB_2008)==0)&& // A 2010+ roadster?
+      (car_doors1 & 0x80)&&               // The car is on
+      (car_speed != can_databuffer[2])&&  // The speed != Amps
+      (sys_features[FEATURE_CANWRITE]>0)) // The CAN bus can be written to
+    {
+    can_lastspeedmsg[0] = can_databuffer[0];
+    can_lastspeedmsg[1] = can_databuffer[1];
+    can_lastspeedmsg[2] = car_speed;
+    can_lastspeedmsg[3] = can_databuffer[3] & 0xf0; // Mask lower nibble (speed always <256)
+    can_lastspeedmsg[4] = can_databuffer[4];
+    can_lastspeedmsg[5] = can_databuffer[5];
+    can_lastspeedmsg[6] = can_databuffer[6];
+    can_lastspeedmsg[7] = can_databuffer[7];
+    can_tx_enqueue(0x400, 8, can_lastspeedmsg, CAN_TX_PRIO_HIGH);
+    can_lastspeedrpt = FEATURE_SPEEDO_REPEATS; // Force re-transmissions
+    if (can_lastspeedrpt>10) can_lastspeedrpt=10;
+    }
+  return TRUE;
+  }
+
+// CAN ID 0x402 0xFA: ODOMETER
+BOOL vehicle_teslaroadster_can402_fa(void)
+  {
+  car_odometer = can_databuffer[3]
+                 + ((unsigned long) can_databuffer[4] << 8)
+                 + ((unsigned long) can_databuffer[5] << 16);   // Miles /10
+  car_trip = can_databuffer[6] + ((unsigned int) can_databuffer[7] << 8); // Miles /10
+  return TRUE;
+  }
+
+// CAN ID dispatch table (sorted by ID, then mux) for buffer 0 (VMS
+// messages 0x100/0x102) and buffer 1 (TPMS, speedo and odometer), see
+// vehicle_can_dispatch(). The RX acceptance filters are derived from this
+// by vehicle_can_filters().
+rom vehicle_can_handler_t vehicle_teslaroadster_can_handlers[] =
+  {
+    { 0x100, VEHICLE_CAN_ID, 0x06, 0, &vehicle_teslaroadster_can100_06, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x80, 0, &vehicle_teslaroadster_can100_80, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x81, 0, &vehicle_teslaroadster_can100_81, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x82, 0, &vehicle_teslaroadster_can100_82, &car_stale_ambient, 120 },
+    { 0x100, VEHICLE_CAN_ID, 0x83, 0, &vehicle_teslaroadster_can100_83, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x84, 0, &vehicle_teslaroadster_can100_84, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x85, 0, &vehicle_teslaroadster_can100_85, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x88, 0, &vehicle_teslaroadster_can100_88, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x89, 0, &vehicle_teslaroadster_can100_89, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x8F, 0, &vehicle_teslaroadster_can100_8f, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x93, 0, &vehicle_teslaroadster_can100_93, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x95, 0, &vehicle_teslaroadster_can100_95, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x96, 0, &vehicle_teslaroadster_can100_96, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0x9E, 0, &vehicle_teslaroadster_can100_9e, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0xA3, 0, &vehicle_teslaroadster_can100_a3, &car_stale_temps, 120 },
+    { 0x100, VEHICLE_CAN_ID, 0xA4, 0, &vehicle_teslaroadster_can100_a4, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0xA5, 0, &vehicle_teslaroadster_can100_a5, NULL, 0 },
+    { 0x100, VEHICLE_CAN_ID, 0xA6, 0, &vehicle_teslaroadster_can100_a6, NULL, 0 },
+    { 0x102, VEHICLE_CAN_ID, 0x0E, 0, &vehicle_teslaroadster_can102_0e, NULL, 0 },
+    { 0x344, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_teslaroadster_can344, &car_stale_tpms, 120 },
+    { 0x400, VEHICLE_CAN_ID, 0x02, 1, &vehicle_teslaroadster_can400_02, NULL, 0 },
+    { 0x402, VEHICLE_CAN_ID, 0xFA, 1, &vehicle_teslaroadster_can402_fa, NULL, 0 }
+  };
+#define TR_CAN_HANDLERS (sizeof(vehicle_teslaroadster_can_handlers)/sizeof(vehicle_can_handler_t))
+
+////////////////////////////////////////////////////////////////////////
+// can_poll()
+// This function is an entry point from the main() program loop, and
+// gives the CAN framework an opportunity to poll for data.
+//
+BOOL vehicle_teslaroadster_poll(void)                 // Both RX buffers
+  {
+  vehicle_can_dispatch(vehicle_teslaroadster_can_handlers, TR_CAN_HANDLERS);
+  return TRUE;
+  }
 
 ////////////////////////////////////////////////////////////////////////
 // vehicle_teslaroadster_ticker10th()
@@ -410,6 +500,8 @@ BOOL vehicle_teslaroadster_ticker10th(void)
 //
 BOOL vehicle_teslaroadster_idlepoll(void)
   {
+  unsigned char data[8];
+
   if (tr_requestcac > 1)
     {
     if (sys_features[FEATURE_CANWRITE]==0)
@@ -421,46 +513,37 @@ BOOL vehicle_teslaroadster_idlepoll(void)
       // Request CAC streaming...
       // 102 06 D0 07 00 00 00 00 40
       tr_requestcac = 1; // Wait for cac, then cancel
-      while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-      TXB0CON = 0;
-      TXB0SIDL = 0b01000000; // Setup 0x102
-      TXB0SIDH = 0b00100000; // Setup 0x102
-      TXB0D0 = 0x06;
-      TXB0D1 = 0xd0;
-      TXB0D2 = 0x07;
-      TXB0D3 = 0x00;
-      TXB0D4 = 0x00;
-      TXB0D5 = 0x00;
-      TXB0D6 = 0x00;
-      TXB0D7 = 0x40;
-      TXB0DLC = 0b00001000; // data length (8)
-      TXB0CON = 0b00001000; // mark for transmission
+      data[0] = 0x06;
+      data[1] = 0xd0;
+      data[2] = 0x07;
+      data[3] = 0x00;
+      data[4] = 0x00;
+      data[5] = 0x00;
+      data[6] = 0x00;
+      data[7] = 0x40;
+      can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
       }
     else if (tr_requestcac == 3)
       {
       // Cancel CAC streaming...
       // 102 06 00 00 00 00 00 00 40
       tr_requestcac = 0; // CAC done
-      while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-      TXB0CON = 0;
-      TXB0SIDL = 0b01000000; // Setup 0x102
-      TXB0SIDH = 0b00100000; // Setup 0x102
-      TXB0D0 = 0x06;
-      TXB0D1 = 0x00;
-      TXB0D2 = 0x00;
-      TXB0D3 = 0x00;
-      TXB0D4 = 0x00;
-      TXB0D5 = 0x00;
-      TXB0D6 = 0x00;
-      TXB0D7 = 0x40;
-      TXB0DLC = 0b00001000; // data length (8)
-      TXB0CON = 0b00001000; // mark for transmission
+      data[0] = 0x06;
+      data[1] = 0x00;
+      data[2] = 0x00;
+      data[3] = 0x00;
+      data[4] = 0x00;
+      data[5] = 0x00;
+      data[6] = 0x00;
+      data[7] = 0x40;
+      can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
       vehicle_teslaroadster_ticker60();      // To calculate charge mins remaining, now we have CAC
       net_req_notification(NET_NOTIFY_STAT); // Notify it (in particular, the charge time estimate
       }
     }
 
   if (can_lastspeedrpt == 0) return FALSE;
+  if (CAN_TXQ_LEVEL() > 0) return FALSE; // Repeat when the last one is out
 
   // Speedometer feature - replace Range->Dash with speed
   if ((can_lastspeedmsg[0]==0x02)&&        // It is a valid AMPS message
@@ -469,21 +552,7 @@ BOOL vehicle_teslaroadster_idlepoll(void)
       (car_doors1 & 0x80)&&                // The car is on
       (sys_features[FEATURE_CANWRITE]>0))  // The CAN bus can be written to
     {
-    Delay1KTCYx(1);
-    while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-    TXB0CON = 0;
-    TXB0SIDL = 0b00000000; // Setup Filter and Mask so that only CAN ID 0x100 will be accepted
-    TXB0SIDH = 0b10000000; // Set Filter to 0x400
-    TXB0D0 = can_lastspeedmsg[0];
-    TXB0D1 = can_lastspeedmsg[1];
-    TXB0D2 = can_lastspeedmsg[2];
-    TXB0D3 = can_lastspeedmsg[3];
-    TXB0D4 = can_lastspeedmsg[4];
-    TXB0D5 = can_lastspeedmsg[5];
-    TXB0D6 = can_lastspeedmsg[6];
-    TXB0D7 = can_lastspeedmsg[7];
-    TXB0DLC = 0b00001000; // data length (8)
-    TXB0CON = 0b00001000; // mark for transmission
+    can_tx_enqueue(0x400, 8, can_lastspeedmsg, CAN_TX_PRIO_HIGH);
     }
   can_lastspeedrpt--;
 
@@ -492,202 +561,194 @@ BOOL vehicle_teslaroadster_idlepoll(void)
 
 void vehicle_teslaroadster_tx_wakeup(void)
   {
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-  TXB0CON = 0;
-  TXB0SIDL = 0b01000000; // Setup 0x102
-  TXB0SIDH = 0b00100000; // Setup 0x102
-  TXB0D0 = 0x0a;
-  TXB0DLC = 0b00000001; // data length (1)
-  TXB0CON = 0b00001000; // mark for transmission
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+  unsigned char data[1];
+
+  data[0] = 0x0a;
+  can_tx_enqueue(0x102, 1, data, CAN_TX_PRIO_NORMAL);
   }
 
 void vehicle_teslaroadster_tx_wakeuptemps(void)
   {
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-  TXB0CON = 0;
-  TXB0SIDL = 0b01000000; // Setup 0x102
-  TXB0SIDH = 0b00100000; // Setup 0x102
-  TXB0D0 = 0x06;
-  TXB0D1 = 0x2c;
-  TXB0D2 = 0x01;
-  TXB0D3 = 0x00;
-  TXB0D4 = 0x00;
-  TXB0D5 = 0x09;
-  TXB0D6 = 0x10;
-  TXB0D7 = 0x00;
-  TXB0DLC = 0b00001000; // data length (8)
-  TXB0CON = 0b00001000; // mark for transmission
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+  unsigned char data[8];
+
+  data[0] = 0x06;
+  data[1] = 0x2c;
+  data[2] = 0x01;
+  data[3] = 0x00;
+  data[4] = 0x00;
+  data[5] = 0x09;
+  data[6] = 0x10;
+  data[7] = 0x00;
+  can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
   }
 
 void vehicle_teslaroadster_tx_wakeuphvac(void)
   {
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-  TXB0CON = 0;
-  TXB0SIDL = 0b01000000; // Setup 0x102
-  TXB0SIDH = 0b00100000; // Setup 0x102
-  TXB0D0 = 0x06;
-  TXB0D1 = 0xd0;
-  TXB0D2 = 0x07;
-  TXB0D3 = 0x00;
-  TXB0D4 = 0x00;
-  TXB0D5 = 0x80;
-  TXB0D6 = 0x00;
-  TXB0D7 = 0x08;
-  TXB0DLC = 0b00001000; // data length (8)
-  TXB0CON = 0b00001000; // mark for transmission
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+  unsigned char data[8];
+
+  data[0] = 0x06;
+  data[1] = 0xd0;
+  data[2] = 0x07;
+  data[3] = 0x00;
+  data[4] = 0x00;
+  data[5] = 0x80;
+  data[6] = 0x00;
+  data[7] = 0x08;
+  can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
   }
 
 void vehicle_teslaroadster_tx_setchargemode(unsigned char mode)
   {
+  unsigned char data[8];
+
   vehicle_teslaroadster_tx_wakeup(); // Also, wakeup the car if necessary
 
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-  TXB0CON = 0;
-  TXB0SIDL = 0b01000000; // Setup 0x102
-  TXB0SIDH = 0b00100000; // Setup 0x102
-  TXB0D0 = 0x05;
-  TXB0D1 = 0x19;
-  TXB0D2 = 0x00;
-  TXB0D3 = 0x00;
-  TXB0D4 = mode;
-  TXB0D5 = 0x00;
-  TXB0D6 = 0x00;
-  TXB0D7 = 0x00;
-  TXB0DLC = 0b00001000; // data length (8)
-  TXB0CON = 0b00001000; // mark for transmission
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+  data[0] = 0x05;
+  data[1] = 0x19;
+  data[2] = 0x00;
+  data[3] = 0x00;
+  data[4] = mode;
+  data[5] = 0x00;
+  data[6] = 0x00;
+  data[7] = 0x00;
+  can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
   }
 
 void vehicle_teslaroadster_tx_setchargecurrent(unsigned char current)
   {
+  unsigned char data[8];
+
   vehicle_teslaroadster_tx_wakeup(); // Also, wakeup the car if necessary
 
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-  TXB0CON = 0;
-  TXB0SIDL = 0b01000000; // Setup 0x102
-  TXB0SIDH = 0b00100000; // Setup 0x102
-  TXB0D0 = 0x05;
-  TXB0D1 = 0x02;
-  TXB0D2 = 0x00;
-  TXB0D3 = 0x00;
-  TXB0D4 = current;
-  TXB0D5 = 0x00;
-  TXB0D6 = 0x00;
-  TXB0D7 = 0x00;
-  TXB0DLC = 0b00001000; // data length (8)
-  TXB0CON = 0b00001000; // mark for transmission
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+  data[0] = 0x05;
+  data[1] = 0x02;
+  data[2] = 0x00;
+  data[3] = 0x00;
+  data[4] = current;
+  data[5] = 0x00;
+  data[6] = 0x00;
+  data[7] = 0x00;
+  can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
   }
 
 void vehicle_teslaroadster_tx_startstopcharge(unsigned char start)
   {
+  unsigned char data[8];
+
   vehicle_teslaroadster_tx_wakeup(); // Also, wakeup the car if necessary
 
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-  TXB0CON = 0;
-  TXB0SIDL = 0b01000000; // Setup 0x102
-  TXB0SIDH = 0b00100000; // Setup 0x102
-  TXB0D0 = 0x05;
-  TXB0D1 = 0x03;
-  TXB0D2 = 0x00;
-  TXB0D3 = 0x00;
-  TXB0D4 = start;
-  TXB0D5 = 0x00;
-  TXB0D6 = 0x00;
-  TXB0D7 = 0x00;
-  TXB0DLC = 0b00001000; // data length (8)
-  TXB0CON = 0b00001000; // mark for transmission
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+  data[0] = 0x05;
+  data[1] = 0x03;
+  data[2] = 0x00;
+  data[3] = 0x00;
+  data[4] = start;
+  data[5] = 0x00;
+  data[6] = 0x00;
+  data[7] = 0x00;
+  can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
   }
 
 void vehicle_teslaroadster_tx_lockunlockcar(unsigned char mode, char *pin)
   {
   // Mode is 0=valet, 1=novalet, 2=lock, 3=unlock
+  unsigned char data[8];
   long lpin;
   lpin = atol(pin);
 
   if ((mode == 0x02)&&(car_doors1 & 0x80))
     return; // Refuse to lock a car that is turned on
 
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-  TXB0CON = 0;
-  TXB0SIDL = 0b01000000; // Setup 0x102
-  TXB0SIDH = 0b00100000; // Setup 0x102
-  TXB0D0 = 0x0B;
-  TXB0D1 = mode;
-  TXB0D2 = 0x00;
-  TXB0D3 = 0x00;
-  TXB0D4 = lpin & 0xff;
-  TXB0D5 = (lpin>>8) & 0xff;
-  TXB0D6 = (lpin>>16) & 0xff;
-  TXB0D7 = (strlen(pin)<<4) + ((lpin>>24) & 0x0f);
-  TXB0DLC = 0b00001000; // data length (8)
-  TXB0CON = 0b00001000; // mark for transmission
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+  data[0] = 0x0B;
+  data[1] = mode;
+  data[2] = 0x00;
+  data[3] = 0x00;
+  data[4] = (unsigned char)(lpin & 0xff);
+  data[5] = (unsigned char)((lpin>>8) & 0xff);
+  data[6] = (unsigned char)((lpin>>16) & 0xff);
+  data[7] = (unsigned char)((strlen(pin)<<4) + ((lpin>>24) & 0x0f));
+  can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
   }
 
 void vehicle_teslaroadster_tx_timermode(unsigned char mode, unsigned int starttime)
   {
+  unsigned char data[8];
+
   vehicle_teslaroadster_tx_wakeup(); // Also, wakeup the car if necessary
 
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-  TXB0CON = 0;
-  TXB0SIDL = 0b01000000; // Setup 0x102
-  TXB0SIDH = 0b00100000; // Setup 0x102
-  TXB0D0 = 0x05;
-  TXB0D1 = 0x1B;
-  TXB0D2 = 0x00;
-  TXB0D3 = 0x00;
-  TXB0D4 = mode;
-  TXB0D5 = 0x00;
-  TXB0D6 = 0x00;
-  TXB0D7 = 0x00;
-  TXB0DLC = 0b00001000; // data length (8)
-  TXB0CON = 0b00001000; // mark for transmission
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+  data[0] = 0x05;
+  data[1] = 0x1B;
+  data[2] = 0x00;
+  data[3] = 0x00;
+  data[4] = mode;
+  data[5] = 0x00;
+  data[6] = 0x00;
+  data[7] = 0x00;
+  can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
   if (mode == 1)
     {
-    TXB0CON = 0;
-    TXB0SIDL = 0b01000000; // Setup 0x102
-    TXB0SIDH = 0b00100000; // Setup 0x102
-    TXB0D0 = 0x05;
-    TXB0D1 = 0x1A;
-    TXB0D2 = 0x00;
-    TXB0D3 = 0x00;
-    TXB0D4 = (starttime >>8)&0xff;
-    TXB0D5 = (starttime & 0xff);
-    TXB0D6 = 0x00;
-    TXB0D7 = 0x00;
-    TXB0DLC = 0b00001000; // data length (8)
-    TXB0CON = 0b00001000; // mark for transmission
-    while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+    data[0] = 0x05;
+    data[1] = 0x1A;
+    data[2] = 0x00;
+    data[3] = 0x00;
+    data[4] = (starttime >>8)&0xff;
+    data[5] = (starttime & 0xff);
+    data[6] = 0x00;
+    data[7] = 0x00;
+    can_tx_enqueue(0x102, 8, data, CAN_TX_PRIO_NORMAL);
     }
   }
 
 void vehicle_teslaroadster_tx_homelink(unsigned char button)
   {
+  unsigned char data[3];
+
   vehicle_teslaroadster_tx_wakeup(); // Also, wakeup the car if necessary
 
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-  TXB0CON = 0;
-  TXB0SIDL = 0b01000000; // Setup 0x102
-  TXB0SIDH = 0b00100000; // Setup 0x102
-  TXB0D0 = 0x09;
-  TXB0D1 = 0x00;
-  TXB0D2 = button;
-  TXB0DLC = 0b00000011; // data length (3)
-  TXB0CON = 0b00001000; // mark for transmission
-  while (TXB0CONbits.TXREQ) {} // Loop until TX is done
+  data[0] = 0x09;
+  data[1] = 0x00;
+  data[2] = button;
+  can_tx_enqueue(0x102, 3, data, CAN_TX_PRIO_NORMAL);
+  }
+
+////////////////////////////////////////////////////////////////////////
+// vehicle_teslaroadster_cooldown_start()
+// Scheduled task: the cooldown start sequence. One second after the
+// wakeup, the 13A / RANGE mode / START charge commands are sent twice
+// (to be persistent), 100ms apart, then the HVAC data is requested.
+//
+void vehicle_teslaroadster_cooldown_start(void)
+  {
+  if (tr_cooldown_step < 6)
+    {
+    switch (tr_cooldown_step++ % 3)
+      {
+      case 0:
+        vehicle_teslaroadster_tx_setchargecurrent(13); // 13A charge
+        break;
+      case 1:
+        vehicle_teslaroadster_tx_setchargemode(3);     // Switch to RANGE mode
+        break;
+      case 2:
+        vehicle_teslaroadster_tx_startstopcharge(1);   // Force START charge
+        break;
+      }
+    sched_post(vehicle_teslaroadster_cooldown_start, 1);
+    }
+  else
+    {
+    vehicle_teslaroadster_tx_wakeuphvac();         // Start HVAC data
+    car_coolingdown = 0;
+    tr_cooldown_recycle = -1;
+    }
   }
 
 void vehicle_teslaroadster_cooldown(void)
   {
   // We have been requested to cool down the battery pack
   char *p;
-  int k;
+
+  if (sched_pending(vehicle_teslaroadster_cooldown_start))
+    return; // The start sequence is running
 
   // Save the old charge mode and limit
   car_cooldown_wascharging = (CAR_IS_CHARGING)?1:0;
@@ -722,26 +783,14 @@ void vehicle_teslaroadster_cooldown(void)
     {
     // We need to start a cooldown
     vehicle_teslaroadster_tx_wakeup();
-    delay100(10);
-    for (k=0;k<2;k++) // Be persistent, and do this a few times to make sure
-      {
-      vehicle_teslaroadster_tx_setchargecurrent(13); // 13A charge
-      delay100(1);
-      vehicle_teslaroadster_tx_setchargemode(3);     // Switch to RANGE mode
-      delay100(1);
-      vehicle_teslaroadster_tx_startstopcharge(1);   // Force START charge
-      delay100(1);
-      }
-    vehicle_teslaroadster_tx_wakeuphvac();         // Start HVAC data
-    car_coolingdown = 0;
-    tr_cooldown_recycle = -1;
+    tr_cooldown_step = 0;
+    sched_post(vehicle_teslaroadster_cooldown_start, 10);
     }
   }
 
 BOOL vehicle_teslaroadster_commandhandler(BOOL msgmode, int code, char* msg)
   {
   char *p;
-  BOOL sendenv = FALSE;
 
   switch (code)
     {
@@ -892,7 +941,6 @@ BOOL vehicle_teslaroadster_commandhandler(BOOL msgmode, int code, char* msg)
         vehicle_teslaroadster_tx_lockunlockcar(2, net_msg_cmd_msg);
         STP_OK(net_scratchpad, code);
         }
-      sendenv=TRUE;
       break;
 
     case 21: // Activate valet mode (params pin)
@@ -905,7 +953,6 @@ BOOL vehicle_teslaroadster_commandhandler(BOOL msgmode, int code, char* msg)
         vehicle_teslaroadster_tx_lockunlockcar(0, net_msg_cmd_msg);
         STP_OK(net_scratchpad, code);
         }
-      sendenv=TRUE;
       break;
 
     case 22: // Unlock car (params pin)
@@ -918,7 +965,6 @@ BOOL vehicle_teslaroadster_commandhandler(BOOL msgmode, int code, char* msg)
         vehicle_teslaroadster_tx_lockunlockcar(3, net_msg_cmd_msg);
         STP_OK(net_scratchpad, code);
         }
-      sendenv=TRUE;
       break;
 
     case 23: // Deactivate valet mode (params pin)
@@ -931,7 +977,6 @@ BOOL vehicle_teslaroadster_commandhandler(BOOL msgmode, int code, char* msg)
         vehicle_teslaroadster_tx_lockunlockcar(1, net_msg_cmd_msg);
         STP_OK(net_scratchpad, code);
         }
-      sendenv=TRUE;
       break;
 
     case 24: // Home Link
@@ -965,7 +1010,6 @@ BOOL vehicle_teslaroadster_commandhandler(BOOL msgmode, int code, char* msg)
   if (msgmode)
     {
     net_msg_encode_puts();
-    delay100(2);
     net_msgp_environment(0);
     }
 
@@ -1017,10 +1061,10 @@ int MinutesToChargeCAC(
   if (pctEnd == 0) pctEnd=100; // Default to a full charge
   
   // IM capacity in range mode is about 31.598 + 1.3193 * cac;
-  imCapacityRange = ((signed long)cac * 199 + 4740 + 75) / 150;
+  imCapacityRange = (int)(((signed long)cac * 199 + 4740 + 75) / 150);
 
   // IM in standard mode is about 13.504 + 1.1075 * cac;
-  imCapacityStandard = ((signed long)cac * 166 + 2026 + 75) / 150;
+  imCapacityStandard = (int)(((signed long)cac * 166 + 2026 + 75) / 150);
 
   imStdToRng = (imCapacityRange - imCapacityStandard + 1) / 2;
 
@@ -1074,8 +1118,8 @@ int MinutesToChargeCAC(
     imEnd = 244;
 
   // calculate temperature to charge rate equation
-  bIntercept = (wAvail >= 2300) ? 288 : (signed long)745 - (signed long)199 * wAvail / 1000;
-  mx1000 = (signed long)3588 - (signed long)250 * wAvail / 1000;
+  bIntercept = (wAvail >= 2300) ? 288 : (int)((signed long)745 - (signed long)199 * wAvail / 1000);
+  mx1000 = (int)((signed long)3588 - (signed long)250 * wAvail / 1000);
 
   // the data says that 70A gets slightly faster in high heat,
   // but I think that's an anomoly in the small data set,
@@ -1084,7 +1128,7 @@ int MinutesToChargeCAC(
     mx1000 = 0;
 
   // calculate seconds per ideal mile
-  whPerIM = bIntercept + (signed long)mx1000 * degAmbient / 1000;
+  whPerIM = (int)(bIntercept + (signed long)mx1000 * degAmbient / 1000);
   secPerIM = whPerIM * 3600L / wAvail;
 
   // detect implausible low power values that can lead to overflowing the number of minutes
@@ -1108,21 +1152,21 @@ int MinutesToChargeCAC(
 
     for ( ; im < imEnd; ++im)
       {
-      int secPerIMTaper = (signed long)3600/(293 - ((signed long)1177*im + 500)/1000);
+      int secPerIMTaper = (int)((signed long)3600/(293 - ((signed long)1177*im + 500)/1000));
       if (secPerIMTaper < secPerIM)
-        secPerIMTaper = secPerIM;
+        secPerIMTaper = (int)secPerIM;
       seconds += secPerIMTaper;
       }
     }
 
   if (net_state == NET_STATE_DIAGMODE)
     {
-    p = stp_i(net_scratchpad,"\r\n# TR MinutesToChargeCAC result=",(seconds + 30) / 60);
+    p = stp_i(net_scratchpad,"\r\n# TR MinutesToChargeCAC result=",(int)((seconds + 30) / 60));
     p = stp_rom(p,"\r\n");
     net_puts_ram(net_scratchpad);
     }
 
-  return (seconds + 30) / 60;
+  return (int)((seconds + 30) / 60);
   }
 
 int vehicle_teslaroadster_minutestocharge(unsigned char chgmod, int wAvail, int ixEnd, int pctEnd)
@@ -1266,8 +1310,6 @@ BOOL vehicle_teslaroadster_ticker60(void)
 //
 void vehicle_teslaroadster_initialise(void)
   {
-  char *p;
-
   car_type[0] = 'T'; // Car is type TR - Tesla Roadster
   car_type[1] = 'R';
   car_type[2] = 0;
@@ -1278,27 +1320,10 @@ void vehicle_teslaroadster_initialise(void)
   while (!CANSTATbits.OPMODE2); // Wait for Configuration mode
 
   // We are now in Configuration Mode
-  RXB0CON = 0b00000000; // RX buffer0 uses Mask RXM0 and filters RXF0, RXF1
-
-  RXM0SIDL = 0b10100000;
-  RXM0SIDH = 0b11111111;       // Set Mask0 to 0x7fd
-
-  RXF0SIDL = 0b00000000;       // Setup Filter0 and Mask so that only CAN ID 0x100 and 0x102 will be accepted
-  RXF0SIDH = 0b00100000;       // Set Filter0 to 0x100
-
-  RXB1CON = 0b00000000;        // RX buffer1 uses Mask RXM1 and filters RXF2, RXF3, RXF4, RXF5
-
-  RXM1SIDL = 0b11100000;
-  RXM1SIDH = 0b11111111;       // Set Mask1 to 0x7ff
-
-  RXF2SIDL = 0b10000000;       // Setup Filter2 so that CAN ID 0x344 will be accepted
-  RXF2SIDH = 0b01101000;
-
-  RXF3SIDL = 0b01000000;       // Setup Filter3 so that CAN ID 0x402 will be accepted
-  RXF3SIDH = 0b10000000;
-
-  RXF4SIDL = 0b00000000;        // Setup Filter4 so that CAN ID 0x400 will be accepted
-  RXF4SIDH = 0b10000000;
+  RXB0CON = 0b00000000; // RX buffer0 uses Mask RXM0 and filters RXF0, RXF1 (0x100, 0x102)
+  RXB1CON = 0b00000000; // RX buffer1 uses Mask RXM1 and filters RXF2..5 (0x344, 0x400, 0x402)
+  // Masks and filters from the CAN ID dispatch table
+  vehicle_can_filters(vehicle_teslaroadster_can_handlers, TR_CAN_HANDLERS);
 
   BRGCON1 = 0; // SET BAUDRATE to 1 Mbps
   BRGCON2 = 0xD2;
@@ -1324,8 +1349,8 @@ void vehicle_teslaroadster_initialise(void)
 
   // Hook in...
   can_capabilities = teslaroadster_capabilities;
-  vehicle_fn_poll0 = &vehicle_teslaroadster_poll0;
-  vehicle_fn_poll1 = &vehicle_teslaroadster_poll1;
+  vehicle_fn_poll0 = &vehicle_teslaroadster_poll;
+  vehicle_fn_poll1 = &vehicle_teslaroadster_poll;
   vehicle_fn_ticker10th = &vehicle_teslaroadster_ticker10th;
   vehicle_fn_ticker1 = &vehicle_teslaroadster_ticker1;
   vehicle_fn_ticker60 = &vehicle_teslaroadster_ticker60;
@@ -291,8 +291,10 @@ BOOL vehicle_thinkcity_state_ticker10(void)
 
     }
     else
+    {
       car_doors1 = 0x00;  // Charge connector disconnected
       car_doors5bits.Charging12V = 0;  //MJ
+    }
    }
 
 
@@ -360,222 +362,206 @@ if ((tc_bit_chrgen == 0) && (tc_bit_dischgenbl == 0)) // Is charge_enable_bit (b
 
 
 ////////////////////////////////////////////////////////////////////////
-// can_poll()
-// This function is an entry point from the main() program loop, and
-// gives the CAN framework an opportunity to poll for data.
+// CAN frame decoders, one per CAN ID, called via vehicle_can_dispatch()
 //
 
-// ISR optimization, see http://www.xargs.com/pic/c18-isr-optim.pdf
-#pragma tmpdata high_isr_tmpdata
-
-BOOL vehicle_thinkcity_poll0(void)
+// CAN ID 0x263
+BOOL vehicle_thinkcity_can263(void)
   {
-  switch (can_id)
-    {
-    case 0x301:
-      tc_pack_current = (((int) can_databuffer[0] << 8) + can_databuffer[1]) / 10;
-      tc_pack_voltage = (((unsigned int) can_databuffer[2] << 8) + can_databuffer[3]) / 10;
-      car_SOC = 100 - ((((unsigned int)can_databuffer[4]<<8) + can_databuffer[5])/10);
-      car_tbattery = (((signed int)can_databuffer[6]<<8) + can_databuffer[7])/10;
-      car_idealrange = (111.958773 * car_SOC / 100);
-      car_estrange = (93.205678 * car_SOC / 100);
-      car_stale_temps = 60;
-    break;
-
-    case 0x302:
-      tc_bit_generalerr = (can_databuffer[0] & 0x01);
-      tc_bit_isoerr = (can_databuffer[2] & 0x01);
-      tc_pack_mindchgvolt = (((unsigned int) can_databuffer[4] << 8) + can_databuffer[5]) / 10;
-      tc_pack_maxdchgamps = (((unsigned int) can_databuffer[6] << 8) + can_databuffer[7]) / 10;
-    break;
-
-    case 0x303:
-      tc_pack_maxchgcurr = (((signed int) can_databuffer[0] << 8) + can_databuffer[1]) / 10;
-      tc_pack_maxchgvolt = (((unsigned int) can_databuffer[2] << 8) + can_databuffer[3]) / 10;
-      tc_bit_syschgenbl = (can_databuffer[4] & 0x01);
-      tc_bit_regenbrkenbl = (can_databuffer[4] & 0x02);
-      tc_bit_dischgenbl = (can_databuffer[4] & 0x04);
-      tc_bit_fastchgenbl = (can_databuffer[4] & 0x08);
-      tc_bit_dcdcenbl = (can_databuffer[4] & 0x10);
-      tc_bit_mainsacdet = (can_databuffer[4] & 0x20);
-      tc_pack_batteriesavail = can_databuffer[5];
-      tc_pack_rednumbatteries = (can_databuffer[6] & 0x01);
-      tc_bit_epoemerg = (can_databuffer[6] & 0x08);
-      tc_bit_crash = (can_databuffer[6] & 0x10);
-      tc_bit_fanactive = (can_databuffer[6] & 0x20);
-      tc_bit_socgreater102 = (can_databuffer[6] & 0x40);
-      tc_bit_isotestinprog = (can_databuffer[6] & 0x80);
-      tc_bit_chgwaittemp = (can_databuffer[7] & 0x01);
-    break;
-
-    case 0x304:
-      tc_sys_voltmaxgen = (((unsigned int) can_databuffer[0] << 8) + can_databuffer[1]) / 10;
-      tc_bit_eoc = (can_databuffer[3] & 0x01);
-      tc_bit_reacheocplease = (can_databuffer[3] & 0x02);
-      tc_bit_chgwaitttemp2 = (can_databuffer[3] & 0x04);
-      tc_bit_manyfailedcells = (can_databuffer[3] & 0x08);
-      tc_bit_acheatrelaystat = (can_databuffer[3] & 0x10);
-      tc_bit_acheatswitchstat = (can_databuffer[3] & 0x20);
-      tc_pack_temp1 = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 10;
-      tc_pack_temp2 = (((signed int) can_databuffer[6] << 8) + can_databuffer[7]) / 10;
-    break;
-
-    case 0x305:
-      tc_charger_pwm = (((unsigned int) can_databuffer[0] << 8) + can_databuffer[1]) / 10;
-      tc_bit_intisoerr = (can_databuffer[2] & 0x10);
-      tc_bit_extisoerr = (can_databuffer[2] & 0x20);
-      tc_bit_chrgen = (can_databuffer[3] & 0x01);
-      tc_bit_ocvmeas = (can_databuffer[3] & 0x02);
-      tc_bit_chgcurr = (can_databuffer[3] & 0x04);
-      tc_bit_chgovervolt = (can_databuffer[3] & 0x08);
-      tc_bit_chgovercurr = (can_databuffer[3] & 0x10);
-      tc_pack_failedcells = ((unsigned int)can_databuffer[4]<<8) + can_databuffer[5];
-      tc_bit_waitoktmpdisch = (can_databuffer[6] & 0x40);
-      tc_bit_thermalisoerr = (can_databuffer[6] & 0x20);
-    break;
+  car_chargecurrent =  ((unsigned int) can_databuffer[0]) / 5;
+  car_linevoltage = (unsigned int) can_databuffer[1];
+  car_ambient_temp = ((signed char) can_databuffer[2]) / 2; // PCU abmbient temp
+  car_speed = ((unsigned char) can_databuffer[5]) / 2;
+  return TRUE;
+  }
 
-    case 0x311:
-      car_chargelimit =  ((unsigned char) can_databuffer[1]) * 0.2 ;  // Charge limit, controlled by the "power charge button", usually 9 or 15A.
-    break;
-    }
+// CAN ID 0x301
+BOOL vehicle_thinkcity_can301(void)
+  {
+  tc_pack_current = (((int) can_databuffer[0] << 8) + can_databuffer[1]) / 10;
+  tc_pack_voltage = (((unsigned int) can_databuffer[2] << 8) + can_databuffer[3]) / 10;
+  car_SOC = 100 - ((((unsigned int)can_databuffer[4]<<8) + can_databuffer[5])/10);
+  car_tbattery = (((signed int)can_databuffer[6]<<8) + can_databuffer[7])/10;
+  car_idealrange = car_SOC + (unsigned int)mulq16(car_SOC, 7837); // 1.11958773 (Q16 0.11958)
+  car_estrange = (unsigned int)mulq16(car_SOC, 61083);             // 0.93205678 (Q16)
+  return TRUE;
+  }
 
+// CAN ID 0x302
+BOOL vehicle_thinkcity_can302(void)
+  {
+  tc_bit_generalerr = (can_databuffer[0] & 0x01);
+  tc_bit_isoerr = (can_databuffer[2] & 0x01);
+  tc_pack_mindchgvolt = (((unsigned int) can_databuffer[4] << 8) + can_databuffer[5]) / 10;
+  tc_pack_maxdchgamps = (((unsigned int) can_databuffer[6] << 8) + can_databuffer[7]) / 10;
   return TRUE;
   }
 
-BOOL vehicle_thinkcity_poll1(void)
+// CAN ID 0x303
+BOOL vehicle_thinkcity_can303(void)
   {
-  switch (can_id)
-    {
-    case 0x263:
-      car_stale_ambient = 60;
-      car_chargecurrent =  ((signed int) can_databuffer[0]) * 0.2;
-      car_linevoltage = (unsigned int) can_databuffer[1];
-      car_ambient_temp = ((signed char) can_databuffer[2]) * 0.5; // PCU abmbient temp
-      car_speed = ((unsigned char) can_databuffer[5]) / 2;
-    break;
+  tc_pack_maxchgcurr = (((signed int) can_databuffer[0] << 8) + can_databuffer[1]) / 10;
+  tc_pack_maxchgvolt = (((unsigned int) can_databuffer[2] << 8) + can_databuffer[3]) / 10;
+  tc_bit_syschgenbl = (can_databuffer[4] & 0x01);
+  tc_bit_regenbrkenbl = (can_databuffer[4] & 0x02);
+  tc_bit_dischgenbl = (can_databuffer[4] & 0x04);
+  tc_bit_fastchgenbl = (can_databuffer[4] & 0x08);
+  tc_bit_dcdcenbl = (can_databuffer[4] & 0x10);
+  tc_bit_mainsacdet = (can_databuffer[4] & 0x20);
+  tc_pack_batteriesavail = can_databuffer[5];
+  tc_pack_rednumbatteries = (can_databuffer[6] & 0x01);
+  tc_bit_epoemerg = (can_databuffer[6] & 0x08);
+  tc_bit_crash = (can_databuffer[6] & 0x10);
+  tc_bit_fanactive = (can_databuffer[6] & 0x20);
+  tc_bit_socgreater102 = (can_databuffer[6] & 0x40);
+  tc_bit_isotestinprog = (can_databuffer[6] & 0x80);
+  tc_bit_chgwaittemp = (can_databuffer[7] & 0x01);
+  return TRUE;
+  }
 
-    case 0x460:
-          // store the message time for checking
-	  tc_srs_tm = car_time;
-	  tc_srs_stat = (unsigned char)(
-                  (can_databuffer[0] == 0x03) &&
-                  (can_databuffer[1] == 0xE0) &&
-                  (can_databuffer[2] == 0) &&
-                  (can_databuffer[3] == 0) &&
-                  (can_databuffer[4] == 0) &&
-                  (can_databuffer[5] == 0) &&
-                  (can_databuffer[6] == 0) &&
-                  (can_databuffer[7] == 0));
-
-          if (tc_srs_stat != 0)
-              tc_srs_nr_err = 0;
-          else
-              tc_srs_nr_err++;
-          
-	break;
-
-    case 0x75B:
-      car_stale_temps = 60;
-      if (can_databuffer[3] == 0x65)
-      {
-        tc_charger_temp = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 100;
-      }
-      else if (can_databuffer[3] == 0x66)
-      {
-        car_tpem = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 100;
-      }
-      else if (can_databuffer[3] == 0x67)
-      {
-        car_tmotor = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 100;
-      }
-      else if (can_databuffer[3] == 0x68)
-      {
-        tc_slibatt_temp = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 100;
-      }
-    break;
+// CAN ID 0x304
+BOOL vehicle_thinkcity_can304(void)
+  {
+  tc_sys_voltmaxgen = (((unsigned int) can_databuffer[0] << 8) + can_databuffer[1]) / 10;
+  tc_bit_eoc = (can_databuffer[3] & 0x01);
+  tc_bit_reacheocplease = (can_databuffer[3] & 0x02);
+  tc_bit_chgwaitttemp2 = (can_databuffer[3] & 0x04);
+  tc_bit_manyfailedcells = (can_databuffer[3] & 0x08);
+  tc_bit_acheatrelaystat = (can_databuffer[3] & 0x10);
+  tc_bit_acheatswitchstat = (can_databuffer[3] & 0x20);
+  tc_pack_temp1 = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 10;
+  tc_pack_temp2 = (((signed int) can_databuffer[6] << 8) + can_databuffer[7]) / 10;
+  return TRUE;
+  }
 
-    default:
-        
-    break;
+// CAN ID 0x305
+BOOL vehicle_thinkcity_can305(void)
+  {
+  tc_charger_pwm = (((unsigned int) can_databuffer[0] << 8) + can_databuffer[1]) / 10;
+  tc_bit_intisoerr = (can_databuffer[2] & 0x10);
+  tc_bit_extisoerr = (can_databuffer[2] & 0x20);
+  tc_bit_chrgen = (can_databuffer[3] & 0x01);
+  tc_bit_ocvmeas = (can_databuffer[3] & 0x02);
+  tc_bit_chgcurr = (can_databuffer[3] & 0x04);
+  tc_bit_chgovervolt = (can_databuffer[3] & 0x08);
+  tc_bit_chgovercurr = (can_databuffer[3] & 0x10);
+  tc_pack_failedcells = ((unsigned int)can_databuffer[4]<<8) + can_databuffer[5];
+  tc_bit_waitoktmpdisch = (can_databuffer[6] & 0x40);
+  tc_bit_thermalisoerr = (can_databuffer[6] & 0x20);
+  return TRUE;
+  }
 
-    }
+// CAN ID 0x311
+BOOL vehicle_thinkcity_can311(void)
+  {
+  car_chargelimit =  ((unsigned char) can_databuffer[1]) / 5 ;  // Charge limit, controlled by the "power charge button", usually 9 or 15A.
+  return TRUE;
+  }
 
+// CAN ID 0x460
+BOOL vehicle_thinkcity_can460(void)
+  {
+  // store the message time for checking
+  tc_srs_tm = car_time;
+  tc_srs_stat = (unsigned char)(
+          (can_databuffer[0] == 0x03) &&
+          (can_databuffer[1] == 0xE0) &&
+          (can_databuffer[2] == 0) &&
+          (can_databuffer[3] == 0) &&
+          (can_databuffer[4] == 0) &&
+          (can_databuffer[5] == 0) &&
+          (can_databuffer[6] == 0) &&
+          (can_databuffer[7] == 0));
+
+  if (tc_srs_stat != 0)
+      tc_srs_nr_err = 0;
+  else
+      tc_srs_nr_err++;
   return TRUE;
   }
 
-#pragma tmpdata
+// CAN ID 0x75B
+BOOL vehicle_thinkcity_can75b(void)
+  {
+  if (can_databuffer[3] == 0x65)
+  {
+    tc_charger_temp = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 100;
+  }
+  else if (can_databuffer[3] == 0x66)
+  {
+    car_tpem = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 100;
+  }
+  else if (can_databuffer[3] == 0x67)
+  {
+    car_tmotor = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 100;
+  }
+  else if (can_databuffer[3] == 0x68)
+  {
+    tc_slibatt_temp = (((signed int) can_databuffer[4] << 8) + can_databuffer[5]) / 100;
+  }
+  return TRUE;
+  }
 
+// CAN ID dispatch table (sorted by ID) for buffer 0 (0x3__ BMS status)
+// and buffer 1 (PCU, SRS and PID responses), see vehicle_can_dispatch().
+// The RX acceptance filters are derived from this by vehicle_can_filters().
+rom vehicle_can_handler_t vehicle_thinkcity_can_handlers[] =
+  {
+    { 0x263, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_thinkcity_can263, &car_stale_ambient, 60 },
+    { 0x301, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 0, &vehicle_thinkcity_can301, &car_stale_temps, 60 },
+    { 0x302, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 0, &vehicle_thinkcity_can302, NULL, 0 },
+    { 0x303, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 0, &vehicle_thinkcity_can303, NULL, 0 },
+    { 0x304, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 0, &vehicle_thinkcity_can304, NULL, 0 },
+    { 0x305, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 0, &vehicle_thinkcity_can305, NULL, 0 },
+    { 0x311, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 0, &vehicle_thinkcity_can311, NULL, 0 },
+    { 0x460, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_thinkcity_can460, NULL, 0 },
+    { 0x75B, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_thinkcity_can75b, &car_stale_temps, 60 }
+  };
+#define TC_CAN_HANDLERS (sizeof(vehicle_thinkcity_can_handlers)/sizeof(vehicle_can_handler_t))
 
 ////////////////////////////////////////////////////////////////////////
-// vehicle_thinkcity_idlepoll()
+// can_poll()
 // This function is an entry point from the main() program loop, and
-// gives the CAN framework a call whenever there is idle time
+// gives the CAN framework an opportunity to poll for data.
 //
-BOOL vehicle_thinkcity_idlepoll(void)
-{
+BOOL vehicle_thinkcity_poll0(void)
+  {
+  vehicle_can_dispatch(vehicle_thinkcity_can_handlers, TC_CAN_HANDLERS);
+  return TRUE;
+  }
 
-  if (sys_features[FEATURE_CANWRITE]>0)
+BOOL vehicle_thinkcity_poll1(void)
   {
-    while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-    TXB0CON = 0;
-    TXB0SIDL = 0b01100000;
-    TXB0SIDH = 0b11101010;
-    TXB0D0 = 0x03;
-    TXB0D1 = 0x22;
-    TXB0D2 = 0x49;
-    TXB0D3 = 0x65;
-    TXB0DLC = 0b00000100; // data length (4)
-    TXB0CON = 0b00001000; // mark for transmission
-    delay100b(); // Delay a little... (100ms, approx)
-
-    while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-    TXB0CON = 0;
-    TXB0SIDL = 0b01100000;
-    TXB0SIDH = 0b11101010;
-    TXB0D0 = 0x03;
-    TXB0D1 = 0x22;
-    TXB0D2 = 0x49;
-    TXB0D3 = 0x66;
-    TXB0DLC = 0b00000100; // data length (4)
-    TXB0CON = 0b00001000; // mark for transmission
-    delay100b(); // Delay a little... (100ms, approx)
-
-    while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-    TXB0CON = 0;
-    TXB0SIDL = 0b01100000;
-    TXB0SIDH = 0b11101010;
-    TXB0D0 = 0x03;
-    TXB0D1 = 0x22;
-    TXB0D2 = 0x49;
-    TXB0D3 = 0x67;
-    TXB0DLC = 0b00000100; // data length (4)
-    TXB0CON = 0b00001000; // mark for transmission
-    delay100b(); // Delay a little... (100ms, approx)
-
-    while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-    TXB0CON = 0;
-    TXB0SIDL = 0b01100000;
-    TXB0SIDH = 0b11101010;
-    TXB0D0 = 0x03;
-    TXB0D1 = 0x22;
-    TXB0D2 = 0x49;
-    TXB0D3 = 0x68;
-    TXB0DLC = 0b00000100; // data length (4)
-    TXB0CON = 0b00001000; // mark for transmission
-    delay100b(); // Delay a little... (100ms, approx)
+  vehicle_can_dispatch(vehicle_thinkcity_can_handlers, TC_CAN_HANDLERS);
+  return TRUE;
   }
 
 
+////////////////////////////////////////////////////////////////////////
+// vehicle_thinkcity_polls
+// This rom table records the PCU temperature PIDs 4965..4968 that need
+// to be polled, the replies come in on 0x75B
 
-return FALSE;
-}
+rom vehicle_poll_t vehicle_thinkcity_polls[]
+  =
+  {
+    { 0x753, 0x75B, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x4965, 4, 10, VEHICLE_POLL_ALWAYS },  // Charger temperature
+    { 0x753, 0x75B, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x4966, 4, 10, VEHICLE_POLL_ALWAYS },  // PEM temperature
+    { 0x753, 0x75B, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x4967, 4, 10, VEHICLE_POLL_ALWAYS },  // Motor temperature
+    { 0x753, 0x75B, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x4968, 4, 10, VEHICLE_POLL_ALWAYS },  // SLI battery temperature
+    { 0 }
+  };
+
+// Scheduled task: end the 500ms lock / unlock pulse on RC1 / RC2
+void vehicle_thinkcity_lockpulse_end(void)
+  {
+  PORTCbits.RC1 = 0;
+  PORTCbits.RC2 = 0;
+  }
 
 void vehicle_thinkcity_tx_lockunlockcar(unsigned char mode, char *pin)
   {
   // Mode is 0=valet, 1=novalet, 2=lock, 3=unlock
-  long lpin;
-  lpin = atol(pin);
-
   if ((mode == 0x02)&&(car_doors1 & 0x80))
     return; // Refuse to lock a car that is turned on
   // Check if RB4 is low, set RB4 high for 500ms and back to low
@@ -585,8 +571,7 @@ void vehicle_thinkcity_tx_lockunlockcar(unsigned char mode, char *pin)
     if (PORTCbits.RC1 == 0)
     {
       PORTCbits.RC1 = 1;
-      delay100(5);
-      PORTCbits.RC1= 0;
+      sched_post(vehicle_thinkcity_lockpulse_end, 5);
     }
     net_req_notification(NET_NOTIFY_ENV);
     car_lockstate = 4;  // Car is locked
@@ -597,8 +582,7 @@ void vehicle_thinkcity_tx_lockunlockcar(unsigned char mode, char *pin)
     if (PORTCbits.RC2 == 0)
     {
       PORTCbits.RC2 = 1;
-      delay100(5);
-      PORTCbits.RC2= 0;
+      sched_post(vehicle_thinkcity_lockpulse_end, 5);
     }
     net_req_notification(NET_NOTIFY_ENV);
     car_lockstate = 5;  // Car unlocked
@@ -633,34 +617,27 @@ void vehicle_thinkcity_tx_lockunlockcar(unsigned char mode, char *pin)
 
 BOOL vehicle_thinkcity_commandhandler(BOOL msgmode, int code, char* msg)
   {
-  char *p;
-  BOOL sendenv = FALSE;
-
   switch (code)
     {
     case 20: // Lock car (params pin)
         vehicle_thinkcity_tx_lockunlockcar(2, net_msg_cmd_msg);
         STP_OK(net_scratchpad, code);
-      sendenv=TRUE;
       break;
 
 
     case 22: // Unlock car (params pin)
         vehicle_thinkcity_tx_lockunlockcar(3, net_msg_cmd_msg);
         STP_OK(net_scratchpad, code);
-      sendenv=TRUE;
       break;
 
     case 21: // Activate valet mode (params pin)
         vehicle_thinkcity_tx_lockunlockcar(0, net_msg_cmd_msg);
         STP_OK(net_scratchpad, code);
-      sendenv=TRUE;
       break;
 
     case 23: // Deactivate valet mode (params pin)
         vehicle_thinkcity_tx_lockunlockcar(1, net_msg_cmd_msg);
         STP_OK(net_scratchpad, code);
-      sendenv=TRUE;
       break;
 
 
@@ -671,7 +648,6 @@ BOOL vehicle_thinkcity_commandhandler(BOOL msgmode, int code, char* msg)
   if (msgmode)
     {
     net_msg_encode_puts();
-    delay100(2);
     net_msgp_environment(0);
     }
 
@@ -884,7 +860,6 @@ BOOL vehicle_thinkcity_stat_sms(BOOL premsg, char *caller, char *command, char *
   cr2lf(net_scratchpad);
 
   // OK, start SMS:
-  delay100(2);
   net_send_sms_start(caller);
   net_puts_ram(net_scratchpad);
 
@@ -966,7 +941,6 @@ BOOL vehicle_thinkcity_fault_sms(BOOL premsg, char *caller, char *command, char
   cr2lf(net_scratchpad);
 
   // OK, start SMS:
-  delay100(2);
   net_send_sms_start(caller);
   net_puts_ram(net_scratchpad);
 
@@ -986,72 +960,29 @@ BOOL vehicle_thinkcity_fault_sms(BOOL premsg, char *caller, char *command, char
 BOOL vehicle_thinkcity_help_sms(BOOL premsg, char *caller, char *command, char *arguments);
 
 rom char vehicle_thinkcity_sms_cmdtable[][NET_SMS_CMDWIDTH] = {
-  "3STAT", // override standard STAT
-  "3FLAG", // Think City: output internal flag state for debug
   "3FAULT", // Think City: output internal errors, warnings and notofications
+  "3FLAG", // Think City: output internal flag state for debug
   "3HELP", // extend HELP output
+  "3STAT", // override standard STAT
   ""
 };
 
 rom far BOOL(*vehicle_thinkcity_sms_hfntable[])(BOOL premsg, char *caller, char *command, char *arguments) = {
-  &vehicle_thinkcity_stat_sms,
-  &vehicle_thinkcity_flag_sms,
   &vehicle_thinkcity_fault_sms,
+  &vehicle_thinkcity_flag_sms,
   &vehicle_thinkcity_help_sms,
+  &vehicle_thinkcity_stat_sms,
 
 };
 
 // SMS COMMAND DISPATCHER:
+// k: index into vehicle_thinkcity_sms_cmdtable, as found by the framework
 // premsg: TRUE=may replace, FALSE=may extend standard handler
-// returns TRUE if handled
-
-BOOL vehicle_thinkcity_fn_sms(BOOL checkauth, BOOL premsg, char *caller, char *command, char *arguments)
-{
-  int k;
-
-  // Command parsing...
-  for (k = 0; vehicle_thinkcity_sms_cmdtable[k][0] != 0; k++)
-  {
-    if (memcmppgm2ram(command,
-                      (char const rom far*)vehicle_thinkcity_sms_cmdtable[k] + 1,
-                      strlenpgm((char const rom far*)vehicle_thinkcity_sms_cmdtable[k]) - 1) == 0)
-    {
-      BOOL result;
-
-      if (checkauth)
-      {
-        // we need to check the caller authorization:
-        arguments = net_sms_initargs(arguments);
-        if (!net_sms_checkauth(vehicle_thinkcity_sms_cmdtable[k][0], caller, &arguments))
-          return FALSE; // failed
-      }
-
-      // Call sms handler:
-      result = (*vehicle_thinkcity_sms_hfntable[k])(premsg, caller, command, arguments);
-
-      if ((premsg) && (result))
-      {
-        // we're in charge + handled it; finish SMS:
-        net_send_sms_finish();
-      }
-
-      return result;
-    }
-  }
-
-  return FALSE; // no vehicle command
-}
-
-BOOL vehicle_thinkcity_fn_smshandler(BOOL premsg, char *caller, char *command, char *arguments)
-{
-  // called to extend/replace standard command: framework did auth check for us
-  return vehicle_thinkcity_fn_sms(FALSE, premsg, caller, command, arguments);
-}
+// returns TRUE if handled, the framework does the auth check & finishes the SMS
 
-BOOL vehicle_thinkcity_fn_smsextensions(char *caller, char *command, char *arguments)
+BOOL vehicle_thinkcity_fn_smscmd(unsigned char k, BOOL premsg, char *caller, char *command, char *arguments)
 {
-  // called for specific command: we need to do the auth check
-  return vehicle_thinkcity_fn_sms(TRUE, TRUE, caller, command, arguments);
+  return (*vehicle_thinkcity_sms_hfntable[k])(premsg, caller, command, arguments);
 }
 
 
@@ -1092,8 +1023,6 @@ BOOL vehicle_thinkcity_help_sms(BOOL premsg, char *caller, char *command, char *
 //
 BOOL vehicle_thinkcity_initialise(void)
   {
-  char *p;
-
   car_type[0] = 'T'; // Car is type Think City
   car_type[1] = 'C';
   car_type[2] = 0;
@@ -1110,39 +1039,12 @@ BOOL vehicle_thinkcity_initialise(void)
 
   // We are now in Configuration Mode
 
-  // Filters: low byte bits 7..5 are the low 3 bits of the filter, and bits 4..0 are all zeros
-  //          high byte bits 7..0 are the high 8 bits of the filter
-  //          So total is 11 bits
-
-  // Buffer 0 (filters 0, 1) for extended PID responses
+  // Buffer 0 (filters 0, 1) for BMS status messages
   RXB0CON  = 0b00000000;
-  // Mask0 = 0b11111111000 (0x7F8), filterbit 0,1,2 deactivated
-  RXM0SIDL = 0b00000000;
-  RXM0SIDH = 0b11111100;
-
-  // Filter0 0b01100000000 (0x300..0x3E0)
-  RXF0SIDL = 0b00000000;
-  RXF0SIDH = 0b01100000;
-
-  // Buffer 1 (filters 2,3, etc) for direct can bus messages
-  RXB1CON  = 0b00000000;	    // RX buffer1 uses Mask RXM1 and filters RXF2. Filters RXF3, RXF4 and RXF5 are not used in this version
-
-  // Mask1 = 0b11111110000 (0x7f0), filterbit 0,1,2,3 deactivated for low volume IDs
-  RXM1SIDL = 0b00000000;
-  RXM1SIDH = 0b11111110;
-
-  // Filter2 0b01001100000 (0x260..0x26F) = GROUP 0x26_:
-  RXF2SIDL = 0b00000000;
-  RXF2SIDH = 0b01001100;
-
-  // Filter3 0b10001100000 (0x460..0x46F) = GROUP 0x46_: (SRS-modele)
-  RXF3SIDL = 0b00000000;
-  RXF3SIDH = 0b10001100;
-
-  // Filter4 0b11101010000 (0x750..0x75F) = GROUP 0x75_: (motor_temp, heat sink temp)
-  RXF4SIDL = 0b00000000;
-  RXF4SIDH = 0b11101010;
-
+  // Buffer 1 (filters 2, 3, 4, 5) for PCU, SRS and PID responses
+  RXB1CON  = 0b00000000;
+  // Masks and filters from the CAN ID dispatch table
+  vehicle_can_filters(vehicle_thinkcity_can_handlers, TC_CAN_HANDLERS);
 
   // CAN bus baud rate
   BRGCON1 = 0x01; // SET BAUDRATE to 500 Kbps
@@ -1168,10 +1070,12 @@ BOOL vehicle_thinkcity_initialise(void)
   vehicle_fn_poll1 = &vehicle_thinkcity_poll1;
   vehicle_fn_ticker1 = &vehicle_thinkcity_state_ticker1;
   vehicle_fn_ticker10 = &vehicle_thinkcity_state_ticker10;
-  vehicle_fn_idlepoll = &vehicle_thinkcity_idlepoll;
   vehicle_fn_commandhandler = &vehicle_thinkcity_commandhandler;
-  vehicle_fn_smshandler = &vehicle_thinkcity_fn_smshandler;
-  vehicle_fn_smsextensions = &vehicle_thinkcity_fn_smsextensions;
+  vehicle_fn_smscmd = &vehicle_thinkcity_fn_smscmd;
+  vehicle_sms_cmdtable = vehicle_thinkcity_sms_cmdtable[0];
+  vehicle_sms_cmds = sizeof(vehicle_thinkcity_sms_cmdtable) / NET_SMS_CMDWIDTH - 1;
+  vehicle_poll_setlist(vehicle_thinkcity_polls);
+  vehicle_poll_setstate(VEHICLE_POLL_ON); // Poll whenever CAN write is enabled
 
 
 
@@ -43,8 +43,6 @@
 //
 BOOL vehicle_track_initialise(void)
   {
-  char *p;
-
   car_type[0] = 'X'; // Car is type XX
   car_type[1] = 'X';
   car_type[2] = 0;
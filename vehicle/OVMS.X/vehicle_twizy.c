@@ -234,6 +234,14 @@ typedef struct battery_cell
 
 } battery_cell;
 
+typedef struct battery_stats // running sums over the cells/cmods
+{
+  UINT32 sum; // sum of all valid current values
+  UINT32 sqrsum; // sum of their squares
+  UINT invalid; // bitfield: current value out of range
+
+} battery_stats;
+
 #endif // OVMS_TWIZY_BATTMON
 
 
@@ -299,11 +307,6 @@ volatile UINT8 twizy_notify; // bit set of...
 // -----------------------------------------------
 
 
-#ifdef OVMS_DIAGMODULE
-volatile int twizy_sim = -1; // CAN simulator: -1=off, else read index in twizy_sim_data
-#endif // OVMS_DIAGMODULE
-
-
 /***************************************************************
  * Twizy POWER STATISTICS variables
  */
@@ -353,7 +356,9 @@ volatile unsigned long twizy_level_rec; // level section rec collector
 battery_pack twizy_batt[BATT_PACKS]; // size:  1 * 18 =  18 bytes
 battery_cmod twizy_cmod[BATT_CMODS]; // size:  7 *  4 =  28 bytes
 battery_cell twizy_cell[BATT_CELLS]; // size: 14 *  8 = 112 bytes
-// ------------- = 158 bytes
+battery_stats twizy_cmod_stats;      // size:  1 * 10 =  10 bytes
+battery_stats twizy_cell_stats;      // size:  1 * 10 =  10 bytes
+// ------------- = 178 bytes
 
 // Battery cell/cmod deviation alert thresholds:
 #define BATT_DEV_TEMP_ALERT         3       // = 3 C
@@ -389,9 +394,9 @@ volatile UINT8 twizy_batt_sensors_state;
 
 
 // -------------------------------------------------
-// TOTAL RAM USAGE FOR BATTERY MONITOR: 159 bytes
+// TOTAL RAM USAGE FOR BATTERY MONITOR: 179 bytes
 // + 16 static CRC WORDS = 32 bytes
-// = TOTAL: 191 bytes
+// = TOTAL: 211 bytes
 // -------------------------------------------------
 
 #pragma udata overlay vehicle_overlay_data
@@ -406,8 +411,7 @@ volatile UINT8 twizy_batt_sensors_state;
  * Twizy functions
  */
 
-BOOL vehicle_twizy_poll0(void);
-BOOL vehicle_twizy_poll1(void);
+BOOL vehicle_twizy_poll(void);
 
 void vehicle_twizy_power_reset(void);
 void vehicle_twizy_power_collect(void);
@@ -417,6 +421,8 @@ BOOL vehicle_twizy_power_sms(BOOL premsg, char *caller, char *command, char *arg
 
 #ifdef OVMS_TWIZY_BATTMON
 void vehicle_twizy_battstatus_reset(void);
+void vehicle_twizy_battstatus_cell(UINT8 i, UINT volt);
+void vehicle_twizy_battstatus_cmod(UINT8 i, UINT8 temp);
 void vehicle_twizy_battstatus_collect(void);
 char vehicle_twizy_battstatus_msgp(char stat, int cmd);
 BOOL vehicle_twizy_battstatus_cmd(BOOL msgmode, int cmd, char *arguments);
@@ -429,7 +435,7 @@ vehicle_twizy_battstatus_sms(BOOL premsg, char *caller, char *command, char *arg
  * vehicle_twizy_chargetime()
  *  Utility: calculate estimated charge time in minutes
  *  to reach dstsoc from current SOC
- *  (dstsoc in 1/100 %)
+ *  (dstsoc in 1/100 %, long: a range ratio may exceed the 16 bit int)
  */
 
 // Charge time approximation constants:
@@ -438,7 +444,7 @@ vehicle_twizy_battstatus_sms(BOOL premsg, char *caller, char *command, char *arg
 #define CHARGETIME_CC       180     // CC phase time (160..180 min.)
 #define CHARGETIME_CV       40      // CV phase time (topoff) (20..40 min.)
 
-int vehicle_twizy_chargetime(int dstsoc)
+int vehicle_twizy_chargetime(long dstsoc)
 {
   int minutes;
 
@@ -454,19 +460,19 @@ int vehicle_twizy_chargetime(int dstsoc)
   {
     // CV phase
     if (twizy_soc < CHARGETIME_CVSOC)
-      minutes += ((long) (dstsoc - CHARGETIME_CVSOC) * CHARGETIME_CV
-              + ((10000-CHARGETIME_CVSOC)/2)) / (10000-CHARGETIME_CVSOC);
+      minutes += (int) (((long) (dstsoc - CHARGETIME_CVSOC) * CHARGETIME_CV
+              + ((10000-CHARGETIME_CVSOC)/2)) / (10000-CHARGETIME_CVSOC));
     else
-      minutes += ((long) (dstsoc - twizy_soc) * CHARGETIME_CV
-              + ((10000-CHARGETIME_CVSOC)/2)) / (10000-CHARGETIME_CVSOC);
+      minutes += (int) (((long) (dstsoc - twizy_soc) * CHARGETIME_CV
+              + ((10000-CHARGETIME_CVSOC)/2)) / (10000-CHARGETIME_CVSOC));
 
     dstsoc = CHARGETIME_CVSOC;
   }
 
   // CC phase
   if (twizy_soc < dstsoc)
-    minutes += ((long) (dstsoc - twizy_soc) * CHARGETIME_CC
-            + (CHARGETIME_CVSOC/2)) / CHARGETIME_CVSOC;
+    minutes += (int) (((long) (dstsoc - twizy_soc) * CHARGETIME_CC
+            + (CHARGETIME_CVSOC/2)) / CHARGETIME_CVSOC);
 
   return minutes;
 }
@@ -498,23 +504,31 @@ char vehicle_twizy_gpslog_msgp(char stat)
 
 
   // H type "RT-GPS-Log", recno = odometer, keep for 1 day
-  s = stp_ul(net_scratchpad, "MP-0 HRT-GPS-Log,", car_odometer); // in 1/10 mi
-  s = stp_latlon(s, ",86400,", car_latitude);
-  s = stp_latlon(s, ",", car_longitude);
-  s = stp_i(s, ",", car_altitude);
-  s = stp_i(s, ",", car_direction);
-  s = stp_i(s, ",", car_speed); // in defined unit (mph or kph)
-  s = stp_i(s, ",", car_gpslock);
-  s = stp_i(s, ",", car_stale_gps);
-  s = stp_i(s, ",", net_sq); // GPRS signal quality
-
-  // Twizy specific (standard model candidates):
-  s = stp_l(s, ",", (long) twizy_power * 16);     // current power (W)
-  s = stp_ul(s, ",", (pwr_use + 11250) / 22500);  // power usage sum (Wh)
-  s = stp_ul(s, ",", (pwr_rec + 11250) / 22500);  // recuperation sum (Wh)
-  s = stp_ul(s, ",", (pwr_dist + 5) / 10);        // distance driven (m)
-
-  return net_msg_encode_statputs(stat, &crc);
+  net_msg_rec_start(stat, &crc, NULL, 0);
+  do
+  {
+    s = stp_ul(net_msg_rec, "MP-0 HRT-GPS-Log,", car_odometer); // in 1/10 mi
+    s = net_msg_rec_put(s);
+    s = stp_latlon(s, ",86400,", car_latitude);
+    s = stp_latlon(s, ",", car_longitude);
+    s = net_msg_rec_put(s);
+    s = stp_i(s, ",", car_altitude);
+    s = stp_i(s, ",", car_direction);
+    s = stp_i(s, ",", car_speed); // in defined unit (mph or kph)
+    s = stp_i(s, ",", car_gpslock);
+    s = stp_i(s, ",", car_stale_gps);
+    s = stp_i(s, ",", net_sq); // GPRS signal quality
+    s = net_msg_rec_put(s);
+
+    // Twizy specific (standard model candidates):
+    s = stp_l(s, ",", (long) twizy_power * 16);     // current power (W)
+    s = stp_ul(s, ",", (pwr_use + 11250) / 22500);  // power usage sum (Wh)
+    s = stp_ul(s, ",", (pwr_rec + 11250) / 22500);  // recuperation sum (Wh)
+    s = stp_ul(s, ",", (pwr_dist + 5) / 10);        // distance driven (m)
+    net_msg_rec_put(s);
+  } while (net_msg_rec_next());
+
+  return net_msg_rec_stat;
 }
 
 
@@ -593,7 +607,7 @@ rom BYTE twizy_sim_data[][11] = {
 
 void vehicle_twizy_simulator_run(int chunk)
 {
-  UINT8 cc;
+  UINT8 cc, i;
   int line;
   char *s;
 
@@ -620,10 +634,12 @@ void vehicle_twizy_simulator_run(int chunk)
       PIE3bits.RXB1IE = 0;
 
       // process sim data:
-      twizy_sim = line;
-      vehicle_twizy_poll0();
-      vehicle_twizy_poll1();
-      twizy_sim = -1;
+      can_id = (((UINT) twizy_sim_data[line][0]) << 8)
+              + twizy_sim_data[line][1];
+      can_datalength = twizy_sim_data[line][2];
+      for (i = 0; i < 8; i++)
+        can_databuffer[i] = twizy_sim_data[line][3 + i];
+      vehicle_twizy_poll();
 
       // turn on CAN RX interrupts:
       PIE3bits.RXB1IE = 1;
@@ -635,464 +651,442 @@ void vehicle_twizy_simulator_run(int chunk)
 
 
 ////////////////////////////////////////////////////////////////////////
-// twizy_poll()
-// This function is an entry point from the main() program loop, and
-// gives the CAN framework an opportunity to poll for data.
+// CAN frame decoders, one per CAN ID, called via vehicle_can_dispatch()
 //
 // See vehicle initialise() for buffer 0/1 filter setup.
 //
 
-// Poll buffer 0:
-
-BOOL vehicle_twizy_poll0(void)
+/*****************************************************
+ * CAN ID 0x155: sent every 10 ms (100 per second)
+ */
+BOOL vehicle_twizy_can155(void)
 {
-  unsigned char i;
   unsigned int t;
 
-
-#ifdef OVMS_DIAGMODULE
-  if (twizy_sim >= 0)
+  // Basic validation:
+  // Byte 4:  0x94 = init/exit phase (CAN data invalid)
+  //          0x54 = Twizy online (CAN data valid)
+  if (can_databuffer[3] == 0x54)
   {
-    // READ SIMULATION DATA:
-    can_id = (((UINT) twizy_sim_data[twizy_sim][0]) << 8)
-            + twizy_sim_data[twizy_sim][1];
-
-    if (can_id == 0x155)
-      can_filter = 0;
-    else
-      return FALSE;
-
-    can_datalength = twizy_sim_data[twizy_sim][2];
-    for (i = 0; i < 8; i++)
-      can_databuffer[i] = twizy_sim_data[twizy_sim][3 + i];
-  }
-#endif // OVMS_DIAGMODULE
-
+    // SOC:
+    t = ((unsigned int) can_databuffer[4] << 8) + can_databuffer[5];
+    if (t > 0 && t <= 40000)
+    {
+      twizy_soc = t >> 2;
+      // car value derived in ticker1()
 
-  // HANDLE CAN MESSAGE:
+      // Remember maximum SOC for charging "done" distinction:
+      if (twizy_soc > twizy_soc_max)
+        twizy_soc_max = twizy_soc;
 
-  if (can_filter == 0)
-  {
-    /*****************************************************
-     * FILTER 0:
-     * CAN ID 0x155: sent every 10 ms (100 per second)
-     */
+      // ...and minimum SOC for range calculation during charging:
+      if (twizy_soc < twizy_soc_min)
+      {
+        twizy_soc_min = twizy_soc;
+        twizy_soc_min_range = twizy_range;
+      }
+    }
 
-    // Basic validation:
-    // Byte 4:  0x94 = init/exit phase (CAN data invalid)
-    //          0x54 = Twizy online (CAN data valid)
-    if (can_databuffer[3] == 0x54)
+    // POWER:
+    t = ((unsigned int) (can_databuffer[1] & 0x0f) << 8) + can_databuffer[2];
+    if (t > 0 && t < 0x0f00)
     {
-      // SOC:
-      t = ((unsigned int) can_databuffer[4] << 8) + can_databuffer[5];
-      if (t > 0 && t <= 40000)
-      {
-        twizy_soc = t >> 2;
-        // car value derived in ticker1()
+      twizy_power = 2000 - (signed int) t;
 
-        // Remember maximum SOC for charging "done" distinction:
-        if (twizy_soc > twizy_soc_max)
-          twizy_soc_max = twizy_soc;
+      // calculate distance from ref:
+      if (twizy_dist >= twizy_speed_distref)
+        t = twizy_dist - twizy_speed_distref;
+      else
+        t = (unsigned int) (twizy_dist + (0x10000L - twizy_speed_distref));
+      twizy_speed_distref = twizy_dist;
 
-        // ...and minimum SOC for range calculation during charging:
-        if (twizy_soc < twizy_soc_min)
-        {
-          twizy_soc_min = twizy_soc;
-          twizy_soc_min_range = twizy_range;
-        }
+      // add to speed state:
+      twizy_speedpwr[twizy_speed_state].dist += t;
+      if (twizy_power > 0)
+      {
+        twizy_speedpwr[twizy_speed_state].use += twizy_power;
+        twizy_level_use += twizy_power;
       }
-
-      // POWER:
-      t = ((unsigned int) (can_databuffer[1] & 0x0f) << 8) + can_databuffer[2];
-      if (t > 0 && t < 0x0f00)
+      else
       {
-        twizy_power = 2000 - (signed int) t;
-
-        // calculate distance from ref:
-        if (twizy_dist >= twizy_speed_distref)
-          t = twizy_dist - twizy_speed_distref;
-        else
-          t = twizy_dist + (0x10000L - twizy_speed_distref);
-        twizy_speed_distref = twizy_dist;
-
-        // add to speed state:
-        twizy_speedpwr[twizy_speed_state].dist += t;
-        if (twizy_power > 0)
-        {
-          twizy_speedpwr[twizy_speed_state].use += twizy_power;
-          twizy_level_use += twizy_power;
-        }
-        else
-        {
-          twizy_speedpwr[twizy_speed_state].rec += -twizy_power;
-          twizy_level_rec += -twizy_power;
-        }
-
-        // do we need to take base power consumption into account?
-        // i.e. for lights etc. -- varies...
+        twizy_speedpwr[twizy_speed_state].rec += -twizy_power;
+        twizy_level_rec += -twizy_power;
       }
 
+      // do we need to take base power consumption into account?
+      // i.e. for lights etc. -- varies...
     }
+
   }
 
-  // else CANfilter == 1 ...reserved...
   return TRUE;
 }
 
 
+#ifdef OVMS_TWIZY_BATTMON
 
-// Poll buffer 1:
-
-BOOL vehicle_twizy_poll1(void)
+// CAN IDs 0x55_: battery sensors.
+//
+// This group really needs to be processed as fast as possible;
+// though only delivered once per second (except 556), the complete
+// group comes at once and needs to be processed together to get
+// a consistent sensor state.
+
+// NEW INFO: group msgs can come in arbitrary order!
+//  => using faster (100ms) 0x556 msgs as examination window
+//    to detect mid-group fetch start
+
+/*****************************************************
+ * CAN ID 0x554: Battery cell module temperatures
+ * (1000 ms = 1 per second)
+ */
+BOOL vehicle_twizy_can554(void)
 {
-  unsigned char i;
-  unsigned int new_speed;
-  unsigned char CANsid;
+  UINT8 i, state;
 
-#ifdef OVMS_DIAGMODULE
-  if (twizy_sim >= 0)
-  {
-    // READ SIMULATION DATA:
-    can_id = (((UINT) twizy_sim_data[twizy_sim][0]) << 8)
-            + twizy_sim_data[twizy_sim][1];
-
-    if ((can_id & 0x590) == 0x590)
-      can_filter = 2;
-    else if ((can_id & 0x690) == 0x690)
-      can_filter = 3;
-    else if ((can_id & 0x550) == 0x550)
-      can_filter = 4;
-    else
-      return FALSE;
+  // volatile optimization:
+  state = twizy_batt_sensors_state;
 
-    can_datalength = twizy_sim_data[twizy_sim][2];
-    for (i = 0; i < 8; i++)
-      can_databuffer[i] = twizy_sim_data[twizy_sim][3 + i];
-  }
-#endif // OVMS_DIAGMODULE
+  if ((CAN_BYTE(0) != 0x0ff) && (state != BATT_SENSORS_READY))
+  {
+    for (i = 0; i < BATT_CMODS; i++)
+      vehicle_twizy_battstatus_cmod(i, CAN_BYTE(i));
 
-  CANsid = can_id & 0x00f;
+    state |= BATT_SENSORS_GOT554;
 
+    // detect fetch completion:
+    if ((state & BATT_SENSORS_READY) >= BATT_SENSORS_GOTALL)
+      state = BATT_SENSORS_READY;
 
-  // HANDLE CAN MESSAGE:
+    twizy_batt_sensors_state = state;
+  }
 
-  if (can_filter == 2)
-  {
-    // Filter 2 = CAN ID GROUP 0x59_:
+  return TRUE;
+}
 
-    switch (CANsid)
+/*****************************************************
+ * CAN ID 0x556: Battery cell voltages 1-5
+ * 100 ms = 10 per second
+ *  => used to clock examination window
+ */
+BOOL vehicle_twizy_can556(void)
+{
+  UINT8 i, state;
+
+  // volatile optimization:
+  state = twizy_batt_sensors_state;
+
+  if ((CAN_BYTE(0) != 0x0ff) && (state != BATT_SENSORS_READY))
+  {
+    // store values:
+    vehicle_twizy_battstatus_cell(0, ((UINT) CAN_BYTE(0) << 4)
+            | ((UINT) CAN_NIBH(1)));
+    vehicle_twizy_battstatus_cell(1, ((UINT) CAN_NIBL(1) << 8)
+            | ((UINT) CAN_BYTE(2)));
+    vehicle_twizy_battstatus_cell(2, ((UINT) CAN_BYTE(3) << 4)
+            | ((UINT) CAN_NIBH(4)));
+    vehicle_twizy_battstatus_cell(3, ((UINT) CAN_NIBL(4) << 8)
+            | ((UINT) CAN_BYTE(5)));
+    vehicle_twizy_battstatus_cell(4, ((UINT) CAN_BYTE(6) << 4)
+            | ((UINT) CAN_NIBH(7)));
+
+    // detect fetch completion/failure:
+    if ((state & ~BATT_SENSORS_GOT556)
+            == (BATT_SENSORS_READY & ~BATT_SENSORS_GOT556))
     {
-      /*****************************************************
-       * FILTER 2:
-       * CAN ID 0x597: sent every 100 ms (10 per second)
-       */
-    case 0x07:
-
-      // VEHICLE state:
-      //  [0]: 0x20 = power line connected
-      
-      if (CAN_BYTE(0) & 0x20)
-      {
-        car_linevoltage = 230; // fix 230 V
-        car_chargecurrent = 10; // fix 10 A
-      }
-      else
-      {
-        car_linevoltage = 0;
-        car_chargecurrent = 0;
-      }
+      // read all sensor data: group complete
+      twizy_batt_sensors_state = BATT_SENSORS_READY;
+    }
+    else if ((state & ~BATT_SENSORS_GOT556))
+    {
+      // read some sensor data: count 0x556 cycles
+      i = (state & BATT_SENSORS_GOT556) + 1;
 
-      //  [1] bit 4 = 0x10 CAN_STATUS_KEYON: 1 = Car ON (key switch)
-      //  [1] bit 5 = 0x20 CAN_STATUS_CHARGING: 1 = Charging
-      //  [1] bit 6 = 0x40 CAN_STATUS_OFFLINE: 1 = Switch-ON/-OFF phase
+      if (i == 3)
+        // not complete in 2 0x556s cycles: drop window (wait for next group)
+        state = BATT_SENSORS_START;
+      else
+        // store new fetch window state:
+        state = (state & ~BATT_SENSORS_GOT556) | i;
 
-      twizy_status = CAN_BYTE(1);
-      // Translation to car_doors1 done in ticker1()
+      twizy_batt_sensors_state = state;
+    }
 
-      // init cyclic distance counter on switch-on:
-      if ((twizy_status & CAN_STATUS_KEYON) && (!car_doors1bits.CarON))
-        twizy_dist = twizy_speed_distref = 0;
+  }
 
-      // PEM temperature:
-      if (CAN_BYTE(7) > 0 && CAN_BYTE(7) < 0xf0)
-        car_tpem = (signed char) CAN_BYTE(7) - 40;
+  return TRUE;
+}
 
-      break;
+/*****************************************************
+ * CAN ID 0x557: Battery cell voltages 6-10
+ * (1000 ms = 1 per second)
+ */
+BOOL vehicle_twizy_can557(void)
+{
+  UINT8 state;
 
+  // volatile optimization:
+  state = twizy_batt_sensors_state;
 
+  if ((CAN_BYTE(0) != 0x0ff) && (state != BATT_SENSORS_READY))
+  {
+    vehicle_twizy_battstatus_cell(5, ((UINT) CAN_BYTE(0) << 4)
+            | ((UINT) CAN_NIBH(1)));
+    vehicle_twizy_battstatus_cell(6, ((UINT) CAN_NIBL(1) << 8)
+            | ((UINT) CAN_BYTE(2)));
+    vehicle_twizy_battstatus_cell(7, ((UINT) CAN_BYTE(3) << 4)
+            | ((UINT) CAN_NIBH(4)));
+    vehicle_twizy_battstatus_cell(8, ((UINT) CAN_NIBL(4) << 8)
+            | ((UINT) CAN_BYTE(5)));
+    vehicle_twizy_battstatus_cell(9, ((UINT) CAN_BYTE(6) << 4)
+            | ((UINT) CAN_NIBH(7)));
 
-      /*****************************************************
-       * FILTER 2:
-       * CAN ID 0x599: sent every 100 ms (10 per second)
-       */
-    case 0x09:
+    state |= BATT_SENSORS_GOT557;
 
-      // RANGE:
-      // we need to check for charging, as the Twizy
-      // does not update range during charging
-      if (((twizy_status & 0x60) == 0)
-              && (can_databuffer[5] != 0xff) && (can_databuffer[5] > 0))
-      {
-        twizy_range = can_databuffer[5];
-        // car values derived in ticker1()
-      }
+    // detect fetch completion:
+    if ((state & BATT_SENSORS_READY) >= BATT_SENSORS_GOTALL)
+      state = BATT_SENSORS_READY;
 
-      // SPEED:
-      new_speed = ((unsigned int) can_databuffer[6] << 8) + can_databuffer[7];
-      if (new_speed != 0xffff)
-      {
-        int delta = (int) new_speed - (int) twizy_speed;
+    twizy_batt_sensors_state = state;
+  }
 
-        if (delta >= CAN_SPEED_THRESHOLD)
-          twizy_speed_state = CAN_SPEED_ACCEL;
-        else if (delta <= -CAN_SPEED_THRESHOLD)
-          twizy_speed_state = CAN_SPEED_DECEL;
-        else
-          twizy_speed_state = CAN_SPEED_CONST;
+  return TRUE;
+}
 
-        twizy_speed = new_speed;
-        // car value derived in ticker1()
-      }
+/*****************************************************
+ * CAN ID 0x55E: Battery cell voltages 11-14
+ * (1000 ms = 1 per second)
+ */
+BOOL vehicle_twizy_can55e(void)
+{
+  UINT8 state;
 
-      break;
+  // volatile optimization:
+  state = twizy_batt_sensors_state;
 
+  if ((CAN_BYTE(0) != 0x0ff) && (state != BATT_SENSORS_READY))
+  {
+    vehicle_twizy_battstatus_cell(10, ((UINT) CAN_BYTE(0) << 4)
+            | ((UINT) CAN_NIBH(1)));
+    vehicle_twizy_battstatus_cell(11, ((UINT) CAN_NIBL(1) << 8)
+            | ((UINT) CAN_BYTE(2)));
+    vehicle_twizy_battstatus_cell(12, ((UINT) CAN_BYTE(3) << 4)
+            | ((UINT) CAN_NIBH(4)));
+    vehicle_twizy_battstatus_cell(13, ((UINT) CAN_NIBL(4) << 8)
+            | ((UINT) CAN_BYTE(5)));
 
-      /*****************************************************
-       * FILTER 2:
-       * CAN ID 0x59E: sent every 100 ms (10 per second)
-       */
-    case 0x0E:
+    state |= BATT_SENSORS_GOT55E;
 
-      // CYCLIC DISTANCE COUNTER:
-      twizy_dist = ((UINT) CAN_BYTE(0) << 8) + CAN_BYTE(1);
+    // detect fetch completion:
+    if ((state & BATT_SENSORS_READY) >= BATT_SENSORS_GOTALL)
+      state = BATT_SENSORS_READY;
 
-      // MOTOR TEMPERATURE:
-      if (CAN_BYTE(5) > 40 && CAN_BYTE(5) < 0xf0)
-        car_tmotor = CAN_BYTE(5) - 40;
-      else
-        car_tmotor = 0; // unsigned, no negative temps allowed...
+    twizy_batt_sensors_state = state;
+  }
 
+  return TRUE;
+}
 
-      break;
-    }
+/*****************************************************
+ * CAN ID 0x55F: Battery pack voltages
+ * (1000 ms = 1 per second)
+ */
+BOOL vehicle_twizy_can55f(void)
+{
+  UINT8 state;
 
-  }
+  // volatile optimization:
+  state = twizy_batt_sensors_state;
 
-  else if (can_filter == 3)
+  if ((CAN_BYTE(5) != 0x0ff) && (state != BATT_SENSORS_READY))
   {
-    // Filter 3 = CAN ID GROUP 0x69_:
+    // we still don't know why there are two pack voltages
+    // best guess: take avg
+    UINT v1, v2;
 
-    switch (CANsid)
-    {
-      /*****************************************************
-       * FILTER 3:
-       * CAN ID 0x69F: sent every 1000 ms (1 per second)
-       */
-    case 0x0f:
-      // VIN: last 7 digits of real VIN, in nibbles, reverse:
-      // (assumption: no hex digits)
-      if (car_vin[7]) // we only need to process this once
-      {
-        car_vin[0] = '0' + CAN_NIB(7);
-        car_vin[1] = '0' + CAN_NIB(6);
-        car_vin[2] = '0' + CAN_NIB(5);
-        car_vin[3] = '0' + CAN_NIB(4);
-        car_vin[4] = '0' + CAN_NIB(3);
-        car_vin[5] = '0' + CAN_NIB(2);
-        car_vin[6] = '0' + CAN_NIB(1);
-        car_vin[7] = 0;
-      }
+    v1 = ((UINT) CAN_BYTE(5) << 4)
+            | ((UINT) CAN_NIBH(6));
+    v2 = ((UINT) CAN_NIBL(6) << 8)
+            | ((UINT) CAN_BYTE(7));
 
-      break;
-    }
+    twizy_batt[0].volt_act = (v1 + v2) >> 1;
+
+    state |= BATT_SENSORS_GOT55F;
+
+    // detect fetch completion:
+    if ((state & BATT_SENSORS_READY) >= BATT_SENSORS_GOTALL)
+      state = BATT_SENSORS_READY;
+
+    twizy_batt_sensors_state = state;
   }
 
-#ifdef OVMS_TWIZY_BATTMON
-  else if (can_filter == 4)
-  {
-    UINT8 i, state;
+  return TRUE;
+}
 
-    // Filter 4 = CAN ID GROUP 0x55_: battery sensors.
-    //
-    // This group really needs to be processed as fast as possible;
-    // though only delivered once per second (except 556), the complete
-    // group comes at once and needs to be processed together to get
-    // a consistent sensor state.
+#endif // OVMS_TWIZY_BATTMON
 
-    // NEW INFO: group msgs can come in arbitrary order!
-    //  => using faster (100ms) 0x556 msgs as examination window
-    //    to detect mid-group fetch start
 
-    // volatile optimization:
-    state = twizy_batt_sensors_state;
+/*****************************************************
+ * CAN ID 0x597: sent every 100 ms (10 per second)
+ */
+BOOL vehicle_twizy_can597(void)
+{
+  // VEHICLE state:
+  //  [0]: 0x20 = power line connected
 
-    switch (CANsid)
-    {
-    case 0x06:
-      // CAN ID 0x556: Battery cell voltages 1-5
-      // 100 ms = 10 per second
-      //  => used to clock examination window
-      if ((CAN_BYTE(0) != 0x0ff) && (state != BATT_SENSORS_READY))
-      {
-        // store values:
-        twizy_cell[0].volt_act = ((UINT) CAN_BYTE(0) << 4)
-                | ((UINT) CAN_NIBH(1));
-        twizy_cell[1].volt_act = ((UINT) CAN_NIBL(1) << 8)
-                | ((UINT) CAN_BYTE(2));
-        twizy_cell[2].volt_act = ((UINT) CAN_BYTE(3) << 4)
-                | ((UINT) CAN_NIBH(4));
-        twizy_cell[3].volt_act = ((UINT) CAN_NIBL(4) << 8)
-                | ((UINT) CAN_BYTE(5));
-        twizy_cell[4].volt_act = ((UINT) CAN_BYTE(6) << 4)
-                | ((UINT) CAN_NIBH(7));
-
-        // detect fetch completion/failure:
-        if ((state & ~BATT_SENSORS_GOT556)
-                == (BATT_SENSORS_READY & ~BATT_SENSORS_GOT556))
-        {
-          // read all sensor data: group complete
-          twizy_batt_sensors_state = BATT_SENSORS_READY;
-        }
-        else if ((state & ~BATT_SENSORS_GOT556))
-        {
-          // read some sensor data: count 0x556 cycles
-          i = (state & BATT_SENSORS_GOT556) + 1;
+  if (CAN_BYTE(0) & 0x20)
+  {
+    car_linevoltage = 230; // fix 230 V
+    car_chargecurrent = 10; // fix 10 A
+  }
+  else
+  {
+    car_linevoltage = 0;
+    car_chargecurrent = 0;
+  }
 
-          if (i == 3)
-            // not complete in 2 0x556s cycles: drop window (wait for next group)
-            state = BATT_SENSORS_START;
-          else
-            // store new fetch window state:
-            state = (state & ~BATT_SENSORS_GOT556) | i;
+  //  [1] bit 4 = 0x10 CAN_STATUS_KEYON: 1 = Car ON (key switch)
+  //  [1] bit 5 = 0x20 CAN_STATUS_CHARGING: 1 = Charging
+  //  [1] bit 6 = 0x40 CAN_STATUS_OFFLINE: 1 = Switch-ON/-OFF phase
 
-          twizy_batt_sensors_state = state;
-        }
+  twizy_status = CAN_BYTE(1);
+  // Translation to car_doors1 done in ticker1()
 
-      }
+  // init cyclic distance counter on switch-on:
+  if ((twizy_status & CAN_STATUS_KEYON) && (!car_doors1bits.CarON))
+    twizy_dist = twizy_speed_distref = 0;
 
-      break;
+  // PEM temperature:
+  if (CAN_BYTE(7) > 0 && CAN_BYTE(7) < 0xf0)
+    car_tpem = (signed char) CAN_BYTE(7) - 40;
 
-    case 0x04:
-      // CAN ID 0x554: Battery cell module temperatures
-      // (1000 ms = 1 per second)
-      if ((CAN_BYTE(0) != 0x0ff) && (state != BATT_SENSORS_READY))
-      {
-        for (i = 0; i < BATT_CMODS; i++)
-          twizy_cmod[i].temp_act = CAN_BYTE(i);
+  return TRUE;
+}
 
-        state |= BATT_SENSORS_GOT554;
+/*****************************************************
+ * CAN ID 0x599: sent every 100 ms (10 per second)
+ */
+BOOL vehicle_twizy_can599(void)
+{
+  unsigned int new_speed;
 
-        // detect fetch completion:
-        if ((state & BATT_SENSORS_READY) >= BATT_SENSORS_GOTALL)
-          state = BATT_SENSORS_READY;
+  // RANGE:
+  // we need to check for charging, as the Twizy
+  // does not update range during charging
+  if (((twizy_status & 0x60) == 0)
+          && (can_databuffer[5] != 0xff) && (can_databuffer[5] > 0))
+  {
+    twizy_range = can_databuffer[5];
+    // car values derived in ticker1()
+  }
 
-        twizy_batt_sensors_state = state;
-      }
-      break;
+  // SPEED:
+  new_speed = ((unsigned int) can_databuffer[6] << 8) + can_databuffer[7];
+  if (new_speed != 0xffff)
+  {
+    int delta = (int) new_speed - (int) twizy_speed;
 
-    case 0x07:
-      // CAN ID 0x557: Battery cell voltages 6-10
-      // (1000 ms = 1 per second)
-      if ((CAN_BYTE(0) != 0x0ff) && (state != BATT_SENSORS_READY))
-      {
-        twizy_cell[5].volt_act = ((UINT) CAN_BYTE(0) << 4)
-                | ((UINT) CAN_NIBH(1));
-        twizy_cell[6].volt_act = ((UINT) CAN_NIBL(1) << 8)
-                | ((UINT) CAN_BYTE(2));
-        twizy_cell[7].volt_act = ((UINT) CAN_BYTE(3) << 4)
-                | ((UINT) CAN_NIBH(4));
-        twizy_cell[8].volt_act = ((UINT) CAN_NIBL(4) << 8)
-                | ((UINT) CAN_BYTE(5));
-        twizy_cell[9].volt_act = ((UINT) CAN_BYTE(6) << 4)
-                | ((UINT) CAN_NIBH(7));
-
-        state |= BATT_SENSORS_GOT557;
-
-        // detect fetch completion:
-        if ((state & BATT_SENSORS_READY) >= BATT_SENSORS_GOTALL)
-          state = BATT_SENSORS_READY;
-
-        twizy_batt_sensors_state = state;
-      }
-      break;
+    if (delta >= CAN_SPEED_THRESHOLD)
+      twizy_speed_state = CAN_SPEED_ACCEL;
+    else if (delta <= -CAN_SPEED_THRESHOLD)
+      twizy_speed_state = CAN_SPEED_DECEL;
+    else
+      twizy_speed_state = CAN_SPEED_CONST;
 
-    case 0x0E:
-      // CAN ID 0x55E: Battery cell voltages 11-14
-      // (1000 ms = 1 per second)
-      if ((CAN_BYTE(0) != 0x0ff) && (state != BATT_SENSORS_READY))
-      {
-        twizy_cell[10].volt_act = ((UINT) CAN_BYTE(0) << 4)
-                | ((UINT) CAN_NIBH(1));
-        twizy_cell[11].volt_act = ((UINT) CAN_NIBL(1) << 8)
-                | ((UINT) CAN_BYTE(2));
-        twizy_cell[12].volt_act = ((UINT) CAN_BYTE(3) << 4)
-                | ((UINT) CAN_NIBH(4));
-        twizy_cell[13].volt_act = ((UINT) CAN_NIBL(4) << 8)
-                | ((UINT) CAN_BYTE(5));
-
-        state |= BATT_SENSORS_GOT55E;
-
-        // detect fetch completion:
-        if ((state & BATT_SENSORS_READY) >= BATT_SENSORS_GOTALL)
-          state = BATT_SENSORS_READY;
-
-        twizy_batt_sensors_state = state;
-      }
-      break;
+    twizy_speed = new_speed;
+    // car value derived in ticker1()
+  }
 
-    case 0x0F:
-      // CAN ID 0x55F: Battery pack voltages
-      // (1000 ms = 1 per second)
-      if ((CAN_BYTE(5) != 0x0ff) && (state != BATT_SENSORS_READY))
-      {
-        // we still don't know why there are two pack voltages
-        // best guess: take avg
-        UINT v1, v2;
+  return TRUE;
+}
 
-        v1 = ((UINT) CAN_BYTE(5) << 4)
-                | ((UINT) CAN_NIBH(6));
-        v2 = ((UINT) CAN_NIBL(6) << 8)
-                | ((UINT) CAN_BYTE(7));
+/*****************************************************
+ * CAN ID 0x59E: sent every 100 ms (10 per second)
+ */
+BOOL vehicle_twizy_can59e(void)
+{
+  // CYCLIC DISTANCE COUNTER:
+  twizy_dist = ((UINT) CAN_BYTE(0) << 8) + CAN_BYTE(1);
 
-        twizy_batt[0].volt_act = (v1 + v2) >> 1;
+  // MOTOR TEMPERATURE:
+  if (CAN_BYTE(5) > 40 && CAN_BYTE(5) < 0xf0)
+    car_tmotor = CAN_BYTE(5) - 40;
+  else
+    car_tmotor = 0; // unsigned, no negative temps allowed...
 
-        state |= BATT_SENSORS_GOT55F;
+  return TRUE;
+}
 
-        // detect fetch completion:
-        if ((state & BATT_SENSORS_READY) >= BATT_SENSORS_GOTALL)
-          state = BATT_SENSORS_READY;
+/*****************************************************
+ * CAN ID 0x5D7: sent every 100 ms (10 per second)
+ * exact speed & odometer
+ */
+BOOL vehicle_twizy_can5d7(void)
+{
+  // ODOMETER:
+  twizy_odometer = ((unsigned long) CAN_BYTE(5) >> 4)
+          | ((unsigned long) CAN_BYTE(4) << 4)
+          | ((unsigned long) CAN_BYTE(3) << 12)
+          | ((unsigned long) CAN_BYTE(2) << 20);
+  // car value derived in ticker1()
 
-        twizy_batt_sensors_state = state;
-      }
-      break;
+  return TRUE;
+}
 
-    } // switch (CANsid)
+/*****************************************************
+ * CAN ID 0x69F: sent every 1000 ms (1 per second)
+ */
+BOOL vehicle_twizy_can69f(void)
+{
+  // VIN: last 7 digits of real VIN, in nibbles, reverse:
+  // (assumption: no hex digits)
+  if (car_vin[7]) // we only need to process this once
+  {
+    car_vin[0] = '0' + CAN_NIB(7);
+    car_vin[1] = '0' + CAN_NIB(6);
+    car_vin[2] = '0' + CAN_NIB(5);
+    car_vin[3] = '0' + CAN_NIB(4);
+    car_vin[4] = '0' + CAN_NIB(3);
+    car_vin[5] = '0' + CAN_NIB(2);
+    car_vin[6] = '0' + CAN_NIB(1);
+    car_vin[7] = 0;
   }
-#endif // OVMS_TWIZY_BATTMON
 
-  else if (can_filter == 5)
-  {
-    // Filter 5 = CAN ID GROUP 0x5D_: exact speed & odometer
+  return TRUE;
+}
 
-    switch (CANsid)
-    {
-      /*****************************************************
-       * FILTER 5:
-       * CAN ID 0x5D7: sent every 100 ms (10 per second)
-       */
-    case 0x07:
-
-      // ODOMETER:
-      twizy_odometer = ((unsigned long) CAN_BYTE(5) >> 4)
-              | ((unsigned long) CAN_BYTE(4) << 4)
-              | ((unsigned long) CAN_BYTE(3) << 12)
-              | ((unsigned long) CAN_BYTE(2) << 20);
-      // car value derived in ticker1()
 
-      break;
-    }
-  }
+// CAN ID dispatch table (sorted by ID): buffer 0 takes the 100 per second
+// ID 0x155 alone, buffer 1 the groups 0x55_, 0x59_, 0x5D_ and 0x69_.
+// The RX acceptance filters are derived from this by vehicle_can_filters().
+rom vehicle_can_handler_t vehicle_twizy_can_handlers[] =
+{
+  { 0x155, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 0, &vehicle_twizy_can155, NULL, 0 },
+#ifdef OVMS_TWIZY_BATTMON
+  { 0x554, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can554, NULL, 0 },
+  { 0x556, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can556, NULL, 0 },
+  { 0x557, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can557, NULL, 0 },
+  { 0x55E, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can55e, NULL, 0 },
+  { 0x55F, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can55f, NULL, 0 },
+#endif // OVMS_TWIZY_BATTMON
+  { 0x597, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can597, NULL, 0 },
+  { 0x599, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can599, NULL, 0 },
+  { 0x59E, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can59e, NULL, 0 },
+  { 0x5D7, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can5d7, NULL, 0 },
+  { 0x69F, VEHICLE_CAN_ID, VEHICLE_CAN_ANYMUX, 1, &vehicle_twizy_can69f, NULL, 0 }
+};
+#define TWIZY_CAN_HANDLERS (sizeof(vehicle_twizy_can_handlers)/sizeof(vehicle_can_handler_t))
 
+
+////////////////////////////////////////////////////////////////////////
+// twizy_poll()
+// This function is an entry point from the main() program loop, and
+// gives the CAN framework an opportunity to poll for data.
+//
+
+BOOL vehicle_twizy_poll(void)
+{
+  vehicle_can_dispatch(vehicle_twizy_can_handlers, TWIZY_CAN_HANDLERS);
   return TRUE;
 }
 
@@ -1108,7 +1102,6 @@ BOOL vehicle_twizy_poll1(void)
 
 void vehicle_twizy_notify(void)
 {
-  char *notify_channels;
   UINT8 notify_sms = 0, notify_msg = 0;
   char stat;
 
@@ -1123,10 +1116,9 @@ void vehicle_twizy_notify(void)
     return;
 
   // Read user config: notification channels
-  notify_channels = par_get(PARAM_NOTIFIES);
-  if (strstrrampgm(notify_channels, "SMS"))
+  if (par_notifies & PAR_NOTIFY_SMS)
     notify_sms = 1;
-  if (strstrrampgm(notify_channels, "IP"))
+  if (par_notifies & PAR_NOTIFY_IP)
     notify_msg = 1;
 
 
@@ -1256,9 +1248,9 @@ BOOL vehicle_twizy_state_ticker1(void)
   {
     // convert user km to miles
     if (suffRange > 0)
-      suffRange = MiFromKm(suffRange);
+      suffRange = (int) MiFromKm(suffRange);
     if (maxRange > 0)
-      maxRange = MiFromKm(maxRange);
+      maxRange = (int) MiFromKm(maxRange);
   }
 
 
@@ -1278,7 +1270,7 @@ BOOL vehicle_twizy_state_ticker1(void)
 
   // SPEED:
   if (can_mileskm == 'M')
-    car_speed = MiFromKm((twizy_speed + 50) / 100); // miles/hour
+    car_speed = (unsigned char) MiFromKm((twizy_speed + 50) / 100); // miles/hour
   else
     car_speed = (twizy_speed + 50) / 100; // km/hour
 
@@ -1396,7 +1388,7 @@ BOOL vehicle_twizy_state_ticker1(void)
               (((float) twizy_soc_min_range) / twizy_soc_min) * twizy_soc;
 
       if (twizy_range > 0)
-        car_estrange = MiFromKm(twizy_range);
+        car_estrange = (unsigned int) MiFromKm(twizy_range);
 
       if (maxRange > 0)
         car_idealrange = (((float) maxRange) * twizy_soc) / 10000;
@@ -1476,7 +1468,7 @@ BOOL vehicle_twizy_state_ticker1(void)
     // Calculate range:
     if (twizy_range > 0)
     {
-      car_estrange = MiFromKm(twizy_range);
+      car_estrange = (unsigned int) MiFromKm(twizy_range);
 
       if (maxRange > 0)
         car_idealrange = (((float) maxRange) * twizy_soc) / 10000;
@@ -1533,7 +1525,7 @@ BOOL vehicle_twizy_state_ticker1(void)
 
   // send stream updates (GPS log) while car is moving:
   // (every 5 seconds for debug/test, should be per second if possible...)
-  if ((twizy_speed > 0) && (sys_features[FEATURE_STREAM] & 2)
+  if ((twizy_speed > 0) && (sys_features[FEATURE_STREAM] & FEATURE_ST_GPSLOG)
           && ((can_granular_tick % 5) == 0))
   {
     twizy_notify |= SEND_StreamUpdate;
@@ -1722,7 +1714,7 @@ void vehicle_twizy_power_collect(void)
 
   // calc grade in percent:
   alt_diff = car_altitude - twizy_level_alt;
-  grade_perc = (long) alt_diff * 100 / (long) dist;
+  grade_perc = (int) ((long) alt_diff * 100 / (long) dist);
 
   // set new section reference:
   twizy_level_odo = twizy_odometer;
@@ -1767,9 +1759,9 @@ void vehicle_twizy_power_prepmsg(char mode)
   // distribution:
   if (pwr_dist > 0)
   {
-    prc_const = (twizy_speedpwr[CAN_SPEED_CONST].dist * 1000 / pwr_dist + 5) / 10;
-    prc_accel = (twizy_speedpwr[CAN_SPEED_ACCEL].dist * 1000 / pwr_dist + 5) / 10;
-    prc_decel = (twizy_speedpwr[CAN_SPEED_DECEL].dist * 1000 / pwr_dist + 5) / 10;
+    prc_const = (UINT8) ((twizy_speedpwr[CAN_SPEED_CONST].dist * 1000 / pwr_dist + 5) / 10);
+    prc_accel = (UINT8) ((twizy_speedpwr[CAN_SPEED_ACCEL].dist * 1000 / pwr_dist + 5) / 10);
+    prc_decel = (UINT8) ((twizy_speedpwr[CAN_SPEED_DECEL].dist * 1000 / pwr_dist + 5) / 10);
   }
 
   s = strchr(net_scratchpad, 0); // append to net_scratchpad
@@ -1817,7 +1809,7 @@ void vehicle_twizy_power_prepmsg(char mode)
     if ((pwr_use > 0) && (dist > 0))
     {
       s = stp_l(s, "Efficiency ", (pwr / dist * 10000 + 11250) / 22500);
-      s = stp_i(s, " Wh/km R=", (pwr_rec * 1000 / pwr_use + 5) / 10);
+      s = stp_i(s, " Wh/km R=", (int) ((pwr_rec * 1000 / pwr_use + 5) / 10));
       s = stp_rom(s, "%");
     }
 
@@ -1829,7 +1821,7 @@ void vehicle_twizy_power_prepmsg(char mode)
     {
       s = stp_i(s, "\r Const ", prc_const);
       s = stp_l(s, "% ", (pwr / dist * 10000 + 11250) / 22500);
-      s = stp_i(s, " Wh/km R=", (pwr_rec * 1000 / pwr_use + 5) / 10);
+      s = stp_i(s, " Wh/km R=", (int) ((pwr_rec * 1000 / pwr_use + 5) / 10));
       s = stp_rom(s, "%");
     }
 
@@ -1841,7 +1833,7 @@ void vehicle_twizy_power_prepmsg(char mode)
     {
       s = stp_i(s, "\r Accel ", prc_accel);
       s = stp_l(s, "% ", (pwr / dist * 10000 + 11250) / 22500);
-      s = stp_i(s, " Wh/km R=", (pwr_rec * 1000 / pwr_use + 5) / 10);
+      s = stp_i(s, " Wh/km R=", (int) ((pwr_rec * 1000 / pwr_use + 5) / 10));
       s = stp_rom(s, "%");
     }
 
@@ -1853,7 +1845,7 @@ void vehicle_twizy_power_prepmsg(char mode)
     {
       s = stp_i(s, "\r Decel ", prc_decel);
       s = stp_l(s, "% ", (pwr / dist * 10000 + 11250) / 22500);
-      s = stp_i(s, " Wh/km R=", (pwr_rec * 1000 / pwr_use + 5) / 10);
+      s = stp_i(s, " Wh/km R=", (int) ((pwr_rec * 1000 / pwr_use + 5) / 10));
       s = stp_rom(s, "%");
     }
 
@@ -1867,7 +1859,7 @@ void vehicle_twizy_power_prepmsg(char mode)
     {
       s = stp_i(s, "\r Up ", twizy_levelpwr[CAN_LEVEL_UP].hsum);
       s = stp_l(s, "m ", (pwr / dist * 1000 + 11250) / 22500);
-      s = stp_i(s, " Wh/km R=", (pwr_rec * 1000 / pwr_use + 5) / 10);
+      s = stp_i(s, " Wh/km R=", (int) ((pwr_rec * 1000 / pwr_use + 5) / 10));
       s = stp_rom(s, "%");
     }
 
@@ -1879,7 +1871,7 @@ void vehicle_twizy_power_prepmsg(char mode)
     {
       s = stp_i(s, "\r Down ", twizy_levelpwr[CAN_LEVEL_DOWN].hsum);
       s = stp_l(s, "m ", (pwr / dist * 1000 + 11250) / 22500);
-      s = stp_i(s, " Wh/km R=", (pwr_rec * 1000 / pwr_use + 5) / 10);
+      s = stp_i(s, " Wh/km R=", (int) ((pwr_rec * 1000 / pwr_use + 5) / 10));
       s = stp_rom(s, "%");
     }
 
@@ -1904,31 +1896,40 @@ char vehicle_twizy_power_msgp(char stat, int cmd)
      *
      */
 
-    s = stp_rom(net_scratchpad, "MP-0 HRT-PWR-UsageStats,0,86400");
-
-    s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_CONST].dist);
-    s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_CONST].use);
-    s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_CONST].rec);
-
-    s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_ACCEL].dist);
-    s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_ACCEL].use);
-    s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_ACCEL].rec);
-
-    s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_DECEL].dist);
-    s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_DECEL].use);
-    s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_DECEL].rec);
-
-    s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_UP].dist);
-    s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_UP].hsum);
-    s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_UP].use);
-    s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_UP].rec);
-
-    s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_DOWN].dist);
-    s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_DOWN].hsum);
-    s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_DOWN].use);
-    s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_DOWN].rec);
-
-    stat = net_msg_encode_statputs(stat, &crc);
+    net_msg_rec_start(stat, &crc, NULL, 0);
+    do
+    {
+      s = stp_rom(net_msg_rec, "MP-0 HRT-PWR-UsageStats,0,86400");
+      s = net_msg_rec_put(s);
+
+      s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_CONST].dist);
+      s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_CONST].use);
+      s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_CONST].rec);
+      s = net_msg_rec_put(s);
+
+      s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_ACCEL].dist);
+      s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_ACCEL].use);
+      s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_ACCEL].rec);
+      s = net_msg_rec_put(s);
+
+      s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_DECEL].dist);
+      s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_DECEL].use);
+      s = stp_ul(s, ",", twizy_speedpwr[CAN_SPEED_DECEL].rec);
+      s = net_msg_rec_put(s);
+
+      s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_UP].dist);
+      s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_UP].hsum);
+      s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_UP].use);
+      s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_UP].rec);
+      s = net_msg_rec_put(s);
+
+      s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_DOWN].dist);
+      s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_DOWN].hsum);
+      s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_DOWN].use);
+      s = stp_ul(s, ",", twizy_levelpwr[CAN_LEVEL_DOWN].rec);
+      net_msg_rec_put(s);
+    } while (net_msg_rec_next());
+    stat = net_msg_rec_stat;
   }
 
   return stat;
@@ -1961,7 +1962,6 @@ BOOL vehicle_twizy_power_sms(BOOL premsg, char *caller, char *command, char *arg
   cr2lf(net_scratchpad);
 
   // OK, send SMS:
-  delay100(2);
   net_send_sms_start(caller);
   net_puts_ram(net_scratchpad);
 
@@ -1981,9 +1981,11 @@ BOOL vehicle_twizy_power_cmd(BOOL msgmode, int cmd, char *arguments)
       vehicle_twizy_power_msgp(0, cmd);
 
       // msg command response:
-      s = stp_i(net_scratchpad, "MP-0 c", cmd);
+      net_msg_encode_start();
+      s = stp_i(net_msg_rec, "MP-0 c", cmd);
       s = stp_rom(s, ",0");
-      net_msg_encode_puts();
+      net_msg_rec_put(s);
+      net_msg_encode_end();
     }
     else
     {
@@ -2008,9 +2010,11 @@ BOOL vehicle_twizy_power_cmd(BOOL msgmode, int cmd, char *arguments)
       net_msg_encode_puts();
 
       // msg command response:
-      s = stp_i(net_scratchpad, "MP-0 c", cmd);
+      net_msg_encode_start();
+      s = stp_i(net_msg_rec, "MP-0 c", cmd);
       s = stp_rom(s, ",0");
-      net_msg_encode_puts();
+      net_msg_rec_put(s);
+      net_msg_encode_end();
     }
     else
     {
@@ -2043,25 +2047,29 @@ char vehicle_twizy_debug_msgp(char stat, int cmd)
 
   stat = net_msgp_environment(stat);
 
-  s = stp_rom(net_scratchpad, "MP-0 ");
+  net_msg_encode_start();
+  s = stp_rom(net_msg_rec, "MP-0 ");
   s = stp_i(s, "c", cmd ? cmd : CMD_Debug);
   s = stp_x(s, ",0,", twizy_status);
   s = stp_x(s, ",", car_doors1);
   s = stp_x(s, ",", car_doors5);
+  s = net_msg_rec_put(s);
   s = stp_i(s, ",", car_chargestate);
   s = stp_i(s, ",", twizy_speed);
   s = stp_i(s, ",", twizy_power);
   s = stp_ul(s, ",", twizy_odometer);
   s = stp_i(s, ",", twizy_soc);
+  s = net_msg_rec_put(s);
   s = stp_i(s, ",", twizy_soc_min);
   s = stp_i(s, ",", twizy_soc_max);
   s = stp_i(s, ",", twizy_range);
   s = stp_i(s, ",", twizy_soc_min_range);
   s = stp_i(s, ",", car_estrange);
+  s = net_msg_rec_put(s);
   s = stp_i(s, ",", car_idealrange);
   s = stp_i(s, ",", can_minSOCnotified);
-
-  net_msg_encode_puts();
+  net_msg_rec_put(s);
+  net_msg_encode_end();
   return (stat == 2) ? 1 : stat;
 }
 
@@ -2245,8 +2253,8 @@ void vehicle_twizy_stat_prepmsg(void)
   }
   else
   {
-    s = stp_i(s, "\r Range: ", KmFromMi(car_estrange));
-    s = stp_i(s, " - ", KmFromMi(car_idealrange));
+    s = stp_i(s, "\r Range: ", (int) KmFromMi(car_estrange));
+    s = stp_i(s, " - ", (int) KmFromMi(car_idealrange));
     s = stp_rom(s, " km");
   }
 
@@ -2294,7 +2302,6 @@ BOOL vehicle_twizy_stat_sms(BOOL premsg, char *caller, char *command, char *argu
   cr2lf(net_scratchpad);
 
   // OK, start SMS:
-  delay100(2);
   net_send_sms_start(caller);
   net_puts_ram(net_scratchpad);
 
@@ -2333,12 +2340,12 @@ char vehicle_twizy_range_msgp(char stat, int cmd)
   //static WORD crc; // diff crc for push msgs
   char *s;
 
-  s = stp_rom(net_scratchpad, "MP-0 ");
+  net_msg_encode_start();
+  s = stp_rom(net_msg_rec, "MP-0 ");
   s = stp_i(s, "c", cmd ? cmd : CMD_QueryRange);
   s = stp_i(s, ",0,", sys_features[FEATURE_MAXRANGE]);
-
-  //return net_msg_encode_statputs( stat, &crc );
-  net_msg_encode_puts();
+  net_msg_rec_put(s);
+  net_msg_encode_end();
   return (stat == 2) ? 1 : stat;
 }
 
@@ -2448,23 +2455,24 @@ char vehicle_twizy_ca_msgp(char stat, int cmd)
     else
       maxrange = 0;
     if (can_mileskm == 'M')
-      maxrange = MiFromKm(maxrange);
+      maxrange = (int) MiFromKm(maxrange);
   }
 
   etr_range = (maxrange) ? vehicle_twizy_chargetime(
           (long) sys_features[FEATURE_SUFFRANGE] * 10000 / maxrange) : 0;
 
   // Send command reply:
-  s = stp_rom(net_scratchpad, "MP-0 ");
+  net_msg_encode_start();
+  s = stp_rom(net_msg_rec, "MP-0 ");
   s = stp_i(s, "c", cmd ? cmd : CMD_QueryChargeAlerts);
   s = stp_i(s, ",0,", sys_features[FEATURE_SUFFRANGE]);
   s = stp_i(s, ",", sys_features[FEATURE_SUFFSOC]);
+  s = net_msg_rec_put(s);
   s = stp_i(s, ",", etr_range);
   s = stp_i(s, ",", etr_soc);
   s = stp_i(s, ",", vehicle_twizy_chargetime(10000));
-
-  //return net_msg_encode_statputs( stat, &crc );
-  net_msg_encode_puts();
+  net_msg_rec_put(s);
+  net_msg_encode_end();
   return (stat == 2) ? 1 : stat;
 }
 
@@ -2515,7 +2523,6 @@ BOOL vehicle_twizy_ca_sms(BOOL premsg, char *caller, char *command, char *argume
 
     int value;
     char unit;
-    unsigned char f;
     char *arg_suffsoc = NULL, *arg_suffrange = NULL;
 
     // clear current alerts:
@@ -2590,7 +2597,7 @@ BOOL vehicle_twizy_ca_sms(BOOL premsg, char *caller, char *command, char *argume
         else
           maxrange = 0;
         if (can_mileskm == 'M')
-          maxrange = MiFromKm(maxrange);
+          maxrange = (int) MiFromKm(maxrange);
       }
 
       etr_range = (maxrange) ? vehicle_twizy_chargetime(
@@ -2715,65 +2722,125 @@ void vehicle_twizy_battstatus_reset(void)
 
 // Collect battery voltages & temperatures:
 
-void vehicle_twizy_battstatus_collect(void)
+// Standard deviation of n values from their sum & sum of squares, rounded:
+// sqrt(n*sqrsum - sum^2) / n, using floor(2*sqrt(v)) to round exactly
+
+UINT vehicle_twizy_stddev(UINT32 sum, UINT32 sqrsum, UINT n)
 {
-  UINT i, stddev, absdev;
-  INT dev;
-  UINT32 sum, sqrsum;
-  float f, m;
+  UINT32 v, r2;
+  UINT r;
 
-  // only if consistent sensor state has been reached:
-  if (twizy_batt_sensors_state != BATT_SENSORS_READY)
-    return;
+  v = n * sqrsum - SQR(sum);
+  r = isqrt(v);
+  r2 = 2 * (UINT32) r + ((v > (UINT32) r * r + r) ? 1 : 0);
+  return (r2 + n) / (2 * n);
+}
+
+// Deviation of value from the mean sum/n, rounded half away from zero
 
-  /*
-  if( (net_buf_mode == NET_BUF_CRLF) && (net_buf_pos == 0) )
+INT vehicle_twizy_dev(UINT value, UINT32 sum, UINT n)
+{
+  INT32 d = (INT32) value * n - (INT32) sum;
+
+  if (d >= 0)
+    return (d + n / 2) / n;
+  else
+    return -((-d + n / 2) / n);
+}
+
+// Update cell/cmod values & running sums, called per sensor frame:
+// min/max are tracked here, mean/stddev/deviations are evaluated
+// from the sums by vehicle_twizy_battstatus_collect() once per group.
+
+void vehicle_twizy_battstatus_cell(UINT8 i, UINT volt)
+{
+  UINT old = twizy_cell[i].volt_act;
+
+  if (!(twizy_cell_stats.invalid & (1 << i)))
   {
-      char *s;
-      s = stp_i( net_scratchpad, "# tic1: ss=", twizy_batt_sensors_state );
-      s = stp_rom( s, "\r\n" );
-      net_puts_ram( net_scratchpad );
+    twizy_cell_stats.sum -= old;
+    twizy_cell_stats.sqrsum -= SQR((UINT32) old);
   }
-   */
-
-  // *********** Temperatures: ************
 
-  // build mean value & standard deviation:
-  sum = 0;
-  sqrsum = 0;
+  twizy_cell[i].volt_act = volt;
 
-  for (i = 0; i < BATT_CMODS; i++)
+  // Validate:
+  if ((volt == 0) || (volt >= 0x0f00))
   {
-    // Validate:
-    if ((twizy_cmod[i].temp_act == 0) || (twizy_cmod[i].temp_act >= 0x0f0))
-      break;
+    twizy_cell_stats.invalid |= (1 << i);
+    return;
+  }
 
-    // Remember min:
-    if ((twizy_cmod[i].temp_min == 0) || (twizy_cmod[i].temp_act < twizy_cmod[i].temp_min))
-      twizy_cmod[i].temp_min = twizy_cmod[i].temp_act;
+  twizy_cell_stats.invalid &= ~(1 << i);
+  twizy_cell_stats.sum += volt;
+  twizy_cell_stats.sqrsum += SQR((UINT32) volt);
 
-    // Remember max:
-    if ((twizy_cmod[i].temp_max == 0) || (twizy_cmod[i].temp_act > twizy_cmod[i].temp_max))
-      twizy_cmod[i].temp_max = twizy_cmod[i].temp_act;
+  // Remember min:
+  if ((twizy_cell[i].volt_min == 0) || (volt < twizy_cell[i].volt_min))
+    twizy_cell[i].volt_min = volt;
 
-    // build sums:
-    sum += twizy_cmod[i].temp_act;
-    sqrsum += SQR((UINT32) twizy_cmod[i].temp_act);
+  // Remember max:
+  if ((twizy_cell[i].volt_max == 0) || (volt > twizy_cell[i].volt_max))
+    twizy_cell[i].volt_max = volt;
+}
+
+void vehicle_twizy_battstatus_cmod(UINT8 i, UINT8 temp)
+{
+  UINT8 old = twizy_cmod[i].temp_act;
+
+  if (!(twizy_cmod_stats.invalid & (1 << i)))
+  {
+    twizy_cmod_stats.sum -= old;
+    twizy_cmod_stats.sqrsum -= SQR((UINT) old);
   }
 
-  if (i == BATT_CMODS)
+  twizy_cmod[i].temp_act = temp;
+
+  // Validate:
+  if ((temp == 0) || (temp >= 0x0f0))
   {
-    // All values valid, process:
+    twizy_cmod_stats.invalid |= (1 << i);
+    return;
+  }
+
+  twizy_cmod_stats.invalid &= ~(1 << i);
+  twizy_cmod_stats.sum += temp;
+  twizy_cmod_stats.sqrsum += SQR((UINT) temp);
+
+  // Remember min:
+  if ((twizy_cmod[i].temp_min == 0) || (temp < twizy_cmod[i].temp_min))
+    twizy_cmod[i].temp_min = temp;
+
+  // Remember max:
+  if ((twizy_cmod[i].temp_max == 0) || (temp > twizy_cmod[i].temp_max))
+    twizy_cmod[i].temp_max = temp;
+}
+
+// Deviation threshold check without division:
+//  |value * n - sum| >= BATT_DEVLIM(t, n)  <=>  rounded |deviation| >= t
+#define BATT_DEVLIM(t, n) ((UINT32) (t) * (n) - (n) / 2)
+
+void vehicle_twizy_battstatus_collect(void)
+{
+  UINT i, stddev;
+  UINT32 sum, absdev, devlim;
+
+  // only if consistent sensor state has been reached:
+  if (twizy_batt_sensors_state != BATT_SENSORS_READY)
+    return;
 
-    m = (float) sum / BATT_CMODS;
 
-    car_tbattery = (signed int) m + 0.5 - 40;
+  // *********** Temperatures: ************
+
+  if (twizy_cmod_stats.invalid == 0)
+  {
+    // All values valid, process:
+
+    sum = twizy_cmod_stats.sum;
+    car_tbattery = (INT) ((sum + BATT_CMODS / 2) / BATT_CMODS) - 40;
     car_stale_temps = 120; // Reset stale indicator
 
-    //stddev = (unsigned int) sqrt( ((float)sqrsum/BATT_CMODS) - SQR((float)sum/BATT_CMODS) ) + 1;
-    // this is too complex for C18, we need to split this up:
-    f = ((float) sqrsum / BATT_CMODS) - SQR(m);
-    stddev = sqrt(f) + 0.5;
+    stddev = vehicle_twizy_stddev(sum, twizy_cmod_stats.sqrsum, BATT_CMODS);
     if (stddev == 0)
       stddev = 1; // not enough precision to allow stddev 0
 
@@ -2791,32 +2858,32 @@ void vehicle_twizy_battstatus_collect(void)
     }
 
     // check cmod deviations:
+    devlim = BATT_DEVLIM(stddev + 1, BATT_CMODS);
     for (i = 0; i < BATT_CMODS; i++)
     {
-      // deviation:
-      dev = (twizy_cmod[i].temp_act - m)
-              + ((twizy_cmod[i].temp_act >= m) ? 0.5 : -0.5);
-      absdev = ABS(dev);
+      // deviation * BATT_CMODS:
+      absdev = (UINT32) twizy_cmod[i].temp_act * BATT_CMODS;
+      absdev = (absdev >= sum) ? (absdev - sum) : (sum - absdev);
 
       // Set watch/alert flags:
       // (applying overall thresholds only in stddev alert mode)
       if ((twizy_batt[0].temp_alerts & BATT_STDDEV_TEMP_FLAG)
-              && (absdev >= BATT_STDDEV_TEMP_ALERT))
+              && (absdev >= BATT_DEVLIM(BATT_STDDEV_TEMP_ALERT, BATT_CMODS)))
         twizy_batt[0].temp_alerts |= (1 << i);
-      else if (absdev >= BATT_DEV_TEMP_ALERT)
+      else if (absdev >= BATT_DEVLIM(BATT_DEV_TEMP_ALERT, BATT_CMODS))
         twizy_batt[0].temp_alerts |= (1 << i);
       else if ((twizy_batt[0].temp_watches & BATT_STDDEV_TEMP_FLAG)
-              && (absdev >= BATT_STDDEV_TEMP_WATCH))
+              && (absdev >= BATT_DEVLIM(BATT_STDDEV_TEMP_WATCH, BATT_CMODS)))
         twizy_batt[0].temp_watches |= (1 << i);
-      else if (absdev > stddev)
+      else if (absdev >= devlim)
         twizy_batt[0].temp_watches |= (1 << i);
 
       // Remember max deviation:
-      if (absdev > ABS(twizy_cmod[i].temp_maxdev))
-        twizy_cmod[i].temp_maxdev = (INT8) dev;
+      if (absdev >= BATT_DEVLIM(ABS(twizy_cmod[i].temp_maxdev) + 1, BATT_CMODS))
+        twizy_cmod[i].temp_maxdev = (INT8) vehicle_twizy_dev(twizy_cmod[i].temp_act, sum, BATT_CMODS);
     }
 
-  } // if( i == BATT_CMODS )
+  } // if( twizy_cmod_stats.invalid == 0 )
 
 
   // ********** Voltages: ************
@@ -2827,39 +2894,13 @@ void vehicle_twizy_battstatus_collect(void)
   if ((twizy_batt[0].volt_max == 0) || (twizy_batt[0].volt_act > twizy_batt[0].volt_max))
     twizy_batt[0].volt_max = twizy_batt[0].volt_act;
 
-  // Cells: build mean value & standard deviation:
-  sum = 0;
-  sqrsum = 0;
-
-  for (i = 0; i < BATT_CELLS; i++)
-  {
-    // Validate:
-    if ((twizy_cell[i].volt_act == 0) || (twizy_cell[i].volt_act >= 0x0f00))
-      break;
-
-    // Remember min:
-    if ((twizy_cell[i].volt_min == 0) || (twizy_cell[i].volt_act < twizy_cell[i].volt_min))
-      twizy_cell[i].volt_min = twizy_cell[i].volt_act;
-
-    // Remember max:
-    if ((twizy_cell[i].volt_max == 0) || (twizy_cell[i].volt_act > twizy_cell[i].volt_max))
-      twizy_cell[i].volt_max = twizy_cell[i].volt_act;
-
-    // build sums:
-    sum += twizy_cell[i].volt_act;
-    sqrsum += SQR((UINT32) twizy_cell[i].volt_act);
-  }
-
-  if (i == BATT_CELLS)
+  // Cells:
+  if (twizy_cell_stats.invalid == 0)
   {
     // All values valid, process:
 
-    m = (float) sum / BATT_CELLS;
-
-    //stddev = (unsigned int) sqrt( ((float)sqrsum/BATT_CELLS) - SQR((float)sum/BATT_CELLS) ) + 1;
-    // this is too complex for C18, we need to split this up:
-    f = ((float) sqrsum / BATT_CELLS) - SQR(m);
-    stddev = sqrt(f) + 0.5;
+    sum = twizy_cell_stats.sum;
+    stddev = vehicle_twizy_stddev(sum, twizy_cell_stats.sqrsum, BATT_CELLS);
     if (stddev == 0)
       stddev = 1; // not enough precision to allow stddev 0
 
@@ -2877,32 +2918,32 @@ void vehicle_twizy_battstatus_collect(void)
     }
 
     // check cell deviations:
+    devlim = BATT_DEVLIM(stddev + 1, BATT_CELLS);
     for (i = 0; i < BATT_CELLS; i++)
     {
-      // deviation:
-      dev = (twizy_cell[i].volt_act - m)
-              + ((twizy_cell[i].volt_act >= m) ? 0.5 : -0.5);
-      absdev = ABS(dev);
+      // deviation * BATT_CELLS:
+      absdev = (UINT32) twizy_cell[i].volt_act * BATT_CELLS;
+      absdev = (absdev >= sum) ? (absdev - sum) : (sum - absdev);
 
       // Set watch/alert flags:
       // (applying overall thresholds only in stddev alert mode)
       if ((twizy_batt[0].volt_alerts & BATT_STDDEV_VOLT_FLAG)
-              && (absdev >= BATT_STDDEV_VOLT_ALERT))
+              && (absdev >= BATT_DEVLIM(BATT_STDDEV_VOLT_ALERT, BATT_CELLS)))
         twizy_batt[0].volt_alerts |= (1L << i);
-      else if (absdev >= BATT_DEV_VOLT_ALERT)
+      else if (absdev >= BATT_DEVLIM(BATT_DEV_VOLT_ALERT, BATT_CELLS))
         twizy_batt[0].volt_alerts |= (1L << i);
       else if ((twizy_batt[0].volt_watches & BATT_STDDEV_VOLT_FLAG)
-              && (absdev >= BATT_STDDEV_VOLT_WATCH))
+              && (absdev >= BATT_DEVLIM(BATT_STDDEV_VOLT_WATCH, BATT_CELLS)))
         twizy_batt[0].volt_watches |= (1L << i);
-      else if (absdev > stddev)
+      else if (absdev >= devlim)
         twizy_batt[0].volt_watches |= (1L << i);
 
       // Remember max deviation:
-      if (absdev > ABS(twizy_cell[i].volt_maxdev))
-        twizy_cell[i].volt_maxdev = (INT) dev;
+      if (absdev >= BATT_DEVLIM(ABS(twizy_cell[i].volt_maxdev) + 1, BATT_CELLS))
+        twizy_cell[i].volt_maxdev = vehicle_twizy_dev(twizy_cell[i].volt_act, sum, BATT_CELLS);
     }
 
-  } // if( i == BATT_CELLS )
+  } // if( twizy_cell_stats.invalid == 0 )
 
 
   // Battery monitor update/alert:
@@ -3093,7 +3134,7 @@ char vehicle_twizy_battstatus_msgp(char stat, int cmd)
         tmax = twizy_cmod[c].temp_max;
     }
 
-    tact = (float) tact / BATT_CMODS + 0.5;
+    tact = (tact + BATT_CMODS / 2) / BATT_CMODS;
 
     // Output battery packs (just one for Twizy up to now):
     for (p = 0; p < BATT_PACKS; p++)
@@ -3123,28 +3164,35 @@ char vehicle_twizy_battstatus_msgp(char stat, int cmd)
       //  ,<temp_act>,<temp_min>,<temp_max>
       //  ,<cell_volt_stddev_max>,<cmod_temp_stddev_max>
 
-      s = stp_rom(net_scratchpad, "MP-0 H");
-      s = stp_i(s, "RT-PWR-BattPack,", p + 1);
-      s = stp_i(s, ",86400,", BATT_CELLS);
-      s = stp_i(s, ",", 1);
-      s = stp_i(s, ",", volt_alert);
-      s = stp_i(s, ",", temp_alert);
-      s = stp_i(s, ",", twizy_soc);
-      s = stp_i(s, ",", twizy_soc_min);
-      s = stp_i(s, ",", twizy_soc_max);
-      s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_act));
-      s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_act) / BATT_CELLS);
-      s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_min));
-      s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_min) / BATT_CELLS);
-      s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_max));
-      s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_max) / BATT_CELLS);
-      s = stp_i(s, ",", CONV_Temp(tact));
-      s = stp_i(s, ",", CONV_Temp(tmin));
-      s = stp_i(s, ",", CONV_Temp(tmax));
-      s = stp_i(s, ",", CONV_CellVolt(twizy_batt[p].cell_volt_stddev_max));
-      s = stp_i(s, ",", twizy_batt[p].cmod_temp_stddev_max);
-
-      stat = net_msg_encode_statputs(stat, &crc_pack[p]);
+      net_msg_rec_start(stat, &crc_pack[p], NULL, 0);
+      do
+      {
+        s = stp_rom(net_msg_rec, "MP-0 H");
+        s = stp_i(s, "RT-PWR-BattPack,", p + 1);
+        s = stp_i(s, ",86400,", BATT_CELLS);
+        s = net_msg_rec_put(s);
+        s = stp_i(s, ",", 1);
+        s = stp_i(s, ",", volt_alert);
+        s = stp_i(s, ",", temp_alert);
+        s = stp_i(s, ",", twizy_soc);
+        s = stp_i(s, ",", twizy_soc_min);
+        s = stp_i(s, ",", twizy_soc_max);
+        s = net_msg_rec_put(s);
+        s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_act));
+        s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_act) / BATT_CELLS);
+        s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_min));
+        s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_min) / BATT_CELLS);
+        s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_max));
+        s = stp_i(s, ",", CONV_PackVolt(twizy_batt[p].volt_max) / BATT_CELLS);
+        s = net_msg_rec_put(s);
+        s = stp_i(s, ",", CONV_Temp(tact));
+        s = stp_i(s, ",", CONV_Temp(tmin));
+        s = stp_i(s, ",", CONV_Temp(tmax));
+        s = stp_i(s, ",", CONV_CellVolt(twizy_batt[p].cell_volt_stddev_max));
+        s = stp_i(s, ",", twizy_batt[p].cmod_temp_stddev_max);
+        net_msg_rec_put(s);
+      } while (net_msg_rec_next());
+      stat = net_msg_rec_stat;
 
       // Output cell status:
       for (c = 0; c < BATT_CELLS; c++)
@@ -3169,21 +3217,27 @@ char vehicle_twizy_battstatus_msgp(char stat, int cmd)
         //  ,<volt_act>,<volt_min>,<volt_max>,<volt_maxdev>
         //  ,<temp_act>,<temp_min>,<temp_max>,<temp_maxdev>
 
-        s = stp_rom(net_scratchpad, "MP-0 H");
-        s = stp_i(s, "RT-PWR-BattCell,", c + 1);
-        s = stp_i(s, ",86400,", p + 1);
-        s = stp_i(s, ",", volt_alert);
-        s = stp_i(s, ",", temp_alert);
-        s = stp_i(s, ",", CONV_CellVolt(twizy_cell[c].volt_act));
-        s = stp_i(s, ",", CONV_CellVolt(twizy_cell[c].volt_min));
-        s = stp_i(s, ",", CONV_CellVolt(twizy_cell[c].volt_max));
-        s = stp_i(s, ",", CONV_CellVoltS(twizy_cell[c].volt_maxdev));
-        s = stp_i(s, ",", CONV_Temp(twizy_cmod[c >> 1].temp_act));
-        s = stp_i(s, ",", CONV_Temp(twizy_cmod[c >> 1].temp_min));
-        s = stp_i(s, ",", CONV_Temp(twizy_cmod[c >> 1].temp_max));
-        s = stp_i(s, ",", twizy_cmod[c >> 1].temp_maxdev);
-
-        stat = net_msg_encode_statputs(stat, &crc_cell[c]);
+        net_msg_rec_start(stat, &crc_cell[c], NULL, 0);
+        do
+        {
+          s = stp_rom(net_msg_rec, "MP-0 H");
+          s = stp_i(s, "RT-PWR-BattCell,", c + 1);
+          s = stp_i(s, ",86400,", p + 1);
+          s = net_msg_rec_put(s);
+          s = stp_i(s, ",", volt_alert);
+          s = stp_i(s, ",", temp_alert);
+          s = stp_i(s, ",", CONV_CellVolt(twizy_cell[c].volt_act));
+          s = stp_i(s, ",", CONV_CellVolt(twizy_cell[c].volt_min));
+          s = stp_i(s, ",", CONV_CellVolt(twizy_cell[c].volt_max));
+          s = net_msg_rec_put(s);
+          s = stp_i(s, ",", CONV_CellVoltS(twizy_cell[c].volt_maxdev));
+          s = stp_i(s, ",", CONV_Temp(twizy_cmod[c >> 1].temp_act));
+          s = stp_i(s, ",", CONV_Temp(twizy_cmod[c >> 1].temp_min));
+          s = stp_i(s, ",", CONV_Temp(twizy_cmod[c >> 1].temp_max));
+          s = stp_i(s, ",", twizy_cmod[c >> 1].temp_maxdev);
+          net_msg_rec_put(s);
+        } while (net_msg_rec_next());
+        stat = net_msg_rec_stat;
       }
     }
 
@@ -3200,9 +3254,11 @@ BOOL vehicle_twizy_battstatus_cmd(BOOL msgmode, int cmd, char *arguments)
   {
     vehicle_twizy_battstatus_msgp(0, cmd);
 
-    s = stp_i(net_scratchpad, "MP-0 c", cmd ? cmd : CMD_BatteryStatus);
+    net_msg_encode_start();
+    s = stp_i(net_msg_rec, "MP-0 c", cmd ? cmd : CMD_BatteryStatus);
     s = stp_rom(s, ",0");
-    net_msg_encode_puts();
+    net_msg_rec_put(s);
+    net_msg_encode_end();
   }
   else
   {
@@ -3219,7 +3275,6 @@ BOOL vehicle_twizy_battstatus_sms(BOOL premsg, char *caller, char *command, char
   char argc1, argc2;
   UINT8 tmin, tmax;
   int tact;
-  UINT8 cc;
   char *s;
 
   if (!premsg)
@@ -3269,7 +3324,7 @@ BOOL vehicle_twizy_battstatus_sms(BOOL premsg, char *caller, char *command, char
       if (twizy_cmod[c].temp_max > tmax)
         tmax = twizy_cmod[c].temp_max;
     }
-    tact = (float) tact / BATT_CMODS + 0.5;
+    tact = (tact + BATT_CMODS / 2) / BATT_CMODS;
 
     // Output pack status:
     s = net_scratchpad;
@@ -3353,8 +3408,7 @@ BOOL vehicle_twizy_battstatus_sms(BOOL premsg, char *caller, char *command, char
         {
           net_puts_ram(net_scratchpad);
           net_send_sms_finish();
-          delay100(30);
-          net_send_sms_start(caller);
+          net_send_sms_start(caller); // (waits for the modem)
           s = net_scratchpad;
         }
 
@@ -3476,86 +3530,41 @@ BOOL vehicle_twizy_fn_commandhandler(BOOL msgmode, int cmd, char *msg)
 BOOL vehicle_twizy_help_sms(BOOL premsg, char *caller, char *command, char *arguments);
 
 rom char vehicle_twizy_sms_cmdtable[][NET_SMS_CMDWIDTH] = {
-  "3DEBUG", // Twizy: output internal state dump for debug
-  "3STAT", // override standard STAT
-  "3RANGE", // Twizy: set/query max ideal range
-  "3CA", // Twizy: set/query charge alerts
-  "3HELP", // extend HELP output
-
 #ifdef OVMS_TWIZY_BATTMON
   "3BATT", // Twizy: battery status
 #endif // OVMS_TWIZY_BATTMON
 
+  "3CA", // Twizy: set/query charge alerts
+  "3DEBUG", // Twizy: output internal state dump for debug
+  "3HELP", // extend HELP output
   "3POWER", // Twizy: power usage statistics
+  "3RANGE", // Twizy: set/query max ideal range
+  "3STAT", // override standard STAT
 
   ""
 };
 
 rom far BOOL(*vehicle_twizy_sms_hfntable[])(BOOL premsg, char *caller, char *command, char *arguments) = {
-  &vehicle_twizy_debug_sms,
-  &vehicle_twizy_stat_sms,
-  &vehicle_twizy_range_sms,
-  &vehicle_twizy_ca_sms,
-  &vehicle_twizy_help_sms,
-
 #ifdef OVMS_TWIZY_BATTMON
   &vehicle_twizy_battstatus_sms,
 #endif // OVMS_TWIZY_BATTMON
 
-  &vehicle_twizy_power_sms
+  &vehicle_twizy_ca_sms,
+  &vehicle_twizy_debug_sms,
+  &vehicle_twizy_help_sms,
+  &vehicle_twizy_power_sms,
+  &vehicle_twizy_range_sms,
+  &vehicle_twizy_stat_sms
 };
 
 // SMS COMMAND DISPATCHER:
+// k: index into vehicle_twizy_sms_cmdtable, as found by the framework
 // premsg: TRUE=may replace, FALSE=may extend standard handler
-// returns TRUE if handled
-
-BOOL vehicle_twizy_fn_sms(BOOL checkauth, BOOL premsg, char *caller, char *command, char *arguments)
-{
-  int k;
-
-  // Command parsing...
-  for (k = 0; vehicle_twizy_sms_cmdtable[k][0] != 0; k++)
-  {
-    if (memcmppgm2ram(command,
-                      (char const rom far*)vehicle_twizy_sms_cmdtable[k] + 1,
-                      strlenpgm((char const rom far*)vehicle_twizy_sms_cmdtable[k]) - 1) == 0)
-    {
-      BOOL result;
-
-      if (checkauth)
-      {
-        // we need to check the caller authorization:
-        arguments = net_sms_initargs(arguments);
-        if (!net_sms_checkauth(vehicle_twizy_sms_cmdtable[k][0], caller, &arguments))
-          return FALSE; // failed
-      }
-
-      // Call sms handler:
-      result = (*vehicle_twizy_sms_hfntable[k])(premsg, caller, command, arguments);
-
-      if ((premsg) && (result))
-      {
-        // we're in charge + handled it; finish SMS:
-        net_send_sms_finish();
-      }
-
-      return result;
-    }
-  }
-
-  return FALSE; // no vehicle command
-}
+// returns TRUE if handled, the framework does the auth check & finishes the SMS
 
-BOOL vehicle_twizy_fn_smshandler(BOOL premsg, char *caller, char *command, char *arguments)
+BOOL vehicle_twizy_fn_smscmd(unsigned char k, BOOL premsg, char *caller, char *command, char *arguments)
 {
-  // called to extend/replace standard command: framework did auth check for us
-  return vehicle_twizy_fn_sms(FALSE, premsg, caller, command, arguments);
-}
-
-BOOL vehicle_twizy_fn_smsextensions(char *caller, char *command, char *arguments)
-{
-  // called for specific command: we need to do the auth check
-  return vehicle_twizy_fn_sms(TRUE, TRUE, caller, command, arguments);
+  return (*vehicle_twizy_sms_hfntable[k])(premsg, caller, command, arguments);
 }
 
 
@@ -3631,12 +3640,17 @@ BOOL vehicle_twizy_initialise(void)
     memset(twizy_batt, 0, sizeof twizy_batt);
     twizy_batt[0].volt_min = 1000; // 100 V
     memset(twizy_cmod, 0, sizeof twizy_cmod);
+    memset(&twizy_cmod_stats, 0, sizeof twizy_cmod_stats);
     for (i = 0; i < BATT_CMODS; i++)
     {
       twizy_cmod[i].temp_act = 40;
       twizy_cmod[i].temp_min = 240;
+      twizy_cmod_stats.sum += 40;
+      twizy_cmod_stats.sqrsum += SQR(40);
     }
     memset(twizy_cell, 0, sizeof twizy_cell);
+    memset(&twizy_cell_stats, 0, sizeof twizy_cell_stats);
+    twizy_cell_stats.invalid = (1 << BATT_CELLS) - 1; // volt_act = 0
     for (i = 0; i < BATT_CELLS; i++)
     {
       twizy_cell[i].volt_min = 2000; // 10 V
@@ -3672,50 +3686,16 @@ BOOL vehicle_twizy_initialise(void)
 
   // We are now in Configuration Mode.
 
-  // ID masks and filters are 11 bit as High-8 + Low-MSB-3
-  // (Filter bit n must match if mask bit n = 1)
-
-
-  // RX buffer0 uses Mask RXM0 and filters RXF0, RXF1
+  // RX buffer0 uses Mask RXM0 and filters RXF0, RXF1:
+  //  ID 0x155 (exact match, high perf)
   RXB0CON = 0b00000000;
 
-  // Setup Filter0 and Mask for CAN ID 0x155
-
-  // Mask0 = 0x7ff = exact ID filter match (high perf)
-  RXM0SIDH = 0b11111111;
-  RXM0SIDL = 0b11100000;
-
-  // Filter0 = ID 0x155:
-  RXF0SIDH = 0b00101010;
-  RXF0SIDL = 0b10100000;
-
-  // Filter1 = unused (reserved for another frequent ID)
-  RXF1SIDH = 0b00000000;
-  RXF1SIDL = 0b00000000;
-
-
-  // RX buffer1 uses Mask RXM1 and filters RXF2, RXF3, RXF4, RXF5
+  // RX buffer1 uses Mask RXM1 and filters RXF2, RXF3, RXF4, RXF5:
+  //  GROUPS 0x55_, 0x59_, 0x5D_, 0x69_ (low volume IDs)
   RXB1CON = 0b00000000;
 
-  // Mask1 = 0x7f0 = group filters for low volume IDs
-  RXM1SIDH = 0b11111110;
-  RXM1SIDL = 0b00000000;
-
-  // Filter2 = GROUP 0x59_:
-  RXF2SIDH = 0b10110010;
-  RXF2SIDL = 0b00000000;
-
-  // Filter3 = GROUP 0x69_:
-  RXF3SIDH = 0b11010010;
-  RXF3SIDL = 0b00000000;
-
-  // Filter4 = GROUP 0x55_:
-  RXF4SIDH = 0b10101010;
-  RXF4SIDL = 0b00000000;
-
-  // Filter5 = GROUP 0x5D_:
-  RXF5SIDH = 0b10111010;
-  RXF5SIDL = 0b00000000;
+  // Masks and filters from the CAN ID dispatch table
+  vehicle_can_filters(vehicle_twizy_can_handlers, TWIZY_CAN_HANDLERS);
 
 
   // SET BAUDRATE (tool: Intrepid CAN Timing Calculator / 20 MHz)
@@ -3767,14 +3747,15 @@ BOOL vehicle_twizy_initialise(void)
   vehicle_version = vehicle_twizy_version;
   can_capabilities = vehicle_twizy_capabilities;
 
-  vehicle_fn_poll0 = &vehicle_twizy_poll0;
-  vehicle_fn_poll1 = &vehicle_twizy_poll1;
+  vehicle_fn_poll0 = &vehicle_twizy_poll;
+  vehicle_fn_poll1 = &vehicle_twizy_poll;
   vehicle_fn_idlepoll = &vehicle_twizy_idlepoll;
   vehicle_fn_ticker1 = &vehicle_twizy_state_ticker1;
   vehicle_fn_ticker10 = &vehicle_twizy_state_ticker10;
   vehicle_fn_ticker60 = &vehicle_twizy_state_ticker60;
-  vehicle_fn_smshandler = &vehicle_twizy_fn_smshandler;
-  vehicle_fn_smsextensions = &vehicle_twizy_fn_smsextensions;
+  vehicle_fn_smscmd = &vehicle_twizy_fn_smscmd;
+  vehicle_sms_cmdtable = vehicle_twizy_sms_cmdtable[0];
+  vehicle_sms_cmds = sizeof(vehicle_twizy_sms_cmdtable) / NET_SMS_CMDWIDTH - 1;
   vehicle_fn_commandhandler = &vehicle_twizy_fn_commandhandler;
 
   net_fnbits |= NET_FN_INTERNALGPS; // Require internal GPS
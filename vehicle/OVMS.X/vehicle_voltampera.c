@@ -54,24 +54,19 @@ unsigned int va_drive_distance_bat_max; // maximum distance drive on battery
 // vehicle_voltampera_polls
 // This rom table records the extended PIDs that need to be polled
 
-rom struct
-  {
-  unsigned int moduleid;
-  unsigned char polltime;
-  unsigned int pid;
-  } vehicle_voltampera_polls[]
+rom vehicle_poll_t vehicle_voltampera_polls[]
   =
   {
-    { 0x07E0, 10, 0x000D },
-    { 0x07E4, 10, 0x4369 },
-    { 0x07E4, 10, 0x4368 },
-    { 0x07E4, 10, 0x801f },
-    { 0x07E4, 10, 0x801e },
-    { 0x07E4, 10, 0x434f },
-    { 0x07E4, 10, 0x1c43 },
-    { 0x07E4, 10, 0x8334 },
-    { 0x07E1, 100, 0x2487 },
-    { 0x0000, 0,  0x0000 }
+    { 0x07E0, 0x07E8, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x000D, 8,  10, VEHICLE_POLL_ON|VEHICLE_POLL_CHARGING },
+    { 0x07E4, 0x07EC, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x4369, 8,  10, VEHICLE_POLL_ON|VEHICLE_POLL_CHARGING },
+    { 0x07E4, 0x07EC, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x4368, 8,  10, VEHICLE_POLL_ON|VEHICLE_POLL_CHARGING },
+    { 0x07E4, 0x07EC, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x801f, 8,  10, VEHICLE_POLL_ON|VEHICLE_POLL_CHARGING },
+    { 0x07E4, 0x07EC, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x801e, 8,  10, VEHICLE_POLL_ON|VEHICLE_POLL_CHARGING },
+    { 0x07E4, 0x07EC, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x434f, 8,  10, VEHICLE_POLL_ON|VEHICLE_POLL_CHARGING },
+    { 0x07E4, 0x07EC, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x1c43, 8,  10, VEHICLE_POLL_ON|VEHICLE_POLL_CHARGING },
+    { 0x07E4, 0x07EC, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x8334, 8,  10, VEHICLE_POLL_ON|VEHICLE_POLL_CHARGING },
+    { 0x07E1, 0x07E9, VEHICLE_POLL_TYPE_OBDIIEXT, 0x22, 0x2487, 8, 100, VEHICLE_POLL_ON|VEHICLE_POLL_CHARGING },
+    { 0 }
   };
 
 ////////////////////////////////////////////////////////////////////////
@@ -81,9 +76,6 @@ rom struct
 //
 BOOL vehicle_voltampera_ticker1(void)
   {
-  int k;
-  BOOL doneone = FALSE;
-
   ////////////////////////////////////////////////////////////////////////
   // Stale tickers
   ////////////////////////////////////////////////////////////////////////
@@ -172,10 +164,10 @@ BOOL vehicle_voltampera_ticker1(void)
   ////////////////////////////////////////////////////////////////////////
   if (va_obd_expect_waiting)
     {
-    delay100(1);
     net_msg_start();
     strcpy(net_scratchpad,va_obd_expect_buf);
     net_msg_encode_puts();
+    net_msg_send();
     va_obd_expect_waiting = FALSE;
     }
 
@@ -184,38 +176,12 @@ BOOL vehicle_voltampera_ticker1(void)
   ////////////////////////////////////////////////////////////////////////
 
   // bus_is_active indicates we've recently seen a message on the can bus
-  // Quick exit if bus is recently not active
-  if ((!va_bus_is_active) && (car_chargecurrent==0) && (car_linevoltage==0)) return FALSE;
-
-  // Also, we need CAN_WRITE enabled, so return if not
-  if (sys_features[FEATURE_CANWRITE]==0) return FALSE;
+  // Stop polling if bus is recently not active and the car is not charging
+  if ((car_chargecurrent!=0)||(car_linevoltage!=0))
+    vehicle_poll_setstate(VEHICLE_POLL_CHARGING);
+  else
+    vehicle_poll_setstate((va_bus_is_active) ? VEHICLE_POLL_ON : 0);
 
-  // Let's run through and see if we have to poll for any data..
-  for (k=0;vehicle_voltampera_polls[k].moduleid != 0; k++)
-    {
-    if ((can_granular_tick % vehicle_voltampera_polls[k].polltime) == 0)
-      {
-      // OK. Let's send it...
-      if (doneone)
-        delay100b(); // Delay a little... (100ms, approx)
-
-      while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-      TXB0CON = 0;
-      TXB0SIDL = (vehicle_voltampera_polls[k].moduleid & 0x07)<<5;
-      TXB0SIDH = (vehicle_voltampera_polls[k].moduleid>>3);
-      TXB0D0 = 0x03;
-      TXB0D1 = 0x22;        // Get extended PID
-      TXB0D2 = vehicle_voltampera_polls[k].pid >> 8;
-      TXB0D3 = vehicle_voltampera_polls[k].pid & 0xff;
-      TXB0D4 = 0x00;
-      TXB0D5 = 0x00;
-      TXB0D6 = 0x00;
-      TXB0D7 = 0x00;
-      TXB0DLC = 0b00001000; // data length (8)
-      TXB0CON = 0b00001000; // mark for transmission
-      doneone = TRUE;
-      }
-    }
   // Assume the bus is not active, so we won't poll any more until we see
   // activity on the bus
   va_bus_is_active = FALSE;
@@ -308,7 +274,7 @@ BOOL vehicle_voltampera_poll0(void)
     switch (pid)
       {
       case 0x2487:  //Distance Traveled on Battery Energy This Drive Cycle
-          edrive_distance = MiFromKm((can_databuffer[5] + ((unsigned int)can_databuffer[4] << 8)) / 100); // German Volt Report im KM
+          edrive_distance = (unsigned int)MiFromKm((can_databuffer[5] + ((unsigned int)can_databuffer[4] << 8)) / 100); // German Volt Report im KM
           if ((edrive_distance > va_drive_distance_bat_max) && (car_chargestate == 4)) va_drive_distance_bat_max = edrive_distance;
         break;
       }
@@ -382,6 +348,8 @@ BOOL vehicle_voltampera_poll1(void)
 
 BOOL vehicle_voltampera_fn_commandhandler(BOOL msgmode, int cmd, char *msg)
   {
+  unsigned char data[8];
+
   switch (cmd)
     {
     case 46:
@@ -395,23 +363,16 @@ BOOL vehicle_voltampera_fn_commandhandler(BOOL msgmode, int cmd, char *msg)
 
       va_obd_expect_waiting = FALSE;
 
-      delay100b(); // Delay a little... (100ms, approx)
-
-      while (TXB0CONbits.TXREQ) {} // Loop until TX is done
-      TXB0CON = 0;
-      TXB0SIDL = (va_obd_expect_id & 0x07)<<5;
-      TXB0SIDH = (va_obd_expect_id >>3);
+      data[0] = 0x03;
+      data[1] = 0x22;        // Get extended PID
+      data[2] = va_obd_expect_pid >> 8;
+      data[3] = va_obd_expect_pid & 0xff;
+      data[4] = 0x00;
+      data[5] = 0x00;
+      data[6] = 0x00;
+      data[7] = 0x00;
+      can_tx_enqueue(va_obd_expect_id, 8, data, CAN_TX_PRIO_NORMAL);
       va_obd_expect_id += 8;   // Get ready for reply
-      TXB0D0 = 0x03;
-      TXB0D1 = 0x22;        // Get extended PID
-      TXB0D2 = va_obd_expect_pid >> 8;
-      TXB0D3 = va_obd_expect_pid & 0xff;
-      TXB0D4 = 0x00;
-      TXB0D5 = 0x00;
-      TXB0D6 = 0x00;
-      TXB0D7 = 0x00;
-      TXB0DLC = 0b00001000; // data length (8)
-      TXB0CON = 0b00001000; // mark for transmission
 
       return TRUE;
     }
@@ -427,8 +388,6 @@ BOOL vehicle_voltampera_fn_commandhandler(BOOL msgmode, int cmd, char *msg)
 //
 BOOL vehicle_voltampera_initialise(void)
   {
-  char *p;
-
   car_type[0] = 'V'; // Car is type VA - Volt/Ampera
   car_type[1] = 'A';
   car_type[2] = 0;
@@ -448,7 +407,7 @@ BOOL vehicle_voltampera_initialise(void)
   car_stale_timer = -1; // Timed charging is not supported for OVMS VA
   car_time = 0;
 
-  va_drive_distance_bat_max = MiFromKm(35);    // initial Battery distance in km
+  va_drive_distance_bat_max = (unsigned int)MiFromKm(35);    // initial Battery distance in km
 
   CANCON = 0b10010000; // Initialize CAN
   while (!CANSTATbits.OPMODE2); // Wait for Configuration mode
@@ -506,6 +465,7 @@ BOOL vehicle_voltampera_initialise(void)
   vehicle_fn_poll0 = &vehicle_voltampera_poll0;
   vehicle_fn_poll1 = &vehicle_voltampera_poll1;
   vehicle_fn_ticker1 = &vehicle_voltampera_ticker1;
+  vehicle_poll_setlist(vehicle_voltampera_polls);
   vehicle_fn_commandhandler = &vehicle_voltampera_fn_commandhandler;
   
   net_fnbits |= NET_FN_INTERNALGPS;   // Require internal GPS